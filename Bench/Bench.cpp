@@ -0,0 +1,276 @@
+#include "Bench.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+
+#ifndef _DEBUG
+#define CXXOPTS_NO_RTTI
+#endif
+#include <cxxopts.hpp>
+
+#include "Api/MotionToGo.h"
+#include "Trace/MemoryTracker.hpp"
+
+namespace
+{
+    uint32_t Hash(uint32_t x, uint32_t y, uint32_t seed) noexcept
+    {
+        uint32_t h = x * 374761393U + y * 668265263U + seed * 2246822519U;
+        h = (h ^ (h >> 13)) * 1274126177U;
+        return h ^ (h >> 16);
+    }
+
+    // Bilinearly interpolated value noise, in [0, 255]
+    uint32_t ValueNoise(int32_t x, int32_t y, uint32_t cell_size, uint32_t seed) noexcept
+    {
+        const int32_t cx = static_cast<int32_t>(std::floor(static_cast<float>(x) / cell_size));
+        const int32_t cy = static_cast<int32_t>(std::floor(static_cast<float>(y) / cell_size));
+        const uint32_t fx = static_cast<uint32_t>(x - cx * static_cast<int32_t>(cell_size));
+        const uint32_t fy = static_cast<uint32_t>(y - cy * static_cast<int32_t>(cell_size));
+
+        const uint32_t v00 = Hash(cx, cy, seed) & 0xFF;
+        const uint32_t v10 = Hash(cx + 1, cy, seed) & 0xFF;
+        const uint32_t v01 = Hash(cx, cy + 1, seed) & 0xFF;
+        const uint32_t v11 = Hash(cx + 1, cy + 1, seed) & 0xFF;
+
+        const uint32_t top = v00 * (cell_size - fx) + v10 * fx;
+        const uint32_t bottom = v01 * (cell_size - fx) + v11 * fx;
+        return (top * (cell_size - fy) + bottom * fy) / (cell_size * cell_size);
+    }
+} // namespace
+
+namespace MotionToGo
+{
+    BenchRecorder::BenchRecorder(const BenchOptions& options) : options_(options)
+    {
+    }
+
+    const BenchOptions& BenchRecorder::Options() const noexcept
+    {
+        return options_;
+    }
+
+    bool BenchRecorder::Enabled(std::string_view stage) const noexcept
+    {
+        return stage.find(options_.filter) != std::string_view::npos;
+    }
+
+    void BenchRecorder::Run(std::string_view stage, const Resolution& resolution, const std::function<void()>& func)
+    {
+        if (!this->Enabled(stage))
+        {
+            return;
+        }
+
+        for (uint32_t i = 0; i < options_.warmup; ++i)
+        {
+            func();
+        }
+
+        std::vector<double> samples_ms(options_.repetitions);
+        for (auto& sample : samples_ms)
+        {
+            const auto start = std::chrono::high_resolution_clock::now();
+            func();
+            sample = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        }
+
+        this->Record(stage, resolution, std::move(samples_ms));
+    }
+
+    void BenchRecorder::Record(std::string_view stage, const Resolution& resolution, std::vector<double> samples_ms)
+    {
+        if (samples_ms.empty())
+        {
+            return;
+        }
+
+        std::sort(samples_ms.begin(), samples_ms.end());
+
+        const size_t num = samples_ms.size();
+        Result result;
+        result.stage = stage;
+        result.resolution = resolution;
+        result.median_ms = (num & 1) ? samples_ms[num / 2] : (samples_ms[num / 2 - 1] + samples_ms[num / 2]) / 2;
+        // Nearest rank
+        result.p99_ms = samples_ms[static_cast<size_t>(std::ceil(0.99 * num)) - 1];
+        result.mean_ms = std::accumulate(samples_ms.begin(), samples_ms.end(), 0.0) / num;
+        result.min_ms = samples_ms.front();
+        result.max_ms = samples_ms.back();
+
+        results_.push_back(std::move(result));
+    }
+
+    double BenchRecorder::MedianMs(std::string_view stage, const Resolution& resolution) const noexcept
+    {
+        for (const auto& result : results_)
+        {
+            if ((result.stage == stage) && (result.resolution.name == resolution.name))
+            {
+                return result.median_ms;
+            }
+        }
+        return 0;
+    }
+
+    void BenchRecorder::PrintTable(std::ostream& os) const
+    {
+        os << std::format(
+            "{:<36} {:>6} {:>12} {:>12} {:>12} {:>12}\n", "Stage", "Size", "Median (ms)", "P99 (ms)", "Mean (ms)", "MPixel/s");
+        for (const auto& result : results_)
+        {
+            const double mpixels = static_cast<double>(result.resolution.width) * result.resolution.height / 1e6;
+            os << std::format("{:<36} {:>6} {:>12.3f} {:>12.3f} {:>12.3f} {:>12.1f}\n", result.stage, result.resolution.name,
+                result.median_ms, result.p99_ms, result.mean_ms, mpixels / (result.median_ms / 1000));
+        }
+    }
+
+    void BenchRecorder::WriteJson(std::ostream& os) const
+    {
+        os << std::format("{{\n  \"version\": \"{}.{}.{}\",\n  \"warmup\": {},\n  \"repetitions\": {},\n  \"results\": [\n",
+            MTG_VERSION_MAJOR, MTG_VERSION_MINOR, MTG_VERSION_PATCH, options_.warmup, options_.repetitions);
+        for (size_t i = 0; i < results_.size(); ++i)
+        {
+            const auto& result = results_[i];
+            const double mpixels = static_cast<double>(result.resolution.width) * result.resolution.height / 1e6;
+            os << std::format("    {{\"stage\": \"{}\", \"resolution\": \"{}\", \"width\": {}, \"height\": {}, \"median_ms\": {:.4f}, "
+                              "\"p99_ms\": {:.4f}, \"mean_ms\": {:.4f}, \"min_ms\": {:.4f}, \"max_ms\": {:.4f}, "
+                              "\"mpixels_per_second\": {:.2f}}}{}\n",
+                result.stage, result.resolution.name, result.resolution.width, result.resolution.height, result.median_ms, result.p99_ms,
+                result.mean_ms, result.min_ms, result.max_ms, mpixels / (result.median_ms / 1000), i + 1 < results_.size() ? "," : "");
+        }
+        os << "  ]\n}\n";
+    }
+
+    std::vector<uint8_t> GenerateBenchFrame(uint32_t width, uint32_t height, uint32_t frame_index)
+    {
+        const int32_t offset_x = static_cast<int32_t>(frame_index * 7);
+        const int32_t offset_y = static_cast<int32_t>(frame_index * 3);
+
+        std::vector<uint8_t> frame(width * height * 4);
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                const int32_t tx = static_cast<int32_t>(x) - offset_x;
+                const int32_t ty = static_cast<int32_t>(y) - offset_y;
+
+                uint8_t* pixel = &frame[(y * width + x) * 4];
+                for (uint32_t c = 0; c < 3; ++c)
+                {
+                    const uint32_t coarse = ValueNoise(tx, ty, 64, c);
+                    const uint32_t fine = ValueNoise(tx, ty, 8, c + 3);
+                    pixel[c] = static_cast<uint8_t>((coarse * 3 + fine) / 4);
+                }
+                pixel[3] = 255;
+            }
+        }
+
+        return frame;
+    }
+} // namespace MotionToGo
+
+int main(int argc, char* argv[])
+{
+    using namespace MotionToGo;
+
+    cxxopts::Options options("MotionToGoBench", "MotionToGoBench: Benchmark the processing stages with synthetic frames.");
+    // clang-format off
+    options.add_options()
+        ("H,help", "Produce help message.")
+        ("S,sizes", "Comma separated frame sizes to run, from 720p, 1080p and 4k (All by default).", cxxopts::value<std::string>())
+        ("W,warmup", "Number of warm-up runs of each stage (3 by default).", cxxopts::value<uint32_t>())
+        ("R,repetitions", "Number of timed runs of each stage (20 by default).", cxxopts::value<uint32_t>())
+        ("F,filter", "Only run the stages whose names contain this string.", cxxopts::value<std::string>())
+        ("I,images", "Also time decoding the PNGs in this directory, such as Test/Data/ImageSeq.", cxxopts::value<std::string>())
+        ("O,output", "Write the results as JSON to this file instead of the standard output.", cxxopts::value<std::string>());
+    // clang-format on
+
+    const auto vm = options.parse(argc, argv);
+
+    if (vm.count("help") > 0)
+    {
+        std::cout << std::format("{}\n", options.help());
+        return 0;
+    }
+
+    BenchOptions bench_options;
+    if (vm.count("warmup") > 0)
+    {
+        bench_options.warmup = vm["warmup"].as<uint32_t>();
+    }
+    if (vm.count("repetitions") > 0)
+    {
+        bench_options.repetitions = std::max(vm["repetitions"].as<uint32_t>(), 1U);
+    }
+    if (vm.count("filter") > 0)
+    {
+        bench_options.filter = vm["filter"].as<std::string>();
+    }
+    if (vm.count("images") > 0)
+    {
+        bench_options.image_dir = vm["images"].as<std::string>();
+    }
+
+    constexpr Resolution AllResolutions[] = {
+        {"720p", 1280, 720},
+        {"1080p", 1920, 1080},
+        {"4k", 3840, 2160},
+    };
+
+    std::vector<Resolution> resolutions;
+    if (vm.count("sizes") > 0)
+    {
+        const std::string sizes = vm["sizes"].as<std::string>();
+        for (const auto& resolution : AllResolutions)
+        {
+            if (sizes.find(resolution.name) != std::string::npos)
+            {
+                resolutions.push_back(resolution);
+            }
+        }
+        if (resolutions.empty())
+        {
+            std::cerr << std::format("ERROR: Unknown sizes {}\n", sizes);
+            return 1;
+        }
+    }
+    else
+    {
+        resolutions.assign(std::begin(AllResolutions), std::end(AllResolutions));
+    }
+
+    BenchRecorder recorder(bench_options);
+
+    RunCpuBenches(recorder, resolutions);
+#ifdef _WIN32
+    RunGpuBenches(recorder, resolutions);
+#endif
+
+    std::cerr << '\n';
+    recorder.PrintTable(std::cerr);
+    std::cerr << '\n' << MemoryTracker::Summary();
+
+    if (vm.count("output") > 0)
+    {
+        const std::string output = vm["output"].as<std::string>();
+        std::ofstream ofs(output);
+        if (!ofs)
+        {
+            std::cerr << std::format("ERROR: COULDN'T open {}\n", output);
+            return 1;
+        }
+        recorder.WriteJson(ofs);
+    }
+    else
+    {
+        recorder.WriteJson(std::cout);
+    }
+
+    return 0;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace MotionToGo
+{
+    struct Resolution
+    {
+        std::string_view name;
+        uint32_t width;
+        uint32_t height;
+    };
+
+    struct BenchOptions
+    {
+        uint32_t warmup = 3;
+        uint32_t repetitions = 20;
+        // Only run stages whose name contains this
+        std::string filter;
+        // Also time decoding the PNGs in this directory
+        std::string image_dir;
+    };
+
+    class BenchRecorder final
+    {
+    public:
+        explicit BenchRecorder(const BenchOptions& options);
+
+        const BenchOptions& Options() const noexcept;
+        bool Enabled(std::string_view stage) const noexcept;
+
+        // Calls func warmup + repetitions times, and records the duration of each repetition.
+        void Run(std::string_view stage, const Resolution& resolution, const std::function<void()>& func);
+        // For stages timed by the caller.
+        void Record(std::string_view stage, const Resolution& resolution, std::vector<double> samples_ms);
+        // Of a stage that ran at resolution, 0 if it didn't.
+        double MedianMs(std::string_view stage, const Resolution& resolution) const noexcept;
+
+        void PrintTable(std::ostream& os) const;
+        void WriteJson(std::ostream& os) const;
+
+    private:
+        struct Result
+        {
+            std::string stage;
+            Resolution resolution;
+            double median_ms;
+            double p99_ms;
+            double mean_ms;
+            double min_ms;
+            double max_ms;
+        };
+
+        BenchOptions options_;
+        std::vector<Result> results_;
+    };
+
+    // A textured RGBA8 frame. Consecutive frame indices move the content by a few pixels, so motion estimation has real work.
+    std::vector<uint8_t> GenerateBenchFrame(uint32_t width, uint32_t height, uint32_t frame_index);
+
+    void RunCpuBenches(BenchRecorder& recorder, std::span<const Resolution> resolutions);
+#ifdef _WIN32
+    void RunGpuBenches(BenchRecorder& recorder, std::span<const Resolution> resolutions);
+#endif
+} // namespace MotionToGo
@@ -0,0 +1,739 @@
+#include "Bench.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <string>
+#include <utility>
+
+#include "Codec/FrameArchive.hpp"
+#include "Codec/ImageCodec.hpp"
+#include "Cpu/CpuColorConversion.hpp"
+#include "Cpu/CpuFeatures.hpp"
+#include "Cpu/CpuMotionBlur.hpp"
+#include "Io/FileWriteQueue.hpp"
+#include "Io/FrameBufferPool.hpp"
+#include "Io/RawFrameSequence.hpp"
+
+namespace
+{
+    unsigned char* StbiZlibCompress(unsigned char* data, int data_len, int* out_len, int quality);
+}
+
+// stb_image_write is the reference the PNG encoder is benchmarked against
+#define STBIW_ZLIB_COMPRESS StbiZlibCompress
+#define STB_IMAGE_WRITE_STATIC
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+#include <stb_image.h>
+
+#include <zlib.h>
+
+using namespace MotionToGo;
+
+namespace
+{
+    // Same level as EncodePng. Off to time stb's filtering alone.
+    bool stb_deflate = true;
+
+    unsigned char* StbiZlibCompress(unsigned char* data, int data_len, int* out_len, [[maybe_unused]] int quality)
+    {
+        if (!stb_deflate)
+        {
+            *out_len = 0;
+            return reinterpret_cast<unsigned char*>(std::malloc(1));
+        }
+
+        uLong buff_len = compressBound(data_len);
+        uint8_t* buf = reinterpret_cast<uint8_t*>(std::malloc(buff_len));
+        if ((buf == nullptr) || (compress2(buf, &buff_len, data, data_len, 5) != 0))
+        {
+            std::free(buf);
+            return nullptr;
+        }
+        *out_len = static_cast<int>(buff_len);
+        return buf;
+    }
+
+    // Only over the tiles that aren't static, the rest is a copy either way
+    double BlurredTilesPsnr(const std::vector<uint8_t>& lhs, const std::vector<uint8_t>& rhs, const Resolution& resolution,
+        const MotionBlurTileLists& tile_lists)
+    {
+        double sum_squared_error = 0;
+        uint64_t num_values = 0;
+        for (const auto tile_class : {MotionBlurTileClass::UniformMotion, MotionBlurTileClass::Complex})
+        {
+            for (const uint32_t tile : tile_lists.tiles[static_cast<uint32_t>(tile_class)])
+            {
+                const uint32_t first_x = (tile & 0xFFFF) * MotionBlurTileSize;
+                const uint32_t first_y = (tile >> 16) * MotionBlurTileSize;
+                for (uint32_t y = first_y; y < std::min(first_y + MotionBlurTileSize, resolution.height); ++y)
+                {
+                    for (uint32_t x = first_x * 4; x < std::min(first_x + MotionBlurTileSize, resolution.width) * 4; ++x)
+                    {
+                        const double diff = static_cast<double>(lhs[y * resolution.width * 4 + x]) - rhs[y * resolution.width * 4 + x];
+                        sum_squared_error += diff * diff;
+                        ++num_values;
+                    }
+                }
+            }
+        }
+
+        if (sum_squared_error == 0)
+        {
+            return std::numeric_limits<double>::infinity();
+        }
+        return 10 * std::log10(255.0 * 255.0 * num_values / sum_squared_error);
+    }
+
+    // Mostly static, like a stop motion set with one moving object
+    void RunCpuMotionBlurBenches(BenchRecorder& recorder, const Resolution& resolution, const std::vector<uint8_t>& frame)
+    {
+        if (!recorder.Enabled("Cpu.NeighborMax") && !recorder.Enabled("Cpu.Gather") && !recorder.Enabled("Cpu.ClassifyTiles"))
+        {
+            return;
+        }
+
+        const uint32_t tiles_x = (resolution.width + MotionBlurTileSize - 1) / MotionBlurTileSize;
+        const uint32_t tiles_y = (resolution.height + MotionBlurTileSize - 1) / MotionBlurTileSize;
+        std::vector<uint8_t> motion_vectors(tiles_x * tiles_y * 2, 128);
+        for (uint32_t y = tiles_y * 2 / 5; y < tiles_y * 3 / 5; ++y)
+        {
+            for (uint32_t x = tiles_x * 2 / 5; x < tiles_x * 3 / 5; ++x)
+            {
+                motion_vectors[(y * tiles_x + x) * 2 + 0] = 200;
+                motion_vectors[(y * tiles_x + x) * 2 + 1] = 150;
+            }
+        }
+        std::vector<uint8_t> neighbor_max(motion_vectors.size());
+
+        // The cost per tile shouldn't grow with the radius
+        for (const uint32_t radius : {1, 2, 4, 8})
+        {
+            recorder.Run(std::format("Cpu.NeighborMax.Radius{}", radius), resolution,
+                [&] { MotionBlurNeighborMax(motion_vectors.data(), tiles_x, tiles_y, radius, neighbor_max.data()); });
+        }
+        MotionBlurNeighborMax(motion_vectors.data(), tiles_x, tiles_y, 1, neighbor_max.data());
+
+        const CpuMotionBlurParams params{
+            resolution.width, resolution.height, 1, 0.5f, 15, (2 * resolution.height + 1056) / 416.0f};
+        const std::vector<uint8_t> random_tile = GenerateMotionBlurRandomTile();
+        std::vector<uint8_t> output(frame.size());
+
+        MotionBlurTileLists tile_lists = ClassifyMotionBlurTiles(params, motion_vectors.data(), neighbor_max.data());
+        recorder.Run("Cpu.ClassifyTiles", resolution,
+            [&] { tile_lists = ClassifyMotionBlurTiles(params, motion_vectors.data(), neighbor_max.data()); });
+        std::cerr << std::format("Tiles at {}: {} static, {} uniform motion, {} complex, of {}\n", resolution.name,
+            tile_lists.tiles[0].size(), tile_lists.tiles[1].size(), tile_lists.tiles[2].size(), tiles_x * tiles_y);
+
+        recorder.Run("Cpu.Gather", resolution, [&] {
+            GatherMotionBlur(params, frame.data(), motion_vectors.data(), neighbor_max.data(), random_tile, &tile_lists, output.data());
+        });
+        recorder.Run("Cpu.Gather.AllTiles", resolution, [&] {
+            GatherMotionBlur(params, frame.data(), motion_vectors.data(), neighbor_max.data(), random_tile, nullptr, output.data());
+        });
+
+        // The fixed-point gather against the float one of Cpu.Gather, at each SIMD level. The levels give the same bytes.
+        const double float_ms = recorder.MedianMs("Cpu.Gather", resolution);
+        std::vector<uint8_t> float_output;
+        CpuMotionBlurParams fixed_point_params = params;
+        fixed_point_params.fixed_point = true;
+        const CpuSimdLevel detected_level = DetectedCpuSimdLevel();
+        for (uint32_t level = 0; level <= static_cast<uint32_t>(detected_level); ++level)
+        {
+            const std::string stage = std::format("Cpu.Gather.FixedPoint.{}", CpuSimdLevelName(static_cast<CpuSimdLevel>(level)));
+            if (!recorder.Enabled(stage))
+            {
+                continue;
+            }
+
+            if (float_output.empty())
+            {
+                float_output.resize(frame.size());
+                GatherMotionBlur(
+                    params, frame.data(), motion_vectors.data(), neighbor_max.data(), random_tile, &tile_lists, float_output.data());
+            }
+
+            SetCpuSimdLevel(static_cast<CpuSimdLevel>(level));
+            recorder.Run(stage, resolution, [&] {
+                GatherMotionBlur(fixed_point_params, frame.data(), motion_vectors.data(), neighbor_max.data(), random_tile, &tile_lists,
+                    output.data());
+            });
+
+            int32_t max_diff = 0;
+            for (uint32_t i = 0; i < output.size(); ++i)
+            {
+                max_diff = std::max(max_diff, std::abs(output[i] - float_output[i]));
+            }
+            std::cerr << std::format("{} at {}: at most {} from float, {:.2f} dB PSNR\n", stage, resolution.name, max_diff,
+                BlurredTilesPsnr(output, float_output, resolution, tile_lists));
+            if (float_ms > 0)
+            {
+                std::cerr << std::format("{} at {}: {:.2f}x the throughput of float\n", stage, resolution.name,
+                    float_ms / recorder.MedianMs(stage, resolution));
+            }
+        }
+        SetCpuSimdLevel(detected_level);
+
+        // Against the fixed sample count of Cpu.Gather
+        if (recorder.Enabled("Cpu.Gather.AdaptiveSamples"))
+        {
+            std::vector<uint8_t> fixed_output(frame.size());
+            const uint64_t fixed_taps = GatherMotionBlur(
+                params, frame.data(), motion_vectors.data(), neighbor_max.data(), random_tile, &tile_lists, fixed_output.data());
+
+            CpuMotionBlurParams adaptive_params = params;
+            adaptive_params.min_reconstruction_samples = 5;
+            uint64_t adaptive_taps = 0;
+            recorder.Run("Cpu.Gather.AdaptiveSamples", resolution, [&] {
+                adaptive_taps = GatherMotionBlur(adaptive_params, frame.data(), motion_vectors.data(), neighbor_max.data(), random_tile,
+                    &tile_lists, output.data());
+            });
+
+            const double num_pixels = static_cast<double>(resolution.width) * resolution.height;
+            std::cerr << std::format("Taps per pixel at {}: {:.2f} adaptive, {:.2f} fixed, {:.2f} dB PSNR against fixed\n",
+                resolution.name, adaptive_taps / num_pixels, fixed_taps / num_pixels,
+                BlurredTilesPsnr(output, fixed_output, resolution, tile_lists));
+        }
+
+        // Against Cpu.Gather.AllTiles, the preview doesn't skip static tiles
+        for (const uint32_t scale : {2, 4})
+        {
+            const std::string stage = std::format("Cpu.Gather.Preview{}", scale);
+            if (!recorder.Enabled(stage))
+            {
+                continue;
+            }
+
+            std::vector<uint8_t> full_output(frame.size());
+            GatherMotionBlur(params, frame.data(), motion_vectors.data(), neighbor_max.data(), random_tile, nullptr, full_output.data());
+
+            const CpuMotionBlurParams preview_params = MotionBlurPreviewParams(params, scale);
+            std::vector<uint8_t> preview(preview_params.width * preview_params.height * 4);
+            std::vector<uint8_t> blurred_preview(preview.size());
+            recorder.Run(stage, resolution, [&] {
+                DownsampleMotionBlurPreview(frame.data(), resolution.width, resolution.height, scale, preview.data());
+                GatherMotionBlur(preview_params, preview.data(), motion_vectors.data(), neighbor_max.data(), random_tile, nullptr,
+                    blurred_preview.data());
+                UpsampleMotionBlurPreview(
+                    preview_params, frame.data(), preview.data(), blurred_preview.data(), neighbor_max.data(), output.data());
+            });
+            std::cerr << std::format("Preview 1/{} at {}: {:.2f} dB PSNR against the full resolution\n", scale, resolution.name,
+                BlurredTilesPsnr(output, full_output, resolution, tile_lists));
+        }
+
+        // Against Cpu.Gather, in strips with an eighth of the memory of the frame and the output
+        if (recorder.Enabled("Cpu.Gather.Streamed"))
+        {
+            std::vector<uint8_t> whole_output(frame.size());
+            GatherMotionBlur(
+                params, frame.data(), motion_vectors.data(), neighbor_max.data(), random_tile, &tile_lists, whole_output.data());
+
+            const uint32_t row_bytes = resolution.width * 4;
+            const uint32_t strip_rows = MotionBlurStripRows(params, frame.size() * 2 / 8);
+            recorder.Run("Cpu.Gather.Streamed", resolution, [&] {
+                StreamMotionBlur(
+                    params, motion_vectors.data(), neighbor_max.data(), random_tile, &tile_lists, strip_rows,
+                    [&](uint32_t first_row, uint32_t num_rows, uint8_t* rows) {
+                        std::memcpy(rows, &frame[first_row * row_bytes], num_rows * row_bytes);
+                    },
+                    [&](uint32_t first_row, uint32_t num_rows, const uint8_t* rows) {
+                        std::memcpy(&output[first_row * row_bytes], rows, num_rows * row_bytes);
+                    });
+            });
+
+            const double working_set_mib = MotionBlurStreamWorkingSetBytes(params, strip_rows) / 1048576.0;
+            const double whole_mib = frame.size() * 2 / 1048576.0;
+            std::cerr << std::format("Streamed at {}: strips of {} rows, {:.2f} MiB working set, {:.1f}% of the {:.2f} MiB frame and "
+                                     "output, {}\n",
+                resolution.name, strip_rows, working_set_mib, working_set_mib / whole_mib * 100, whole_mib,
+                output == whole_output ? "same as the whole frame" : "DIFFERENT from the whole frame");
+        }
+
+        // The speed / quality curve, against many more samples
+        constexpr uint32_t ReferenceSamples = 63;
+        std::vector<uint8_t> reference;
+        for (const uint32_t samples : {3, 7, 11, 15, 23, 31})
+        {
+            const std::string stage = std::format("Cpu.Gather.Samples{}", samples);
+            if (!recorder.Enabled(stage))
+            {
+                continue;
+            }
+
+            if (reference.empty())
+            {
+                CpuMotionBlurParams reference_params = params;
+                reference_params.reconstruction_samples = ReferenceSamples;
+                reference.resize(frame.size());
+                GatherMotionBlur(reference_params, frame.data(), motion_vectors.data(), neighbor_max.data(), random_tile, &tile_lists,
+                    reference.data());
+            }
+
+            CpuMotionBlurParams samples_params = params;
+            samples_params.reconstruction_samples = samples;
+            recorder.Run(stage, resolution, [&] {
+                GatherMotionBlur(samples_params, frame.data(), motion_vectors.data(), neighbor_max.data(), random_tile, &tile_lists,
+                    output.data());
+            });
+            std::cerr << std::format("{} samples at {}: {:.2f} dB PSNR against {} samples\n", samples, resolution.name,
+                BlurredTilesPsnr(output, reference, resolution, tile_lists), ReferenceSamples);
+        }
+    }
+
+    // Mostly static, like a stop motion set with one moving object, alternating between 2 frames. Against a PNG file per frame.
+    void RunArchiveBenches(BenchRecorder& recorder, const Resolution& resolution, const std::vector<uint8_t>& frame)
+    {
+        if (!recorder.Enabled("Cpu.Archive") && !recorder.Enabled("Cpu.PngSeq"))
+        {
+            return;
+        }
+
+        const uint32_t width = resolution.width;
+        const uint32_t height = resolution.height;
+        std::vector<uint8_t> frames[2] = {frame, frame};
+        const std::vector<uint8_t> moved = GenerateBenchFrame(width, height, 1);
+        for (uint32_t y = height * 2 / 5; y < height * 3 / 5; ++y)
+        {
+            const uint32_t offset = (y * width + width * 2 / 5) * 4;
+            std::memcpy(&frames[1][offset], &moved[offset], width / 5 * 4);
+        }
+
+        const double raw_kib = frame.size() / 1024.0;
+        const std::filesystem::path temp_dir = std::filesystem::temp_directory_path() / "MotionToGoBench";
+        std::filesystem::create_directories(temp_dir);
+
+        if (recorder.Enabled("Cpu.PngSeq.Write"))
+        {
+            uint32_t frame_index = 0;
+            uint64_t total_size = 0;
+            recorder.Run("Cpu.PngSeq.Write", resolution, [&] {
+                const std::vector<uint8_t> png = EncodePng(frames[frame_index & 1].data(), width, height);
+                std::ofstream ofs(temp_dir / std::format("Frame_{}.png", frame_index + 1), std::ios_base::binary);
+                ofs.write(reinterpret_cast<const char*>(png.data()), png.size());
+                total_size += png.size();
+                ++frame_index;
+            });
+            std::cerr << std::format("PNG sequence at {}: {:.1f} KiB per frame, {:.1f}% of raw\n", resolution.name,
+                total_size / 1024.0 / frame_index, total_size / 1024.0 / frame_index / raw_kib * 100);
+        }
+
+        const std::pair<std::string_view, uint32_t> archive_stages[] = {
+            {"Cpu.Archive.Write", 0},
+            {"Cpu.Archive.WriteDelta", DefaultFrameArchiveKeyFrameInterval},
+        };
+        for (const auto& [stage, key_frame_interval] : archive_stages)
+        {
+            if (!recorder.Enabled(stage))
+            {
+                continue;
+            }
+
+            FrameArchiveWriter archive(temp_dir / "Frames.mtga", key_frame_interval);
+            recorder.Run(stage, resolution, [&] {
+                const uint32_t frame_index = archive.NumFrames();
+                archive.AddFrame(frame_index, width, height, frames[frame_index & 1]);
+            });
+            archive.Close();
+            std::cerr << std::format("{} at {}: {:.1f} KiB per frame, {:.1f}% of raw\n", stage, resolution.name,
+                archive.Size() / 1024.0 / archive.NumFrames(), archive.Size() / 1024.0 / archive.NumFrames() / raw_kib * 100);
+        }
+
+        std::filesystem::remove_all(temp_dir);
+    }
+
+    // Each repetition writes a batch of PNGs, like the encoding threads of a PngSeqWriter finishing together
+    void RunFileWriteBenches(BenchRecorder& recorder, const Resolution& resolution, const std::vector<uint8_t>& frame)
+    {
+        constexpr uint32_t FilesPerBatch = 8;
+
+        const std::pair<std::string_view, FileWriteBackend> stages[] = {
+            {"Cpu.FileWrite.Blocking", FileWriteBackend::Blocking},
+            {"Cpu.FileWrite.IoUring", FileWriteBackend::IoUring},
+        };
+        if (std::none_of(std::begin(stages), std::end(stages), [&](const auto& stage) { return recorder.Enabled(stage.first); }))
+        {
+            return;
+        }
+
+        const std::vector<uint8_t> png = EncodePng(frame.data(), resolution.width, resolution.height);
+        const std::filesystem::path temp_dir = std::filesystem::temp_directory_path() / "MotionToGoBench";
+        std::filesystem::create_directories(temp_dir);
+
+        for (const auto& [stage, backend] : stages)
+        {
+            if (!recorder.Enabled(stage))
+            {
+                continue;
+            }
+            if ((backend == FileWriteBackend::IoUring) && !IsIoUringSupported())
+            {
+                std::cerr << std::format("{} skipped, io_uring isn't supported\n", stage);
+                continue;
+            }
+
+            FileWriteQueue queue(backend);
+            uint32_t file_index = 0;
+            recorder.Run(stage, resolution, [&] {
+                for (uint32_t i = 0; i < FilesPerBatch; ++i)
+                {
+                    queue.Write(temp_dir / std::format("Frame_{}.png", file_index % (FilesPerBatch * 4) + 1), std::vector<uint8_t>(png));
+                    ++file_index;
+                }
+                queue.Flush();
+            });
+
+            const FileWriteStats stats = queue.Stats();
+            std::cerr << std::format("{} at {}: {} files of {:.1f} KiB, {:.2f} syscalls per file, p50 {} us, p90 {} us, p99 {} us\n",
+                stage, resolution.name, stats.files, png.size() / 1024.0, static_cast<double>(stats.syscalls) / stats.files,
+                FileWriteLatencyPercentile(stats, 50), FileWriteLatencyPercentile(stats, 90), FileWriteLatencyPercentile(stats, 99));
+        }
+
+        std::filesystem::remove_all(temp_dir);
+    }
+
+    // A frame through the readback to a writer, a copy stands in for the readback. A fresh vector is zeroed and faulted in each time.
+    void RunFrameBufferBenches(BenchRecorder& recorder, const Resolution& resolution, const std::vector<uint8_t>& frame)
+    {
+        recorder.Run("Cpu.FrameBuffer.Vector", resolution, [&] {
+            std::vector<uint8_t> data(frame.size());
+            std::memcpy(data.data(), frame.data(), frame.size());
+        });
+
+        if (recorder.Enabled("Cpu.FrameBuffer.Pool"))
+        {
+            FrameBufferPool pool;
+            recorder.Run("Cpu.FrameBuffer.Pool", resolution, [&] {
+                FrameBuffer data = pool.Acquire(frame.size());
+                std::memcpy(data.Data(), frame.data(), frame.size());
+            });
+
+            const FrameBufferPoolStats stats = pool.Stats();
+            std::cerr << std::format("Cpu.FrameBuffer.Pool at {}: {:.1f}% hits, peak {:.1f} MiB\n", resolution.name,
+                100.0 * stats.hits / stats.acquires, stats.peak_bytes / (1024.0 * 1024.0));
+        }
+    }
+
+    // The cost of getting a raw frame into the upload heap, a copy stands in for the upload. Compare with Cpu.PngDecode.
+    void RunRawInputBenches(BenchRecorder& recorder, const Resolution& resolution)
+    {
+        if (!recorder.Enabled("Cpu.RawInput.Mapped"))
+        {
+            return;
+        }
+
+        constexpr uint32_t NumFrames = 8;
+
+        const std::filesystem::path temp_dir = std::filesystem::temp_directory_path() / "MotionToGoBench";
+        std::filesystem::create_directories(temp_dir);
+        const std::filesystem::path raw_path = temp_dir / "Frames.rgba";
+        {
+            std::ofstream ofs(raw_path, std::ios_base::binary);
+            for (uint32_t i = 0; i < NumFrames; ++i)
+            {
+                const std::vector<uint8_t> frame = GenerateBenchFrame(resolution.width, resolution.height, i);
+                ofs.write(reinterpret_cast<const char*>(frame.data()), frame.size());
+            }
+        }
+
+        {
+            RawFrameSequence sequence(raw_path, resolution.width, resolution.height);
+            std::vector<uint8_t> upload(RawFrameBytes(RawPixelFormat::Rgba8, resolution.width, resolution.height));
+            uint32_t frame_index = 0;
+            recorder.Run("Cpu.RawInput.Mapped", resolution, [&] {
+                const std::span<const uint8_t> frame = sequence.Frame(frame_index % NumFrames);
+                std::memcpy(upload.data(), frame.data(), frame.size());
+                ++frame_index;
+            });
+        }
+
+        std::filesystem::remove_all(temp_dir);
+    }
+
+    // Filtering alone, and the whole encode with the same deflate, against stb_image_write
+    void RunPngEncodeBenches(BenchRecorder& recorder, const Resolution& resolution, const std::vector<uint8_t>& frame)
+    {
+        const uint32_t width = resolution.width;
+        const uint32_t height = resolution.height;
+        const uint32_t row_bytes = width * 4;
+        const double raw_kib = frame.size() / 1024.0;
+
+        int stb_size = 0;
+        const auto stb_encode = [&](bool deflate) {
+            stb_deflate = deflate;
+            unsigned char* png = stbi_write_png_to_mem(frame.data(), static_cast<int>(row_bytes), static_cast<int>(width),
+                static_cast<int>(height), 4, &stb_size);
+            STBIW_FREE(png);
+        };
+        recorder.Run("Cpu.PngFilter.Stb", resolution, [&] { stb_encode(false); });
+        if (recorder.Enabled("Cpu.PngEncode.Stb"))
+        {
+            recorder.Run("Cpu.PngEncode.Stb", resolution, [&] { stb_encode(true); });
+            std::cerr << std::format("Cpu.PngEncode.Stb at {}: {:.1f} KiB, {:.1f}% of raw\n", resolution.name, stb_size / 1024.0,
+                stb_size / 1024.0 / raw_kib * 100);
+        }
+
+        const std::vector<uint8_t> zero_row(row_bytes, 0);
+        std::vector<uint8_t> filtered(row_bytes);
+        const CpuSimdLevel detected_level = DetectedCpuSimdLevel();
+        for (const auto strategy : {PngFilterStrategy::Fixed, PngFilterStrategy::Heuristic, PngFilterStrategy::Exhaustive})
+        {
+            for (uint32_t level = 0; level <= static_cast<uint32_t>(detected_level); ++level)
+            {
+                SetCpuSimdLevel(static_cast<CpuSimdLevel>(level));
+                recorder.Run(std::format("Cpu.PngFilter.{}.{}", PngFilterStrategyName(strategy), CpuSimdLevelName(ActiveCpuSimdLevel())),
+                    resolution, [&] {
+                        for (uint32_t y = 0; y < height; ++y)
+                        {
+                            const uint8_t* row = &frame[y * row_bytes];
+                            FilterPngRow(strategy, PngFilter::Paeth, row, y > 0 ? row - row_bytes : zero_row.data(), row_bytes,
+                                filtered.data());
+                        }
+                    });
+            }
+            SetCpuSimdLevel(detected_level);
+
+            const std::string stage = std::format("Cpu.PngEncode.{}", PngFilterStrategyName(strategy));
+            if (recorder.Enabled(stage))
+            {
+                std::vector<uint8_t> png;
+                recorder.Run(stage, resolution, [&] { png = EncodePng(frame.data(), width, height, 0, {strategy, PngFilter::Paeth}); });
+                std::cerr << std::format("{} at {}: {:.1f} KiB, {:.1f}% of raw\n", stage, resolution.name, png.size() / 1024.0,
+                    png.size() / 1024.0 / raw_kib * 100);
+            }
+        }
+    }
+
+    void AppendBenchPngChunk(std::vector<uint8_t>& png, const char* type, const std::vector<uint8_t>& data)
+    {
+        const auto append_big_endian = [&png](uint32_t value) {
+            for (int shift = 24; shift >= 0; shift -= 8)
+            {
+                png.push_back(static_cast<uint8_t>(value >> shift));
+            }
+        };
+
+        append_big_endian(static_cast<uint32_t>(data.size()));
+        const size_t type_offset = png.size();
+        png.insert(png.end(), type, type + 4);
+        png.insert(png.end(), data.begin(), data.end());
+        append_big_endian(crc32(0, &png[type_offset], static_cast<uInt>(4 + data.size())));
+    }
+
+    // The frame in a format EncodePng doesn't write, every row Paeth filtered. 16-bit gets a low byte that isn't a copy of the
+    // high one, so it deflates like a real 16-bit frame.
+    std::vector<uint8_t> EncodeBenchPng(const std::vector<uint8_t>& frame, uint32_t width, uint32_t height, PngRowFormat format)
+    {
+        const uint32_t bytes_per_pixel = PngRowFormatBytesPerPixel(format);
+        const uint32_t channels = (format == PngRowFormat::Rgb8) || (format == PngRowFormat::Rgb16) ? 3 : 4;
+        const uint32_t bytes_per_channel = bytes_per_pixel / channels;
+        const uint32_t row_bytes = width * bytes_per_pixel;
+
+        std::vector<uint8_t> rows(static_cast<size_t>(height) * row_bytes);
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                for (uint32_t c = 0; c < channels; ++c)
+                {
+                    const uint8_t value = frame[(y * width + x) * 4 + c];
+                    uint8_t* dst = &rows[y * row_bytes + (x * channels + c) * bytes_per_channel];
+                    dst[0] = value;
+                    if (bytes_per_channel == 2)
+                    {
+                        dst[1] = static_cast<uint8_t>(value * 7 + x);
+                    }
+                }
+            }
+        }
+
+        std::vector<uint8_t> filtered(static_cast<size_t>(height) * (row_bytes + 1));
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            const uint8_t* row = &rows[y * row_bytes];
+            const uint8_t* prev_row = y > 0 ? row - row_bytes : nullptr;
+            uint8_t* dst = &filtered[y * (row_bytes + 1)];
+            dst[0] = static_cast<uint8_t>(PngFilter::Paeth);
+            for (uint32_t i = 0; i < row_bytes; ++i)
+            {
+                const int a = i >= bytes_per_pixel ? row[i - bytes_per_pixel] : 0;
+                const int b = prev_row != nullptr ? prev_row[i] : 0;
+                const int c = (i >= bytes_per_pixel) && (prev_row != nullptr) ? prev_row[i - bytes_per_pixel] : 0;
+                const int pa = std::abs(b - c);
+                const int pb = std::abs(a - c);
+                const int pc = std::abs(a + b - 2 * c);
+                const int predictor = (pa <= pb) && (pa <= pc) ? a : (pb <= pc ? b : c);
+                dst[i + 1] = static_cast<uint8_t>(row[i] - predictor);
+            }
+        }
+
+        uLongf compressed_size = compressBound(static_cast<uLong>(filtered.size()));
+        std::vector<uint8_t> compressed(compressed_size);
+        compress2(compressed.data(), &compressed_size, filtered.data(), static_cast<uLong>(filtered.size()), 5);
+        compressed.resize(compressed_size);
+
+        std::vector<uint8_t> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+        std::vector<uint8_t> header;
+        for (const uint32_t value : {width, height})
+        {
+            for (int shift = 24; shift >= 0; shift -= 8)
+            {
+                header.push_back(static_cast<uint8_t>(value >> shift));
+            }
+        }
+        header.insert(header.end(), {static_cast<uint8_t>(bytes_per_channel * 8), static_cast<uint8_t>(channels == 4 ? 6 : 2), 0, 0, 0});
+        AppendBenchPngChunk(png, "IHDR", header);
+        AppendBenchPngChunk(png, "IDAT", compressed);
+        AppendBenchPngChunk(png, "IEND", {});
+        return png;
+    }
+
+    void RunPngDecodeStages(BenchRecorder& recorder, const Resolution& resolution, std::string_view name,
+        const std::vector<std::vector<uint8_t>>& pngs)
+    {
+        recorder.Run(std::format("Cpu.PngDecode.{}.Stb", name), resolution, [&] {
+            for (const auto& png : pngs)
+            {
+                int width, height;
+                stbi_image_free(stbi_load_from_memory(png.data(), static_cast<int>(png.size()), &width, &height, nullptr, 4));
+            }
+        });
+
+        // Into a padded pitch, like the upload heap's. There's nothing for AVX2 in the decoder.
+        std::vector<uint8_t> rgba;
+        const CpuSimdLevel detected_level = DetectedCpuSimdLevel();
+        for (uint32_t level = 0; level <= std::min(static_cast<uint32_t>(detected_level), static_cast<uint32_t>(CpuSimdLevel::Sse41));
+             ++level)
+        {
+            SetCpuSimdLevel(static_cast<CpuSimdLevel>(level));
+            recorder.Run(std::format("Cpu.PngDecode.{}.{}", name, CpuSimdLevelName(ActiveCpuSimdLevel())), resolution, [&] {
+                for (const auto& png : pngs)
+                {
+                    uint32_t width, height;
+                    ImageSize(png, width, height);
+                    const uint32_t row_pitch = (width * 4 + 255) & ~255U;
+                    rgba.resize(static_cast<size_t>(height) * row_pitch);
+                    DecodeImage(png, rgba.data(), row_pitch);
+                }
+            });
+        }
+        SetCpuSimdLevel(detected_level);
+    }
+
+    // Frame sized plates in the formats an image sequence comes in, against stb_image
+    void RunPngDecodeBenches(BenchRecorder& recorder, const Resolution& resolution, const std::vector<uint8_t>& frame)
+    {
+        const uint32_t width = resolution.width;
+        const uint32_t height = resolution.height;
+        const std::pair<std::string_view, PngRowFormat> formats[] = {
+            {"Rgb8", PngRowFormat::Rgb8},
+            {"Rgba8", PngRowFormat::Rgba8},
+            {"Rgba16", PngRowFormat::Rgba16},
+        };
+        for (const auto& [name, format] : formats)
+        {
+            if (!recorder.Enabled(std::format("Cpu.PngDecode.{}.", name)))
+            {
+                continue;
+            }
+
+            const std::vector<uint8_t> png =
+                format == PngRowFormat::Rgba8 ? EncodePng(frame.data(), width, height) : EncodeBenchPng(frame, width, height, format);
+            RunPngDecodeStages(recorder, resolution, name, {png});
+        }
+    }
+
+    // All the PNGs in a directory, such as an image sequence's, for each run
+    void RunPngDecodeFileBenches(BenchRecorder& recorder, const std::filesystem::path& dir)
+    {
+        std::vector<std::vector<uint8_t>> pngs;
+        for (const auto& entry : std::filesystem::directory_iterator(dir))
+        {
+            std::string ext = entry.path().extension().string();
+            std::transform(ext.begin(), ext.end(), ext.begin(), [](char ch) { return static_cast<char>(std::tolower(ch)); });
+            if (!entry.is_directory() && (ext == ".png"))
+            {
+                std::ifstream ifs(entry.path(), std::ios_base::binary);
+                pngs.emplace_back(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+            }
+        }
+
+        uint32_t width, height;
+        if (pngs.empty() || !ImageSize(pngs[0], width, height))
+        {
+            std::cerr << std::format("{} has no PNGs\n", dir.string());
+            return;
+        }
+
+        std::cerr << std::format("Cpu.PngDecode.Files: {} PNGs of {}x{}\n", pngs.size(), width, height);
+        RunPngDecodeStages(recorder, {"files", width, height}, "Files", pngs);
+    }
+} // namespace
+
+namespace MotionToGo
+{
+    void RunCpuBenches(BenchRecorder& recorder, std::span<const Resolution> resolutions)
+    {
+        for (const auto& resolution : resolutions)
+        {
+            const uint32_t width = resolution.width;
+            const uint32_t height = resolution.height;
+
+            const std::vector<uint8_t> frame = GenerateBenchFrame(width, height, 0);
+
+            std::vector<uint8_t> luma(width * height);
+            std::vector<uint8_t> chroma(width * height / 2);
+            std::vector<uint8_t> rgba(width * height * 4);
+            const CpuSimdLevel detected_level = DetectedCpuSimdLevel();
+            for (uint32_t level = 0; level <= static_cast<uint32_t>(detected_level); ++level)
+            {
+                SetCpuSimdLevel(static_cast<CpuSimdLevel>(level));
+                const char* level_name = CpuSimdLevelName(ActiveCpuSimdLevel());
+
+                recorder.Run(std::format("Cpu.RgbaToNv12.{}", level_name), resolution,
+                    [&] { RgbaToNv12(frame.data(), width * 4, width, height, luma.data(), width, chroma.data(), width); });
+                recorder.Run(std::format("Cpu.Nv12ToRgba.{}", level_name), resolution,
+                    [&] { Nv12ToRgba(luma.data(), width, chroma.data(), width, width, height, rgba.data(), width * 4); });
+            }
+            SetCpuSimdLevel(detected_level);
+
+            RunCpuMotionBlurBenches(recorder, resolution, frame);
+            RunArchiveBenches(recorder, resolution, frame);
+            RunFileWriteBenches(recorder, resolution, frame);
+            RunFrameBufferBenches(recorder, resolution, frame);
+            RunRawInputBenches(recorder, resolution);
+            RunPngEncodeBenches(recorder, resolution, frame);
+            RunPngDecodeBenches(recorder, resolution, frame);
+
+            std::vector<uint8_t> png;
+            recorder.Run("Cpu.PngEncode", resolution, [&] { png = EncodePng(frame.data(), width, height); });
+            if (recorder.Enabled("Cpu.PngDecode"))
+            {
+                if (png.empty())
+                {
+                    png = EncodePng(frame.data(), width, height);
+                }
+
+                recorder.Run("Cpu.PngDecode", resolution, [&] {
+                    uint32_t decoded_width;
+                    uint32_t decoded_height;
+                    rgba = DecodeImage(png, decoded_width, decoded_height);
+                });
+            }
+        }
+
+        if (!recorder.Options().image_dir.empty())
+        {
+            RunPngDecodeFileBenches(recorder, recorder.Options().image_dir);
+        }
+    }
+} // namespace MotionToGo
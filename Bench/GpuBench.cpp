@@ -0,0 +1,215 @@
+#include "Bench.hpp"
+
+#include <array>
+#include <format>
+#include <iostream>
+#include <string>
+#include <utility>
+
+#include "Gpu/GpuCommandList.hpp"
+#include "Gpu/GpuSystem.hpp"
+#include "Gpu/GpuTexture2D.hpp"
+#include "MotionBlurGenerator/MotionBlurGenerator.hpp"
+
+namespace MotionToGo
+{
+    void RunGpuBenches(BenchRecorder& recorder, std::span<const Resolution> resolutions)
+    {
+        using Stage = MotionBlurGenerator::Stage;
+
+        constexpr std::pair<Stage, std::string_view> ProfiledStages[] = {
+            {Stage::CopyFrame, "Gpu.CopyFrame"},
+            {Stage::ConvertToNv12, "Gpu.ConvertToNv12"},
+            {Stage::EstimateMotionVectors, "Gpu.EstimateMotionVectors"},
+            {Stage::PropagateMotionBlur, "Gpu.NeighborMax"},
+            {Stage::ClassifyTiles, "Gpu.ClassifyTiles"},
+            {Stage::GatherMotionBlur, "Gpu.Gather"},
+        };
+
+        try
+        {
+            GpuSystem gpu_system(MotionBlurGenerator::ConfirmDeviceFunc);
+            MotionBlurGenerator generator(gpu_system);
+
+            const BenchOptions& options = recorder.Options();
+            for (const auto& resolution : resolutions)
+            {
+                GpuTexture2D frame_texs[2];
+                for (uint32_t i = 0; i < std::size(frame_texs); ++i)
+                {
+                    const std::vector<uint8_t> frame = GenerateBenchFrame(resolution.width, resolution.height, i);
+
+                    frame_texs[i] = GpuTexture2D(gpu_system, resolution.width, resolution.height, 1, DXGI_FORMAT_R8G8B8A8_UNORM,
+                        D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COMMON, std::format(L"bench_frame_tex {}", i));
+                    auto cmd_list = gpu_system.CreateCommandList(GpuSystem::CmdQueueType::Compute);
+                    frame_texs[i].Upload(gpu_system, cmd_list, 0, frame.data());
+                    gpu_system.Execute(std::move(cmd_list));
+                }
+
+                GpuTexture2D motion_blurred_texs[GpuSystem::FrameCount];
+                for (uint32_t i = 0; i < GpuSystem::FrameCount; ++i)
+                {
+                    motion_blurred_texs[i] = GpuTexture2D(gpu_system, resolution.width, resolution.height, 1,
+                        DXGI_FORMAT_R8G8B8A8_UNORM, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COMMON,
+                        std::format(L"bench_motion_blurred_tex {}", i));
+                }
+
+                uint32_t frame_index = 0;
+                const auto add_frame = [&] {
+                    GpuTexture2D& motion_blurred_tex = motion_blurred_texs[gpu_system.FrameIndex() % GpuSystem::FrameCount];
+                    generator.AddFrame(motion_blurred_tex, frame_texs[frame_index & 1], 1 / 24.0f, false);
+                    gpu_system.WaitForGpu();
+                    gpu_system.MoveToNextFrame();
+                    ++frame_index;
+                };
+
+                // The first frame of a sequence only allocates the intermediate textures
+                generator.Reset();
+                add_frame();
+
+                const MotionBlurTextureMemory texture_memory = generator.TextureMemory();
+                std::cerr << std::format("Textures at {}: {:.1f} MB resident, {:.1f} MB without aliasing\n", resolution.name,
+                    texture_memory.resident_bytes / 1e6, texture_memory.unaliased_bytes / 1e6);
+
+                recorder.Run("Gpu.AddFrame", resolution, add_frame);
+
+                const auto profile_stages = [&] {
+                    generator.ProfileStages(true);
+                    std::array<std::vector<double>, static_cast<uint32_t>(Stage::Num)> stage_samples;
+                    for (uint32_t i = 0; i < options.warmup + options.repetitions; ++i)
+                    {
+                        add_frame();
+                        if (i >= options.warmup)
+                        {
+                            const auto stage_times = generator.StageTimes();
+                            for (uint32_t s = 0; s < stage_times.size(); ++s)
+                            {
+                                stage_samples[s].push_back(stage_times[s]);
+                            }
+                        }
+                    }
+                    generator.ProfileStages(false);
+                    return stage_samples;
+                };
+
+                auto stage_samples = profile_stages();
+                for (const auto& [stage, name] : ProfiledStages)
+                {
+                    if (recorder.Enabled(name))
+                    {
+                        recorder.Record(name, resolution, std::move(stage_samples[static_cast<uint32_t>(stage)]));
+                    }
+                }
+
+                const auto tile_counts = generator.TileCounts();
+                const uint32_t num_tiles = tile_counts[0] + tile_counts[1] + tile_counts[2];
+                std::cerr << std::format("Tiles at {}: {} static, {} uniform motion, {} complex, of {}\n", resolution.name,
+                    tile_counts[0], tile_counts[1], tile_counts[2], num_tiles);
+
+                // The baseline of the time saved by skipping the static tiles
+                if (recorder.Enabled("Gpu.Gather.AllTiles"))
+                {
+                    generator.SkipStaticTiles(false);
+                    stage_samples = profile_stages();
+                    generator.SkipStaticTiles(true);
+
+                    recorder.Record("Gpu.Gather.AllTiles", resolution,
+                        std::move(stage_samples[static_cast<uint32_t>(Stage::GatherMotionBlur)]));
+                }
+
+                // The adaptive sample counts, against the fixed count of Gpu.Gather
+                if (recorder.Enabled("Gpu.Gather.AdaptiveSamples"))
+                {
+                    generator.MinReconstructionSamples(5);
+                    stage_samples = profile_stages();
+                    generator.MinReconstructionSamples(MotionBlurGenerator::DefaultMinReconstructionSamples);
+
+                    recorder.Record("Gpu.Gather.AdaptiveSamples", resolution,
+                        std::move(stage_samples[static_cast<uint32_t>(Stage::GatherMotionBlur)]));
+                }
+
+                // The speed side of the speed / quality curve, Cpu.Gather.Samples* reports the quality of the same gather
+                for (const uint32_t samples : {7, 11, 15, 23})
+                {
+                    const std::string stage = std::format("Gpu.Gather.Samples{}", samples);
+                    if (recorder.Enabled(stage))
+                    {
+                        generator.BlurParameters(
+                            MotionBlurGenerator::DefaultExposure, MotionBlurGenerator::DefaultBlurRadius, samples);
+                        stage_samples = profile_stages();
+                        recorder.Record(stage, resolution, std::move(stage_samples[static_cast<uint32_t>(Stage::GatherMotionBlur)]));
+                    }
+                }
+                generator.BlurParameters(MotionBlurGenerator::DefaultExposure, MotionBlurGenerator::DefaultBlurRadius,
+                    MotionBlurGenerator::DefaultReconstructionSamples);
+
+                // Includes the tile max, which doesn't depend on the radius
+                for (const uint32_t radius : {1, 2, 4, 8})
+                {
+                    const std::string stage = std::format("Gpu.NeighborMax.Radius{}", radius);
+                    if (recorder.Enabled(stage))
+                    {
+                        generator.NeighborMaxParameters(MotionBlurGenerator::DefaultNeighborMaxTileSize, radius);
+                        stage_samples = profile_stages();
+                        recorder.Record(stage, resolution, std::move(stage_samples[static_cast<uint32_t>(Stage::PropagateMotionBlur)]));
+                    }
+                }
+                generator.NeighborMaxParameters(
+                    MotionBlurGenerator::DefaultNeighborMaxTileSize, MotionBlurGenerator::DefaultNeighborMaxRadius);
+
+                // Downsample, gather and upsample, against Gpu.Gather.AllTiles. Takes a new sequence to allocate the preview.
+                for (const uint32_t scale : {2, 4})
+                {
+                    const std::string stage = std::format("Gpu.Gather.Preview{}", scale);
+                    if (recorder.Enabled(stage))
+                    {
+                        generator.PreviewScale(scale);
+                        generator.Reset();
+                        add_frame();
+                        stage_samples = profile_stages();
+
+                        std::vector<double> preview_samples = std::move(stage_samples[static_cast<uint32_t>(Stage::GatherMotionBlur)]);
+                        for (const auto preview_stage : {Stage::DownsamplePreview, Stage::UpsamplePreview})
+                        {
+                            for (uint32_t i = 0; i < preview_samples.size(); ++i)
+                            {
+                                preview_samples[i] += stage_samples[static_cast<uint32_t>(preview_stage)][i];
+                            }
+                        }
+                        recorder.Record(stage, resolution, std::move(preview_samples));
+                    }
+                }
+                generator.PreviewScale(1);
+
+                // Filling and gathering strips of 256 rows, against Gpu.Gather.AllTiles, and the textures they keep resident
+                if (recorder.Enabled("Gpu.Gather.Strips"))
+                {
+                    generator.StripRows(256);
+                    generator.Reset();
+                    add_frame();
+                    stage_samples = profile_stages();
+
+                    std::vector<double> strip_samples = std::move(stage_samples[static_cast<uint32_t>(Stage::GatherMotionBlur)]);
+                    for (uint32_t i = 0; i < strip_samples.size(); ++i)
+                    {
+                        strip_samples[i] += stage_samples[static_cast<uint32_t>(Stage::CopyFrame)][i];
+                    }
+                    recorder.Record("Gpu.Gather.Strips", resolution, std::move(strip_samples));
+
+                    const MotionBlurTextureMemory strip_memory = generator.TextureMemory();
+                    std::cerr << std::format("Textures at {} in strips: {:.1f} MB resident, for a {:.1f} MB frame\n", resolution.name,
+                        strip_memory.resident_bytes / 1e6, strip_memory.frame_bytes / 1e6);
+
+                    generator.StripRows(0);
+                }
+                generator.Reset();
+            }
+
+            gpu_system.WaitForGpu();
+        }
+        catch (const std::exception& ex)
+        {
+            std::cerr << std::format("Skipping the GPU stages: {}\n", ex.what());
+        }
+    }
+} // namespace MotionToGo
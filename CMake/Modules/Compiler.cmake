@@ -77,6 +77,29 @@ if(MSVC)
     endforeach()
 
     add_definitions(-DWIN32 -D_WINDOWS)
+else()
+    set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} -Wall -Werror")
+
+    set(CMAKE_CXX_STANDARD 20)
+
+    if(CMAKE_CXX_COMPILER_ID MATCHES Clang)
+        set(motion_to_go_compiler_name "clang")
+        set(motion_to_go_compiler_clang TRUE)
+        if(CMAKE_CXX_COMPILER_VERSION VERSION_LESS "17.0")
+            message(FATAL_ERROR "Unsupported compiler version. Please install clang 17.0 or up.")
+        endif()
+    elseif(CMAKE_CXX_COMPILER_ID MATCHES GNU)
+        set(motion_to_go_compiler_name "gcc")
+        set(motion_to_go_compiler_gcc TRUE)
+        if(CMAKE_CXX_COMPILER_VERSION VERSION_LESS "13.0")
+            message(FATAL_ERROR "Unsupported compiler version. Please install gcc 13.0 or up.")
+        endif()
+    else()
+        message(FATAL_ERROR "Unsupported compiler.")
+    endif()
+    string(REGEX REPLACE "^([0-9]+).*" "\\1" motion_to_go_compiler_version ${CMAKE_CXX_COMPILER_VERSION})
+
+    set(CMAKE_CXX_FLAGS_RELEASE "${CMAKE_CXX_FLAGS_RELEASE} -DGOLDEN_SUN_SHIP")
 endif()
 
 set(CMAKE_C_FLAGS_DEBUG ${CMAKE_CXX_FLAGS_DEBUG})
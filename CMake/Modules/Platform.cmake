@@ -9,11 +9,17 @@ if(WIN32)
     endif()
     set(motion_to_go_platform_name "win")
     set(motion_to_go_platform_windows TRUE)
+elseif(CMAKE_SYSTEM_NAME STREQUAL "Linux")
+    set(motion_to_go_platform_name "linux")
+    set(motion_to_go_platform_linux TRUE)
 endif()
 
 if(${CMAKE_HOST_SYSTEM_NAME} STREQUAL "Windows")
     set(motion_to_go_host_platform_name "win")
     set(motion_to_go_host_platform_windows TRUE)
+elseif(${CMAKE_HOST_SYSTEM_NAME} STREQUAL "Linux")
+    set(motion_to_go_host_platform_name "linux")
+    set(motion_to_go_host_platform_linux TRUE)
 endif()
 
 if(NOT motion_to_go_arch_name)
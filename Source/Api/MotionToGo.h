@@ -0,0 +1,175 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define MTG_VERSION_MAJOR 0
+#define MTG_VERSION_MINOR 1
+#define MTG_VERSION_PATCH 0
+
+    typedef struct MtgContext MtgContext;
+
+    typedef enum MtgResult
+    {
+        MTG_RESULT_OK = 0,
+        MTG_RESULT_INVALID_ARGUMENT,
+        MTG_RESULT_INVALID_STATE,
+        MTG_RESULT_IO_ERROR,
+        MTG_RESULT_DEVICE_ERROR,
+        MTG_RESULT_UNKNOWN_ERROR,
+    } MtgResult;
+
+    typedef enum MtgPixelFormat
+    {
+        MTG_PIXEL_FORMAT_RGBA8 = 0,
+        MTG_PIXEL_FORMAT_NV12,
+    } MtgPixelFormat;
+
+    // RGBA8 uses planes[0]. NV12 uses planes[0] for Y and planes[1] for the interleaved, half resolution UV.
+    // A row pitch of 0 means tightly packed rows.
+    typedef struct MtgFrame
+    {
+        MtgPixelFormat format;
+        uint32_t width;
+        uint32_t height;
+        const void* planes[2];
+        uint32_t row_pitches[2];
+    } MtgFrame;
+
+    // The frame is owned by the library and only valid during the callback. Frames are delivered in push order.
+    typedef void (*MtgFrameCallback)(void* user_data, uint32_t frame_index, const MtgFrame* frame);
+    typedef void (*MtgProgressCallback)(void* user_data, uint32_t frame_index);
+
+    // Trades the blur quality for speed. A field of 0 takes the default, 1 for the exposure and the blur radius, 15 for the
+    // reconstruction samples. The exposure is the fraction of the frame time the shutter is open, in (0, 1]. The blur radius is
+    // at least 0.1. At most 64 reconstruction samples. A preview scale of 2 or 4 computes the blur at 1/2 or 1/4 of the resolution
+    // and upsamples it, several times faster, for previews. 0 or 1 is the full resolution.
+    typedef struct MtgBlurParams
+    {
+        float exposure;
+        float blur_radius;
+        uint32_t reconstruction_samples;
+        uint32_t preview_scale;
+    } MtgBlurParams;
+
+    // Descs from before blur was added are still accepted, with the default blur. The neighbor max radius is how far, in 16 pixel
+    // tiles, the blur of a moving object reaches out. Motion longer than (radius + 1) * 16 pixels gets truncated. 0 takes the
+    // default of 1, larger than 8 is clamped to 8. Larger is slower, and blurs the background around the fast objects more. With
+    // min reconstruction samples, the tiles with short blur take about one sample per pixel of blur, down to this, instead of all
+    // the reconstruction samples. 0 is off, at most 64. 5 is about 3 times faster on smooth content, visually the same. Strip rows,
+    // a multiple of 16, gather the blur that many rows at a time, for 8K and larger frames. Only a strip and its halo of the full
+    // resolution frame are held in GPU memory. Slower, the output is the same. 0 processes whole frames. Ignored in preview.
+    typedef struct MtgStreamDesc
+    {
+        uint32_t struct_size;
+        uint32_t overlay_motion_vectors;
+        MtgFrameCallback frame_callback;
+        void* user_data;
+        MtgBlurParams blur;
+        uint32_t neighbor_max_radius;
+        uint32_t min_reconstruction_samples;
+        uint32_t strip_rows;
+    } MtgStreamDesc;
+
+    typedef enum MtgOutputFormat
+    {
+        // Frame_N.png per frame
+        MTG_OUTPUT_FORMAT_PNG_SEQUENCE = 0,
+        // One LZ4 compressed Frames.mtga, MotionArchive extracts it to PNG
+        MTG_OUTPUT_FORMAT_ARCHIVE,
+        // Like the archive, with most frames stored as the difference from the previous one. Smaller on static shots.
+        MTG_OUTPUT_FORMAT_DELTA_ARCHIVE,
+    } MtgOutputFormat;
+
+    // Paths are UTF-8. input_path is either a directory of images or a video file. Descs from before output_format was added write
+    // PNG sequences. With a raw size, input_path is raw frames instead, a .rgba or .nv12 file of them concatenated, or a directory
+    // of one such file per frame. They are memory mapped rather than decoded.
+    typedef struct MtgJobDesc
+    {
+        uint32_t struct_size;
+        const char* input_path;
+        const char* output_dir;
+        float framerate;
+        uint32_t overlay_motion_vectors;
+        MtgProgressCallback progress_callback;
+        void* user_data;
+        MtgBlurParams blur;
+        MtgOutputFormat output_format;
+        // Both 0 if the input isn't raw
+        uint32_t raw_width;
+        uint32_t raw_height;
+        // As in MtgStreamDesc
+        uint32_t neighbor_max_radius;
+        uint32_t min_reconstruction_samples;
+        uint32_t strip_rows;
+    } MtgJobDesc;
+
+    typedef struct MtgJobStats
+    {
+        uint32_t struct_size;
+        uint32_t frames;
+        double total_ms;
+        double ms_per_frame;
+        // Frames identical to the previous one, hard linked in a PNG sequence or repeated in an archive, and what encoding them
+        // would have written
+        uint32_t deduplicated_frames;
+        uint64_t deduplicated_bytes;
+        // Encoding the other frames, summed over the encoding threads
+        double encode_ms;
+        // The read back frames. An acquire is a hit if it reused the buffer of an earlier frame instead of allocating one. The
+        // peak is of the context's pool, over its life.
+        uint32_t frame_buffer_acquires;
+        uint32_t frame_buffer_hits;
+        uint64_t frame_buffer_peak_bytes;
+        // The textures the job needed, from the context's texture pool or created, and the most the pool held between owners
+        // during the job. The pool is trimmed when a job ends.
+        uint32_t texture_hits;
+        uint32_t texture_misses;
+        uint64_t texture_pool_peak_bytes;
+        // Process wide, not of the job: the most memory of each kind held at once since the process started, by all the contexts
+        // and their jobs, including the concurrent ones. Staging for the copies to and from the GPU, descriptor heaps, the textures
+        // of the read and written frames, the motion blur intermediates, and the read back frames. Then the most held of all of
+        // them together, and what they held when the job ended.
+        uint64_t process_upload_staging_peak_bytes;
+        uint64_t process_readback_staging_peak_bytes;
+        uint64_t process_descriptor_peak_bytes;
+        uint64_t process_frame_texture_peak_bytes;
+        uint64_t process_intermediate_texture_peak_bytes;
+        uint64_t process_cpu_frame_buffer_peak_bytes;
+        uint64_t process_memory_peak_bytes;
+        uint64_t process_memory_bytes;
+        // Of the job: the bytes of a full resolution RGBA8 frame, and the most the motion blur textures held at once. With strip
+        // rows, they hold a strip and its halo of the frame instead of all of it.
+        uint64_t frame_bytes;
+        uint64_t motion_blur_peak_bytes;
+    } MtgJobStats;
+
+    void MtgGetVersion(uint32_t* major, uint32_t* minor, uint32_t* patch);
+
+    // A context owns the device, the pipelines and the intermediate resources. It can be reused for any number of
+    // streams and jobs, but must only be used by one thread at a time.
+    MtgResult MtgCreateContext(MtgContext** context);
+    void MtgDestroyContext(MtgContext* context);
+
+    // Returns the message of the last failure on this context, or of the last failed call without a context on this thread
+    // if context is NULL.
+    const char* MtgGetLastError(const MtgContext* context);
+
+    // Tracing is process wide. MtgEndTrace writes the events recorded since MtgBeginTrace to a Chrome trace / Perfetto JSON
+    // file. When tracing is off, the instrumentation costs one relaxed atomic load per scope.
+    MtgResult MtgBeginTrace(void);
+    MtgResult MtgEndTrace(const char* output_path);
+
+    MtgResult MtgBeginStream(MtgContext* context, const MtgStreamDesc* desc);
+    MtgResult MtgPushFrame(MtgContext* context, const MtgFrame* frame, float time_span);
+    MtgResult MtgEndStream(MtgContext* context);
+
+    MtgResult MtgProcessJob(MtgContext* context, const MtgJobDesc* desc, MtgJobStats* stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,538 @@
+#include "MotionToGo.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <format>
+#include <memory>
+#include <string>
+
+#include <mfapi.h>
+
+#include "Codec/FrameArchive.hpp"
+#include "ErrorHandling.hpp"
+#include "Gpu/GpuCommandList.hpp"
+#include "Gpu/GpuSystem.hpp"
+#include "MotionBlurGenerator/MotionBlurGenerator.hpp"
+#include "Pipeline/FramePipeline.hpp"
+#include "Reader/Reader.hpp"
+#include "Trace/MemoryTracker.hpp"
+#include "Trace/Trace.hpp"
+#include "Writer/Writer.hpp"
+
+using namespace MotionToGo;
+
+struct MtgContext
+{
+    MtgContext()
+        : com_initialized(SUCCEEDED(::CoInitializeEx(nullptr, COINIT_MULTITHREADED))), gpu_system(MotionBlurGenerator::ConfirmDeviceFunc),
+          motion_blur_gen(gpu_system), pipeline(gpu_system, motion_blur_gen)
+    {
+        // Keep Media Foundation alive for the whole context, so video jobs don't pay for starting it up.
+        TIFHR(::MFStartup(MF_VERSION, MFSTARTUP_FULL));
+    }
+
+    ~MtgContext() noexcept
+    {
+        gpu_system.WaitForGpu();
+
+        ::MFShutdown();
+
+        if (com_initialized)
+        {
+            ::CoUninitialize();
+        }
+    }
+
+    bool com_initialized;
+
+    GpuSystem gpu_system;
+    MotionBlurGenerator motion_blur_gen;
+    FramePipeline pipeline;
+
+    bool in_stream = false;
+    std::string last_error;
+};
+
+namespace
+{
+    thread_local std::string thread_last_error;
+
+    class InvalidArgumentException : public std::runtime_error
+    {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+    class InvalidStateException : public std::runtime_error
+    {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+    template <typename Func>
+    MtgResult Guard(std::string& last_error, Func&& func)
+    {
+        try
+        {
+            func();
+            last_error.clear();
+            return MTG_RESULT_OK;
+        }
+        catch (const InvalidArgumentException& ex)
+        {
+            last_error = ex.what();
+            return MTG_RESULT_INVALID_ARGUMENT;
+        }
+        catch (const InvalidStateException& ex)
+        {
+            last_error = ex.what();
+            return MTG_RESULT_INVALID_STATE;
+        }
+        catch (const HrException& ex)
+        {
+            last_error = ex.what();
+            return MTG_RESULT_DEVICE_ERROR;
+        }
+        catch (const std::filesystem::filesystem_error& ex)
+        {
+            last_error = ex.what();
+            return MTG_RESULT_IO_ERROR;
+        }
+        catch (const std::exception& ex)
+        {
+            last_error = ex.what();
+            return MTG_RESULT_UNKNOWN_ERROR;
+        }
+        catch (...)
+        {
+            last_error = "Unknown error";
+            return MTG_RESULT_UNKNOWN_ERROR;
+        }
+    }
+
+    std::filesystem::path Utf8ToPath(const char* str)
+    {
+        return std::filesystem::path(std::u8string_view(reinterpret_cast<const char8_t*>(str)));
+    }
+
+    template <typename Desc>
+    void ApplyBlurParams(MotionBlurGenerator& motion_blur_gen, const Desc& desc)
+    {
+        MtgBlurParams blur{};
+        if (desc.struct_size >= offsetof(Desc, blur) + sizeof(desc.blur))
+        {
+            blur = desc.blur;
+        }
+
+        if (!(blur.exposure >= 0) || (blur.exposure > 1))
+        {
+            throw InvalidArgumentException(std::format("Invalid exposure {}", blur.exposure));
+        }
+        if (!(blur.blur_radius >= 0) || ((blur.blur_radius > 0) && (blur.blur_radius < 0.1f)))
+        {
+            throw InvalidArgumentException(std::format("Invalid blur radius {}", blur.blur_radius));
+        }
+        if (blur.reconstruction_samples > MotionBlurGenerator::MaxReconstructionSamples)
+        {
+            throw InvalidArgumentException(std::format("Invalid reconstruction samples {}", blur.reconstruction_samples));
+        }
+        if ((blur.preview_scale != 0) && (blur.preview_scale != 1) && (blur.preview_scale != 2) &&
+            (blur.preview_scale != MotionBlurGenerator::MaxPreviewScale))
+        {
+            throw InvalidArgumentException(std::format("Invalid preview scale {}", blur.preview_scale));
+        }
+
+        motion_blur_gen.BlurParameters(blur.exposure > 0 ? blur.exposure : MotionBlurGenerator::DefaultExposure,
+            blur.blur_radius > 0 ? blur.blur_radius : MotionBlurGenerator::DefaultBlurRadius,
+            blur.reconstruction_samples > 0 ? blur.reconstruction_samples : MotionBlurGenerator::DefaultReconstructionSamples);
+        motion_blur_gen.PreviewScale(blur.preview_scale > 0 ? blur.preview_scale : 1);
+
+        uint32_t neighbor_max_radius = 0;
+        if (desc.struct_size >= offsetof(Desc, neighbor_max_radius) + sizeof(desc.neighbor_max_radius))
+        {
+            neighbor_max_radius = desc.neighbor_max_radius;
+        }
+        motion_blur_gen.NeighborMaxParameters(MotionBlurGenerator::DefaultNeighborMaxTileSize,
+            neighbor_max_radius > 0 ? std::min(neighbor_max_radius, MaxMotionBlurNeighborMaxRadius)
+                                    : MotionBlurGenerator::DefaultNeighborMaxRadius);
+
+        uint32_t min_reconstruction_samples = MotionBlurGenerator::DefaultMinReconstructionSamples;
+        if (desc.struct_size >= offsetof(Desc, min_reconstruction_samples) + sizeof(desc.min_reconstruction_samples))
+        {
+            min_reconstruction_samples = desc.min_reconstruction_samples;
+        }
+        if (min_reconstruction_samples > MotionBlurGenerator::MaxReconstructionSamples)
+        {
+            throw InvalidArgumentException(std::format("Invalid min reconstruction samples {}", min_reconstruction_samples));
+        }
+        motion_blur_gen.MinReconstructionSamples(min_reconstruction_samples);
+
+        uint32_t strip_rows = 0;
+        if (desc.struct_size >= offsetof(Desc, strip_rows) + sizeof(desc.strip_rows))
+        {
+            strip_rows = desc.strip_rows;
+        }
+        if (strip_rows % MotionBlurTileSize != 0)
+        {
+            throw InvalidArgumentException(std::format("Invalid strip rows {}", strip_rows));
+        }
+        motion_blur_gen.StripRows(strip_rows);
+    }
+
+    void UploadFrame(GpuSystem& gpu_system, const MtgFrame& frame, GpuTexture2D& frame_tex)
+    {
+        GO_MOTION_TRACE_SCOPE("UploadFrame");
+
+        DXGI_FORMAT format;
+        D3D12_RESOURCE_FLAGS flags;
+        switch (frame.format)
+        {
+        case MTG_PIXEL_FORMAT_RGBA8:
+            format = DXGI_FORMAT_R8G8B8A8_UNORM;
+            flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
+            break;
+
+        case MTG_PIXEL_FORMAT_NV12:
+            if ((frame.width & 1) || (frame.height & 1))
+            {
+                throw InvalidArgumentException("NV12 frames MUST have even width and height");
+            }
+            format = DXGI_FORMAT_NV12;
+            flags = D3D12_RESOURCE_FLAG_NONE;
+            break;
+
+        default:
+            throw InvalidArgumentException("Unsupported pixel format");
+        }
+
+        gpu_system.RecycleTexture(frame_tex, frame.width, frame.height, format, flags, L"pushed_frame_tex");
+
+        auto cmd_list = gpu_system.CreateCommandList(GpuSystem::CmdQueueType::Compute);
+        for (uint32_t p = 0; p < frame_tex.Planes(); ++p)
+        {
+            if (frame.planes[p] == nullptr)
+            {
+                throw InvalidArgumentException(std::format("Plane {} of the frame is NULL", p));
+            }
+            frame_tex.Upload(gpu_system, cmd_list, p, frame.planes[p], frame.row_pitches[p]);
+        }
+        gpu_system.Execute(std::move(cmd_list));
+    }
+} // namespace
+
+void MtgGetVersion(uint32_t* major, uint32_t* minor, uint32_t* patch)
+{
+    if (major != nullptr)
+    {
+        *major = MTG_VERSION_MAJOR;
+    }
+    if (minor != nullptr)
+    {
+        *minor = MTG_VERSION_MINOR;
+    }
+    if (patch != nullptr)
+    {
+        *patch = MTG_VERSION_PATCH;
+    }
+}
+
+MtgResult MtgCreateContext(MtgContext** context)
+{
+    return Guard(thread_last_error, [context] {
+        if (context == nullptr)
+        {
+            throw InvalidArgumentException("context is NULL");
+        }
+
+        *context = nullptr;
+        *context = new MtgContext;
+    });
+}
+
+void MtgDestroyContext(MtgContext* context)
+{
+    delete context;
+}
+
+const char* MtgGetLastError(const MtgContext* context)
+{
+    return (context != nullptr) ? context->last_error.c_str() : thread_last_error.c_str();
+}
+
+MtgResult MtgBeginTrace()
+{
+    return Guard(thread_last_error, [] { Tracer::Start(); });
+}
+
+MtgResult MtgEndTrace(const char* output_path)
+{
+    return Guard(thread_last_error, [output_path] {
+        if (output_path == nullptr)
+        {
+            throw InvalidArgumentException("output_path is NULL");
+        }
+
+        Tracer::Stop(Utf8ToPath(output_path));
+    });
+}
+
+MtgResult MtgBeginStream(MtgContext* context, const MtgStreamDesc* desc)
+{
+    if (context == nullptr)
+    {
+        return MTG_RESULT_INVALID_ARGUMENT;
+    }
+
+    return Guard(context->last_error, [context, desc] {
+        if ((desc == nullptr) || (desc->struct_size < offsetof(MtgStreamDesc, blur)) || (desc->frame_callback == nullptr))
+        {
+            throw InvalidArgumentException("Invalid stream desc");
+        }
+        if (context->in_stream)
+        {
+            throw InvalidStateException("A stream is already in progress");
+        }
+
+        ApplyBlurParams(context->motion_blur_gen, *desc);
+
+        const MtgFrameCallback frame_callback = desc->frame_callback;
+        void* user_data = desc->user_data;
+        context->pipeline.Begin(desc->overlay_motion_vectors != 0,
+            [frame_callback, user_data](uint32_t frame_index, uint32_t width, uint32_t height, FrameBuffer&& data) {
+                const MtgFrame frame{MTG_PIXEL_FORMAT_RGBA8, width, height, {data.Data(), nullptr}, {width * 4, 0}};
+                frame_callback(user_data, frame_index, &frame);
+            });
+        context->in_stream = true;
+    });
+}
+
+MtgResult MtgPushFrame(MtgContext* context, const MtgFrame* frame, float time_span)
+{
+    if (context == nullptr)
+    {
+        return MTG_RESULT_INVALID_ARGUMENT;
+    }
+
+    return Guard(context->last_error, [context, frame, time_span] {
+        if ((frame == nullptr) || (frame->width == 0) || (frame->height == 0))
+        {
+            throw InvalidArgumentException("Invalid frame");
+        }
+        if (!context->in_stream)
+        {
+            throw InvalidStateException("MtgBeginStream MUST be called before pushing frames");
+        }
+
+        UploadFrame(context->gpu_system, *frame, context->pipeline.InputTexture());
+        context->pipeline.SubmitFrame(time_span);
+    });
+}
+
+MtgResult MtgEndStream(MtgContext* context)
+{
+    if (context == nullptr)
+    {
+        return MTG_RESULT_INVALID_ARGUMENT;
+    }
+
+    return Guard(context->last_error, [context] {
+        if (!context->in_stream)
+        {
+            throw InvalidStateException("No stream is in progress");
+        }
+
+        context->in_stream = false;
+        context->pipeline.End();
+    });
+}
+
+MtgResult MtgProcessJob(MtgContext* context, const MtgJobDesc* desc, MtgJobStats* stats)
+{
+    if (context == nullptr)
+    {
+        return MTG_RESULT_INVALID_ARGUMENT;
+    }
+
+    return Guard(context->last_error, [context, desc, stats] {
+        if ((desc == nullptr) || (desc->struct_size < offsetof(MtgJobDesc, blur)) || (desc->input_path == nullptr) ||
+            (desc->output_dir == nullptr))
+        {
+            throw InvalidArgumentException("Invalid job desc");
+        }
+        if ((stats != nullptr) && (stats->struct_size < offsetof(MtgJobStats, deduplicated_frames)))
+        {
+            throw InvalidArgumentException("Invalid job stats");
+        }
+        if (context->in_stream)
+        {
+            throw InvalidStateException("A stream is already in progress");
+        }
+
+        const std::filesystem::path input_path = Utf8ToPath(desc->input_path);
+        const std::filesystem::path output_dir = Utf8ToPath(desc->output_dir);
+        const float framerate = desc->framerate > 0 ? desc->framerate : 24;
+
+        MtgOutputFormat output_format = MTG_OUTPUT_FORMAT_PNG_SEQUENCE;
+        if (desc->struct_size >= offsetof(MtgJobDesc, output_format) + sizeof(desc->output_format))
+        {
+            output_format = desc->output_format;
+        }
+        if ((output_format != MTG_OUTPUT_FORMAT_PNG_SEQUENCE) && (output_format != MTG_OUTPUT_FORMAT_ARCHIVE) &&
+            (output_format != MTG_OUTPUT_FORMAT_DELTA_ARCHIVE))
+        {
+            throw InvalidArgumentException(std::format("Invalid output format {}", static_cast<uint32_t>(output_format)));
+        }
+
+        uint32_t raw_width = 0;
+        uint32_t raw_height = 0;
+        if (desc->struct_size >= offsetof(MtgJobDesc, raw_height) + sizeof(desc->raw_height))
+        {
+            raw_width = desc->raw_width;
+            raw_height = desc->raw_height;
+        }
+        if ((raw_width == 0) != (raw_height == 0))
+        {
+            throw InvalidArgumentException(std::format("Invalid raw frame size {}x{}", raw_width, raw_height));
+        }
+
+        if (!std::filesystem::exists(input_path))
+        {
+            throw InvalidArgumentException(std::format("COULDN'T find {}", input_path.string()));
+        }
+
+        const bool image_seq = std::filesystem::is_directory(input_path);
+        if (!image_seq && !std::filesystem::is_regular_file(input_path))
+        {
+            throw InvalidArgumentException(std::format("{} is not a file or a directory", input_path.string()));
+        }
+
+        ApplyBlurParams(context->motion_blur_gen, *desc);
+
+        auto& gpu_system = context->gpu_system;
+        auto& pipeline = context->pipeline;
+
+        std::unique_ptr<Reader> reader;
+        if (raw_width != 0)
+        {
+            reader = CreateRawSeqReader(gpu_system, input_path, raw_width, raw_height, framerate);
+        }
+        else if (image_seq)
+        {
+            reader = CreateImageSeqReader(gpu_system, input_path, framerate);
+        }
+        else
+        {
+            reader = CreateVideoReader(gpu_system, input_path);
+        }
+
+        std::unique_ptr<Writer> writer;
+        switch (output_format)
+        {
+        case MTG_OUTPUT_FORMAT_PNG_SEQUENCE:
+            writer = CreatePngSeqWriter(output_dir);
+            break;
+
+        case MTG_OUTPUT_FORMAT_ARCHIVE:
+            writer = CreateArchiveWriter(output_dir / "Frames.mtga", 0);
+            break;
+
+        case MTG_OUTPUT_FORMAT_DELTA_ARCHIVE:
+            writer = CreateArchiveWriter(output_dir / "Frames.mtga", DefaultFrameArchiveKeyFrameInterval);
+            break;
+        }
+
+        // The pools live as long as the context, the job takes its share. The texture pool's peak is the job's own.
+        const FrameBufferPoolStats pool_stats_before = pipeline.FrameBufferStats();
+        gpu_system.ResetTexturePoolPeak();
+        const GpuTexturePoolStats texture_stats_before = gpu_system.TexturePoolStats();
+
+        const auto start = std::chrono::high_resolution_clock::now();
+
+        pipeline.Begin(desc->overlay_motion_vectors != 0,
+            [&writer](uint32_t frame_index, uint32_t width, uint32_t height, FrameBuffer&& data) {
+                writer->WriteFrame(frame_index, width, height, std::move(data));
+            });
+        context->in_stream = true;
+
+        try
+        {
+            float time_span;
+            while (reader->ReadFrame(pipeline.InputTexture(), time_span))
+            {
+                if (desc->progress_callback != nullptr)
+                {
+                    desc->progress_callback(desc->user_data, pipeline.SubmittedFrames());
+                }
+
+                pipeline.SubmitFrame(time_span);
+            }
+        }
+        catch (...)
+        {
+            context->in_stream = false;
+            pipeline.End();
+            gpu_system.TrimTexturePool();
+            throw;
+        }
+
+        context->in_stream = false;
+        pipeline.End();
+        // The next job may be of another size, the pooled textures of this one would only sit there
+        gpu_system.TrimTexturePool();
+        writer->Flush();
+
+        const auto duration = std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(
+            std::chrono::high_resolution_clock::now() - start);
+        const uint32_t total_frames = pipeline.SubmittedFrames();
+
+        reader.reset();
+
+        if (stats != nullptr)
+        {
+            stats->frames = total_frames;
+            stats->total_ms = duration.count();
+            stats->ms_per_frame = total_frames > 0 ? duration.count() / total_frames : 0;
+            if (stats->struct_size >= offsetof(MtgJobStats, encode_ms) + sizeof(stats->encode_ms))
+            {
+                const WriterStats writer_stats = writer->Stats();
+                stats->deduplicated_frames = writer_stats.deduplicated_frames;
+                stats->deduplicated_bytes = writer_stats.deduplicated_bytes;
+                stats->encode_ms = writer_stats.encode_ms;
+            }
+            if (stats->struct_size >= offsetof(MtgJobStats, frame_buffer_peak_bytes) + sizeof(stats->frame_buffer_peak_bytes))
+            {
+                const FrameBufferPoolStats pool_stats = pipeline.FrameBufferStats();
+                stats->frame_buffer_acquires = static_cast<uint32_t>(pool_stats.acquires - pool_stats_before.acquires);
+                stats->frame_buffer_hits = static_cast<uint32_t>(pool_stats.hits - pool_stats_before.hits);
+                stats->frame_buffer_peak_bytes = pool_stats.peak_bytes;
+            }
+            if (stats->struct_size >= offsetof(MtgJobStats, texture_pool_peak_bytes) + sizeof(stats->texture_pool_peak_bytes))
+            {
+                const GpuTexturePoolStats& texture_stats = gpu_system.TexturePoolStats();
+                stats->texture_hits = static_cast<uint32_t>(texture_stats.hits - texture_stats_before.hits);
+                stats->texture_misses = static_cast<uint32_t>(texture_stats.misses - texture_stats_before.misses);
+                stats->texture_pool_peak_bytes = texture_stats.peak_resident_bytes;
+            }
+            if (stats->struct_size >= offsetof(MtgJobStats, process_memory_bytes) + sizeof(stats->process_memory_bytes))
+            {
+                stats->process_upload_staging_peak_bytes = MemoryTracker::Usage(MemoryCategory::UploadStaging).peak_bytes;
+                stats->process_readback_staging_peak_bytes = MemoryTracker::Usage(MemoryCategory::ReadbackStaging).peak_bytes;
+                stats->process_descriptor_peak_bytes = MemoryTracker::Usage(MemoryCategory::Descriptors).peak_bytes;
+                stats->process_frame_texture_peak_bytes = MemoryTracker::Usage(MemoryCategory::FrameTextures).peak_bytes;
+                stats->process_intermediate_texture_peak_bytes = MemoryTracker::Usage(MemoryCategory::IntermediateTextures).peak_bytes;
+                stats->process_cpu_frame_buffer_peak_bytes = MemoryTracker::Usage(MemoryCategory::CpuFrameBuffers).peak_bytes;
+                const MemoryUsage total = MemoryTracker::TotalUsage();
+                stats->process_memory_peak_bytes = total.peak_bytes;
+                stats->process_memory_bytes = total.bytes;
+            }
+            if (stats->struct_size >= offsetof(MtgJobStats, motion_blur_peak_bytes) + sizeof(stats->motion_blur_peak_bytes))
+            {
+                const MotionBlurTextureMemory motion_blur_memory = pipeline.MotionBlurMemory();
+                stats->frame_bytes = motion_blur_memory.frame_bytes;
+                stats->motion_blur_peak_bytes = motion_blur_memory.resident_bytes;
+            }
+        }
+    });
+}
@@ -0,0 +1,296 @@
+#include "FrameArchive.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <format>
+#include <stdexcept>
+
+#include "Codec/Lz4.hpp"
+#include "Trace/Trace.hpp"
+
+using namespace MotionToGo;
+
+namespace
+{
+    // The header, the compressed frames, the index entries, then the footer. Little endian.
+    constexpr uint32_t FileMagic = 0x4147544D; // "MTGA"
+    constexpr uint32_t IndexMagic = 0x4947544D; // "MTGI"
+    // 2 added the repeats, 1 is still read
+    constexpr uint32_t Version = 2;
+
+    constexpr uint32_t DeltaFlag = 1U << 0;
+    constexpr uint32_t RepeatFlag = 1U << 1;
+
+    struct FileHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+    };
+
+    struct IndexEntry
+    {
+        uint32_t frame_index;
+        uint32_t width;
+        uint32_t height;
+        uint32_t flags;
+        uint64_t offset;
+        uint64_t size;
+    };
+    static_assert(sizeof(IndexEntry) == 32);
+
+    struct Footer
+    {
+        uint64_t index_offset;
+        uint32_t num_entries;
+        uint32_t magic;
+    };
+    static_assert(sizeof(Footer) == 16);
+
+    template <typename T>
+    void Write(std::ofstream& ofs, const T& value)
+    {
+        ofs.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    template <typename T>
+    void Read(std::ifstream& ifs, T& value)
+    {
+        ifs.read(reinterpret_cast<char*>(&value), sizeof(value));
+    }
+} // namespace
+
+namespace MotionToGo
+{
+    FrameArchiveWriter::FrameArchiveWriter(const std::filesystem::path& path, uint32_t key_frame_interval)
+        : path_(path), ofs_(path, std::ios_base::binary), key_frame_interval_(key_frame_interval)
+    {
+        if (!ofs_)
+        {
+            throw std::runtime_error(std::format("COULDN'T open {}", path_.string()));
+        }
+
+        Write(ofs_, FileHeader{FileMagic, Version});
+        size_ = sizeof(FileHeader);
+    }
+
+    FrameArchiveWriter::~FrameArchiveWriter() noexcept
+    {
+        if (ofs_.is_open())
+        {
+            try
+            {
+                this->Close();
+            }
+            catch (...)
+            {
+            }
+        }
+    }
+
+    void FrameArchiveWriter::AddFrame(uint32_t frame_index, uint32_t width, uint32_t height, std::span<const uint8_t> rgba)
+    {
+        GO_MOTION_TRACE_SCOPE("AddArchiveFrame");
+
+        assert(ofs_.is_open() && (rgba.size() == static_cast<size_t>(width) * height * 4));
+
+        // Holds and static shots give the same frame again. A compare stops at the first difference, far cheaper than compressing.
+        const bool same_size = !entries_.empty() && (entries_.back().width == width) && (entries_.back().height == height);
+        if (same_size && std::equal(rgba.begin(), rgba.end(), prev_frame_.begin()))
+        {
+            auto stored = entries_.rbegin();
+            while (stored->repeat)
+            {
+                ++stored;
+            }
+            repeated_bytes_ += stored->size;
+            ++num_repeats_;
+
+            entries_.push_back({frame_index, width, height, false, true, size_, 0});
+            return;
+        }
+
+        const bool delta = (key_frame_interval_ > 0) && (frames_since_key_frame_ + 1 < key_frame_interval_) && same_size;
+
+        std::vector<uint8_t> compressed;
+        if (delta)
+        {
+            delta_.resize(rgba.size());
+            for (size_t i = 0; i < rgba.size(); ++i)
+            {
+                delta_[i] = static_cast<uint8_t>(rgba[i] - prev_frame_[i]);
+            }
+            compressed = CompressLz4Block(delta_);
+            ++frames_since_key_frame_;
+        }
+        else
+        {
+            compressed = CompressLz4Block(rgba);
+            frames_since_key_frame_ = 0;
+        }
+        prev_frame_.assign(rgba.begin(), rgba.end());
+
+        ofs_.write(reinterpret_cast<const char*>(compressed.data()), compressed.size());
+        if (!ofs_)
+        {
+            throw std::runtime_error(std::format("COULDN'T write to {}", path_.string()));
+        }
+
+        entries_.push_back({frame_index, width, height, delta, false, size_, compressed.size()});
+        size_ += compressed.size();
+    }
+
+    void FrameArchiveWriter::Close()
+    {
+        const uint64_t index_offset = size_;
+        for (const auto& entry : entries_)
+        {
+            const uint32_t flags = (entry.delta ? DeltaFlag : 0) | (entry.repeat ? RepeatFlag : 0);
+            Write(ofs_, IndexEntry{entry.frame_index, entry.width, entry.height, flags, entry.offset, entry.size});
+        }
+        Write(ofs_, Footer{index_offset, static_cast<uint32_t>(entries_.size()), IndexMagic});
+        size_ += entries_.size() * sizeof(IndexEntry) + sizeof(Footer);
+
+        ofs_.close();
+        if (!ofs_)
+        {
+            throw std::runtime_error(std::format("COULDN'T write to {}", path_.string()));
+        }
+    }
+
+    uint32_t FrameArchiveWriter::NumFrames() const noexcept
+    {
+        return static_cast<uint32_t>(entries_.size());
+    }
+
+    uint32_t FrameArchiveWriter::NumRepeats() const noexcept
+    {
+        return num_repeats_;
+    }
+
+    uint64_t FrameArchiveWriter::Size() const noexcept
+    {
+        return size_;
+    }
+
+    uint64_t FrameArchiveWriter::RepeatedBytes() const noexcept
+    {
+        return repeated_bytes_;
+    }
+
+    FrameArchiveReader::FrameArchiveReader(const std::filesystem::path& path) : path_(path), ifs_(path, std::ios_base::binary)
+    {
+        if (!ifs_)
+        {
+            throw std::runtime_error(std::format("COULDN'T open {}", path_.string()));
+        }
+
+        FileHeader header{};
+        Read(ifs_, header);
+        if (!ifs_ || (header.magic != FileMagic) || (header.version == 0) || (header.version > Version))
+        {
+            throw std::runtime_error(std::format("{} is not a frame archive", path_.string()));
+        }
+
+        Footer footer{};
+        ifs_.seekg(-static_cast<std::streamoff>(sizeof(Footer)), std::ios_base::end);
+        const uint64_t footer_offset = ifs_.tellg();
+        Read(ifs_, footer);
+        if (!ifs_ || (footer.magic != IndexMagic) ||
+            (footer.index_offset + static_cast<uint64_t>(footer.num_entries) * sizeof(IndexEntry) != footer_offset))
+        {
+            throw std::runtime_error(std::format("{} has no index, it wasn't closed", path_.string()));
+        }
+
+        ifs_.seekg(footer.index_offset);
+        entries_.resize(footer.num_entries);
+        for (uint32_t i = 0; i < footer.num_entries; ++i)
+        {
+            IndexEntry entry;
+            Read(ifs_, entry);
+            const bool delta = (entry.flags & DeltaFlag) != 0;
+            const bool repeat = (entry.flags & RepeatFlag) != 0;
+            if (!ifs_ || (entry.offset + entry.size > footer.index_offset) || (delta && repeat) || (repeat && (entry.size != 0)) ||
+                ((delta || repeat) &&
+                    ((i == 0) || (entry.width != entries_[i - 1].width) || (entry.height != entries_[i - 1].height))))
+            {
+                throw std::runtime_error(std::format("{} has a broken index", path_.string()));
+            }
+            entries_[i] = {entry.frame_index, entry.width, entry.height, delta, repeat, entry.offset, entry.size};
+        }
+    }
+
+    FrameArchiveReader::~FrameArchiveReader() noexcept = default;
+
+    std::span<const FrameArchiveEntry> FrameArchiveReader::Entries() const noexcept
+    {
+        return entries_;
+    }
+
+    std::vector<uint8_t> FrameArchiveReader::ReadFrame(uint32_t entry)
+    {
+        GO_MOTION_TRACE_SCOPE("ReadArchiveFrame");
+
+        assert(entry < entries_.size());
+
+        if (entry == frame_entry_)
+        {
+            return frame_;
+        }
+
+        // Continue from the decoded frame if it's on the way, otherwise from the key frame
+        uint32_t first = entry;
+        while ((entries_[first].delta || entries_[first].repeat) && (first != frame_entry_ + 1))
+        {
+            --first;
+        }
+        for (uint32_t i = first; i <= entry; ++i)
+        {
+            this->DecodeEntry(i);
+        }
+
+        return frame_;
+    }
+
+    void FrameArchiveReader::DecodeEntry(uint32_t entry)
+    {
+        const FrameArchiveEntry& info = entries_[entry];
+        if (info.repeat)
+        {
+            assert(frame_entry_ + 1 == entry);
+
+            frame_entry_ = entry;
+            return;
+        }
+
+        compressed_.resize(info.size);
+        ifs_.seekg(info.offset);
+        ifs_.read(reinterpret_cast<char*>(compressed_.data()), compressed_.size());
+
+        const size_t frame_size = static_cast<size_t>(info.width) * info.height * 4;
+        bool succeeded = static_cast<bool>(ifs_);
+        if (info.delta)
+        {
+            assert(frame_entry_ + 1 == entry);
+
+            delta_.resize(frame_size);
+            succeeded = succeeded && DecompressLz4Block(compressed_, delta_);
+            for (size_t i = 0; succeeded && (i < frame_size); ++i)
+            {
+                frame_[i] = static_cast<uint8_t>(frame_[i] + delta_[i]);
+            }
+        }
+        else
+        {
+            frame_.resize(frame_size);
+            succeeded = succeeded && DecompressLz4Block(compressed_, frame_);
+        }
+
+        if (!succeeded)
+        {
+            ifs_.clear();
+            frame_entry_ = ~0U;
+            throw std::runtime_error(std::format("Frame {} of {} is corrupted", info.frame_index, path_.string()));
+        }
+        frame_entry_ = entry;
+    }
+} // namespace MotionToGo
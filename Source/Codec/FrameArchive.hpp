@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <vector>
+
+#include "Noncopyable.hpp"
+
+namespace MotionToGo
+{
+    // Of the delta archives. A read decodes at most this many frames.
+    constexpr uint32_t DefaultFrameArchiveKeyFrameInterval = 30;
+
+    struct FrameArchiveEntry
+    {
+        uint32_t frame_index;
+        uint32_t width;
+        uint32_t height;
+        // The bytes are the difference from the previous entry, not the frame
+        bool delta;
+        // The same frame as the previous entry, without bytes of its own
+        bool repeat;
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    // Appends RGBA8 frames to one file, each compressed with CompressLz4Block, and an index of them at the end.
+    class FrameArchiveWriter final
+    {
+        DISALLOW_COPY_AND_ASSIGN(FrameArchiveWriter)
+
+    public:
+        // A key frame interval of 0 stores every frame whole. Otherwise, the frames between the key frames are stored as their byte
+        // difference from the previous one, which is mostly 0 on static shots.
+        FrameArchiveWriter(const std::filesystem::path& path, uint32_t key_frame_interval);
+        ~FrameArchiveWriter() noexcept;
+
+        // A frame identical to the previous one is only an index entry, a repeat. Repeats don't count toward the key frame interval.
+        void AddFrame(uint32_t frame_index, uint32_t width, uint32_t height, std::span<const uint8_t> rgba);
+        // Writes the index. The archive can't be read without it.
+        void Close();
+
+        uint32_t NumFrames() const noexcept;
+        uint32_t NumRepeats() const noexcept;
+        uint64_t Size() const noexcept;
+        // What the entries the repeats refer to take
+        uint64_t RepeatedBytes() const noexcept;
+
+    private:
+        std::filesystem::path path_;
+        std::ofstream ofs_;
+        uint32_t key_frame_interval_;
+
+        std::vector<FrameArchiveEntry> entries_;
+        uint64_t size_ = 0;
+        uint32_t frames_since_key_frame_ = 0;
+        uint32_t num_repeats_ = 0;
+        uint64_t repeated_bytes_ = 0;
+        std::vector<uint8_t> prev_frame_;
+        std::vector<uint8_t> delta_;
+    };
+
+    class FrameArchiveReader final
+    {
+        DISALLOW_COPY_AND_ASSIGN(FrameArchiveReader)
+
+    public:
+        explicit FrameArchiveReader(const std::filesystem::path& path);
+        ~FrameArchiveReader() noexcept;
+
+        std::span<const FrameArchiveEntry> Entries() const noexcept;
+
+        // Tightly packed RGBA8. Reading the entries in order decodes each once, a seek decodes from the key frame before it.
+        std::vector<uint8_t> ReadFrame(uint32_t entry);
+
+    private:
+        void DecodeEntry(uint32_t entry);
+
+    private:
+        std::filesystem::path path_;
+        std::ifstream ifs_;
+        std::vector<FrameArchiveEntry> entries_;
+
+        std::vector<uint8_t> compressed_;
+        std::vector<uint8_t> delta_;
+        std::vector<uint8_t> frame_;
+        uint32_t frame_entry_ = ~0U;
+    };
+} // namespace MotionToGo
@@ -0,0 +1,333 @@
+#include "ImageCodec.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <span>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include <zlib.h>
+
+#include "Codec/Inflate.hpp"
+#include "Trace/Trace.hpp"
+
+using namespace MotionToGo;
+
+namespace
+{
+    constexpr int PngCompressionLevel = 5;
+    // Rows are filtered and deflated this many at a time, so the filtered image is never whole in memory
+    constexpr uint32_t PngStripRows = 16;
+    constexpr uint32_t IdatChunkBytes = 64 * 1024;
+    constexpr uint8_t PngSignature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    // Same as stb_image
+    constexpr uint32_t MaxImageDimension = 1U << 24;
+    constexpr uint64_t MaxImageBytes = 1ULL << 31;
+
+    void AppendBigEndian(std::vector<uint8_t>& png, uint32_t value)
+    {
+        const uint8_t bytes[] = {static_cast<uint8_t>(value >> 24), static_cast<uint8_t>(value >> 16), static_cast<uint8_t>(value >> 8),
+            static_cast<uint8_t>(value)};
+        png.insert(png.end(), std::begin(bytes), std::end(bytes));
+    }
+
+    uint32_t ReadBigEndian(const uint8_t* bytes) noexcept
+    {
+        return (static_cast<uint32_t>(bytes[0]) << 24) | (static_cast<uint32_t>(bytes[1]) << 16) | (static_cast<uint32_t>(bytes[2]) << 8) |
+               bytes[3];
+    }
+
+    void AppendChunk(std::vector<uint8_t>& png, const char* type, std::span<const uint8_t> data)
+    {
+        AppendBigEndian(png, static_cast<uint32_t>(data.size()));
+        const size_t type_offset = png.size();
+        png.insert(png.end(), type, type + 4);
+        png.insert(png.end(), data.begin(), data.end());
+        AppendBigEndian(png, crc32(0, &png[type_offset], static_cast<uInt>(4 + data.size())));
+    }
+
+    struct PngInfo
+    {
+        uint32_t width;
+        uint32_t height;
+        PngRowFormat format;
+        // False for what stb_image decodes instead: palettes, gray, below 8 bits, and interlacing
+        bool supported;
+    };
+
+    bool ReadPngInfo(std::span<const uint8_t> encoded, PngInfo& info) noexcept
+    {
+        // The signature, then IHDR's length, type, and 13 bytes
+        constexpr size_t IhdrEnd = sizeof(PngSignature) + 8 + 13;
+        if ((encoded.size() < IhdrEnd) || (std::memcmp(encoded.data(), PngSignature, sizeof(PngSignature)) != 0))
+        {
+            return false;
+        }
+
+        const uint8_t* ihdr = &encoded[sizeof(PngSignature)];
+        if ((ReadBigEndian(ihdr) != 13) || (std::memcmp(&ihdr[4], "IHDR", 4) != 0))
+        {
+            return false;
+        }
+
+        info.width = ReadBigEndian(&ihdr[8]);
+        info.height = ReadBigEndian(&ihdr[12]);
+        const uint8_t bit_depth = ihdr[16];
+        const uint8_t color_type = ihdr[17];
+        const uint8_t interlace = ihdr[20];
+        info.supported = ((bit_depth == 8) || (bit_depth == 16)) && ((color_type == 2) || (color_type == 6)) && (interlace == 0) &&
+                         (info.width > 0) && (info.width <= MaxImageDimension) && (info.height > 0) &&
+                         (info.height <= MaxImageDimension) && (static_cast<uint64_t>(info.width) * info.height * 4 < MaxImageBytes);
+        if (bit_depth == 8)
+        {
+            info.format = color_type == 6 ? PngRowFormat::Rgba8 : PngRowFormat::Rgb8;
+        }
+        else
+        {
+            info.format = color_type == 6 ? PngRowFormat::Rgba16 : PngRowFormat::Rgb16;
+        }
+        return true;
+    }
+
+    // Inflates the filtered rows with our own inflate, then unfilters them in place. Returns false for what's left to stb_image,
+    // including the broken files. Neither the CRCs nor the Adler-32 are checked, like stb_image.
+    bool DecodePng(std::span<const uint8_t> encoded, const PngInfo& info, uint8_t* rgba, uint32_t row_pitch)
+    {
+        std::vector<std::span<const uint8_t>> idats;
+        for (size_t offset = sizeof(PngSignature); offset + 12 <= encoded.size();)
+        {
+            const uint32_t length = ReadBigEndian(&encoded[offset]);
+            const uint8_t* type = &encoded[offset + 4];
+            if (length > encoded.size() - offset - 12)
+            {
+                return false;
+            }
+
+            if (std::memcmp(type, "IDAT", 4) == 0)
+            {
+                idats.emplace_back(&encoded[offset + 8], length);
+            }
+            else if (std::memcmp(type, "tRNS", 4) == 0)
+            {
+                // stb_image turns the color key into alpha
+                return false;
+            }
+            else if (std::memcmp(type, "IEND", 4) == 0)
+            {
+                break;
+            }
+            offset += 12 + length;
+        }
+        if (idats.empty())
+        {
+            return false;
+        }
+
+        // Most PNGs have a stream split over many IDATs
+        std::span<const uint8_t> stream = idats[0];
+        std::vector<uint8_t> joined;
+        if (idats.size() > 1)
+        {
+            for (const auto& idat : idats)
+            {
+                joined.insert(joined.end(), idat.begin(), idat.end());
+            }
+            stream = joined;
+        }
+
+        // Each row starts with its filter type
+        const uint32_t row_bytes = info.width * PngRowFormatBytesPerPixel(info.format);
+        std::vector<uint8_t> filtered(static_cast<size_t>(info.height) * (row_bytes + 1));
+        {
+            GO_MOTION_TRACE_SCOPE("Inflate");
+
+            if (!InflateZlib(stream, filtered))
+            {
+                return false;
+            }
+        }
+
+        // The rows are unfiltered in place, the first one against a row of 0
+        const std::vector<uint8_t> zero_row(row_bytes, 0);
+        for (uint32_t y = 0; y < info.height; ++y)
+        {
+            uint8_t* row = &filtered[static_cast<size_t>(y) * (row_bytes + 1)];
+            if (row[0] > static_cast<uint8_t>(PngFilter::Paeth))
+            {
+                return false;
+            }
+
+            const uint8_t* prev_row = y > 0 ? row - row_bytes : zero_row.data();
+            UnfilterPngRow(static_cast<PngFilter>(row[0]), info.format, prev_row, row_bytes, row + 1);
+            PngRowToRgba8(info.format, row + 1, info.width, &rgba[static_cast<size_t>(y) * row_pitch]);
+        }
+        return true;
+    }
+} // namespace
+
+namespace MotionToGo
+{
+    std::vector<uint8_t> EncodePng(const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t row_pitch)
+    {
+        return EncodePng(rgba, width, height, row_pitch, PngEncodeOptions{});
+    }
+
+    std::vector<uint8_t> EncodePng(
+        const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t row_pitch, const PngEncodeOptions& options)
+    {
+        // Row filtering, plus the nested Deflate
+        GO_MOTION_TRACE_SCOPE("EncodePng");
+
+        if ((width == 0) || (height == 0))
+        {
+            return {};
+        }
+
+        const uint32_t row_bytes = width * 4;
+        if (row_pitch == 0)
+        {
+            row_pitch = row_bytes;
+        }
+
+        z_stream stream{};
+        if (deflateInit(&stream, PngCompressionLevel) != Z_OK)
+        {
+            return {};
+        }
+
+        std::vector<uint8_t> png(std::begin(PngSignature), std::end(PngSignature));
+
+        std::vector<uint8_t> header;
+        AppendBigEndian(header, width);
+        AppendBigEndian(header, height);
+        // 8-bit, RGBA, deflate, adaptive filtering, not interlaced
+        header.insert(header.end(), {8, 6, 0, 0, 0});
+        AppendChunk(png, "IHDR", header);
+
+        // The first row is filtered against a row of 0
+        const std::vector<uint8_t> zero_row(row_bytes, 0);
+        std::vector<uint8_t> strip((row_bytes + 1) * PngStripRows);
+        std::vector<uint8_t> idat(IdatChunkBytes);
+        stream.next_out = idat.data();
+        stream.avail_out = IdatChunkBytes;
+
+        bool succeeded = true;
+        for (uint32_t y = 0; (y < height) && succeeded; y += PngStripRows)
+        {
+            const uint32_t strip_rows = std::min(PngStripRows, height - y);
+            {
+                GO_MOTION_TRACE_SCOPE("FilterPng");
+
+                for (uint32_t i = 0; i < strip_rows; ++i)
+                {
+                    const uint8_t* row = &rgba[static_cast<size_t>(y + i) * row_pitch];
+                    const uint8_t* prev_row = y + i > 0 ? row - row_pitch : zero_row.data();
+                    uint8_t* filtered = &strip[i * (row_bytes + 1)];
+                    filtered[0] = static_cast<uint8_t>(
+                        FilterPngRow(options.filter_strategy, options.fixed_filter, row, prev_row, row_bytes, filtered + 1));
+                }
+            }
+
+            {
+                GO_MOTION_TRACE_SCOPE("Deflate");
+
+                stream.next_in = strip.data();
+                stream.avail_in = strip_rows * (row_bytes + 1);
+                const int flush = y + strip_rows == height ? Z_FINISH : Z_NO_FLUSH;
+                bool idat_full;
+                do
+                {
+                    if (deflate(&stream, flush) == Z_STREAM_ERROR)
+                    {
+                        succeeded = false;
+                        break;
+                    }
+
+                    // Out as soon as a chunk is full
+                    idat_full = stream.avail_out == 0;
+                    if (idat_full)
+                    {
+                        AppendChunk(png, "IDAT", idat);
+                        stream.next_out = idat.data();
+                        stream.avail_out = IdatChunkBytes;
+                    }
+                } while (idat_full);
+            }
+        }
+
+        deflateEnd(&stream);
+        if (!succeeded)
+        {
+            return {};
+        }
+
+        if (stream.avail_out < IdatChunkBytes)
+        {
+            AppendChunk(png, "IDAT", std::span(idat.data(), IdatChunkBytes - stream.avail_out));
+        }
+        AppendChunk(png, "IEND", {});
+        return png;
+    }
+
+    bool ImageSize(std::span<const uint8_t> encoded, uint32_t& width, uint32_t& height)
+    {
+        PngInfo info;
+        if (ReadPngInfo(encoded, info))
+        {
+            width = info.width;
+            height = info.height;
+            return true;
+        }
+
+        int w, h, channels;
+        if (!stbi_info_from_memory(encoded.data(), static_cast<int>(encoded.size()), &w, &h, &channels))
+        {
+            return false;
+        }
+
+        width = static_cast<uint32_t>(w);
+        height = static_cast<uint32_t>(h);
+        return true;
+    }
+
+    bool DecodeImage(std::span<const uint8_t> encoded, uint8_t* rgba, uint32_t row_pitch)
+    {
+        GO_MOTION_TRACE_SCOPE("DecodeImage");
+
+        PngInfo info;
+        if (ReadPngInfo(encoded, info) && info.supported && DecodePng(encoded, info, rgba, row_pitch))
+        {
+            return true;
+        }
+
+        int w, h;
+        uint8_t* data = stbi_load_from_memory(encoded.data(), static_cast<int>(encoded.size()), &w, &h, nullptr, 4);
+        if (data == nullptr)
+        {
+            return false;
+        }
+
+        for (int y = 0; y < h; ++y)
+        {
+            std::memcpy(&rgba[static_cast<size_t>(y) * row_pitch], &data[static_cast<size_t>(y) * w * 4], w * 4);
+        }
+        stbi_image_free(data);
+        return true;
+    }
+
+    std::vector<uint8_t> DecodeImage(std::span<const uint8_t> encoded, uint32_t& width, uint32_t& height)
+    {
+        if (!ImageSize(encoded, width, height))
+        {
+            return {};
+        }
+
+        std::vector<uint8_t> ret(static_cast<size_t>(width) * height * 4);
+        if (!DecodeImage(encoded, ret.data(), width * 4))
+        {
+            return {};
+        }
+        return ret;
+    }
+} // namespace MotionToGo
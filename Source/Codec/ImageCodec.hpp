@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "Codec/PngFilter.hpp"
+
+namespace MotionToGo
+{
+    struct PngEncodeOptions
+    {
+        PngFilterStrategy filter_strategy = PngFilterStrategy::Heuristic;
+        // Only for PngFilterStrategy::Fixed
+        PngFilter fixed_filter = PngFilter::Paeth;
+    };
+
+    // Encodes RGBA8 pixels into the content of a PNG file. A row pitch of 0 means tightly packed rows. Returns an empty vector on
+    // failure.
+    std::vector<uint8_t> EncodePng(const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t row_pitch = 0);
+    std::vector<uint8_t> EncodePng(
+        const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t row_pitch, const PngEncodeOptions& options);
+
+    // The size of any image DecodeImage reads. Returns false if it can't be read.
+    bool ImageSize(std::span<const uint8_t> encoded, uint32_t& width, uint32_t& height);
+
+    // Decodes any format stb_image supports into RGBA8 rows of row_pitch bytes, for the size from ImageSize. 8- and 16-bit RGB and
+    // RGBA PNGs go through our own inflate and SIMD unfiltering, the rest through stb_image. Returns false on failure.
+    bool DecodeImage(std::span<const uint8_t> encoded, uint8_t* rgba, uint32_t row_pitch);
+    // Same, into tightly packed rows. Returns an empty vector on failure.
+    std::vector<uint8_t> DecodeImage(std::span<const uint8_t> encoded, uint32_t& width, uint32_t& height);
+} // namespace MotionToGo
@@ -0,0 +1,627 @@
+#include "Inflate.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace MotionToGo;
+
+namespace
+{
+    constexpr uint32_t MaxCodeLength = 15;
+    constexpr uint32_t NumLitLenSymbols = 288;
+    constexpr uint32_t NumDistanceSymbols = 32;
+    constexpr uint32_t NumCodeLengthSymbols = 19;
+    // The most a dynamic block may use
+    constexpr uint32_t MaxLitLenCodes = 286;
+    constexpr uint32_t MaxDistanceCodes = 30;
+    constexpr uint32_t EndOfBlockSymbol = 256;
+
+    // Most codes are found in the first level. The sizes have room for the subtables of any code.
+    constexpr uint32_t LitLenTableBits = 10;
+    constexpr uint32_t LitLenTableSize = 2048;
+    constexpr uint32_t DistanceTableBits = 8;
+    constexpr uint32_t DistanceTableSize = 1024;
+    constexpr uint32_t CodeLengthTableBits = 7;
+    constexpr uint32_t CodeLengthTableSize = 1U << CodeLengthTableBits;
+
+    // Matches are copied 8 bytes at a time when there's room for this much past them
+    constexpr uint32_t CopyOvershoot = 8;
+
+    constexpr uint16_t LengthBases[] = {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    constexpr uint8_t LengthExtraBits[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    constexpr uint16_t DistanceBases[] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049,
+        3073, 4097, 6145, 8193, 12289, 16385, 24577};
+    constexpr uint8_t DistanceExtraBits[] = {
+        0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+    constexpr uint8_t CodeLengthOrder[] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+    enum class EntryKind : uint32_t
+    {
+        Literal,
+        // A length or a distance, the base plus the extra bits
+        Base,
+        EndOfBlock,
+        SubTable,
+        Invalid,
+    };
+
+    // A table entry is the bits of the code in [0, 5), the kind in [5, 8), the extra bits in [8, 13), and a literal, a base, or
+    // where the subtable starts in [16, 32). A subtable entry's extra bits are the bits of the subtable index.
+    constexpr uint32_t MakeEntry(EntryKind kind, uint32_t extra_bits, uint32_t value) noexcept
+    {
+        return (static_cast<uint32_t>(kind) << 5) | (extra_bits << 8) | (value << 16);
+    }
+
+    uint32_t EntryCodeBits(uint32_t entry) noexcept
+    {
+        return entry & 0x1F;
+    }
+
+    EntryKind EntryKindOf(uint32_t entry) noexcept
+    {
+        return static_cast<EntryKind>((entry >> 5) & 0x7);
+    }
+
+    uint32_t EntryExtraBits(uint32_t entry) noexcept
+    {
+        return (entry >> 8) & 0x1F;
+    }
+
+    uint32_t EntryValue(uint32_t entry) noexcept
+    {
+        return entry >> 16;
+    }
+
+    // The entries of the symbols, without the bits of their codes
+    struct SymbolEntries
+    {
+        uint32_t lit_len[NumLitLenSymbols];
+        uint32_t distance[NumDistanceSymbols];
+        uint32_t code_length[NumCodeLengthSymbols];
+    };
+
+    constexpr SymbolEntries MakeSymbolEntries() noexcept
+    {
+        SymbolEntries ret{};
+        for (uint32_t symbol = 0; symbol < NumLitLenSymbols; ++symbol)
+        {
+            if (symbol < EndOfBlockSymbol)
+            {
+                ret.lit_len[symbol] = MakeEntry(EntryKind::Literal, 0, symbol);
+            }
+            else if (symbol == EndOfBlockSymbol)
+            {
+                ret.lit_len[symbol] = MakeEntry(EntryKind::EndOfBlock, 0, 0);
+            }
+            else if (symbol < EndOfBlockSymbol + 1 + std::size(LengthBases))
+            {
+                const uint32_t index = symbol - EndOfBlockSymbol - 1;
+                ret.lit_len[symbol] = MakeEntry(EntryKind::Base, LengthExtraBits[index], LengthBases[index]);
+            }
+            else
+            {
+                ret.lit_len[symbol] = MakeEntry(EntryKind::Invalid, 0, 0);
+            }
+        }
+        for (uint32_t symbol = 0; symbol < NumDistanceSymbols; ++symbol)
+        {
+            ret.distance[symbol] = symbol < std::size(DistanceBases)
+                                       ? MakeEntry(EntryKind::Base, DistanceExtraBits[symbol], DistanceBases[symbol])
+                                       : MakeEntry(EntryKind::Invalid, 0, 0);
+        }
+        for (uint32_t symbol = 0; symbol < NumCodeLengthSymbols; ++symbol)
+        {
+            ret.code_length[symbol] = MakeEntry(EntryKind::Literal, 0, symbol);
+        }
+        return ret;
+    }
+
+    constexpr SymbolEntries Entries = MakeSymbolEntries();
+
+    uint32_t ReverseBits(uint32_t code, uint32_t num_bits) noexcept
+    {
+        uint32_t reversed = 0;
+        for (uint32_t i = 0; i < num_bits; ++i)
+        {
+            reversed = (reversed << 1) | ((code >> i) & 1);
+        }
+        return reversed;
+    }
+
+    // Fills the table of a canonical Huffman code. Codes longer than table_bits go to subtables after the first 2^table_bits
+    // entries, sized like zlib's inflate_table does. The entries no code reaches are invalid, so an incomplete code fails when
+    // it's used. Returns false for over-subscribed lengths.
+    bool BuildTable(const uint8_t* lengths, uint32_t num_symbols, const uint32_t* symbol_entries, uint32_t table_bits, uint32_t* table,
+        uint32_t table_size)
+    {
+        uint32_t counts[MaxCodeLength + 1]{};
+        for (uint32_t symbol = 0; symbol < num_symbols; ++symbol)
+        {
+            ++counts[lengths[symbol]];
+        }
+        counts[0] = 0;
+
+        int32_t left = 1;
+        for (uint32_t length = 1; length <= MaxCodeLength; ++length)
+        {
+            left = left * 2 - static_cast<int32_t>(counts[length]);
+            if (left < 0)
+            {
+                return false;
+            }
+        }
+
+        // By length, then by symbol, the order the canonical codes are assigned in
+        uint32_t offsets[MaxCodeLength + 2]{};
+        for (uint32_t length = 1; length <= MaxCodeLength; ++length)
+        {
+            offsets[length + 1] = offsets[length] + counts[length];
+        }
+        uint16_t sorted_symbols[NumLitLenSymbols];
+        for (uint32_t symbol = 0; symbol < num_symbols; ++symbol)
+        {
+            if (lengths[symbol] != 0)
+            {
+                sorted_symbols[offsets[lengths[symbol]]++] = static_cast<uint16_t>(symbol);
+            }
+        }
+
+        const uint32_t invalid = MakeEntry(EntryKind::Invalid, 0, 0);
+        const uint32_t root_size = 1U << table_bits;
+        std::fill(table, table + root_size, invalid);
+
+        uint32_t remaining[MaxCodeLength + 1];
+        std::copy(std::begin(counts), std::end(counts), remaining);
+        uint32_t next_subtable = root_size;
+        uint32_t code = 0;
+        uint32_t sorted_index = 0;
+        for (uint32_t length = 1; length <= MaxCodeLength; ++length)
+        {
+            for (uint32_t i = 0; i < counts[length]; ++i, ++code)
+            {
+                const uint32_t entry = symbol_entries[sorted_symbols[sorted_index]];
+                ++sorted_index;
+
+                // The bits come in the stream from the first bit of the code, the tables are indexed by the reversed code
+                const uint32_t reversed = ReverseBits(code, length);
+                if (length <= table_bits)
+                {
+                    for (uint32_t index = reversed; index < root_size; index += 1U << length)
+                    {
+                        table[index] = entry | length;
+                    }
+                }
+                else
+                {
+                    const uint32_t prefix = reversed & (root_size - 1);
+                    if (EntryKindOf(table[prefix]) != EntryKind::SubTable)
+                    {
+                        // Big enough for the codes left that start with this prefix
+                        uint32_t sub_bits = length - table_bits;
+                        int32_t sub_left = 1 << sub_bits;
+                        while (sub_bits + table_bits < MaxCodeLength)
+                        {
+                            sub_left -= static_cast<int32_t>(remaining[sub_bits + table_bits]);
+                            if (sub_left <= 0)
+                            {
+                                break;
+                            }
+                            ++sub_bits;
+                            sub_left <<= 1;
+                        }
+
+                        if (next_subtable + (1U << sub_bits) > table_size)
+                        {
+                            return false;
+                        }
+                        table[prefix] = MakeEntry(EntryKind::SubTable, sub_bits, next_subtable) | table_bits;
+                        std::fill(table + next_subtable, table + next_subtable + (1U << sub_bits), invalid);
+                        next_subtable += 1U << sub_bits;
+                    }
+
+                    uint32_t* subtable = table + EntryValue(table[prefix]);
+                    const uint32_t sub_size = 1U << EntryExtraBits(table[prefix]);
+                    for (uint32_t index = reversed >> table_bits; index < sub_size; index += 1U << (length - table_bits))
+                    {
+                        subtable[index] = entry | (length - table_bits);
+                    }
+                }
+
+                --remaining[length];
+            }
+            code <<= 1;
+        }
+
+        return true;
+    }
+
+    class BitReader final
+    {
+    public:
+        explicit BitReader(std::span<const uint8_t> input) noexcept : next_(input.data()), end_(input.data() + input.size())
+        {
+        }
+
+        // At least 56 bits in the buffer after this. Past the end of the input, they are 0s.
+        void Refill() noexcept
+        {
+            if (end_ - next_ >= 8)
+            {
+                // The whole bytes that fit are taken. The bits above num_bits_ are the start of next_, so the same bits are ORed
+                // in again on the next refill.
+                uint64_t word;
+                std::memcpy(&word, next_, sizeof(word));
+                buffer_ |= word << num_bits_;
+                next_ += (63 - num_bits_) >> 3;
+                num_bits_ |= 56;
+            }
+            else
+            {
+                while (num_bits_ <= 56)
+                {
+                    uint64_t byte = 0;
+                    if (next_ < end_)
+                    {
+                        byte = *next_;
+                        ++next_;
+                    }
+                    else
+                    {
+                        ++overrun_bytes_;
+                    }
+                    buffer_ |= byte << num_bits_;
+                    num_bits_ += 8;
+                }
+            }
+        }
+
+        uint32_t Bits(uint32_t num_bits) noexcept
+        {
+            const uint32_t value = static_cast<uint32_t>(buffer_ & ((1ULL << num_bits) - 1));
+            this->Consume(num_bits);
+            return value;
+        }
+
+        void Consume(uint32_t num_bits) noexcept
+        {
+            buffer_ >>= num_bits;
+            num_bits_ -= num_bits;
+        }
+
+        uint32_t DecodeSymbol(const uint32_t* table, uint32_t table_bits) noexcept
+        {
+            uint32_t entry = table[buffer_ & ((1U << table_bits) - 1)];
+            if (EntryKindOf(entry) == EntryKind::SubTable)
+            {
+                this->Consume(table_bits);
+                entry = table[EntryValue(entry) + (buffer_ & ((1U << EntryExtraBits(entry)) - 1))];
+            }
+            this->Consume(EntryCodeBits(entry));
+            return entry;
+        }
+
+        // The 0s past the end of the input were used
+        bool Overrun() const noexcept
+        {
+            return overrun_bytes_ * 8 > num_bits_;
+        }
+
+        // For stored blocks. Drops the bits to the next byte, and gives back the whole bytes in the buffer.
+        bool TakeBytes(uint32_t num_bytes, const uint8_t*& bytes) noexcept
+        {
+            this->Consume(num_bits_ & 7);
+            if (this->Overrun())
+            {
+                return false;
+            }
+
+            next_ -= num_bits_ / 8 - overrun_bytes_;
+            buffer_ = 0;
+            num_bits_ = 0;
+            overrun_bytes_ = 0;
+            if (static_cast<size_t>(end_ - next_) < num_bytes)
+            {
+                return false;
+            }
+
+            bytes = next_;
+            next_ += num_bytes;
+            return true;
+        }
+
+    private:
+        const uint8_t* next_;
+        const uint8_t* end_;
+        uint64_t buffer_ = 0;
+        uint32_t num_bits_ = 0;
+        uint32_t overrun_bytes_ = 0;
+    };
+
+    struct FixedTables
+    {
+        uint32_t lit_len[LitLenTableSize];
+        uint32_t distance[DistanceTableSize];
+    };
+
+    const FixedTables& GetFixedTables()
+    {
+        static const FixedTables tables = [] {
+            FixedTables ret;
+
+            uint8_t lengths[NumLitLenSymbols];
+            std::fill(lengths, lengths + 144, static_cast<uint8_t>(8));
+            std::fill(lengths + 144, lengths + 256, static_cast<uint8_t>(9));
+            std::fill(lengths + 256, lengths + 280, static_cast<uint8_t>(7));
+            std::fill(lengths + 280, lengths + NumLitLenSymbols, static_cast<uint8_t>(8));
+            BuildTable(lengths, NumLitLenSymbols, Entries.lit_len, LitLenTableBits, ret.lit_len, LitLenTableSize);
+
+            std::fill(lengths, lengths + NumDistanceSymbols, static_cast<uint8_t>(5));
+            BuildTable(lengths, NumDistanceSymbols, Entries.distance, DistanceTableBits, ret.distance, DistanceTableSize);
+
+            return ret;
+        }();
+        return tables;
+    }
+
+    bool ReadDynamicTables(BitReader& reader, uint32_t* lit_len_table, uint32_t* distance_table)
+    {
+        reader.Refill();
+        const uint32_t num_lit_len_codes = reader.Bits(5) + 257;
+        const uint32_t num_distance_codes = reader.Bits(5) + 1;
+        const uint32_t num_code_length_codes = reader.Bits(4) + 4;
+        if ((num_lit_len_codes > MaxLitLenCodes) || (num_distance_codes > MaxDistanceCodes))
+        {
+            return false;
+        }
+
+        uint8_t code_length_lengths[NumCodeLengthSymbols]{};
+        for (uint32_t i = 0; i < num_code_length_codes; ++i)
+        {
+            reader.Refill();
+            code_length_lengths[CodeLengthOrder[i]] = static_cast<uint8_t>(reader.Bits(3));
+        }
+        uint32_t code_length_table[CodeLengthTableSize];
+        if (!BuildTable(code_length_lengths, NumCodeLengthSymbols, Entries.code_length, CodeLengthTableBits, code_length_table,
+                CodeLengthTableSize))
+        {
+            return false;
+        }
+
+        // The literal / length and distance code lengths are one sequence, a repeat can go across
+        uint8_t lengths[MaxLitLenCodes + MaxDistanceCodes];
+        const uint32_t num_lengths = num_lit_len_codes + num_distance_codes;
+        for (uint32_t i = 0; i < num_lengths;)
+        {
+            reader.Refill();
+            const uint32_t entry = reader.DecodeSymbol(code_length_table, CodeLengthTableBits);
+            if (EntryKindOf(entry) != EntryKind::Literal)
+            {
+                return false;
+            }
+
+            const uint32_t symbol = EntryValue(entry);
+            if (symbol < 16)
+            {
+                lengths[i] = static_cast<uint8_t>(symbol);
+                ++i;
+                continue;
+            }
+
+            uint8_t value = 0;
+            uint32_t repeat;
+            if (symbol == 16)
+            {
+                if (i == 0)
+                {
+                    return false;
+                }
+                value = lengths[i - 1];
+                repeat = 3 + reader.Bits(2);
+            }
+            else if (symbol == 17)
+            {
+                repeat = 3 + reader.Bits(3);
+            }
+            else
+            {
+                repeat = 11 + reader.Bits(7);
+            }
+            if (i + repeat > num_lengths)
+            {
+                return false;
+            }
+            std::fill(lengths + i, lengths + i + repeat, value);
+            i += repeat;
+        }
+
+        if (lengths[EndOfBlockSymbol] == 0)
+        {
+            return false;
+        }
+        return BuildTable(lengths, num_lit_len_codes, Entries.lit_len, LitLenTableBits, lit_len_table, LitLenTableSize) &&
+               BuildTable(lengths + num_lit_len_codes, num_distance_codes, Entries.distance, DistanceTableBits, distance_table,
+                   DistanceTableSize);
+    }
+
+    void CopyMatch(uint8_t* out, uint32_t distance, uint32_t length, const uint8_t* out_end) noexcept
+    {
+        const uint8_t* src = out - distance;
+        if (static_cast<size_t>(out_end - out) >= length + CopyOvershoot)
+        {
+            if (distance >= 8)
+            {
+                // Writes up to 7 bytes past the match, they are overwritten later
+                uint8_t* const end = out + length;
+                do
+                {
+                    std::memcpy(out, src, 8);
+                    out += 8;
+                    src += 8;
+                } while (out < end);
+                return;
+            }
+            if (distance == 1)
+            {
+                std::memset(out, *src, length);
+                return;
+            }
+
+            // A repeating pattern, copied in chunks that double, each from what's written already
+            for (uint32_t copied = 0; copied < length;)
+            {
+                const uint32_t n = std::min(length - copied, copied + distance);
+                std::memcpy(out + copied, src, n);
+                copied += n;
+            }
+            return;
+        }
+
+        for (uint32_t i = 0; i < length; ++i)
+        {
+            out[i] = src[i];
+        }
+    }
+
+    bool DecodeBlock(BitReader& reader, const uint32_t* lit_len_table, const uint32_t* distance_table, uint8_t*& out,
+        const uint8_t* out_begin, const uint8_t* out_end)
+    {
+        for (;;)
+        {
+            // 56 bits are 2 literal codes and a length code, and after another refill, its extra bits, a distance code, and its
+            // extra bits
+            reader.Refill();
+
+            uint32_t entry = reader.DecodeSymbol(lit_len_table, LitLenTableBits);
+            if (EntryKindOf(entry) == EntryKind::Literal)
+            {
+                if (out == out_end)
+                {
+                    return false;
+                }
+                *out = static_cast<uint8_t>(EntryValue(entry));
+                ++out;
+
+                entry = reader.DecodeSymbol(lit_len_table, LitLenTableBits);
+                if (EntryKindOf(entry) == EntryKind::Literal)
+                {
+                    if (out == out_end)
+                    {
+                        return false;
+                    }
+                    *out = static_cast<uint8_t>(EntryValue(entry));
+                    ++out;
+                    continue;
+                }
+            }
+
+            const EntryKind kind = EntryKindOf(entry);
+            if (kind == EntryKind::EndOfBlock)
+            {
+                return true;
+            }
+            if (kind != EntryKind::Base)
+            {
+                return false;
+            }
+
+            reader.Refill();
+            const uint32_t length = EntryValue(entry) + reader.Bits(EntryExtraBits(entry));
+            entry = reader.DecodeSymbol(distance_table, DistanceTableBits);
+            if (EntryKindOf(entry) != EntryKind::Base)
+            {
+                return false;
+            }
+            const uint32_t distance = EntryValue(entry) + reader.Bits(EntryExtraBits(entry));
+            if ((distance > static_cast<size_t>(out - out_begin)) || (length > static_cast<size_t>(out_end - out)))
+            {
+                return false;
+            }
+
+            CopyMatch(out, distance, length, out_end);
+            out += length;
+        }
+    }
+} // namespace
+
+namespace MotionToGo
+{
+    bool InflateZlib(std::span<const uint8_t> input, std::span<uint8_t> output)
+    {
+        // CM 8 is deflate, CINFO up to 7 is a window up to 32 KiB, and there's no preset dictionary
+        if (input.size() < 2)
+        {
+            return false;
+        }
+        const uint32_t cmf = input[0];
+        const uint32_t flags = input[1];
+        if (((cmf & 0xF) != 8) || ((cmf >> 4) > 7) || ((((cmf << 8) | flags) % 31) != 0) || ((flags & 0x20) != 0))
+        {
+            return false;
+        }
+
+        BitReader reader(input.subspan(2));
+        uint8_t* out = output.data();
+        const uint8_t* out_begin = output.data();
+        const uint8_t* out_end = output.data() + output.size();
+
+        uint32_t lit_len_table[LitLenTableSize];
+        uint32_t distance_table[DistanceTableSize];
+        bool final_block;
+        do
+        {
+            reader.Refill();
+            final_block = reader.Bits(1) != 0;
+            switch (reader.Bits(2))
+            {
+            case 0:
+            {
+                const uint8_t* header;
+                if (!reader.TakeBytes(4, header))
+                {
+                    return false;
+                }
+                const uint32_t length = header[0] | (header[1] << 8);
+                const uint32_t inverted_length = header[2] | (header[3] << 8);
+                const uint8_t* bytes;
+                if ((length != (~inverted_length & 0xFFFF)) || (length > static_cast<size_t>(out_end - out)) ||
+                    !reader.TakeBytes(length, bytes))
+                {
+                    return false;
+                }
+                std::memcpy(out, bytes, length);
+                out += length;
+                break;
+            }
+
+            case 1:
+            {
+                const FixedTables& fixed_tables = GetFixedTables();
+                if (!DecodeBlock(reader, fixed_tables.lit_len, fixed_tables.distance, out, out_begin, out_end))
+                {
+                    return false;
+                }
+                break;
+            }
+
+            case 2:
+                if (!ReadDynamicTables(reader, lit_len_table, distance_table) ||
+                    !DecodeBlock(reader, lit_len_table, distance_table, out, out_begin, out_end))
+                {
+                    return false;
+                }
+                break;
+
+            default:
+                return false;
+            }
+
+            if (reader.Overrun())
+            {
+                return false;
+            }
+        } while (!final_block);
+
+        return out == out_end;
+    }
+} // namespace MotionToGo
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+namespace MotionToGo
+{
+    // Decodes a zlib stream into exactly output.size() bytes. Built for throughput over zlib's inflate: a 64-bit bit buffer refilled
+    // without branches, 2 level tables looked up once per symbol, and matches copied 8 bytes at a time. The Adler-32 isn't checked.
+    // Returns false on a malformed or truncated stream, or one that doesn't decode to exactly output.size() bytes.
+    bool InflateZlib(std::span<const uint8_t> input, std::span<uint8_t> output);
+} // namespace MotionToGo
@@ -0,0 +1,219 @@
+#include "Lz4.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "Trace/Trace.hpp"
+
+using namespace MotionToGo;
+
+namespace
+{
+    constexpr uint32_t MinMatch = 4;
+    // The format ends a block with literals, the last match starts at least this far from the end, and stops 5 bytes from it
+    constexpr uint32_t MatchFindLimit = 12;
+    constexpr uint32_t LastLiterals = 5;
+    constexpr uint32_t MaxOffset = 65535;
+    constexpr uint32_t HashBits = 16;
+    // Every this many misses in a row, the search takes bigger steps over incompressible data
+    constexpr uint32_t SkipTrigger = 6;
+
+    uint32_t Read32(const uint8_t* p) noexcept
+    {
+        uint32_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    uint32_t Hash(uint32_t sequence) noexcept
+    {
+        return (sequence * 2654435761U) >> (32 - HashBits);
+    }
+
+    void WriteLength(std::vector<uint8_t>& output, uint32_t length)
+    {
+        for (; length >= 255; length -= 255)
+        {
+            output.push_back(255);
+        }
+        output.push_back(static_cast<uint8_t>(length));
+    }
+
+    void WriteSequence(std::vector<uint8_t>& output, const uint8_t* literals, uint32_t num_literals, uint32_t offset, uint32_t match_length)
+    {
+        const uint32_t match_code = match_length - MinMatch;
+        output.push_back(static_cast<uint8_t>((std::min(num_literals, 15U) << 4) | std::min(match_code, 15U)));
+        if (num_literals >= 15)
+        {
+            WriteLength(output, num_literals - 15);
+        }
+        output.insert(output.end(), literals, literals + num_literals);
+
+        output.push_back(static_cast<uint8_t>(offset));
+        output.push_back(static_cast<uint8_t>(offset >> 8));
+        if (match_code >= 15)
+        {
+            WriteLength(output, match_code - 15);
+        }
+    }
+
+    void WriteLastLiterals(std::vector<uint8_t>& output, const uint8_t* literals, uint32_t num_literals)
+    {
+        output.push_back(static_cast<uint8_t>(std::min(num_literals, 15U) << 4));
+        if (num_literals >= 15)
+        {
+            WriteLength(output, num_literals - 15);
+        }
+        output.insert(output.end(), literals, literals + num_literals);
+    }
+
+    // Returns false past the end of the input
+    bool ReadLength(const uint8_t*& p, const uint8_t* end, uint32_t& length) noexcept
+    {
+        uint8_t byte;
+        do
+        {
+            if (p == end)
+            {
+                return false;
+            }
+            byte = *p++;
+            length += byte;
+        } while (byte == 255);
+        return true;
+    }
+} // namespace
+
+namespace MotionToGo
+{
+    std::vector<uint8_t> CompressLz4Block(std::span<const uint8_t> input)
+    {
+        GO_MOTION_TRACE_SCOPE("CompressLz4Block");
+
+        const uint32_t size = static_cast<uint32_t>(input.size());
+        std::vector<uint8_t> output;
+        output.reserve(size + size / 255 + 16);
+
+        const uint8_t* base = input.data();
+        uint32_t anchor = 0;
+        if (size > MatchFindLimit)
+        {
+            // Positions + 1, 0 is empty
+            std::vector<uint32_t> table(1U << HashBits, 0);
+
+            const uint32_t match_limit = size - MatchFindLimit;
+            const uint32_t end_of_matches = size - LastLiterals;
+            uint32_t pos = 0;
+            uint32_t misses = 0;
+            while (pos < match_limit)
+            {
+                const uint32_t sequence = Read32(base + pos);
+                const uint32_t hash = Hash(sequence);
+                const uint32_t candidate = table[hash];
+                table[hash] = pos + 1;
+
+                if ((candidate == 0) || (pos - (candidate - 1) > MaxOffset) || (Read32(base + candidate - 1) != sequence))
+                {
+                    pos += 1 + (misses++ >> SkipTrigger);
+                    continue;
+                }
+                misses = 0;
+
+                uint32_t match = candidate - 1;
+                while ((pos > anchor) && (match > 0) && (base[pos - 1] == base[match - 1]))
+                {
+                    --pos;
+                    --match;
+                }
+
+                uint32_t length = MinMatch;
+                while ((pos + length < end_of_matches) && (base[pos + length] == base[match + length]))
+                {
+                    ++length;
+                }
+
+                WriteSequence(output, base + anchor, pos - anchor, pos - match, length);
+                pos += length;
+                anchor = pos;
+
+                if (pos - 2 < match_limit)
+                {
+                    table[Hash(Read32(base + pos - 2))] = pos - 2 + 1;
+                }
+            }
+        }
+
+        WriteLastLiterals(output, base + anchor, size - anchor);
+        return output;
+    }
+
+    bool DecompressLz4Block(std::span<const uint8_t> input, std::span<uint8_t> output)
+    {
+        GO_MOTION_TRACE_SCOPE("DecompressLz4Block");
+
+        const uint8_t* p = input.data();
+        const uint8_t* const end = p + input.size();
+        uint8_t* dst = output.data();
+        uint8_t* const dst_end = dst + output.size();
+        for (;;)
+        {
+            if (p == end)
+            {
+                return false;
+            }
+            const uint8_t token = *p++;
+
+            uint32_t num_literals = token >> 4;
+            if ((num_literals == 15) && !ReadLength(p, end, num_literals))
+            {
+                return false;
+            }
+            if ((num_literals > static_cast<size_t>(end - p)) || (num_literals > static_cast<size_t>(dst_end - dst)))
+            {
+                return false;
+            }
+            std::memcpy(dst, p, num_literals);
+            p += num_literals;
+            dst += num_literals;
+
+            if (p == end)
+            {
+                // The last sequence has no match
+                return dst == dst_end;
+            }
+
+            if (end - p < 2)
+            {
+                return false;
+            }
+            const uint32_t offset = p[0] | (p[1] << 8);
+            p += 2;
+            if ((offset == 0) || (offset > static_cast<size_t>(dst - output.data())))
+            {
+                return false;
+            }
+
+            uint32_t match_length = token & 0xF;
+            if ((match_length == 15) && !ReadLength(p, end, match_length))
+            {
+                return false;
+            }
+            match_length += MinMatch;
+            if (match_length > static_cast<size_t>(dst_end - dst))
+            {
+                return false;
+            }
+
+            // An overlapping match repeats the last offset bytes. The copies double, each a whole number of repeats away from its
+            // source, so they never overlap. That keeps the long runs of 0 in the delta frames fast.
+            const uint8_t* src = dst - offset;
+            for (uint32_t copied = 0; copied < match_length;)
+            {
+                const uint32_t n = std::min(match_length - copied, copied + offset);
+                std::memcpy(dst + copied, src, n);
+                copied += n;
+            }
+            dst += match_length;
+        }
+    }
+} // namespace MotionToGo
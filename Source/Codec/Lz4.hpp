@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace MotionToGo
+{
+    // A greedy LZ4 block format compressor, the output decodes with LZ4_decompress_safe. Fast rather than small, for frames that go
+    // to disk as they are produced.
+    std::vector<uint8_t> CompressLz4Block(std::span<const uint8_t> input);
+
+    // Decodes a block of exactly output.size() bytes. Returns false on a malformed or truncated block.
+    bool DecompressLz4Block(std::span<const uint8_t> input, std::span<uint8_t> output);
+} // namespace MotionToGo
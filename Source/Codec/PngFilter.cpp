@@ -0,0 +1,268 @@
+#include "PngFilter.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "Cpu/CpuFeatures.hpp"
+#include "PngFilterKernels.hpp"
+
+using namespace MotionToGo;
+
+namespace
+{
+    // The heuristic scores 1/8 of the row, in runs long enough for the SIMD kernels
+    constexpr uint32_t HeuristicSampleBytes = 64;
+    constexpr uint32_t HeuristicSampleStride = 512;
+
+    int PngPredictor(PngFilter filter, int a, int b, int c) noexcept
+    {
+        switch (filter)
+        {
+        case PngFilter::Sub:
+            return a;
+
+        case PngFilter::Up:
+            return b;
+
+        case PngFilter::Average:
+            return (a + b) / 2;
+
+        case PngFilter::Paeth:
+        {
+            // |p - a|, |p - b|, |p - c| of p = a + b - c
+            const int pa = std::abs(b - c);
+            const int pb = std::abs(a - c);
+            const int pc = std::abs(a + b - 2 * c);
+            if ((pa <= pb) && (pa <= pc))
+            {
+                return a;
+            }
+            if (pb <= pc)
+            {
+                return b;
+            }
+            return c;
+        }
+
+        default:
+            return 0;
+        }
+    }
+
+    uint8_t FilterPngByte(PngFilter filter, const uint8_t* row, const uint8_t* prev_row, uint32_t x) noexcept
+    {
+        const int a = x >= PngBytesPerPixel ? row[x - PngBytesPerPixel] : 0;
+        const int b = prev_row[x];
+        const int c = x >= PngBytesPerPixel ? prev_row[x - PngBytesPerPixel] : 0;
+        return static_cast<uint8_t>(row[x] - PngPredictor(filter, a, b, c));
+    }
+
+    void FilterPngBytes(CpuSimdLevel simd_level, PngFilter filter, const uint8_t* row, const uint8_t* prev_row, uint32_t x_begin,
+        uint32_t x_end, uint8_t* filtered)
+    {
+        // The first pixel has no left neighbor, the SIMD kernels don't handle it
+        if ((simd_level == CpuSimdLevel::Scalar) || (x_begin < PngBytesPerPixel))
+        {
+            const uint32_t scalar_end = simd_level == CpuSimdLevel::Scalar ? x_end : std::min(x_end, PngBytesPerPixel);
+            FilterPngBytesScalar(filter, row, prev_row, x_begin, scalar_end, filtered);
+            x_begin = scalar_end;
+        }
+        if (x_begin >= x_end)
+        {
+            return;
+        }
+
+        if (simd_level == CpuSimdLevel::Avx2)
+        {
+            FilterPngBytesAvx2(filter, row, prev_row, x_begin, x_end, filtered);
+        }
+        else
+        {
+            FilterPngBytesSse41(filter, row, prev_row, x_begin, x_end, filtered);
+        }
+    }
+
+    uint32_t PngFilterCost(
+        CpuSimdLevel simd_level, PngFilter filter, const uint8_t* row, const uint8_t* prev_row, uint32_t x_begin, uint32_t x_end)
+    {
+        uint32_t cost = 0;
+        if ((simd_level == CpuSimdLevel::Scalar) || (x_begin < PngBytesPerPixel))
+        {
+            const uint32_t scalar_end = simd_level == CpuSimdLevel::Scalar ? x_end : std::min(x_end, PngBytesPerPixel);
+            cost = PngFilterCostScalar(filter, row, prev_row, x_begin, scalar_end);
+            x_begin = scalar_end;
+        }
+        if (x_begin >= x_end)
+        {
+            return cost;
+        }
+
+        if (simd_level == CpuSimdLevel::Avx2)
+        {
+            cost += PngFilterCostAvx2(filter, row, prev_row, x_begin, x_end);
+        }
+        else
+        {
+            cost += PngFilterCostSse41(filter, row, prev_row, x_begin, x_end);
+        }
+        return cost;
+    }
+} // namespace
+
+namespace MotionToGo
+{
+    void FilterPngBytesScalar(
+        PngFilter filter, const uint8_t* row, const uint8_t* prev_row, uint32_t x_begin, uint32_t x_end, uint8_t* filtered)
+    {
+        for (uint32_t x = x_begin; x < x_end; ++x)
+        {
+            filtered[x] = FilterPngByte(filter, row, prev_row, x);
+        }
+    }
+
+    uint32_t PngFilterCostScalar(PngFilter filter, const uint8_t* row, const uint8_t* prev_row, uint32_t x_begin, uint32_t x_end)
+    {
+        uint32_t cost = 0;
+        for (uint32_t x = x_begin; x < x_end; ++x)
+        {
+            cost += std::abs(static_cast<int8_t>(FilterPngByte(filter, row, prev_row, x)));
+        }
+        return cost;
+    }
+
+    void UnfilterPngRowScalar(PngFilter filter, uint32_t bytes_per_pixel, const uint8_t* prev_row, uint32_t row_bytes, uint8_t* row)
+    {
+        for (uint32_t x = 0; x < row_bytes; ++x)
+        {
+            // The left ones are unfiltered already
+            const int a = x >= bytes_per_pixel ? row[x - bytes_per_pixel] : 0;
+            const int b = prev_row[x];
+            const int c = x >= bytes_per_pixel ? prev_row[x - bytes_per_pixel] : 0;
+            row[x] = static_cast<uint8_t>(row[x] + PngPredictor(filter, a, b, c));
+        }
+    }
+
+    void PngRowToRgba8Scalar(PngRowFormat format, const uint8_t* row, uint32_t x_begin, uint32_t width, uint8_t* rgba)
+    {
+        const uint32_t bytes_per_pixel = PngRowFormatBytesPerPixel(format);
+        const uint32_t bytes_per_sample = (format == PngRowFormat::Rgb16) || (format == PngRowFormat::Rgba16) ? 2 : 1;
+        const bool has_alpha = (format == PngRowFormat::Rgba8) || (format == PngRowFormat::Rgba16);
+        for (uint32_t x = x_begin; x < width; ++x)
+        {
+            const uint8_t* pixel = &row[x * bytes_per_pixel];
+            for (uint32_t c = 0; c < 3; ++c)
+            {
+                rgba[x * 4 + c] = pixel[c * bytes_per_sample];
+            }
+            rgba[x * 4 + 3] = has_alpha ? pixel[3 * bytes_per_sample] : 0xFF;
+        }
+    }
+
+    const char* PngFilterStrategyName(PngFilterStrategy strategy) noexcept
+    {
+        switch (strategy)
+        {
+        case PngFilterStrategy::Fixed:
+            return "Fixed";
+
+        case PngFilterStrategy::Heuristic:
+            return "Heuristic";
+
+        case PngFilterStrategy::Exhaustive:
+            return "Exhaustive";
+
+        default:
+            return "Unknown";
+        }
+    }
+
+    uint32_t PngRowFormatBytesPerPixel(PngRowFormat format) noexcept
+    {
+        switch (format)
+        {
+        case PngRowFormat::Rgb8:
+            return 3;
+
+        case PngRowFormat::Rgba8:
+            return 4;
+
+        case PngRowFormat::Rgb16:
+            return 6;
+
+        case PngRowFormat::Rgba16:
+            return 8;
+
+        default:
+            return 0;
+        }
+    }
+
+    PngFilter FilterPngRow(PngFilterStrategy strategy, PngFilter fixed_filter, const uint8_t* row, const uint8_t* prev_row,
+        uint32_t row_bytes, uint8_t* filtered)
+    {
+        const CpuSimdLevel simd_level = ActiveCpuSimdLevel();
+
+        PngFilter best_filter = fixed_filter;
+        if (strategy != PngFilterStrategy::Fixed)
+        {
+            const bool sampled = (strategy == PngFilterStrategy::Heuristic) && (row_bytes > HeuristicSampleStride);
+
+            uint32_t best_cost = ~0U;
+            for (const PngFilter filter : {PngFilter::None, PngFilter::Sub, PngFilter::Up, PngFilter::Average, PngFilter::Paeth})
+            {
+                uint32_t cost = 0;
+                if (sampled)
+                {
+                    for (uint32_t x = 0; x < row_bytes; x += HeuristicSampleStride)
+                    {
+                        cost += PngFilterCost(simd_level, filter, row, prev_row, x, std::min(x + HeuristicSampleBytes, row_bytes));
+                    }
+                }
+                else
+                {
+                    cost = PngFilterCost(simd_level, filter, row, prev_row, 0, row_bytes);
+                }
+
+                // The first of the equally good ones, same as stb_image_write
+                if (cost < best_cost)
+                {
+                    best_cost = cost;
+                    best_filter = filter;
+                }
+            }
+        }
+
+        FilterPngBytes(simd_level, best_filter, row, prev_row, 0, row_bytes, filtered);
+        return best_filter;
+    }
+
+    void UnfilterPngRow(PngFilter filter, PngRowFormat format, const uint8_t* prev_row, uint32_t row_bytes, uint8_t* row)
+    {
+        if (filter == PngFilter::None)
+        {
+            return;
+        }
+
+        const uint32_t bytes_per_pixel = PngRowFormatBytesPerPixel(format);
+        if (ActiveCpuSimdLevel() == CpuSimdLevel::Scalar)
+        {
+            UnfilterPngRowScalar(filter, bytes_per_pixel, prev_row, row_bytes, row);
+        }
+        else
+        {
+            UnfilterPngRowSse41(filter, bytes_per_pixel, prev_row, row_bytes, row);
+        }
+    }
+
+    void PngRowToRgba8(PngRowFormat format, const uint8_t* row, uint32_t width, uint8_t* rgba)
+    {
+        if (ActiveCpuSimdLevel() == CpuSimdLevel::Scalar)
+        {
+            PngRowToRgba8Scalar(format, row, 0, width, rgba);
+        }
+        else
+        {
+            PngRowToRgba8Sse41(format, row, width, rgba);
+        }
+    }
+} // namespace MotionToGo
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+
+namespace MotionToGo
+{
+    // The filter types of the PNG spec, the values go to the stream
+    enum class PngFilter : uint8_t
+    {
+        None,
+        Sub,
+        Up,
+        Average,
+        Paeth,
+    };
+
+    enum class PngFilterStrategy : uint32_t
+    {
+        // The same filter on every row
+        Fixed,
+        // Every filter is scored on a sample of the row, the one with the smallest sum of |filtered| filters the whole row
+        Heuristic,
+        // Every filter is scored on the whole row, what stb_image_write does
+        Exhaustive,
+    };
+
+    // The pixel formats the PNG decoder reads itself, 16-bit samples are big endian
+    enum class PngRowFormat : uint32_t
+    {
+        Rgb8,
+        Rgba8,
+        Rgb16,
+        Rgba16,
+    };
+
+    const char* PngFilterStrategyName(PngFilterStrategy strategy) noexcept;
+    uint32_t PngRowFormatBytesPerPixel(PngRowFormat format) noexcept;
+
+    // Filters a row of RGBA8 pixels for the IDAT stream. prev_row is all 0 for the first row. Returns the filter picked, filtered gets
+    // row_bytes bytes without the filter type byte. Dispatches to the ActiveCpuSimdLevel kernels.
+    PngFilter FilterPngRow(PngFilterStrategy strategy, PngFilter fixed_filter, const uint8_t* row, const uint8_t* prev_row,
+        uint32_t row_bytes, uint8_t* filtered);
+
+    // Reverses the filter of a row in place. prev_row is the unfiltered previous row, all 0 for the first row.
+    void UnfilterPngRow(PngFilter filter, PngRowFormat format, const uint8_t* prev_row, uint32_t row_bytes, uint8_t* row);
+    // Converts an unfiltered row to RGBA8, 16-bit samples keep their high byte like stb_image does. RGB gets an opaque alpha.
+    void PngRowToRgba8(PngRowFormat format, const uint8_t* row, uint32_t width, uint8_t* rgba);
+} // namespace MotionToGo
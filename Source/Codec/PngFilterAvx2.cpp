@@ -0,0 +1,141 @@
+#include "PngFilterKernels.hpp"
+
+#include <immintrin.h>
+
+using namespace MotionToGo;
+
+namespace
+{
+    __m256i Load32(const uint8_t* src) noexcept
+    {
+        return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+    }
+
+    // Paeth on 16 pixel bytes widened to int16
+    __m256i PaethPredictor(__m256i a, __m256i b, __m256i c) noexcept
+    {
+        const __m256i pa = _mm256_abs_epi16(_mm256_sub_epi16(b, c));
+        const __m256i pb = _mm256_abs_epi16(_mm256_sub_epi16(a, c));
+        const __m256i pc = _mm256_abs_epi16(_mm256_add_epi16(_mm256_sub_epi16(a, c), _mm256_sub_epi16(b, c)));
+        const __m256i b_or_c = _mm256_blendv_epi8(b, c, _mm256_cmpgt_epi16(pb, pc));
+        return _mm256_blendv_epi8(a, b_or_c, _mm256_cmpgt_epi16(pa, _mm256_min_epi16(pb, pc)));
+    }
+
+    template <PngFilter Filter>
+    __m256i Filter32Bytes(const uint8_t* row, const uint8_t* prev_row, uint32_t x) noexcept
+    {
+        const __m256i value = Load32(&row[x]);
+        if constexpr (Filter == PngFilter::Sub)
+        {
+            return _mm256_sub_epi8(value, Load32(&row[x - PngBytesPerPixel]));
+        }
+        else if constexpr (Filter == PngFilter::Up)
+        {
+            return _mm256_sub_epi8(value, Load32(&prev_row[x]));
+        }
+        else if constexpr (Filter == PngFilter::Average)
+        {
+            // avg_epu8 rounds up, the spec rounds down
+            const __m256i a = Load32(&row[x - PngBytesPerPixel]);
+            const __m256i b = Load32(&prev_row[x]);
+            const __m256i average = _mm256_sub_epi8(_mm256_avg_epu8(a, b), _mm256_and_si256(_mm256_xor_si256(a, b), _mm256_set1_epi8(1)));
+            return _mm256_sub_epi8(value, average);
+        }
+        else if constexpr (Filter == PngFilter::Paeth)
+        {
+            // The unpacks and the pack work in 128-bit lanes alike, so the bytes come back in order
+            const __m256i zero = _mm256_setzero_si256();
+            const __m256i a = Load32(&row[x - PngBytesPerPixel]);
+            const __m256i b = Load32(&prev_row[x]);
+            const __m256i c = Load32(&prev_row[x - PngBytesPerPixel]);
+            const __m256i predictor_lo =
+                PaethPredictor(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero), _mm256_unpacklo_epi8(c, zero));
+            const __m256i predictor_hi =
+                PaethPredictor(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero), _mm256_unpackhi_epi8(c, zero));
+            return _mm256_sub_epi8(value, _mm256_packus_epi16(predictor_lo, predictor_hi));
+        }
+        else
+        {
+            return value;
+        }
+    }
+
+    template <PngFilter Filter>
+    void FilterBytes(const uint8_t* row, const uint8_t* prev_row, uint32_t x_begin, uint32_t x_end, uint8_t* filtered)
+    {
+        uint32_t x = x_begin;
+        for (; x + 32 <= x_end; x += 32)
+        {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(&filtered[x]), Filter32Bytes<Filter>(row, prev_row, x));
+        }
+
+        FilterPngBytesScalar(Filter, row, prev_row, x, x_end, filtered);
+    }
+
+    template <PngFilter Filter>
+    uint32_t FilterCost(const uint8_t* row, const uint8_t* prev_row, uint32_t x_begin, uint32_t x_end)
+    {
+        // 4 uint64 partial sums
+        __m256i sum = _mm256_setzero_si256();
+        uint32_t x = x_begin;
+        for (; x + 32 <= x_end; x += 32)
+        {
+            sum = _mm256_add_epi64(sum, _mm256_sad_epu8(_mm256_abs_epi8(Filter32Bytes<Filter>(row, prev_row, x)), _mm256_setzero_si256()));
+        }
+
+        const __m128i sum_128 = _mm_add_epi64(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+        const uint32_t cost = static_cast<uint32_t>(_mm_cvtsi128_si32(sum_128) + _mm_extract_epi32(sum_128, 2));
+        return cost + PngFilterCostScalar(Filter, row, prev_row, x, x_end);
+    }
+} // namespace
+
+namespace MotionToGo
+{
+    void FilterPngBytesAvx2(
+        PngFilter filter, const uint8_t* row, const uint8_t* prev_row, uint32_t x_begin, uint32_t x_end, uint8_t* filtered)
+    {
+        switch (filter)
+        {
+        case PngFilter::Sub:
+            FilterBytes<PngFilter::Sub>(row, prev_row, x_begin, x_end, filtered);
+            break;
+
+        case PngFilter::Up:
+            FilterBytes<PngFilter::Up>(row, prev_row, x_begin, x_end, filtered);
+            break;
+
+        case PngFilter::Average:
+            FilterBytes<PngFilter::Average>(row, prev_row, x_begin, x_end, filtered);
+            break;
+
+        case PngFilter::Paeth:
+            FilterBytes<PngFilter::Paeth>(row, prev_row, x_begin, x_end, filtered);
+            break;
+
+        default:
+            FilterBytes<PngFilter::None>(row, prev_row, x_begin, x_end, filtered);
+            break;
+        }
+    }
+
+    uint32_t PngFilterCostAvx2(PngFilter filter, const uint8_t* row, const uint8_t* prev_row, uint32_t x_begin, uint32_t x_end)
+    {
+        switch (filter)
+        {
+        case PngFilter::Sub:
+            return FilterCost<PngFilter::Sub>(row, prev_row, x_begin, x_end);
+
+        case PngFilter::Up:
+            return FilterCost<PngFilter::Up>(row, prev_row, x_begin, x_end);
+
+        case PngFilter::Average:
+            return FilterCost<PngFilter::Average>(row, prev_row, x_begin, x_end);
+
+        case PngFilter::Paeth:
+            return FilterCost<PngFilter::Paeth>(row, prev_row, x_begin, x_end);
+
+        default:
+            return FilterCost<PngFilter::None>(row, prev_row, x_begin, x_end);
+        }
+    }
+} // namespace MotionToGo
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+
+#include "PngFilter.hpp"
+
+// Row kernels behind PngFilter.hpp. Filtering on the encoding side is for 4 bytes per pixel, and only reads the unfiltered bytes, so
+// every byte is independent. Unfiltering on the decoding side needs the pixel on the left first, so it goes a pixel at a time and
+// wider vectors don't help, there are no AVX2 variants.
+
+namespace MotionToGo
+{
+    constexpr uint32_t PngBytesPerPixel = 4;
+
+    // Filters the bytes [x_begin, x_end) of a row.
+    void FilterPngBytesScalar(
+        PngFilter filter, const uint8_t* row, const uint8_t* prev_row, uint32_t x_begin, uint32_t x_end, uint8_t* filtered);
+    // x_begin MUST be at least PngBytesPerPixel.
+    void FilterPngBytesSse41(
+        PngFilter filter, const uint8_t* row, const uint8_t* prev_row, uint32_t x_begin, uint32_t x_end, uint8_t* filtered);
+    void FilterPngBytesAvx2(
+        PngFilter filter, const uint8_t* row, const uint8_t* prev_row, uint32_t x_begin, uint32_t x_end, uint8_t* filtered);
+
+    // The sum of |filtered| as signed bytes over [x_begin, x_end), without storing the filtered bytes.
+    uint32_t PngFilterCostScalar(PngFilter filter, const uint8_t* row, const uint8_t* prev_row, uint32_t x_begin, uint32_t x_end);
+    // x_begin MUST be at least PngBytesPerPixel.
+    uint32_t PngFilterCostSse41(PngFilter filter, const uint8_t* row, const uint8_t* prev_row, uint32_t x_begin, uint32_t x_end);
+    uint32_t PngFilterCostAvx2(PngFilter filter, const uint8_t* row, const uint8_t* prev_row, uint32_t x_begin, uint32_t x_end);
+
+    void UnfilterPngRowScalar(PngFilter filter, uint32_t bytes_per_pixel, const uint8_t* prev_row, uint32_t row_bytes, uint8_t* row);
+    void UnfilterPngRowSse41(PngFilter filter, uint32_t bytes_per_pixel, const uint8_t* prev_row, uint32_t row_bytes, uint8_t* row);
+
+    // Converts the pixels [x_begin, width) of a row.
+    void PngRowToRgba8Scalar(PngRowFormat format, const uint8_t* row, uint32_t x_begin, uint32_t width, uint8_t* rgba);
+    void PngRowToRgba8Sse41(PngRowFormat format, const uint8_t* row, uint32_t width, uint8_t* rgba);
+} // namespace MotionToGo
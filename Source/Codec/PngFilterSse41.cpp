@@ -0,0 +1,328 @@
+#include "PngFilterKernels.hpp"
+
+#include <cstring>
+
+#include <smmintrin.h>
+
+using namespace MotionToGo;
+
+namespace
+{
+    __m128i Load16(const uint8_t* src) noexcept
+    {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+    }
+
+    // Paeth on 8 pixel bytes widened to int16
+    __m128i PaethPredictor(__m128i a, __m128i b, __m128i c) noexcept
+    {
+        const __m128i pa = _mm_abs_epi16(_mm_sub_epi16(b, c));
+        const __m128i pb = _mm_abs_epi16(_mm_sub_epi16(a, c));
+        const __m128i pc = _mm_abs_epi16(_mm_add_epi16(_mm_sub_epi16(a, c), _mm_sub_epi16(b, c)));
+        const __m128i b_or_c = _mm_blendv_epi8(b, c, _mm_cmpgt_epi16(pb, pc));
+        return _mm_blendv_epi8(a, b_or_c, _mm_cmpgt_epi16(pa, _mm_min_epi16(pb, pc)));
+    }
+
+    template <PngFilter Filter>
+    __m128i Filter16Bytes(const uint8_t* row, const uint8_t* prev_row, uint32_t x) noexcept
+    {
+        const __m128i value = Load16(&row[x]);
+        if constexpr (Filter == PngFilter::Sub)
+        {
+            return _mm_sub_epi8(value, Load16(&row[x - PngBytesPerPixel]));
+        }
+        else if constexpr (Filter == PngFilter::Up)
+        {
+            return _mm_sub_epi8(value, Load16(&prev_row[x]));
+        }
+        else if constexpr (Filter == PngFilter::Average)
+        {
+            // avg_epu8 rounds up, the spec rounds down
+            const __m128i a = Load16(&row[x - PngBytesPerPixel]);
+            const __m128i b = Load16(&prev_row[x]);
+            const __m128i average = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1)));
+            return _mm_sub_epi8(value, average);
+        }
+        else if constexpr (Filter == PngFilter::Paeth)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i a = Load16(&row[x - PngBytesPerPixel]);
+            const __m128i b = Load16(&prev_row[x]);
+            const __m128i c = Load16(&prev_row[x - PngBytesPerPixel]);
+            const __m128i predictor_lo = PaethPredictor(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(c, zero));
+            const __m128i predictor_hi = PaethPredictor(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(c, zero));
+            return _mm_sub_epi8(value, _mm_packus_epi16(predictor_lo, predictor_hi));
+        }
+        else
+        {
+            return value;
+        }
+    }
+
+    template <PngFilter Filter>
+    void FilterBytes(const uint8_t* row, const uint8_t* prev_row, uint32_t x_begin, uint32_t x_end, uint8_t* filtered)
+    {
+        uint32_t x = x_begin;
+        for (; x + 16 <= x_end; x += 16)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&filtered[x]), Filter16Bytes<Filter>(row, prev_row, x));
+        }
+
+        FilterPngBytesScalar(Filter, row, prev_row, x, x_end, filtered);
+    }
+
+    template <PngFilter Filter>
+    uint32_t FilterCost(const uint8_t* row, const uint8_t* prev_row, uint32_t x_begin, uint32_t x_end)
+    {
+        // 2 uint64 partial sums
+        __m128i sum = _mm_setzero_si128();
+        uint32_t x = x_begin;
+        for (; x + 16 <= x_end; x += 16)
+        {
+            sum = _mm_add_epi64(sum, _mm_sad_epu8(_mm_abs_epi8(Filter16Bytes<Filter>(row, prev_row, x)), _mm_setzero_si128()));
+        }
+
+        const uint32_t cost = static_cast<uint32_t>(_mm_cvtsi128_si32(sum) + _mm_extract_epi32(sum, 2));
+        return cost + PngFilterCostScalar(Filter, row, prev_row, x, x_end);
+    }
+
+    // A pixel of 3, 4, 6 or 8 bytes in the low bytes
+    template <uint32_t Bytes>
+    __m128i LoadPixel(const uint8_t* src) noexcept
+    {
+        uint64_t value = 0;
+        std::memcpy(&value, src, Bytes);
+        return _mm_cvtsi64_si128(static_cast<int64_t>(value));
+    }
+
+    template <uint32_t Bytes>
+    void StorePixel(uint8_t* dst, __m128i pixel) noexcept
+    {
+        const uint64_t value = static_cast<uint64_t>(_mm_cvtsi128_si64(pixel));
+        std::memcpy(dst, &value, Bytes);
+    }
+
+    // unfilter(raw, b) gets the filtered pixel and the one above, and returns the unfiltered pixel. Only the low BytesPerPixel bytes
+    // of the predictors may be non-zero, so the bytes past the pixel come back as they were.
+    template <uint32_t BytesPerPixel, typename UnfilterFunc>
+    void UnfilterPixels(const uint8_t* prev_row, uint32_t row_bytes, uint8_t* row, UnfilterFunc&& unfilter)
+    {
+        // 3 and 6 bytes go in 4 and 8 bytes loads and stores. The next pixel is loaded before the store that overlaps it, so it
+        // doesn't wait for the store to be forwarded.
+        constexpr uint32_t WideBytes = BytesPerPixel <= 4 ? 4 : 8;
+
+        uint32_t x = 0;
+        if (row_bytes >= WideBytes)
+        {
+            __m128i raw = LoadPixel<WideBytes>(&row[0]);
+            for (; x + BytesPerPixel + WideBytes <= row_bytes; x += BytesPerPixel)
+            {
+                const __m128i next_raw = LoadPixel<WideBytes>(&row[x + BytesPerPixel]);
+                StorePixel<WideBytes>(&row[x], unfilter(raw, LoadPixel<WideBytes>(&prev_row[x])));
+                raw = next_raw;
+            }
+        }
+        for (; x < row_bytes; x += BytesPerPixel)
+        {
+            StorePixel<BytesPerPixel>(&row[x], unfilter(LoadPixel<BytesPerPixel>(&row[x]), LoadPixel<BytesPerPixel>(&prev_row[x])));
+        }
+    }
+
+    template <uint32_t BytesPerPixel>
+    void UnfilterRow(PngFilter filter, const uint8_t* prev_row, uint32_t row_bytes, uint8_t* row)
+    {
+        const __m128i pixel_mask =
+            _mm_cvtsi64_si128(BytesPerPixel == 8 ? -1 : static_cast<int64_t>((1ULL << (BytesPerPixel * 8)) - 1));
+
+        switch (filter)
+        {
+        case PngFilter::Sub:
+        {
+            __m128i a = _mm_setzero_si128();
+            UnfilterPixels<BytesPerPixel>(prev_row, row_bytes, row, [&](__m128i raw, [[maybe_unused]] __m128i b) {
+                a = _mm_add_epi8(raw, _mm_and_si128(a, pixel_mask));
+                return a;
+            });
+            break;
+        }
+
+        case PngFilter::Up:
+        {
+            uint32_t x = 0;
+            for (; x + 16 <= row_bytes; x += 16)
+            {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(&row[x]), _mm_add_epi8(Load16(&row[x]), Load16(&prev_row[x])));
+            }
+            for (; x < row_bytes; ++x)
+            {
+                row[x] = static_cast<uint8_t>(row[x] + prev_row[x]);
+            }
+            break;
+        }
+
+        case PngFilter::Average:
+        {
+            __m128i a = _mm_setzero_si128();
+            UnfilterPixels<BytesPerPixel>(prev_row, row_bytes, row, [&](__m128i raw, __m128i b) {
+                // avg_epu8 rounds up, the spec rounds down
+                const __m128i average = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1)));
+                a = _mm_add_epi8(raw, _mm_and_si128(average, pixel_mask));
+                return a;
+            });
+            break;
+        }
+
+        case PngFilter::Paeth:
+        {
+            // a and c widened to int16, carried from the pixel on the left
+            __m128i a = _mm_setzero_si128();
+            __m128i c = _mm_setzero_si128();
+            UnfilterPixels<BytesPerPixel>(prev_row, row_bytes, row, [&](__m128i raw, __m128i b) {
+                const __m128i b_16 = _mm_cvtepu8_epi16(b);
+                const __m128i predictor = PaethPredictor(a, b_16, c);
+                const __m128i value = _mm_add_epi8(raw, _mm_and_si128(_mm_packus_epi16(predictor, predictor), pixel_mask));
+                a = _mm_cvtepu8_epi16(value);
+                c = b_16;
+                return value;
+            });
+            break;
+        }
+
+        default:
+            break;
+        }
+    }
+} // namespace
+
+namespace MotionToGo
+{
+    void FilterPngBytesSse41(
+        PngFilter filter, const uint8_t* row, const uint8_t* prev_row, uint32_t x_begin, uint32_t x_end, uint8_t* filtered)
+    {
+        switch (filter)
+        {
+        case PngFilter::Sub:
+            FilterBytes<PngFilter::Sub>(row, prev_row, x_begin, x_end, filtered);
+            break;
+
+        case PngFilter::Up:
+            FilterBytes<PngFilter::Up>(row, prev_row, x_begin, x_end, filtered);
+            break;
+
+        case PngFilter::Average:
+            FilterBytes<PngFilter::Average>(row, prev_row, x_begin, x_end, filtered);
+            break;
+
+        case PngFilter::Paeth:
+            FilterBytes<PngFilter::Paeth>(row, prev_row, x_begin, x_end, filtered);
+            break;
+
+        default:
+            FilterBytes<PngFilter::None>(row, prev_row, x_begin, x_end, filtered);
+            break;
+        }
+    }
+
+    uint32_t PngFilterCostSse41(PngFilter filter, const uint8_t* row, const uint8_t* prev_row, uint32_t x_begin, uint32_t x_end)
+    {
+        switch (filter)
+        {
+        case PngFilter::Sub:
+            return FilterCost<PngFilter::Sub>(row, prev_row, x_begin, x_end);
+
+        case PngFilter::Up:
+            return FilterCost<PngFilter::Up>(row, prev_row, x_begin, x_end);
+
+        case PngFilter::Average:
+            return FilterCost<PngFilter::Average>(row, prev_row, x_begin, x_end);
+
+        case PngFilter::Paeth:
+            return FilterCost<PngFilter::Paeth>(row, prev_row, x_begin, x_end);
+
+        default:
+            return FilterCost<PngFilter::None>(row, prev_row, x_begin, x_end);
+        }
+    }
+
+    void UnfilterPngRowSse41(PngFilter filter, uint32_t bytes_per_pixel, const uint8_t* prev_row, uint32_t row_bytes, uint8_t* row)
+    {
+        switch (bytes_per_pixel)
+        {
+        case 3:
+            UnfilterRow<3>(filter, prev_row, row_bytes, row);
+            break;
+
+        case 4:
+            UnfilterRow<4>(filter, prev_row, row_bytes, row);
+            break;
+
+        case 6:
+            UnfilterRow<6>(filter, prev_row, row_bytes, row);
+            break;
+
+        case 8:
+            UnfilterRow<8>(filter, prev_row, row_bytes, row);
+            break;
+
+        default:
+            UnfilterPngRowScalar(filter, bytes_per_pixel, prev_row, row_bytes, row);
+            break;
+        }
+    }
+
+    void PngRowToRgba8Sse41(PngRowFormat format, const uint8_t* row, uint32_t width, uint8_t* rgba)
+    {
+        const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xFF000000));
+
+        uint32_t x = 0;
+        switch (format)
+        {
+        case PngRowFormat::Rgb8:
+        {
+            // 4 pixels from 16 bytes, the last 4 aren't used
+            const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+            for (; x * 3 + 16 <= width * 3; x += 4)
+            {
+                const __m128i pixels = _mm_or_si128(_mm_shuffle_epi8(Load16(&row[x * 3]), shuffle), alpha);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(&rgba[x * 4]), pixels);
+            }
+            break;
+        }
+
+        case PngRowFormat::Rgba8:
+            std::memcpy(rgba, row, width * 4);
+            x = width;
+            break;
+
+        case PngRowFormat::Rgb16:
+        {
+            // 2 pixels from 16 bytes, the high bytes come first
+            const __m128i shuffle = _mm_setr_epi8(0, 2, 4, -1, 6, 8, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+            for (; x * 6 + 16 <= width * 6; x += 2)
+            {
+                const __m128i pixels = _mm_or_si128(_mm_shuffle_epi8(Load16(&row[x * 6]), shuffle), alpha);
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(&rgba[x * 4]), pixels);
+            }
+            break;
+        }
+
+        case PngRowFormat::Rgba16:
+        {
+            // 4 pixels from 32 bytes, the high bytes are the low bytes of the little endian words
+            const __m128i low_bytes = _mm_set1_epi16(0xFF);
+            for (; x + 4 <= width; x += 4)
+            {
+                const __m128i pixels01 = _mm_and_si128(Load16(&row[x * 8]), low_bytes);
+                const __m128i pixels23 = _mm_and_si128(Load16(&row[x * 8 + 16]), low_bytes);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(&rgba[x * 4]), _mm_packus_epi16(pixels01, pixels23));
+            }
+            break;
+        }
+
+        default:
+            break;
+        }
+
+        PngRowToRgba8Scalar(format, row, x, width, rgba);
+    }
+} // namespace MotionToGo
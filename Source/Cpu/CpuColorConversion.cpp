@@ -0,0 +1,138 @@
+#include "CpuColorConversion.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+#include "CpuColorConversionKernels.hpp"
+#include "CpuFeatures.hpp"
+#include "Trace/Trace.hpp"
+
+using namespace MotionToGo::ColorConversion;
+
+namespace
+{
+    uint8_t FloatToUnorm8(float value) noexcept
+    {
+        return static_cast<uint8_t>(std::clamp(value, 0.0f, 1.0f) * 255 + 0.5f);
+    }
+} // namespace
+
+namespace MotionToGo
+{
+    void RgbaToNv12RowsScalar(const uint8_t* rgba_row0, const uint8_t* rgba_row1, uint32_t x_begin, uint32_t width, uint8_t* luma_row0,
+        uint8_t* luma_row1, uint8_t* chroma_row)
+    {
+        const uint8_t* rgba_rows[] = {rgba_row0, rgba_row1};
+        uint8_t* luma_rows[] = {luma_row0, luma_row1};
+
+        for (uint32_t x = x_begin; x < width; x += 2)
+        {
+            uint32_t cb_sum = 0;
+            uint32_t cr_sum = 0;
+            for (uint32_t dy = 0; dy < 2; ++dy)
+            {
+                for (uint32_t dx = 0; dx < 2; ++dx)
+                {
+                    const uint8_t* pixel = &rgba_rows[dy][(x + dx) * 4];
+                    const float r = pixel[0] / 255.0f;
+                    const float g = pixel[1] / 255.0f;
+                    const float b = pixel[2] / 255.0f;
+
+                    const float luma_value = Kr * r + Kg * g + Kb * b;
+                    const float cb = (b - luma_value) / Kcb;
+                    const float cr = (r - luma_value) / Kcr;
+
+                    // The shader truncates to integers before storing
+                    luma_rows[dy][x + dx] = static_cast<uint8_t>(static_cast<int>(luma_value * 219 + 16));
+                    cb_sum += static_cast<int>(cb * 224 + 128);
+                    cr_sum += static_cast<int>(cr * 224 + 128);
+                }
+            }
+
+            chroma_row[x + 0] = static_cast<uint8_t>((cb_sum + 2) / 4);
+            chroma_row[x + 1] = static_cast<uint8_t>((cr_sum + 2) / 4);
+        }
+    }
+
+    void Nv12ToRgbaRowScalar(const uint8_t* luma_row, const uint8_t* chroma_row, uint32_t x_begin, uint32_t width, uint8_t* rgba_row)
+    {
+        for (uint32_t x = x_begin; x < width; ++x)
+        {
+            const uint8_t* uv = &chroma_row[x & ~1U];
+
+            const float luma_value = (luma_row[x] - 16) / 219.0f;
+            const float cb = (uv[0] - 128) / 224.0f;
+            const float cr = (uv[1] - 128) / 224.0f;
+
+            uint8_t* pixel = &rgba_row[x * 4];
+            pixel[0] = FloatToUnorm8(luma_value + Kcr * cr);
+            pixel[1] = FloatToUnorm8(luma_value - KgCb * cb - KgCr * cr);
+            pixel[2] = FloatToUnorm8(luma_value + Kcb * cb);
+            pixel[3] = 255;
+        }
+    }
+
+    void RgbaToNv12(const uint8_t* rgba, uint32_t rgba_row_pitch, uint32_t width, uint32_t height, uint8_t* luma, uint32_t luma_row_pitch,
+        uint8_t* chroma, uint32_t chroma_row_pitch)
+    {
+        GO_MOTION_TRACE_SCOPE("RgbaToNv12");
+
+        assert(((width & 1) == 0) && ((height & 1) == 0));
+
+        const CpuSimdLevel simd_level = ActiveCpuSimdLevel();
+        for (uint32_t y = 0; y < height; y += 2)
+        {
+            const uint8_t* rgba_row0 = &rgba[y * rgba_row_pitch];
+            const uint8_t* rgba_row1 = rgba_row0 + rgba_row_pitch;
+            uint8_t* luma_row0 = &luma[y * luma_row_pitch];
+            uint8_t* luma_row1 = luma_row0 + luma_row_pitch;
+            uint8_t* chroma_row = &chroma[(y / 2) * chroma_row_pitch];
+
+            switch (simd_level)
+            {
+            case CpuSimdLevel::Avx2:
+                RgbaToNv12RowsAvx2(rgba_row0, rgba_row1, width, luma_row0, luma_row1, chroma_row);
+                break;
+
+            case CpuSimdLevel::Sse41:
+                RgbaToNv12RowsSse41(rgba_row0, rgba_row1, width, luma_row0, luma_row1, chroma_row);
+                break;
+
+            default:
+                RgbaToNv12RowsScalar(rgba_row0, rgba_row1, 0, width, luma_row0, luma_row1, chroma_row);
+                break;
+            }
+        }
+    }
+
+    void Nv12ToRgba(const uint8_t* luma, uint32_t luma_row_pitch, const uint8_t* chroma, uint32_t chroma_row_pitch, uint32_t width,
+        uint32_t height, uint8_t* rgba, uint32_t rgba_row_pitch)
+    {
+        GO_MOTION_TRACE_SCOPE("Nv12ToRgba");
+
+        assert(((width & 1) == 0) && ((height & 1) == 0));
+
+        const CpuSimdLevel simd_level = ActiveCpuSimdLevel();
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            const uint8_t* luma_row = &luma[y * luma_row_pitch];
+            const uint8_t* chroma_row = &chroma[(y / 2) * chroma_row_pitch];
+            uint8_t* rgba_row = &rgba[y * rgba_row_pitch];
+
+            switch (simd_level)
+            {
+            case CpuSimdLevel::Avx2:
+                Nv12ToRgbaRowAvx2(luma_row, chroma_row, width, rgba_row);
+                break;
+
+            case CpuSimdLevel::Sse41:
+                Nv12ToRgbaRowSse41(luma_row, chroma_row, width, rgba_row);
+                break;
+
+            default:
+                Nv12ToRgbaRowScalar(luma_row, chroma_row, 0, width, rgba_row);
+                break;
+            }
+        }
+    }
+} // namespace MotionToGo
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstdint>
+
+namespace MotionToGo
+{
+    // CPU versions of RgbToNv12Cs and Nv12ToRgbCs for frames that don't need scaling. Width and height MUST be even.
+    void RgbaToNv12(const uint8_t* rgba, uint32_t rgba_row_pitch, uint32_t width, uint32_t height, uint8_t* luma, uint32_t luma_row_pitch,
+        uint8_t* chroma, uint32_t chroma_row_pitch);
+    void Nv12ToRgba(const uint8_t* luma, uint32_t luma_row_pitch, const uint8_t* chroma, uint32_t chroma_row_pitch, uint32_t width,
+        uint32_t height, uint8_t* rgba, uint32_t rgba_row_pitch);
+} // namespace MotionToGo
@@ -0,0 +1,105 @@
+#include "CpuColorConversionKernels.hpp"
+
+#include <immintrin.h>
+
+using namespace MotionToGo::ColorConversion;
+
+namespace
+{
+    // 8 int32 in [0, 255] to 8 bytes
+    void Store8Bytes(uint8_t* dst, __m256i value) noexcept
+    {
+        const __m256i words = _mm256_packus_epi32(value, value);
+        // The packs work in 128-bit lanes, the results are in the first dword of each lane
+        const __m256i bytes = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(words, words), _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0, 0));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst), _mm256_castsi256_si128(bytes));
+    }
+
+    // value * scale + offset, truncated like the shader does
+    __m256i ScaleOffsetToInt(__m256 value, float scale, float offset) noexcept
+    {
+        return _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(value, _mm256_set1_ps(scale)), _mm256_set1_ps(offset)));
+    }
+
+    __m256i FloatToUnorm8(__m256 value) noexcept
+    {
+        value = _mm256_min_ps(_mm256_max_ps(value, _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+        return ScaleOffsetToInt(value, 255, 0.5f);
+    }
+} // namespace
+
+namespace MotionToGo
+{
+    void RgbaToNv12RowsAvx2(const uint8_t* rgba_row0, const uint8_t* rgba_row1, uint32_t width, uint8_t* luma_row0, uint8_t* luma_row1,
+        uint8_t* chroma_row)
+    {
+        const __m256i byte_mask = _mm256_set1_epi32(0xFF);
+        const __m256 unorm_scale = _mm256_set1_ps(255.0f);
+
+        const uint8_t* rgba_rows[] = {rgba_row0, rgba_row1};
+        uint8_t* luma_rows[] = {luma_row0, luma_row1};
+
+        uint32_t x = 0;
+        for (; x + 8 <= width; x += 8)
+        {
+            __m256i cb_sum = _mm256_setzero_si256();
+            __m256i cr_sum = _mm256_setzero_si256();
+            for (uint32_t dy = 0; dy < 2; ++dy)
+            {
+                const __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&rgba_rows[dy][x * 4]));
+                const __m256 r = _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_and_si256(pixels, byte_mask)), unorm_scale);
+                const __m256 g = _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(pixels, 8), byte_mask)), unorm_scale);
+                const __m256 b =
+                    _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(pixels, 16), byte_mask)), unorm_scale);
+
+                const __m256 luma = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(Kr), r), _mm256_mul_ps(_mm256_set1_ps(Kg), g)),
+                    _mm256_mul_ps(_mm256_set1_ps(Kb), b));
+                const __m256 cb = _mm256_div_ps(_mm256_sub_ps(b, luma), _mm256_set1_ps(Kcb));
+                const __m256 cr = _mm256_div_ps(_mm256_sub_ps(r, luma), _mm256_set1_ps(Kcr));
+
+                Store8Bytes(&luma_rows[dy][x], ScaleOffsetToInt(luma, 219, 16));
+                cb_sum = _mm256_add_epi32(cb_sum, ScaleOffsetToInt(cb, 224, 128));
+                cr_sum = _mm256_add_epi32(cr_sum, ScaleOffsetToInt(cr, 224, 128));
+            }
+
+            // Per lane, cb01, cb23, cr01, cr23 -> cb01, cr01, cb23, cr23
+            __m256i uv = _mm256_shuffle_epi32(_mm256_hadd_epi32(cb_sum, cr_sum), _MM_SHUFFLE(3, 1, 2, 0));
+            uv = _mm256_srli_epi32(_mm256_add_epi32(uv, _mm256_set1_epi32(2)), 2);
+            Store8Bytes(&chroma_row[x], uv);
+        }
+
+        RgbaToNv12RowsScalar(rgba_row0, rgba_row1, x, width, luma_row0, luma_row1, chroma_row);
+    }
+
+    void Nv12ToRgbaRowAvx2(const uint8_t* luma_row, const uint8_t* chroma_row, uint32_t width, uint8_t* rgba_row)
+    {
+        const __m256i alpha = _mm256_set1_epi32(static_cast<int>(0xFF000000));
+        const __m256i cb_index = _mm256_setr_epi32(0, 0, 2, 2, 4, 4, 6, 6);
+        const __m256i cr_index = _mm256_setr_epi32(1, 1, 3, 3, 5, 5, 7, 7);
+
+        uint32_t x = 0;
+        for (; x + 8 <= width; x += 8)
+        {
+            const __m256i luma_int = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(&luma_row[x])));
+            // Each chroma pair covers 2 pixels. Converting before expanding them halves the divisions.
+            const __m256i uv_int = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(&chroma_row[x])));
+            const __m256 uv = _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_sub_epi32(uv_int, _mm256_set1_epi32(128))), _mm256_set1_ps(224.0f));
+            const __m256 cb = _mm256_permutevar8x32_ps(uv, cb_index);
+            const __m256 cr = _mm256_permutevar8x32_ps(uv, cr_index);
+
+            const __m256 luma =
+                _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_sub_epi32(luma_int, _mm256_set1_epi32(16))), _mm256_set1_ps(219.0f));
+
+            const __m256i r = FloatToUnorm8(_mm256_add_ps(luma, _mm256_mul_ps(_mm256_set1_ps(Kcr), cr)));
+            const __m256i g = FloatToUnorm8(
+                _mm256_sub_ps(_mm256_sub_ps(luma, _mm256_mul_ps(_mm256_set1_ps(KgCb), cb)), _mm256_mul_ps(_mm256_set1_ps(KgCr), cr)));
+            const __m256i b = FloatToUnorm8(_mm256_add_ps(luma, _mm256_mul_ps(_mm256_set1_ps(Kcb), cb)));
+
+            const __m256i rgba =
+                _mm256_or_si256(_mm256_or_si256(r, _mm256_slli_epi32(g, 8)), _mm256_or_si256(_mm256_slli_epi32(b, 16), alpha));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(&rgba_row[x * 4]), rgba);
+        }
+
+        Nv12ToRgbaRowScalar(luma_row, chroma_row, x, width, rgba_row);
+    }
+} // namespace MotionToGo
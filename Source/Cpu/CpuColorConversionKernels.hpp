@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+
+// Row kernels behind CpuColorConversion.hpp. Every variant does the same float operations in the same order as the scalar one, and
+// none of them may be contracted to FMA, so they produce identical bytes.
+#if defined(_MSC_VER) && !defined(__clang__)
+#pragma float_control(precise, on)
+#pragma fp_contract(off)
+#endif
+
+namespace MotionToGo
+{
+    namespace ColorConversion
+    {
+        // BT.2020, same as the shaders
+        constexpr float Kr = 0.2627f;
+        constexpr float Kb = 0.0593f;
+        constexpr float Kg = 1 - Kr - Kb;
+        constexpr float Kcr = (1 - Kr) / 0.5f;
+        constexpr float Kcb = (1 - Kb) / 0.5f;
+        constexpr float KgCb = Kb * Kcb / Kg;
+        constexpr float KgCr = Kr * Kcr / Kg;
+    } // namespace ColorConversion
+
+    // Converts the columns [x_begin, width) of 2 rows. x_begin and width MUST be even.
+    void RgbaToNv12RowsScalar(const uint8_t* rgba_row0, const uint8_t* rgba_row1, uint32_t x_begin, uint32_t width, uint8_t* luma_row0,
+        uint8_t* luma_row1, uint8_t* chroma_row);
+    void RgbaToNv12RowsSse41(const uint8_t* rgba_row0, const uint8_t* rgba_row1, uint32_t width, uint8_t* luma_row0, uint8_t* luma_row1,
+        uint8_t* chroma_row);
+    void RgbaToNv12RowsAvx2(const uint8_t* rgba_row0, const uint8_t* rgba_row1, uint32_t width, uint8_t* luma_row0, uint8_t* luma_row1,
+        uint8_t* chroma_row);
+
+    // Converts the columns [x_begin, width) of a row. x_begin and width MUST be even.
+    void Nv12ToRgbaRowScalar(const uint8_t* luma_row, const uint8_t* chroma_row, uint32_t x_begin, uint32_t width, uint8_t* rgba_row);
+    void Nv12ToRgbaRowSse41(const uint8_t* luma_row, const uint8_t* chroma_row, uint32_t width, uint8_t* rgba_row);
+    void Nv12ToRgbaRowAvx2(const uint8_t* luma_row, const uint8_t* chroma_row, uint32_t width, uint8_t* rgba_row);
+} // namespace MotionToGo
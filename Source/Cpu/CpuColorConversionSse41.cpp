@@ -0,0 +1,98 @@
+#include "CpuColorConversionKernels.hpp"
+
+#include <smmintrin.h>
+
+using namespace MotionToGo::ColorConversion;
+
+namespace
+{
+    // 4 int32 in [0, 255] to 4 bytes
+    void Store4Bytes(uint8_t* dst, __m128i value) noexcept
+    {
+        const __m128i words = _mm_packus_epi32(value, value);
+        _mm_storeu_si32(dst, _mm_packus_epi16(words, words));
+    }
+
+    // value * scale + offset, truncated like the shader does
+    __m128i ScaleOffsetToInt(__m128 value, float scale, float offset) noexcept
+    {
+        return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(value, _mm_set1_ps(scale)), _mm_set1_ps(offset)));
+    }
+
+    __m128i FloatToUnorm8(__m128 value) noexcept
+    {
+        value = _mm_min_ps(_mm_max_ps(value, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+        return ScaleOffsetToInt(value, 255, 0.5f);
+    }
+} // namespace
+
+namespace MotionToGo
+{
+    void RgbaToNv12RowsSse41(const uint8_t* rgba_row0, const uint8_t* rgba_row1, uint32_t width, uint8_t* luma_row0, uint8_t* luma_row1,
+        uint8_t* chroma_row)
+    {
+        const __m128i byte_mask = _mm_set1_epi32(0xFF);
+        const __m128 unorm_scale = _mm_set1_ps(255.0f);
+
+        const uint8_t* rgba_rows[] = {rgba_row0, rgba_row1};
+        uint8_t* luma_rows[] = {luma_row0, luma_row1};
+
+        uint32_t x = 0;
+        for (; x + 4 <= width; x += 4)
+        {
+            __m128i cb_sum = _mm_setzero_si128();
+            __m128i cr_sum = _mm_setzero_si128();
+            for (uint32_t dy = 0; dy < 2; ++dy)
+            {
+                const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&rgba_rows[dy][x * 4]));
+                const __m128 r = _mm_div_ps(_mm_cvtepi32_ps(_mm_and_si128(pixels, byte_mask)), unorm_scale);
+                const __m128 g = _mm_div_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(pixels, 8), byte_mask)), unorm_scale);
+                const __m128 b = _mm_div_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(pixels, 16), byte_mask)), unorm_scale);
+
+                const __m128 luma = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(_mm_set1_ps(Kr), r), _mm_mul_ps(_mm_set1_ps(Kg), g)), _mm_mul_ps(_mm_set1_ps(Kb), b));
+                const __m128 cb = _mm_div_ps(_mm_sub_ps(b, luma), _mm_set1_ps(Kcb));
+                const __m128 cr = _mm_div_ps(_mm_sub_ps(r, luma), _mm_set1_ps(Kcr));
+
+                Store4Bytes(&luma_rows[dy][x], ScaleOffsetToInt(luma, 219, 16));
+                cb_sum = _mm_add_epi32(cb_sum, ScaleOffsetToInt(cb, 224, 128));
+                cr_sum = _mm_add_epi32(cr_sum, ScaleOffsetToInt(cr, 224, 128));
+            }
+
+            // cb01, cb23, cr01, cr23 -> cb01, cr01, cb23, cr23
+            __m128i uv = _mm_shuffle_epi32(_mm_hadd_epi32(cb_sum, cr_sum), _MM_SHUFFLE(3, 1, 2, 0));
+            uv = _mm_srli_epi32(_mm_add_epi32(uv, _mm_set1_epi32(2)), 2);
+            Store4Bytes(&chroma_row[x], uv);
+        }
+
+        RgbaToNv12RowsScalar(rgba_row0, rgba_row1, x, width, luma_row0, luma_row1, chroma_row);
+    }
+
+    void Nv12ToRgbaRowSse41(const uint8_t* luma_row, const uint8_t* chroma_row, uint32_t width, uint8_t* rgba_row)
+    {
+        const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xFF000000));
+
+        uint32_t x = 0;
+        for (; x + 4 <= width; x += 4)
+        {
+            const __m128i luma_int = _mm_cvtepu8_epi32(_mm_loadu_si32(&luma_row[x]));
+            // Each chroma pair covers 2 pixels. Converting before expanding them halves the divisions.
+            const __m128i uv_int = _mm_cvtepu8_epi32(_mm_loadu_si32(&chroma_row[x]));
+            const __m128 uv = _mm_div_ps(_mm_cvtepi32_ps(_mm_sub_epi32(uv_int, _mm_set1_epi32(128))), _mm_set1_ps(224.0f));
+            const __m128 cb = _mm_shuffle_ps(uv, uv, _MM_SHUFFLE(2, 2, 0, 0));
+            const __m128 cr = _mm_shuffle_ps(uv, uv, _MM_SHUFFLE(3, 3, 1, 1));
+
+            const __m128 luma = _mm_div_ps(_mm_cvtepi32_ps(_mm_sub_epi32(luma_int, _mm_set1_epi32(16))), _mm_set1_ps(219.0f));
+
+            const __m128i r = FloatToUnorm8(_mm_add_ps(luma, _mm_mul_ps(_mm_set1_ps(Kcr), cr)));
+            const __m128i g = FloatToUnorm8(
+                _mm_sub_ps(_mm_sub_ps(luma, _mm_mul_ps(_mm_set1_ps(KgCb), cb)), _mm_mul_ps(_mm_set1_ps(KgCr), cr)));
+            const __m128i b = FloatToUnorm8(_mm_add_ps(luma, _mm_mul_ps(_mm_set1_ps(Kcb), cb)));
+
+            const __m128i rgba = _mm_or_si128(_mm_or_si128(r, _mm_slli_epi32(g, 8)), _mm_or_si128(_mm_slli_epi32(b, 16), alpha));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&rgba_row[x * 4]), rgba);
+        }
+
+        Nv12ToRgbaRowScalar(luma_row, chroma_row, x, width, rgba_row);
+    }
+} // namespace MotionToGo
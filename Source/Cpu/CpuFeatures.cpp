@@ -0,0 +1,90 @@
+#include "CpuFeatures.hpp"
+
+#include <algorithm>
+#include <atomic>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+using namespace MotionToGo;
+
+namespace
+{
+    CpuSimdLevel Detect() noexcept
+    {
+#ifdef _MSC_VER
+        int regs[4];
+        __cpuid(regs, 0);
+        const int max_leaf = regs[0];
+
+        __cpuid(regs, 1);
+        const bool sse41 = (regs[2] & (1 << 19)) != 0;
+        const bool os_xsave = (regs[2] & (1 << 27)) != 0;
+        const bool avx = (regs[2] & (1 << 28)) != 0;
+
+        bool avx2 = false;
+        // The OS must save the YMM registers on context switches
+        if ((max_leaf >= 7) && os_xsave && avx && ((_xgetbv(0) & 0x6) == 0x6))
+        {
+            __cpuidex(regs, 7, 0);
+            avx2 = (regs[1] & (1 << 5)) != 0;
+        }
+#else
+        __builtin_cpu_init();
+        const bool sse41 = __builtin_cpu_supports("sse4.1");
+        const bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+
+        if (avx2 && sse41)
+        {
+            return CpuSimdLevel::Avx2;
+        }
+        if (sse41)
+        {
+            return CpuSimdLevel::Sse41;
+        }
+        return CpuSimdLevel::Scalar;
+    }
+
+    std::atomic<CpuSimdLevel>& ActiveLevel() noexcept
+    {
+        static std::atomic<CpuSimdLevel> level(DetectedCpuSimdLevel());
+        return level;
+    }
+} // namespace
+
+namespace MotionToGo
+{
+    CpuSimdLevel DetectedCpuSimdLevel() noexcept
+    {
+        static const CpuSimdLevel level = Detect();
+        return level;
+    }
+
+    CpuSimdLevel ActiveCpuSimdLevel() noexcept
+    {
+        return ActiveLevel().load(std::memory_order_relaxed);
+    }
+
+    void SetCpuSimdLevel(CpuSimdLevel level) noexcept
+    {
+        ActiveLevel().store(std::min(level, DetectedCpuSimdLevel()), std::memory_order_relaxed);
+    }
+
+    const char* CpuSimdLevelName(CpuSimdLevel level) noexcept
+    {
+        switch (level)
+        {
+        case CpuSimdLevel::Sse41:
+            return "SSE4.1";
+
+        case CpuSimdLevel::Avx2:
+            return "AVX2";
+
+        default:
+            return "Scalar";
+        }
+    }
+} // namespace MotionToGo
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+
+namespace MotionToGo
+{
+    enum class CpuSimdLevel : uint32_t
+    {
+        Scalar,
+        Sse41,
+        Avx2,
+    };
+
+    // The highest level both the CPU and the OS support.
+    CpuSimdLevel DetectedCpuSimdLevel() noexcept;
+
+    // The level the CPU kernels dispatch to. It's the detected one unless lowered by SetCpuSimdLevel, for testing and benchmarking.
+    CpuSimdLevel ActiveCpuSimdLevel() noexcept;
+    // Clamped to the detected level.
+    void SetCpuSimdLevel(CpuSimdLevel level) noexcept;
+
+    const char* CpuSimdLevelName(CpuSimdLevel level) noexcept;
+} // namespace MotionToGo
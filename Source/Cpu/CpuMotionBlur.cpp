@@ -0,0 +1,1087 @@
+#include "CpuMotionBlur.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <random>
+
+#include "CpuFeatures.hpp"
+#include "CpuMotionBlurKernels.hpp"
+#include "Trace/Trace.hpp"
+
+using namespace MotionToGo;
+
+namespace
+{
+    constexpr float Epsilon = 0.01f;
+    constexpr float HalfVelocityCutoff = 0.2f;
+    constexpr float VarianceThreshold = 1.5f;
+    constexpr float WeightCorrectionFactor = 60;
+    // Of the adaptive sample counts. Denser gains little, the taps sample bilinearly.
+    constexpr float TapsPerBlurPixel = 1;
+
+    struct Float2
+    {
+        float x;
+        float y;
+    };
+
+    float Length(const Float2& v) noexcept
+    {
+        return std::sqrt(v.x * v.x + v.y * v.y);
+    }
+
+    // HLSL's clamp, without std::clamp's requirement of min <= max
+    float Clamp(float value, float min_value, float max_value) noexcept
+    {
+        return std::min(std::max(value, min_value), max_value);
+    }
+
+    // The weights are functions of the ratio of the tap distance to the blur length. Cone is 1 - ratio, Cylinder is
+    // 1 - smoothstep(0.95, 1.05, ratio), tabulated over the corners.
+    constexpr float CylinderCorner1 = 0.95f;
+    constexpr float CylinderCorner2 = 1.05f;
+    constexpr uint32_t CylinderTableSize = 64;
+    constexpr std::array<float, CylinderTableSize + 1> CylinderTable = [] {
+        std::array<float, CylinderTableSize + 1> table{};
+        for (uint32_t i = 0; i <= CylinderTableSize; ++i)
+        {
+            const float t = static_cast<float>(i) / CylinderTableSize;
+            table[i] = 1 - t * t * (3 - 2 * t);
+        }
+        return table;
+    }();
+
+    float Cylinder(float ratio) noexcept
+    {
+        if (ratio <= CylinderCorner1)
+        {
+            return 1;
+        }
+        if (ratio >= CylinderCorner2)
+        {
+            return 0;
+        }
+
+        const float x = (ratio - CylinderCorner1) * (CylinderTableSize / (CylinderCorner2 - CylinderCorner1));
+        const uint32_t index = std::min(static_cast<uint32_t>(x), CylinderTableSize - 1);
+        const float frac = x - index;
+        return CylinderTable[index] + (CylinderTable[index + 1] - CylinderTable[index]) * frac;
+    }
+
+    Float2 DecodeVelocity(const uint8_t* texel) noexcept
+    {
+        return {texel[0] / 255.0f * 2 - 1, texel[1] / 255.0f * 2 - 1};
+    }
+
+    // HLSL's lerp. std::lerp guarantees more, and costs branches for it.
+    float Lerp(float a, float b, float t) noexcept
+    {
+        return a + (b - a) * t;
+    }
+
+    // std::floor is a call without SSE4.1
+    int32_t FloorToInt(float value) noexcept
+    {
+        const int32_t truncated = static_cast<int32_t>(value);
+        return truncated - (value < truncated);
+    }
+
+    uint8_t ToUnorm8(float value) noexcept
+    {
+        return static_cast<uint8_t>(Clamp(value, 0, 1) * 255 + 0.5f);
+    }
+
+    // Point sampler with clamp addressing
+    uint32_t TexelIndex(float coord, uint32_t size) noexcept
+    {
+        return static_cast<uint32_t>(Clamp(std::floor(coord * size), 0, size - 1.0f));
+    }
+
+    // The texels the point sampler picks for pixels [first_pixel, last_pixel] along one axis. The margin keeps it conservative
+    // when the GPU rounds the texture coordinates differently.
+    void TexelRange(uint32_t first_pixel, uint32_t last_pixel, float inv_size, uint32_t num_texels, uint32_t& first, uint32_t& last)
+    {
+        constexpr float Margin = 1e-3f;
+        first = static_cast<uint32_t>(std::max(std::floor((first_pixel + 0.5f) * inv_size * num_texels - Margin), 0.0f));
+        last = std::min(static_cast<uint32_t>(std::floor((last_pixel + 0.5f) * inv_size * num_texels + Margin)), num_texels - 1);
+    }
+
+    // The motion vectors are for preview_scale times the size of the frame. It divides MotionBlurTileSize, so the count is the same
+    // as the full resolution frame's.
+    uint32_t MotionVectorTiles(uint32_t pixels, uint32_t preview_scale) noexcept
+    {
+        return (pixels * preview_scale + MotionBlurTileSize - 1) / MotionBlurTileSize;
+    }
+
+    // Orders the quantized vectors by length, then by value. 0 is below all of them.
+    uint32_t VelocityKey(const uint8_t* texel) noexcept
+    {
+        const int32_t dx = texel[0] - 128;
+        const int32_t dy = texel[1] - 128;
+        return (static_cast<uint32_t>(dx * dx + dy * dy) << 16) | (texel[0] << 8) | texel[1];
+    }
+
+    // Along x, into a transposed output, so running it twice covers both axes
+    void DilateRowsTransposed(const uint32_t* keys, uint32_t width, uint32_t height, uint32_t radius, uint32_t* output)
+    {
+        const uint32_t window = radius * 2 + 1;
+        std::vector<uint32_t> suffix_max(window);
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            const uint32_t* row = &keys[y * width];
+            const auto key_at = [row, width](int32_t x) { return (x >= 0) && (x < static_cast<int32_t>(width)) ? row[x] : 0; };
+
+            // The windows of a block of outputs span 2 blocks of inputs. Each is the max of a suffix of the first and a prefix of
+            // the second.
+            for (uint32_t block = 0; block < width; block += window)
+            {
+                const int32_t first = static_cast<int32_t>(block) - static_cast<int32_t>(radius);
+
+                suffix_max[window - 1] = key_at(first + window - 1);
+                for (int32_t i = window - 2; i >= 0; --i)
+                {
+                    suffix_max[i] = std::max(suffix_max[i + 1], key_at(first + i));
+                }
+
+                uint32_t prefix_max = 0;
+                for (uint32_t i = 0; (i < window) && (block + i < width); ++i)
+                {
+                    output[(block + i) * height + y] = std::max(suffix_max[i], prefix_max);
+                    prefix_max = std::max(prefix_max, key_at(first + window + i));
+                }
+            }
+        }
+    }
+
+    bool IsStaticVelocity(const CpuMotionBlurParams& params, const Float2& vel) noexcept
+    {
+        return Clamp(Length(vel) * params.half_exposure, 0.1f, params.blur_radius) < HalfVelocityCutoff;
+    }
+
+    // RGB in Q4, in [0, 255 * 16]
+    void FilterFixedPoint(const FixedPointTap& tap, int32_t color[3]) noexcept
+    {
+        for (uint32_t c = 0; c < 3; ++c)
+        {
+            // Q8, fits in 16 bits
+            const int32_t top = tap.texels[0][c] * (256 - tap.tx) + tap.texels[1][c] * tap.tx;
+            const int32_t bottom = tap.texels[2][c] * (256 - tap.tx) + tap.texels[3][c] * tap.tx;
+            color[c] = (top * (256 - tap.ty) + bottom * tap.ty + (1 << 11)) >> 12;
+        }
+    }
+
+    struct GatherContext
+    {
+        const CpuMotionBlurParams& params;
+        // Frame rows [rgba_first_row, rgba_first_row + rgba_rows), the output rows from output_first_row on
+        const uint8_t* rgba;
+        uint32_t rgba_first_row;
+        uint32_t rgba_rows;
+        uint32_t output_first_row;
+        const uint8_t* motion_vectors;
+        // 1 / the clamped blur length of each motion vector texel, computed once instead of per tap
+        const float* inv_blur_lengths;
+        const uint8_t* neighbor_max;
+        std::span<const uint8_t> random_tile;
+        uint32_t tiles_x;
+        uint32_t tiles_y;
+        uint32_t neighbor_max_x;
+        uint32_t neighbor_max_y;
+        float inv_width;
+        float inv_height;
+
+        Float2 SampleVelocity(float u, float v) const noexcept
+        {
+            return DecodeVelocity(&motion_vectors[(TexelIndex(v, tiles_y) * tiles_x + TexelIndex(u, tiles_x)) * 2]);
+        }
+
+        float SampleInvBlurLength(float u, float v) const noexcept
+        {
+            return inv_blur_lengths[TexelIndex(v, tiles_y) * tiles_x + TexelIndex(u, tiles_x)];
+        }
+
+        Float2 SampleNeighborMax(float u, float v) const noexcept
+        {
+            return DecodeVelocity(&neighbor_max[(TexelIndex(v, neighbor_max_y) * neighbor_max_x + TexelIndex(u, neighbor_max_x)) * 2]);
+        }
+
+        float SampleRandom(float u, float v) const noexcept
+        {
+            const uint32_t x = TexelIndex(u, MotionBlurRandomTileSize);
+            const uint32_t y = TexelIndex(v, MotionBlurRandomTileSize);
+            return random_tile[y * MotionBlurRandomTileSize + x] / 255.0f;
+        }
+
+        const uint8_t* Texel(uint32_t x, uint32_t y) const noexcept
+        {
+            assert(y - rgba_first_row < rgba_rows);
+            return &rgba[((y - rgba_first_row) * params.width + x) * 4];
+        }
+
+        // Bilinear with clamp addressing, in [0, 1]
+        void SampleColor(float u, float v, float color[4]) const noexcept
+        {
+            const float x = u * params.width - 0.5f;
+            const float y = v * params.height - 0.5f;
+            const float floor_x = std::floor(x);
+            const float floor_y = std::floor(y);
+            const float tx = x - floor_x;
+            const float ty = y - floor_y;
+
+            const int32_t max_x = static_cast<int32_t>(params.width) - 1;
+            const int32_t max_y = static_cast<int32_t>(params.height) - 1;
+            const uint32_t x0 = std::clamp(static_cast<int32_t>(floor_x), 0, max_x);
+            const uint32_t x1 = std::clamp(static_cast<int32_t>(floor_x) + 1, 0, max_x);
+            const uint32_t y0 = std::clamp(static_cast<int32_t>(floor_y), 0, max_y);
+            const uint32_t y1 = std::clamp(static_cast<int32_t>(floor_y) + 1, 0, max_y);
+
+            const uint8_t* p00 = this->Texel(x0, y0);
+            const uint8_t* p10 = this->Texel(x1, y0);
+            const uint8_t* p01 = this->Texel(x0, y1);
+            const uint8_t* p11 = this->Texel(x1, y1);
+            for (uint32_t c = 0; c < 4; ++c)
+            {
+                const float top = Lerp(static_cast<float>(p00[c]), static_cast<float>(p10[c]), tx);
+                const float bottom = Lerp(static_cast<float>(p01[c]), static_cast<float>(p11[c]), tx);
+                color[c] = Lerp(top, bottom, ty) / 255;
+            }
+        }
+
+        // The texels and the subtexel position of a bilinear sample with clamp addressing, with 8 bits of subtexel precision like the
+        // GPU's filtering. FilterFixedPoint filters them.
+        void FixedPointFootprint(float u, float v, FixedPointTap& tap) const noexcept
+        {
+            const int32_t x = FloorToInt((u * params.width - 0.5f) * 256);
+            const int32_t y = FloorToInt((v * params.height - 0.5f) * 256);
+            tap.tx = x & 0xFF;
+            tap.ty = y & 0xFF;
+
+            const int32_t max_x = static_cast<int32_t>(params.width) - 1;
+            const int32_t max_y = static_cast<int32_t>(params.height) - 1;
+            const uint32_t x0 = std::clamp(x >> 8, 0, max_x);
+            const uint32_t x1 = std::clamp((x >> 8) + 1, 0, max_x);
+            const uint32_t y0 = std::clamp(y >> 8, 0, max_y);
+            const uint32_t y1 = std::clamp((y >> 8) + 1, 0, max_y);
+
+            std::memcpy(tap.texels[0], this->Texel(x0, y0), 4);
+            std::memcpy(tap.texels[1], this->Texel(x1, y0), 4);
+            std::memcpy(tap.texels[2], this->Texel(x0, y1), 4);
+            std::memcpy(tap.texels[3], this->Texel(x1, y1), 4);
+        }
+
+        // A NumSamples of 0 takes the count at runtime. The others are known at compile time, so the tap loop is unrolled. TapSum
+        // filters and accumulates the colors, FloatTapSum or FixedPointTapSum. Returns the number of taps.
+        template <uint32_t NumSamples, typename TapSum>
+        uint32_t GatherPixel(uint32_t x, uint32_t y, uint32_t runtime_num_samples, uint8_t* output) const noexcept
+        {
+            const uint32_t num_samples = NumSamples != 0 ? NumSamples : runtime_num_samples;
+
+            const float u = (x + 0.5f) * inv_width;
+            const float v = (y + 0.5f) * inv_height;
+
+            Float2 neighbor_vel = this->SampleNeighborMax(u, v);
+            const float len_neighbor_vel = Length(neighbor_vel);
+
+            float temp_neighbor_vel = len_neighbor_vel * params.half_exposure;
+            const bool flag_neighbor_vel = (temp_neighbor_vel >= Epsilon);
+            temp_neighbor_vel = Clamp(temp_neighbor_vel, 0.1f, params.blur_radius);
+
+            uint8_t* pixel = &output[((y - output_first_row) * params.width + x) * 4];
+            if (temp_neighbor_vel < HalfVelocityCutoff)
+            {
+                // The pixel center samples its texel exactly
+                std::memcpy(pixel, this->Texel(x, y), 4);
+                return 0;
+            }
+
+            if (flag_neighbor_vel)
+            {
+                neighbor_vel.x *= temp_neighbor_vel / len_neighbor_vel;
+                neighbor_vel.y *= temp_neighbor_vel / len_neighbor_vel;
+            }
+
+            Float2 curr_vel = this->SampleVelocity(u, v);
+            float len_curr_vel = Length(curr_vel);
+
+            float temp_curr_vel = len_curr_vel * params.half_exposure;
+            const bool flag_curr_vel = (temp_curr_vel >= Epsilon);
+            temp_curr_vel = Clamp(temp_curr_vel, 0.1f, params.blur_radius);
+            if (flag_curr_vel)
+            {
+                curr_vel.x *= temp_curr_vel / len_curr_vel;
+                curr_vel.y *= temp_curr_vel / len_curr_vel;
+                len_curr_vel = Length(curr_vel);
+            }
+
+            const float rand = this->SampleRandom(u * params.blur_radius, v * params.blur_radius) - 0.5f;
+
+            // If current velocity is too small, then we use neighbor velocity
+            Float2 corrected_vel = (len_curr_vel < VarianceThreshold) ? neighbor_vel : curr_vel;
+            const float len_corrected_vel = Length(corrected_vel);
+            corrected_vel.x /= len_corrected_vel;
+            corrected_vel.y /= len_corrected_vel;
+
+            const float weight = num_samples / WeightCorrectionFactor / temp_curr_vel;
+
+            TapSum sum(*this, u, v, weight, 1 / temp_curr_vel);
+
+            const uint32_t self_index = (num_samples - 1) / 2;
+
+            // The taps are evenly spaced in [-max_distance, max_distance], shifted by the jitter
+            assert(num_samples <= MaxMotionBlurReconstructionSamples);
+            const float max_distance = params.max_sample_tap_distance * inv_width;
+            const float tap_step = 2 * max_distance / (num_samples + 1);
+            const float first_t = (rand + 1) * tap_step - max_distance;
+            const float half_texel = 0.5f * inv_width;
+
+            for (uint32_t i = 0; i < num_samples; ++i)
+            {
+                if (i != self_index)
+                {
+                    const float t = first_t + i * tap_step;
+
+                    const Float2& velocity = ((i & 1) == 1) ? corrected_vel : neighbor_vel;
+
+                    const float sample_u = u + velocity.x * t + half_texel;
+                    const float sample_v = v + velocity.y * t + half_texel;
+
+                    sum.Add(*this, sample_u, sample_v, std::abs(t), this->SampleInvBlurLength(sample_u, sample_v));
+                }
+            }
+
+            sum.Store(pixel);
+            pixel[3] = 255;
+
+            return num_samples - 1;
+        }
+    };
+
+    struct FloatTapSum
+    {
+        float sum[4];
+        float inv_temp_curr_vel;
+
+        FloatTapSum(const GatherContext& context, float u, float v, float weight, float inv_temp_curr_vel) noexcept
+            : inv_temp_curr_vel(inv_temp_curr_vel)
+        {
+            float color[4];
+            context.SampleColor(u, v, color);
+            for (uint32_t c = 0; c < 3; ++c)
+            {
+                sum[c] = color[c] * weight;
+            }
+            sum[3] = weight;
+        }
+
+        void Add(const GatherContext& context, float u, float v, float abs_t, float inv_temp_sample_vel) noexcept
+        {
+            const float sample_ratio = abs_t * inv_temp_sample_vel;
+            const float curr_ratio = abs_t * inv_temp_curr_vel;
+
+            // alpha = foreground contribution + background contribution + blur of both foreground and background, 1 + Cone for each
+            const float weight = (2 - sample_ratio) + (2 - curr_ratio) + Cylinder(sample_ratio) * Cylinder(curr_ratio) * 2;
+
+            float color[4];
+            context.SampleColor(u, v, color);
+            for (uint32_t c = 0; c < 3; ++c)
+            {
+                sum[c] += color[c] * weight;
+            }
+            sum[3] += weight;
+        }
+
+        void Store(uint8_t* pixel) const noexcept
+        {
+            for (uint32_t c = 0; c < 3; ++c)
+            {
+                pixel[c] = ToUnorm8(sum[c] / sum[3]);
+            }
+        }
+    };
+
+    // Q4 colors times Q8 weights, both in 16 bits, accumulated in 32 bits. The center weight is at most 64 / 60 / 0.1 and the
+    // taps' at most 6, so 64 samples fit. Scalar filters and accumulates each tap as it comes, the SIMD levels keep the taps and
+    // filter and sum them all in Store.
+    template <CpuSimdLevel SimdLevel>
+    struct FixedPointTapSum
+    {
+        static constexpr int32_t One = 1 << 12;
+        // The center isn't a tap
+        static constexpr uint32_t MaxTaps = MaxMotionBlurReconstructionSamples - 1;
+
+        int32_t sum[4];
+        float inv_temp_curr_vel;
+        uint32_t num_taps = 0;
+        FixedPointTap taps[MaxTaps];
+
+        FixedPointTapSum(const GatherContext& context, float u, float v, float weight, float inv_temp_curr_vel) noexcept
+            : inv_temp_curr_vel(inv_temp_curr_vel)
+        {
+            const int32_t fixed_weight = static_cast<int32_t>(weight * 256 + 0.5f);
+            FixedPointTap center;
+            context.FixedPointFootprint(u, v, center);
+            int32_t color[3];
+            FilterFixedPoint(center, color);
+            for (uint32_t c = 0; c < 3; ++c)
+            {
+                sum[c] = color[c] * fixed_weight;
+            }
+            sum[3] = fixed_weight;
+        }
+
+        void Add(const GatherContext& context, float u, float v, float abs_t, float inv_temp_sample_vel) noexcept
+        {
+            // Cone and Cylinder of the ratios, in Q12
+            const int32_t sample_ratio = ToFixedPoint(abs_t * inv_temp_sample_vel);
+            const int32_t curr_ratio = ToFixedPoint(abs_t * inv_temp_curr_vel);
+            const int32_t weight = 2 * One + (One - sample_ratio) + (One - curr_ratio) +
+                                   ((Cylinder(sample_ratio) * Cylinder(curr_ratio)) >> 11);
+            const int32_t fixed_weight = (weight + 8) >> 4;
+
+            if constexpr (SimdLevel == CpuSimdLevel::Scalar)
+            {
+                FixedPointTap tap;
+                context.FixedPointFootprint(u, v, tap);
+                tap.weight = fixed_weight;
+                FixedPointTapSumScalar(&tap, 0, 1, sum);
+            }
+            else
+            {
+                assert(num_taps < MaxTaps);
+                FixedPointTap& tap = taps[num_taps];
+                context.FixedPointFootprint(u, v, tap);
+                tap.weight = fixed_weight;
+                ++num_taps;
+            }
+        }
+
+        void Store(uint8_t* pixel) const noexcept
+        {
+            int32_t total[4] = {sum[0], sum[1], sum[2], sum[3]};
+            if constexpr (SimdLevel == CpuSimdLevel::Avx2)
+            {
+                FixedPointTapSumAvx2(taps, num_taps, total);
+            }
+            else if constexpr (SimdLevel == CpuSimdLevel::Sse41)
+            {
+                FixedPointTapSumSse41(taps, num_taps, total);
+            }
+
+            // Rounded, from Q4 to 8 bits
+            const int32_t divisor = std::max(total[3], 1) * 16;
+            for (uint32_t c = 0; c < 3; ++c)
+            {
+                pixel[c] = static_cast<uint8_t>(std::clamp((total[c] + divisor / 2) / divisor, 0, 255));
+            }
+        }
+
+        // The ratios past 2 only make the cone more negative, the weights stay in 16 bits
+        static int32_t ToFixedPoint(float ratio) noexcept
+        {
+            return static_cast<int32_t>(std::min(ratio, 2.0f) * One + 0.5f);
+        }
+
+        // The float table in Q12
+        static constexpr std::array<int32_t, CylinderTableSize + 1> CylinderTable = [] {
+            std::array<int32_t, CylinderTableSize + 1> table{};
+            for (uint32_t i = 0; i <= CylinderTableSize; ++i)
+            {
+                table[i] = static_cast<int32_t>(::CylinderTable[i] * One + 0.5f);
+            }
+            return table;
+        }();
+
+        static int32_t Cylinder(int32_t ratio) noexcept
+        {
+            constexpr int32_t Corner1 = static_cast<int32_t>(CylinderCorner1 * One + 0.5f);
+            constexpr int32_t Corner2 = static_cast<int32_t>(CylinderCorner2 * One + 0.5f);
+            if (ratio <= Corner1)
+            {
+                return One;
+            }
+            if (ratio >= Corner2)
+            {
+                return 0;
+            }
+
+            // Index in the high bits, lerp factor in the low 8
+            const int32_t x = (ratio - Corner1) * (CylinderTableSize << 8) / (Corner2 - Corner1);
+            const int32_t index = x >> 8;
+            const int32_t frac = x & 0xFF;
+            return (CylinderTable[index] * (256 - frac) + CylinderTable[index + 1] * frac + 128) >> 8;
+        }
+    };
+
+    template <uint32_t NumSamples, typename TapSum>
+    uint64_t GatherTile(const GatherContext& context, uint32_t tile_x, uint32_t tile_y, uint32_t num_samples, uint8_t* output)
+    {
+        const CpuMotionBlurParams& params = context.params;
+        const uint32_t first_x = tile_x * MotionBlurTileSize;
+        const uint32_t first_y = tile_y * MotionBlurTileSize;
+        const uint32_t end_x = std::min(first_x + MotionBlurTileSize, params.width);
+        const uint32_t end_y = std::min(first_y + MotionBlurTileSize, params.height);
+
+        uint64_t num_taps = 0;
+        for (uint32_t y = first_y; y < end_y; ++y)
+        {
+            for (uint32_t x = first_x; x < end_x; ++x)
+            {
+                num_taps += context.GatherPixel<NumSamples, TapSum>(x, y, num_samples, output);
+            }
+        }
+        return num_taps;
+    }
+
+    template <typename TapSum>
+    uint64_t ReconstructTile(const GatherContext& context, uint32_t tile_x, uint32_t tile_y, uint8_t* output)
+    {
+        const uint32_t num_samples = MotionBlurTileSamples(context.params, context.neighbor_max, tile_x, tile_y);
+        if (!context.params.specialized_samples)
+        {
+            return GatherTile<0, TapSum>(context, tile_x, tile_y, num_samples, output);
+        }
+
+        // The common quality presets
+        switch (num_samples)
+        {
+        case 7:
+            return GatherTile<7, TapSum>(context, tile_x, tile_y, num_samples, output);
+
+        case 11:
+            return GatherTile<11, TapSum>(context, tile_x, tile_y, num_samples, output);
+
+        case 15:
+            return GatherTile<15, TapSum>(context, tile_x, tile_y, num_samples, output);
+
+        case 23:
+            return GatherTile<23, TapSum>(context, tile_x, tile_y, num_samples, output);
+
+        default:
+            return GatherTile<0, TapSum>(context, tile_x, tile_y, num_samples, output);
+        }
+    }
+
+    uint64_t ReconstructTile(const GatherContext& context, uint32_t tile_x, uint32_t tile_y, uint8_t* output)
+    {
+        if (context.params.fixed_point)
+        {
+            switch (ActiveCpuSimdLevel())
+            {
+            case CpuSimdLevel::Avx2:
+                return ReconstructTile<FixedPointTapSum<CpuSimdLevel::Avx2>>(context, tile_x, tile_y, output);
+
+            case CpuSimdLevel::Sse41:
+                return ReconstructTile<FixedPointTapSum<CpuSimdLevel::Sse41>>(context, tile_x, tile_y, output);
+
+            default:
+                return ReconstructTile<FixedPointTapSum<CpuSimdLevel::Scalar>>(context, tile_x, tile_y, output);
+            }
+        }
+        return ReconstructTile<FloatTapSum>(context, tile_x, tile_y, output);
+    }
+
+    std::vector<float> InvBlurLengths(const CpuMotionBlurParams& params, const uint8_t* motion_vectors, uint32_t num_texels)
+    {
+        std::vector<float> inv_blur_lengths(num_texels);
+        for (uint32_t i = 0; i < num_texels; ++i)
+        {
+            const float len_vel = Length(DecodeVelocity(&motion_vectors[i * 2]));
+            inv_blur_lengths[i] = 1 / Clamp(len_vel * params.half_exposure, 0.1f, params.blur_radius);
+        }
+        return inv_blur_lengths;
+    }
+
+    // The rgba and the row ranges are left to the caller
+    GatherContext MakeGatherContext(const CpuMotionBlurParams& params, const uint8_t* motion_vectors, const float* inv_blur_lengths,
+        const uint8_t* neighbor_max, std::span<const uint8_t> random_tile) noexcept
+    {
+        const uint32_t motion_vector_x = MotionVectorTiles(params.width, params.preview_scale);
+        const uint32_t motion_vector_y = MotionVectorTiles(params.height, params.preview_scale);
+        return GatherContext{params, nullptr, 0, 0, 0, motion_vectors, inv_blur_lengths, neighbor_max, random_tile, motion_vector_x,
+            motion_vector_y, MotionBlurTileMaxSize(motion_vector_x, params.neighbor_max_tile_size),
+            MotionBlurTileMaxSize(motion_vector_y, params.neighbor_max_tile_size), 1.0f / params.width, 1.0f / params.height};
+    }
+
+    // The output rows [first_row, end_row), first_row on a tile boundary. The tile lists are in raster order, the tiles of the rows are
+    // a range of each.
+    uint64_t GatherRows(
+        const GatherContext& context, const MotionBlurTileLists* tile_lists, uint32_t first_row, uint32_t end_row, uint8_t* output)
+    {
+        const CpuMotionBlurParams& params = context.params;
+        assert(first_row % MotionBlurTileSize == 0);
+
+        const uint32_t tiles_x = (params.width + MotionBlurTileSize - 1) / MotionBlurTileSize;
+        const uint32_t first_tile_y = first_row / MotionBlurTileSize;
+        const uint32_t end_tile_y = (end_row + MotionBlurTileSize - 1) / MotionBlurTileSize;
+
+        uint64_t num_taps = 0;
+        if (tile_lists == nullptr)
+        {
+            for (uint32_t y = first_tile_y; y < end_tile_y; ++y)
+            {
+                for (uint32_t x = 0; x < tiles_x; ++x)
+                {
+                    num_taps += ReconstructTile(context, x, y, output);
+                }
+            }
+            return num_taps;
+        }
+
+        for (uint32_t tile_class = 0; tile_class < static_cast<uint32_t>(MotionBlurTileClass::Num); ++tile_class)
+        {
+            const std::vector<uint32_t>& tiles = tile_lists->tiles[tile_class];
+            const auto first_tile = std::lower_bound(tiles.begin(), tiles.end(), first_tile_y << 16);
+            const auto end_tile = std::lower_bound(first_tile, tiles.end(), end_tile_y << 16);
+            for (auto iter = first_tile; iter != end_tile; ++iter)
+            {
+                const uint32_t tile_x = *iter & 0xFFFF;
+                const uint32_t tile_y = *iter >> 16;
+                if (tile_class == static_cast<uint32_t>(MotionBlurTileClass::Static))
+                {
+                    const uint32_t first_x = tile_x * MotionBlurTileSize;
+                    const uint32_t end_x = std::min(first_x + MotionBlurTileSize, params.width);
+                    for (uint32_t y = tile_y * MotionBlurTileSize; y < std::min((tile_y + 1) * MotionBlurTileSize, end_row); ++y)
+                    {
+                        std::memcpy(&output[((y - first_row) * params.width + first_x) * 4], context.Texel(first_x, y),
+                            (end_x - first_x) * 4);
+                    }
+                }
+                else
+                {
+                    num_taps += ReconstructTile(context, tile_x, tile_y, output);
+                }
+            }
+        }
+
+        return num_taps;
+    }
+} // namespace
+
+namespace MotionToGo
+{
+    void FixedPointTapSumScalar(const FixedPointTap* taps, uint32_t first_tap, uint32_t num_taps, int32_t sum[4])
+    {
+        for (uint32_t i = first_tap; i < num_taps; ++i)
+        {
+            int32_t color[3];
+            FilterFixedPoint(taps[i], color);
+            for (uint32_t c = 0; c < 3; ++c)
+            {
+                sum[c] += color[c] * taps[i].weight;
+            }
+            sum[3] += taps[i].weight;
+        }
+    }
+
+    std::vector<uint8_t> GenerateMotionBlurRandomTile()
+    {
+        std::ranlux24_base gen;
+        std::uniform_int_distribution<> random_dis(0, 255);
+        std::vector<uint8_t> rand_data(MotionBlurRandomTileSize * MotionBlurRandomTileSize);
+        for (auto& value : rand_data)
+        {
+            value = static_cast<uint8_t>(random_dis(gen));
+        }
+        return rand_data;
+    }
+
+    uint32_t MotionBlurTileMaxSize(uint32_t tiles, uint32_t tile_size) noexcept
+    {
+        const uint32_t tiles_per_texel = tile_size / MotionBlurTileSize;
+        return (tiles + tiles_per_texel - 1) / tiles_per_texel;
+    }
+
+    void MotionBlurTileMax(const uint8_t* motion_vectors, uint32_t tiles_x, uint32_t tiles_y, uint32_t tile_size, uint8_t* tile_max)
+    {
+        GO_MOTION_TRACE_SCOPE("MotionBlurTileMax");
+
+        assert((tile_size >= MotionBlurTileSize) && (tile_size % MotionBlurTileSize == 0));
+
+        const uint32_t tiles_per_texel = tile_size / MotionBlurTileSize;
+        const uint32_t tile_max_x = MotionBlurTileMaxSize(tiles_x, tile_size);
+        const uint32_t tile_max_y = MotionBlurTileMaxSize(tiles_y, tile_size);
+        for (uint32_t y = 0; y < tile_max_y; ++y)
+        {
+            for (uint32_t x = 0; x < tile_max_x; ++x)
+            {
+                const uint8_t* max_texel = &motion_vectors[(y * tiles_per_texel * tiles_x + x * tiles_per_texel) * 2];
+                uint32_t max_key = VelocityKey(max_texel);
+                for (uint32_t ty = y * tiles_per_texel; ty < std::min((y + 1) * tiles_per_texel, tiles_y); ++ty)
+                {
+                    for (uint32_t tx = x * tiles_per_texel; tx < std::min((x + 1) * tiles_per_texel, tiles_x); ++tx)
+                    {
+                        const uint8_t* texel = &motion_vectors[(ty * tiles_x + tx) * 2];
+                        const uint32_t key = VelocityKey(texel);
+                        if (max_key < key)
+                        {
+                            max_key = key;
+                            max_texel = texel;
+                        }
+                    }
+                }
+
+                tile_max[(y * tile_max_x + x) * 2 + 0] = max_texel[0];
+                tile_max[(y * tile_max_x + x) * 2 + 1] = max_texel[1];
+            }
+        }
+    }
+
+    void MotionBlurNeighborMax(const uint8_t* tile_max, uint32_t width, uint32_t height, uint32_t radius, uint8_t* neighbor_max)
+    {
+        GO_MOTION_TRACE_SCOPE("MotionBlurNeighborMax");
+
+        std::vector<uint32_t> keys(width * height);
+        for (uint32_t i = 0; i < keys.size(); ++i)
+        {
+            keys[i] = VelocityKey(&tile_max[i * 2]);
+        }
+
+        std::vector<uint32_t> transposed(keys.size());
+        DilateRowsTransposed(keys.data(), width, height, radius, transposed.data());
+        DilateRowsTransposed(transposed.data(), height, width, radius, keys.data());
+
+        for (uint32_t i = 0; i < keys.size(); ++i)
+        {
+            neighbor_max[i * 2 + 0] = static_cast<uint8_t>(keys[i] >> 8);
+            neighbor_max[i * 2 + 1] = static_cast<uint8_t>(keys[i]);
+        }
+    }
+
+    MotionBlurTileLists ClassifyMotionBlurTiles(
+        const CpuMotionBlurParams& params, const uint8_t* motion_vectors, const uint8_t* neighbor_max)
+    {
+        GO_MOTION_TRACE_SCOPE("ClassifyMotionBlurTiles");
+
+        const uint32_t tiles_x = (params.width + MotionBlurTileSize - 1) / MotionBlurTileSize;
+        const uint32_t tiles_y = (params.height + MotionBlurTileSize - 1) / MotionBlurTileSize;
+        const uint32_t neighbor_max_x = MotionBlurTileMaxSize(tiles_x, params.neighbor_max_tile_size);
+        const uint32_t neighbor_max_y = MotionBlurTileMaxSize(tiles_y, params.neighbor_max_tile_size);
+        const float inv_width = 1.0f / params.width;
+        const float inv_height = 1.0f / params.height;
+
+        MotionBlurTileLists tile_lists;
+        for (uint32_t y = 0; y < tiles_y; ++y)
+        {
+            const uint32_t first_pixel_y = y * MotionBlurTileSize;
+            const uint32_t last_pixel_y = std::min((y + 1) * MotionBlurTileSize, params.height) - 1;
+            uint32_t first_texel_y;
+            uint32_t last_texel_y;
+            TexelRange(first_pixel_y, last_pixel_y, inv_height, tiles_y, first_texel_y, last_texel_y);
+            uint32_t first_neighbor_max_y;
+            uint32_t last_neighbor_max_y;
+            TexelRange(first_pixel_y, last_pixel_y, inv_height, neighbor_max_y, first_neighbor_max_y, last_neighbor_max_y);
+
+            for (uint32_t x = 0; x < tiles_x; ++x)
+            {
+                const uint32_t first_pixel_x = x * MotionBlurTileSize;
+                const uint32_t last_pixel_x = std::min((x + 1) * MotionBlurTileSize, params.width) - 1;
+                uint32_t first_texel_x;
+                uint32_t last_texel_x;
+                TexelRange(first_pixel_x, last_pixel_x, inv_width, tiles_x, first_texel_x, last_texel_x);
+                uint32_t first_neighbor_max_x;
+                uint32_t last_neighbor_max_x;
+                TexelRange(first_pixel_x, last_pixel_x, inv_width, neighbor_max_x, first_neighbor_max_x, last_neighbor_max_x);
+
+                const uint8_t* vel = &neighbor_max[(first_neighbor_max_y * neighbor_max_x + first_neighbor_max_x) * 2];
+                bool is_static = true;
+                bool is_uniform = true;
+                for (uint32_t ty = first_neighbor_max_y; ty <= last_neighbor_max_y; ++ty)
+                {
+                    for (uint32_t tx = first_neighbor_max_x; tx <= last_neighbor_max_x; ++tx)
+                    {
+                        const uint8_t* texel = &neighbor_max[(ty * neighbor_max_x + tx) * 2];
+                        is_static &= IsStaticVelocity(params, DecodeVelocity(texel));
+                        is_uniform &= (texel[0] == vel[0]) && (texel[1] == vel[1]);
+                    }
+                }
+
+                // The reconstruction taps reach into the neighbor tiles
+                for (uint32_t ty = std::max(first_texel_y, 1U) - 1; is_uniform && (ty <= std::min(last_texel_y + 1, tiles_y - 1)); ++ty)
+                {
+                    for (uint32_t tx = std::max(first_texel_x, 1U) - 1; tx <= std::min(last_texel_x + 1, tiles_x - 1); ++tx)
+                    {
+                        const uint8_t* texel = &motion_vectors[(ty * tiles_x + tx) * 2];
+                        is_uniform &= (texel[0] == vel[0]) && (texel[1] == vel[1]);
+                    }
+                }
+
+                MotionBlurTileClass tile_class;
+                if (is_static)
+                {
+                    tile_class = MotionBlurTileClass::Static;
+                }
+                else if (is_uniform)
+                {
+                    tile_class = MotionBlurTileClass::UniformMotion;
+                }
+                else
+                {
+                    tile_class = MotionBlurTileClass::Complex;
+                }
+                tile_lists.tiles[static_cast<uint32_t>(tile_class)].push_back((y << 16) | x);
+            }
+        }
+
+        return tile_lists;
+    }
+
+    uint32_t MotionBlurPreviewSize(uint32_t pixels, uint32_t scale) noexcept
+    {
+        return (pixels + scale - 1) / scale;
+    }
+
+    CpuMotionBlurParams MotionBlurPreviewParams(const CpuMotionBlurParams& params, uint32_t scale) noexcept
+    {
+        assert((params.preview_scale == 1) && ((scale == 1) || (scale == 2) || (scale == 4)));
+
+        CpuMotionBlurParams preview_params = params;
+        preview_params.width = MotionBlurPreviewSize(params.width, scale);
+        preview_params.height = MotionBlurPreviewSize(params.height, scale);
+        preview_params.max_sample_tap_distance = params.max_sample_tap_distance / scale;
+        preview_params.preview_scale = scale;
+        return preview_params;
+    }
+
+    void DownsampleMotionBlurPreview(const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t scale, uint8_t* preview)
+    {
+        GO_MOTION_TRACE_SCOPE("DownsampleMotionBlurPreview");
+
+        const uint32_t preview_width = MotionBlurPreviewSize(width, scale);
+        const uint32_t preview_height = MotionBlurPreviewSize(height, scale);
+        for (uint32_t y = 0; y < preview_height; ++y)
+        {
+            for (uint32_t x = 0; x < preview_width; ++x)
+            {
+                uint32_t sum[4]{};
+                uint32_t num_pixels = 0;
+                for (uint32_t sy = y * scale; sy < std::min((y + 1) * scale, height); ++sy)
+                {
+                    for (uint32_t sx = x * scale; sx < std::min((x + 1) * scale, width); ++sx)
+                    {
+                        for (uint32_t c = 0; c < 4; ++c)
+                        {
+                            sum[c] += rgba[(sy * width + sx) * 4 + c];
+                        }
+                        ++num_pixels;
+                    }
+                }
+
+                for (uint32_t c = 0; c < 4; ++c)
+                {
+                    preview[(y * preview_width + x) * 4 + c] = static_cast<uint8_t>((sum[c] + num_pixels / 2) / num_pixels);
+                }
+            }
+        }
+    }
+
+    void UpsampleMotionBlurPreview(const CpuMotionBlurParams& params, const uint8_t* rgba, const uint8_t* preview,
+        const uint8_t* blurred_preview, const uint8_t* neighbor_max, uint8_t* output)
+    {
+        GO_MOTION_TRACE_SCOPE("UpsampleMotionBlurPreview");
+
+        // Of the color difference between the frame and a preview texel, in [0, 1]
+        constexpr float RangeSigma = 0.1f;
+        constexpr float RangeScale = -1 / (2 * RangeSigma * RangeSigma * 255 * 255);
+
+        const uint32_t scale = params.preview_scale;
+        const uint32_t width = params.width * scale;
+        const uint32_t height = params.height * scale;
+        const uint32_t neighbor_max_x = MotionBlurTileMaxSize(MotionVectorTiles(params.width, scale), params.neighbor_max_tile_size);
+        const uint32_t neighbor_max_y = MotionBlurTileMaxSize(MotionVectorTiles(params.height, scale), params.neighbor_max_tile_size);
+        const float inv_width = 1.0f / width;
+        const float inv_height = 1.0f / height;
+
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            const float v = (y + 0.5f) * inv_height;
+            const float preview_y = (y + 0.5f) / scale - 0.5f;
+            const int32_t y0 = static_cast<int32_t>(std::floor(preview_y));
+            const float ty = preview_y - y0;
+
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                const uint8_t* pixel = &rgba[(y * width + x) * 4];
+                uint8_t* out = &output[(y * width + x) * 4];
+
+                const float u = (x + 0.5f) * inv_width;
+                const uint8_t* nm_texel =
+                    &neighbor_max[(TexelIndex(v, neighbor_max_y) * neighbor_max_x + TexelIndex(u, neighbor_max_x)) * 2];
+                if (IsStaticVelocity(params, DecodeVelocity(nm_texel)))
+                {
+                    std::memcpy(out, pixel, 4);
+                    continue;
+                }
+
+                const float preview_x = (x + 0.5f) / scale - 0.5f;
+                const int32_t x0 = static_cast<int32_t>(std::floor(preview_x));
+                const float tx = preview_x - x0;
+
+                // Bilinear weights, times how close the preview texel's color is to the pixel's
+                float delta[3]{};
+                float sum_weight = 0;
+                float bilinear_delta[3]{};
+                for (int32_t dy = 0; dy < 2; ++dy)
+                {
+                    const uint32_t sy = std::clamp(y0 + dy, 0, static_cast<int32_t>(params.height) - 1);
+                    for (int32_t dx = 0; dx < 2; ++dx)
+                    {
+                        const uint32_t sx = std::clamp(x0 + dx, 0, static_cast<int32_t>(params.width) - 1);
+                        const uint8_t* preview_texel = &preview[(sy * params.width + sx) * 4];
+                        const uint8_t* blurred_texel = &blurred_preview[(sy * params.width + sx) * 4];
+
+                        float distance_squared = 0;
+                        for (uint32_t c = 0; c < 3; ++c)
+                        {
+                            const float diff = static_cast<float>(pixel[c]) - preview_texel[c];
+                            distance_squared += diff * diff;
+                        }
+
+                        const float spatial_weight = (dx ? tx : 1 - tx) * (dy ? ty : 1 - ty);
+                        const float weight = spatial_weight * std::exp(distance_squared * RangeScale);
+                        for (uint32_t c = 0; c < 3; ++c)
+                        {
+                            const float texel_delta = static_cast<float>(blurred_texel[c]) - preview_texel[c];
+                            delta[c] += texel_delta * weight;
+                            bilinear_delta[c] += texel_delta * spatial_weight;
+                        }
+                        sum_weight += weight;
+                    }
+                }
+
+                // No preview texel is close, fall back to bilinear
+                constexpr float MinWeight = 1e-4f;
+                for (uint32_t c = 0; c < 3; ++c)
+                {
+                    const float pixel_delta = sum_weight > MinWeight ? delta[c] / sum_weight : bilinear_delta[c];
+                    out[c] = static_cast<uint8_t>(Clamp(pixel[c] + pixel_delta + 0.5f, 0, 255));
+                }
+                out[3] = 255;
+            }
+        }
+    }
+
+    uint32_t MotionBlurTileSamples(const CpuMotionBlurParams& params, const uint8_t* neighbor_max, uint32_t tile_x, uint32_t tile_y)
+    {
+        if ((params.min_reconstruction_samples == 0) || (params.min_reconstruction_samples >= params.reconstruction_samples))
+        {
+            return params.reconstruction_samples;
+        }
+
+        const uint32_t neighbor_max_x =
+            MotionBlurTileMaxSize(MotionVectorTiles(params.width, params.preview_scale), params.neighbor_max_tile_size);
+        const uint32_t neighbor_max_y =
+            MotionBlurTileMaxSize(MotionVectorTiles(params.height, params.preview_scale), params.neighbor_max_tile_size);
+        uint32_t first_x;
+        uint32_t last_x;
+        TexelRange(tile_x * MotionBlurTileSize, std::min((tile_x + 1) * MotionBlurTileSize, params.width) - 1, 1.0f / params.width,
+            neighbor_max_x, first_x, last_x);
+        uint32_t first_y;
+        uint32_t last_y;
+        TexelRange(tile_y * MotionBlurTileSize, std::min((tile_y + 1) * MotionBlurTileSize, params.height) - 1, 1.0f / params.height,
+            neighbor_max_y, first_y, last_y);
+
+        float max_len_vel = 0;
+        for (uint32_t y = first_y; y <= last_y; ++y)
+        {
+            for (uint32_t x = first_x; x <= last_x; ++x)
+            {
+                max_len_vel = std::max(max_len_vel, Length(DecodeVelocity(&neighbor_max[(y * neighbor_max_x + x) * 2])));
+            }
+        }
+
+        // The taps along the neighbor max spread over 2 * max_sample_tap_distance pixels per unit of its length
+        const float len_blur = Clamp(max_len_vel * params.half_exposure, 0.1f, params.blur_radius);
+        const float blur_pixels = 2 * params.max_sample_tap_distance * len_blur;
+        const uint32_t num_samples = static_cast<uint32_t>(std::ceil(blur_pixels * TapsPerBlurPixel)) | 1;
+        return std::clamp(num_samples, params.min_reconstruction_samples, params.reconstruction_samples);
+    }
+
+    uint64_t GatherMotionBlur(const CpuMotionBlurParams& params, const uint8_t* rgba, const uint8_t* motion_vectors,
+        const uint8_t* neighbor_max, std::span<const uint8_t> random_tile, const MotionBlurTileLists* tile_lists, uint8_t* output)
+    {
+        GO_MOTION_TRACE_SCOPE("GatherMotionBlur");
+
+        const std::vector<float> inv_blur_lengths = InvBlurLengths(params, motion_vectors,
+            MotionVectorTiles(params.width, params.preview_scale) * MotionVectorTiles(params.height, params.preview_scale));
+        GatherContext context = MakeGatherContext(params, motion_vectors, inv_blur_lengths.data(), neighbor_max, random_tile);
+        context.rgba = rgba;
+        context.rgba_rows = params.height;
+        return GatherRows(context, tile_lists, 0, params.height, output);
+    }
+
+    uint32_t MotionBlurGatherHaloRows(const CpuMotionBlurParams& params) noexcept
+    {
+        // The taps are at most max_sample_tap_distance frame widths / width along a velocity no longer than max(blur_radius, 1),
+        // shifted by half a texel. In v, that's height / width as many rows.
+        const float reach = (std::max(params.blur_radius, 1.0f) * params.max_sample_tap_distance + 0.5f) * params.height / params.width;
+        // The bilinear footprint, and a row for the rounding
+        return static_cast<uint32_t>(std::ceil(reach)) + 2;
+    }
+
+    uint64_t MotionBlurStreamWorkingSetBytes(const CpuMotionBlurParams& params, uint32_t strip_rows) noexcept
+    {
+        const uint32_t window_rows = std::min(strip_rows + 2 * MotionBlurGatherHaloRows(params), params.height);
+        return static_cast<uint64_t>(window_rows + std::min(strip_rows, params.height)) * params.width * 4;
+    }
+
+    uint32_t MotionBlurStripRows(const CpuMotionBlurParams& params, uint64_t budget_bytes) noexcept
+    {
+        const uint64_t budget_rows = budget_bytes / (params.width * 4);
+        const uint64_t halo_rows = 2 * MotionBlurGatherHaloRows(params);
+        // The window and the output both hold the strip
+        const uint64_t strip_rows = budget_rows > halo_rows ? (budget_rows - halo_rows) / 2 : 0;
+        return std::max(static_cast<uint32_t>(std::min<uint64_t>(strip_rows, params.height)) / MotionBlurTileSize * MotionBlurTileSize,
+            MotionBlurTileSize);
+    }
+
+    uint64_t StreamMotionBlur(const CpuMotionBlurParams& params, const uint8_t* motion_vectors, const uint8_t* neighbor_max,
+        std::span<const uint8_t> random_tile, const MotionBlurTileLists* tile_lists, uint32_t strip_rows,
+        const MotionBlurReadRowsFunc& read_rows, const MotionBlurWriteRowsFunc& write_rows)
+    {
+        GO_MOTION_TRACE_SCOPE("StreamMotionBlur");
+
+        assert((strip_rows > 0) && (strip_rows % MotionBlurTileSize == 0));
+
+        const uint32_t halo_rows = MotionBlurGatherHaloRows(params);
+        const uint32_t row_bytes = params.width * 4;
+        std::vector<uint8_t> window(std::min(strip_rows + 2 * halo_rows, params.height) * row_bytes);
+        std::vector<uint8_t> output(std::min(strip_rows, params.height) * row_bytes);
+
+        const std::vector<float> inv_blur_lengths = InvBlurLengths(params, motion_vectors,
+            MotionVectorTiles(params.width, params.preview_scale) * MotionVectorTiles(params.height, params.preview_scale));
+        GatherContext context = MakeGatherContext(params, motion_vectors, inv_blur_lengths.data(), neighbor_max, random_tile);
+        context.rgba = window.data();
+
+        // The frame rows in the window
+        uint32_t window_first_row = 0;
+        uint32_t window_end_row = 0;
+
+        uint64_t num_taps = 0;
+        for (uint32_t first_row = 0; first_row < params.height; first_row += strip_rows)
+        {
+            const uint32_t end_row = std::min(first_row + strip_rows, params.height);
+            const uint32_t needed_first_row = std::max(first_row, halo_rows) - halo_rows;
+            const uint32_t needed_end_row = std::min(end_row + halo_rows, params.height);
+
+            // The halo the strips share is already in the window, each row is only read once
+            assert(needed_first_row <= window_end_row);
+            const uint32_t kept_rows = window_end_row - needed_first_row;
+            std::memmove(window.data(), &window[(needed_first_row - window_first_row) * row_bytes], kept_rows * row_bytes);
+            read_rows(window_end_row, needed_end_row - window_end_row, &window[kept_rows * row_bytes]);
+            window_first_row = needed_first_row;
+            window_end_row = needed_end_row;
+
+            context.rgba_first_row = window_first_row;
+            context.rgba_rows = window_end_row - window_first_row;
+            context.output_first_row = first_row;
+            num_taps += GatherRows(context, tile_lists, first_row, end_row, output.data());
+
+            write_rows(first_row, end_row - first_row, output.data());
+        }
+
+        return num_taps;
+    }
+} // namespace MotionToGo
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <vector>
+
+namespace MotionToGo
+{
+    // The motion vectors and their neighbor max have one R8G8 texel, v * 0.5 + 0.5, per tile of MotionBlurTileSize pixels.
+    constexpr uint32_t MotionBlurTileSize = 16;
+    constexpr uint32_t MotionBlurRandomTileSize = 128;
+    // The GPU neighbor max keeps a window in registers
+    constexpr uint32_t MaxMotionBlurNeighborMaxRadius = 8;
+    // The fixed-point gather keeps the taps of a pixel in an array, of this many samples at most
+    constexpr uint32_t MaxMotionBlurReconstructionSamples = 64;
+
+    struct CpuMotionBlurParams
+    {
+        uint32_t width;
+        uint32_t height;
+        float blur_radius;
+        float half_exposure;
+        // At most MaxMotionBlurReconstructionSamples
+        uint32_t reconstruction_samples;
+        float max_sample_tap_distance;
+        // In pixels, of the neighbor max texels. A multiple of MotionBlurTileSize.
+        uint32_t neighbor_max_tile_size = MotionBlurTileSize;
+        // The tiles with short blur take fewer samples, down to this. 0 keeps every tile at reconstruction_samples.
+        uint32_t min_reconstruction_samples = 0;
+        // The frame is 1 / preview_scale of the size the motion vectors are for, 1, 2 or 4
+        uint32_t preview_scale = 1;
+        // The fixed-point gather: filters and weights the taps in integers instead of float, Q4 colors times Q8 weights summed in 32
+        // bits. It's an arithmetic variant, not a bandwidth one, the taps read the same RGBA8 texels. Within 1 of float per channel,
+        // the same bytes at every SIMD level.
+        bool fixed_point = false;
+        // The common sample counts, 7, 11, 15 and 23, run a kernel with the tap loop unrolled. false runs every count through the
+        // generic one. The bytes are the same.
+        bool specialized_samples = true;
+    };
+
+    enum class MotionBlurTileClass : uint32_t
+    {
+        // Every pixel is below the velocity cutoff, the frame is copied
+        Static,
+        // The neighbor max and the motion vectors around the tile are the same, the blur has one direction
+        UniformMotion,
+        Complex,
+
+        Num,
+    };
+
+    struct MotionBlurTileLists
+    {
+        // (y << 16) | x of the tiles in each class, in raster order
+        std::array<std::vector<uint32_t>, static_cast<uint32_t>(MotionBlurTileClass::Num)> tiles;
+    };
+
+    // The R8 noise that jitters the reconstruction taps, the same on CPU and GPU.
+    std::vector<uint8_t> GenerateMotionBlurRandomTile();
+
+    // Number of neighbor max texels along an axis of tiles motion vector texels.
+    uint32_t MotionBlurTileMaxSize(uint32_t tiles, uint32_t tile_size) noexcept;
+
+    // Largest motion vector of each tile_size / MotionBlurTileSize square of motion vector texels, like MotionBlurTileMaxCs. The
+    // vectors are compared quantized, 128 as 0, so the result is always one of the texels.
+    void MotionBlurTileMax(const uint8_t* motion_vectors, uint32_t tiles_x, uint32_t tiles_y, uint32_t tile_size, uint8_t* tile_max);
+
+    // Largest tile max within radius texels on both axes, like 2 passes of MotionBlurNeighborMaxCs. Separable, with a van Herk /
+    // Gil-Werman running max, so the cost per texel doesn't depend on the radius.
+    void MotionBlurNeighborMax(const uint8_t* tile_max, uint32_t width, uint32_t height, uint32_t radius, uint8_t* neighbor_max);
+
+    // CPU version of MotionBlurTileClassifyCs. Conservative, a tile is only static if every texel its pixels read is.
+    MotionBlurTileLists ClassifyMotionBlurTiles(
+        const CpuMotionBlurParams& params, const uint8_t* motion_vectors, const uint8_t* neighbor_max);
+
+    // The size of the preview along an axis of pixels.
+    uint32_t MotionBlurPreviewSize(uint32_t pixels, uint32_t scale) noexcept;
+
+    // The params of the gather on a preview, with the tap distance in its pixels.
+    CpuMotionBlurParams MotionBlurPreviewParams(const CpuMotionBlurParams& params, uint32_t scale) noexcept;
+
+    // Box filtered RGBA8 preview of the frame, like MotionBlurPreviewDownsampleCs.
+    void DownsampleMotionBlurPreview(const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t scale, uint8_t* preview);
+
+    // Like MotionBlurPreviewUpsampleCs. Adds the blur of the preview, blurred_preview - preview, to the full resolution frame, with
+    // a joint bilateral upsampling guided by the frame. The pixels without motion keep the frame.
+    void UpsampleMotionBlurPreview(const CpuMotionBlurParams& params, const uint8_t* rgba, const uint8_t* preview,
+        const uint8_t* blurred_preview, const uint8_t* neighbor_max, uint8_t* output);
+
+    // The reconstruction samples of the tile at tile_x, tile_y. Scales with the length of the blur, in [min_reconstruction_samples,
+    // reconstruction_samples].
+    uint32_t MotionBlurTileSamples(const CpuMotionBlurParams& params, const uint8_t* neighbor_max, uint32_t tile_x, uint32_t tile_y);
+
+    // CPU version of MotionBlurGatherCs, on tightly packed RGBA8. With tile_lists, the static tiles are copied and only the others run
+    // the reconstruction. Without, every tile runs it. Returns the number of taps the reconstruction took.
+    uint64_t GatherMotionBlur(const CpuMotionBlurParams& params, const uint8_t* rgba, const uint8_t* motion_vectors,
+        const uint8_t* neighbor_max, std::span<const uint8_t> random_tile, const MotionBlurTileLists* tile_lists, uint8_t* output);
+
+    // Frame rows the gather reads above and below the rows it writes.
+    uint32_t MotionBlurGatherHaloRows(const CpuMotionBlurParams& params) noexcept;
+
+    // Bytes of frame and output rows StreamMotionBlur holds at a time, with strips of strip_rows.
+    uint64_t MotionBlurStreamWorkingSetBytes(const CpuMotionBlurParams& params, uint32_t strip_rows) noexcept;
+
+    // The largest strip, a multiple of MotionBlurTileSize, that keeps the working set within budget_bytes. At least one tile.
+    uint32_t MotionBlurStripRows(const CpuMotionBlurParams& params, uint64_t budget_bytes) noexcept;
+
+    using MotionBlurReadRowsFunc = std::function<void(uint32_t first_row, uint32_t num_rows, uint8_t* rgba)>;
+    using MotionBlurWriteRowsFunc = std::function<void(uint32_t first_row, uint32_t num_rows, const uint8_t* rgba)>;
+
+    // GatherMotionBlur in strips of strip_rows, a multiple of MotionBlurTileSize, for frames too large to hold. read_rows is called
+    // with each frame row once, in order, and write_rows with each output row once, in order. Only a strip and its halo of the frame
+    // are kept, the output is the same as GatherMotionBlur's. The motion vectors and the neighbor max are whole, they are small.
+    // MotionBlurGenerator::StripRows is the GPU version, with the same halo.
+    uint64_t StreamMotionBlur(const CpuMotionBlurParams& params, const uint8_t* motion_vectors, const uint8_t* neighbor_max,
+        std::span<const uint8_t> random_tile, const MotionBlurTileLists* tile_lists, uint32_t strip_rows,
+        const MotionBlurReadRowsFunc& read_rows, const MotionBlurWriteRowsFunc& write_rows);
+} // namespace MotionToGo
@@ -0,0 +1,52 @@
+#include "CpuMotionBlurKernels.hpp"
+
+#include <immintrin.h>
+
+namespace MotionToGo
+{
+    void FixedPointTapSumAvx2(const FixedPointTap* taps, uint32_t num_taps, int32_t sum[4])
+    {
+        // As in the SSE4.1 kernel, a tap per 128-bit lane
+        const __m256i pair_shuffle =
+            _mm256_setr_epi8(0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13, 10, 14, 11, 15, 0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13, 10, 14, 11, 15);
+        const __m256i full = _mm256_set1_epi32(256);
+        const __m256i round = _mm256_set1_epi32(1 << 11);
+        const __m256i one = _mm256_set1_epi32(1);
+
+        __m256i acc = _mm256_setzero_si256();
+
+        uint32_t i = 0;
+        for (; i + 2 <= num_taps; i += 2)
+        {
+            const __m256i tap0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&taps[i]));
+            const __m256i tap1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&taps[i + 1]));
+            const __m256i texels = _mm256_permute2x128_si256(tap0, tap1, 0x20);
+            // tx, ty, weight of each tap in its lane
+            const __m256i params = _mm256_permute2x128_si256(tap0, tap1, 0x31);
+
+            const __m256i pairs = _mm256_shuffle_epi8(texels, pair_shuffle);
+
+            const __m256i tx = _mm256_shuffle_epi32(params, _MM_SHUFFLE(0, 0, 0, 0));
+            const __m256i tx_weights = _mm256_or_si256(_mm256_slli_epi32(tx, 16), _mm256_sub_epi32(full, tx));
+            const __m256i top = _mm256_madd_epi16(_mm256_unpacklo_epi8(pairs, _mm256_setzero_si256()), tx_weights);
+            const __m256i bottom = _mm256_madd_epi16(_mm256_unpackhi_epi8(pairs, _mm256_setzero_si256()), tx_weights);
+
+            const __m256i ty = _mm256_shuffle_epi32(params, _MM_SHUFFLE(1, 1, 1, 1));
+            __m256i color = _mm256_add_epi32(_mm256_mullo_epi32(top, _mm256_sub_epi32(full, ty)), _mm256_mullo_epi32(bottom, ty));
+            color = _mm256_srai_epi32(_mm256_add_epi32(color, round), 12);
+            color = _mm256_blend_epi16(color, one, 0xC0);
+
+            const __m256i weight = _mm256_shuffle_epi32(params, _MM_SHUFFLE(2, 2, 2, 2));
+            acc = _mm256_add_epi32(acc, _mm256_madd_epi16(color, weight));
+        }
+
+        alignas(16) int32_t acc_sum[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(acc_sum), _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1)));
+        for (uint32_t c = 0; c < 4; ++c)
+        {
+            sum[c] += acc_sum[c];
+        }
+
+        FixedPointTapSumScalar(taps, i, num_taps, sum);
+    }
+} // namespace MotionToGo
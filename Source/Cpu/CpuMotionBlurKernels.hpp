@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+
+// Tap kernels behind CpuMotionBlur.cpp's fixed-point gather. They're integer only, every variant gives the same sums.
+namespace MotionToGo
+{
+    // A tap of the fixed-point gather: the RGBA8 texels of its bilinear footprint, top left, top right, bottom left and bottom right,
+    // its subtexel position in Q8, and its weight in Q8. 32 bytes, a tap is one AVX2 load.
+    struct alignas(32) FixedPointTap
+    {
+        uint8_t texels[4][4];
+        int32_t tx;
+        int32_t ty;
+        int32_t weight;
+        int32_t padding;
+    };
+
+    // Filters the taps [first_tap, num_taps) to RGB in Q4 and adds them times their weights to sum, in int32. The weights go to
+    // sum[3].
+    void FixedPointTapSumScalar(const FixedPointTap* taps, uint32_t first_tap, uint32_t num_taps, int32_t sum[4]);
+    // pmaddwd filters a tap at a time
+    void FixedPointTapSumSse41(const FixedPointTap* taps, uint32_t num_taps, int32_t sum[4]);
+    // And 2 taps at a time
+    void FixedPointTapSumAvx2(const FixedPointTap* taps, uint32_t num_taps, int32_t sum[4]);
+} // namespace MotionToGo
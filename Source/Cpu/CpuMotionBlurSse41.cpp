@@ -0,0 +1,44 @@
+#include "CpuMotionBlurKernels.hpp"
+
+#include <smmintrin.h>
+
+namespace MotionToGo
+{
+    void FixedPointTapSumSse41(const FixedPointTap* taps, uint32_t num_taps, int32_t sum[4])
+    {
+        // The channels of the left and the right texel side by side, the top row in the low half, the bottom one in the high half
+        const __m128i pair_shuffle = _mm_setr_epi8(0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13, 10, 14, 11, 15);
+        const __m128i round = _mm_set1_epi32(1 << 11);
+        const __m128i one = _mm_set1_epi32(1);
+
+        __m128i acc = _mm_setzero_si128();
+        for (uint32_t i = 0; i < num_taps; ++i)
+        {
+            const FixedPointTap& tap = taps[i];
+
+            const __m128i texels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tap.texels));
+            const __m128i pairs = _mm_shuffle_epi8(texels, pair_shuffle);
+
+            // 16-bit texels times 256 - tx and tx, summed in 32 bits, Q8
+            const __m128i tx_weights = _mm_set1_epi32((tap.tx << 16) | (256 - tap.tx));
+            const __m128i top = _mm_madd_epi16(_mm_cvtepu8_epi16(pairs), tx_weights);
+            const __m128i bottom = _mm_madd_epi16(_mm_unpackhi_epi8(pairs, _mm_setzero_si128()), tx_weights);
+
+            // Up to 255 * 256, too wide for another madd
+            __m128i color =
+                _mm_add_epi32(_mm_mullo_epi32(top, _mm_set1_epi32(256 - tap.ty)), _mm_mullo_epi32(bottom, _mm_set1_epi32(tap.ty)));
+            color = _mm_srai_epi32(_mm_add_epi32(color, round), 12);
+            color = _mm_blend_epi16(color, one, 0xC0);
+
+            // Both in the low 16 bits of their dwords, the madd is the exact product
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(color, _mm_set1_epi32(tap.weight)));
+        }
+
+        alignas(16) int32_t acc_sum[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(acc_sum), acc);
+        for (uint32_t c = 0; c < 4; ++c)
+        {
+            sum[c] += acc_sum[c];
+        }
+    }
+} // namespace MotionToGo
@@ -35,6 +35,8 @@ namespace MotionToGo
         desc_.Flags = flags;
         desc_.NodeMask = 0;
         TIFHR(gpu_system.NativeDevice()->CreateDescriptorHeap(&desc_, winrt::guid_of<ID3D12DescriptorHeap>(), heap_.put_void()));
+        tracked_memory_ = TrackedMemory(
+            MemoryCategory::Descriptors, static_cast<uint64_t>(size) * gpu_system.NativeDevice()->GetDescriptorHandleIncrementSize(type));
         if (!name.empty())
         {
             heap_->SetName(std::wstring(std::move(name)).c_str());
@@ -74,5 +76,6 @@ namespace MotionToGo
     {
         heap_ = nullptr;
         desc_ = {};
+        tracked_memory_.Reset();
     }
 } // namespace MotionToGo
@@ -3,6 +3,7 @@
 #include <tuple>
 
 #include "Noncopyable.hpp"
+#include "Trace/MemoryTracker.hpp"
 
 namespace MotionToGo
 {
@@ -40,5 +41,6 @@ namespace MotionToGo
     private:
         winrt::com_ptr<ID3D12DescriptorHeap> heap_;
         D3D12_DESCRIPTOR_HEAP_DESC desc_{};
+        TrackedMemory tracked_memory_;
     };
 } // namespace MotionToGo
@@ -32,6 +32,7 @@ namespace MotionToGo
         buffer_ = GpuBuffer(gpu_system, size_in_bytes, heap_type, D3D12_RESOURCE_FLAG_NONE, init_state, L"GpuMemoryPage");
         cpu_addr_ = buffer_.Map();
         gpu_addr_ = buffer_.GpuVirtualAddress();
+        tracked_memory_ = TrackedMemory(is_upload_ ? MemoryCategory::UploadStaging : MemoryCategory::ReadbackStaging, size_in_bytes);
     }
 
     GpuMemoryPage::~GpuMemoryPage() noexcept
@@ -44,7 +45,7 @@ namespace MotionToGo
 
     GpuMemoryPage::GpuMemoryPage(GpuMemoryPage&& other) noexcept
         : is_upload_(other.is_upload_), buffer_(std::move(other.buffer_)), cpu_addr_(std::move(other.cpu_addr_)),
-          gpu_addr_(std::move(other.gpu_addr_))
+          gpu_addr_(std::move(other.gpu_addr_)), tracked_memory_(std::move(other.tracked_memory_))
     {
     }
 
@@ -57,6 +58,7 @@ namespace MotionToGo
             buffer_ = std::move(other.buffer_);
             cpu_addr_ = std::move(other.cpu_addr_);
             gpu_addr_ = std::move(other.gpu_addr_);
+            tracked_memory_ = std::move(other.tracked_memory_);
         }
         return *this;
     }
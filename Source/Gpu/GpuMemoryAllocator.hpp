@@ -5,6 +5,7 @@
 
 #include "GpuBuffer.hpp"
 #include "Noncopyable.hpp"
+#include "Trace/MemoryTracker.hpp"
 
 namespace MotionToGo
 {
@@ -47,6 +48,7 @@ namespace MotionToGo
         GpuBuffer buffer_;
         void* cpu_addr_;
         D3D12_GPU_VIRTUAL_ADDRESS gpu_addr_;
+        TrackedMemory tracked_memory_;
     };
 
     class GpuMemoryBlock final
@@ -261,6 +261,52 @@ namespace MotionToGo
         return readback_mem_allocator_.Reallocate(mem_block, fence_vals_[frame_index_], size_in_bytes, alignment);
     }
 
+    GpuTexture2D GpuSystem::AcquireTexture(
+        uint32_t width, uint32_t height, DXGI_FORMAT format, D3D12_RESOURCE_FLAGS flags, std::wstring_view name)
+    {
+        return texture_pool_.Acquire({width, height, format, flags}, fence_->GetCompletedValue(),
+            [&] { return GpuTexture2D(*this, width, height, 1, format, flags, D3D12_RESOURCE_STATE_COMMON, name); });
+    }
+
+    void GpuSystem::ReleaseTexture(GpuTexture2D&& texture)
+    {
+        if (!texture)
+        {
+            return;
+        }
+
+        const D3D12_RESOURCE_DESC desc = texture.NativeTexture()->GetDesc();
+        const uint64_t size_in_bytes = device_->GetResourceAllocationInfo(0, 1, &desc).SizeInBytes;
+        texture_pool_.Release({texture.Width(0), texture.Height(0), texture.Format(), texture.Flags()}, std::move(texture), size_in_bytes,
+            fence_vals_[frame_index_]);
+    }
+
+    void GpuSystem::RecycleTexture(GpuTexture2D& texture, uint32_t width, uint32_t height, DXGI_FORMAT format,
+        D3D12_RESOURCE_FLAGS flags, std::wstring_view name)
+    {
+        if (!texture || (texture.Width(0) != width) || (texture.Height(0) != height) || (texture.Format() != format) ||
+            (texture.Flags() != flags))
+        {
+            this->ReleaseTexture(std::move(texture));
+            texture = this->AcquireTexture(width, height, format, flags, name);
+        }
+    }
+
+    void GpuSystem::TrimTexturePool()
+    {
+        texture_pool_.Trim(fence_->GetCompletedValue());
+    }
+
+    void GpuSystem::ResetTexturePoolPeak() noexcept
+    {
+        texture_pool_.ResetPeak();
+    }
+
+    const GpuTexturePoolStats& GpuSystem::TexturePoolStats() const noexcept
+    {
+        return texture_pool_.Stats();
+    }
+
     void GpuSystem::WaitForGpu(uint64_t fence_value)
     {
         if (fence_ && (fence_event_.get() != INVALID_HANDLE_VALUE))
@@ -291,6 +337,15 @@ namespace MotionToGo
         }
     }
 
+    void GpuSystem::WaitForFence(uint64_t fence_value)
+    {
+        if (fence_->GetCompletedValue() < fence_value)
+        {
+            TIFHR(fence_->SetEventOnCompletion(fence_value, fence_event_.get()));
+            ::WaitForSingleObjectEx(fence_event_.get(), INFINITE, FALSE);
+        }
+    }
+
     void GpuSystem::HandleDeviceLost()
     {
         upload_mem_allocator_.Clear();
@@ -298,6 +353,8 @@ namespace MotionToGo
 
         cbv_srv_uav_desc_allocator_.Clear();
 
+        texture_pool_.Clear();
+
         for (auto& cmd_queue : cmd_queues_)
         {
             cmd_queue.cmd_queue = nullptr;
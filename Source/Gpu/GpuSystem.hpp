@@ -6,6 +6,8 @@
 
 #include "GpuDescriptorAllocator.hpp"
 #include "GpuMemoryAllocator.hpp"
+#include "GpuTexture2D.hpp"
+#include "GpuTexturePool.hpp"
 #include "Noncopyable.hpp"
 #include "SmartPtrHelper.hpp"
 
@@ -59,7 +61,22 @@ namespace MotionToGo
         void DeallocReadbackMemBlock(GpuMemoryBlock&& mem_block);
         void ReallocReadbackMemBlock(GpuMemoryBlock& mem_block, uint32_t size_in_bytes, uint32_t alignment);
 
+        // A texture from the pool once the GPU is done with it, or a new one. The content is undefined.
+        GpuTexture2D AcquireTexture(
+            uint32_t width, uint32_t height, DXGI_FORMAT format, D3D12_RESOURCE_FLAGS flags, std::wstring_view name = L"");
+        // Back to the pool, for an acquire after the current frame is done on the GPU
+        void ReleaseTexture(GpuTexture2D&& texture);
+        // Keeps texture if it already is width x height of format and flags, otherwise swaps it for a pooled one.
+        void RecycleTexture(GpuTexture2D& texture, uint32_t width, uint32_t height, DXGI_FORMAT format, D3D12_RESOURCE_FLAGS flags,
+            std::wstring_view name = L"");
+        // Destroys the pooled textures the GPU is done with
+        void TrimTexturePool();
+        void ResetTexturePoolPeak() noexcept;
+        const GpuTexturePoolStats& TexturePoolStats() const noexcept;
+
         void WaitForGpu(uint64_t fence_value = MaxFenceValue);
+        // Waits for the work that signaled fence_value, without signaling the queues
+        void WaitForFence(uint64_t fence_value);
 
         void HandleDeviceLost();
 
@@ -88,5 +105,7 @@ namespace MotionToGo
         GpuMemoryAllocator readback_mem_allocator_;
 
         GpuDescriptorAllocator cbv_srv_uav_desc_allocator_;
+
+        GpuTexturePool<GpuTexture2D> texture_pool_;
     };
 } // namespace MotionToGo
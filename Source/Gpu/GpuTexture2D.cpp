@@ -52,6 +52,13 @@ namespace MotionToGo
         }
     }
 
+    D3D12_RESOURCE_DESC Texture2DDesc(
+        uint32_t width, uint32_t height, uint32_t mip_levels, DXGI_FORMAT format, D3D12_RESOURCE_FLAGS flags) noexcept
+    {
+        return {D3D12_RESOURCE_DIMENSION_TEXTURE2D, 0, static_cast<uint64_t>(width), height, 1, static_cast<uint16_t>(mip_levels), format,
+            {1, 0}, D3D12_TEXTURE_LAYOUT_UNKNOWN, flags};
+    }
+
     void SubResourceToMipLevelPlane(uint32_t sub_resource, uint32_t num_mip_levels, uint32_t& mip, uint32_t& plane)
     {
         plane = sub_resource / num_mip_levels;
@@ -62,16 +69,29 @@ namespace MotionToGo
     GpuTexture2D::GpuTexture2D() = default;
 
     GpuTexture2D::GpuTexture2D(GpuSystem& gpu_system, uint32_t width, uint32_t height, uint32_t mip_levels, DXGI_FORMAT format,
-        D3D12_RESOURCE_FLAGS flags, D3D12_RESOURCE_STATES init_state, std::wstring_view name)
+        D3D12_RESOURCE_FLAGS flags, D3D12_RESOURCE_STATES init_state, std::wstring_view name, MemoryCategory category)
         : curr_states_(mip_levels * NumPlanes(format), init_state)
     {
         const D3D12_HEAP_PROPERTIES default_heap_prop = {
             D3D12_HEAP_TYPE_DEFAULT, D3D12_CPU_PAGE_PROPERTY_UNKNOWN, D3D12_MEMORY_POOL_UNKNOWN, 1, 1};
 
-        desc_ = {D3D12_RESOURCE_DIMENSION_TEXTURE2D, 0, static_cast<uint64_t>(width), height, 1, static_cast<uint16_t>(mip_levels), format,
-            {1, 0}, D3D12_TEXTURE_LAYOUT_UNKNOWN, flags};
+        desc_ = Texture2DDesc(width, height, mip_levels, format, flags);
         TIFHR(gpu_system.NativeDevice()->CreateCommittedResource(
             &default_heap_prop, D3D12_HEAP_FLAG_NONE, &desc_, init_state, nullptr, winrt::guid_of<ID3D12Resource>(), resource_.put_void()));
+        tracked_memory_ = std::make_shared<TrackedMemory>(
+            category, gpu_system.NativeDevice()->GetResourceAllocationInfo(0, 1, &desc_).SizeInBytes);
+        if (!name.empty())
+        {
+            resource_->SetName(std::wstring(name).c_str());
+        }
+    }
+
+    GpuTexture2D::GpuTexture2D(GpuSystem& gpu_system, ID3D12Heap* heap, uint64_t heap_offset, uint32_t width, uint32_t height,
+        uint32_t mip_levels, DXGI_FORMAT format, D3D12_RESOURCE_FLAGS flags, D3D12_RESOURCE_STATES init_state, std::wstring_view name)
+        : desc_(Texture2DDesc(width, height, mip_levels, format, flags)), curr_states_(mip_levels * NumPlanes(format), init_state)
+    {
+        TIFHR(gpu_system.NativeDevice()->CreatePlacedResource(
+            heap, heap_offset, &desc_, init_state, nullptr, winrt::guid_of<ID3D12Resource>(), resource_.put_void()));
         if (!name.empty())
         {
             resource_->SetName(std::wstring(name).c_str());
@@ -103,6 +123,7 @@ namespace MotionToGo
         texture.resource_ = resource_;
         texture.desc_ = desc_;
         texture.curr_states_ = curr_states_;
+        texture.tracked_memory_ = tracked_memory_;
         return texture;
     }
 
@@ -151,6 +172,7 @@ namespace MotionToGo
         resource_ = nullptr;
         desc_ = {};
         curr_states_.clear();
+        tracked_memory_.reset();
     }
 
     D3D12_RESOURCE_STATES GpuTexture2D::State(uint32_t sub_resource) const noexcept
@@ -235,31 +257,40 @@ namespace MotionToGo
         curr_states_.assign(this->MipLevels() * this->Planes(), target_state);
     }
 
-    void GpuTexture2D::Upload(GpuSystem& gpu_system, GpuCommandList& cmd_list, uint32_t sub_resource, const void* data)
+    void GpuTexture2D::Upload(GpuSystem& gpu_system, GpuCommandList& cmd_list, uint32_t sub_resource, const void* data, uint32_t row_pitch)
     {
-        const uint32_t mip = sub_resource % this->MipLevels();
-        const uint32_t width = this->Width(mip);
-        const uint32_t height = this->Height(mip);
-        const uint32_t format_size = FormatSize(this->Format());
+        // The footprint is per plane, so the row size and the number of rows are right for NV12's chroma plane as well.
+        uint32_t num_row = 0;
+        uint64_t row_size_in_bytes = 0;
+        gpu_system.NativeDevice()->GetCopyableFootprints(&desc_, sub_resource, 1, 0, nullptr, &num_row, &row_size_in_bytes, nullptr);
 
+        if (row_pitch == 0)
+        {
+            row_pitch = static_cast<uint32_t>(row_size_in_bytes);
+        }
+        assert(row_pitch >= row_size_in_bytes);
+
+        this->Upload(gpu_system, cmd_list, sub_resource, [&](uint8_t* tex_data, uint32_t tex_row_pitch) {
+            for (uint32_t y = 0; y < num_row; ++y)
+            {
+                memcpy(tex_data + y * tex_row_pitch, reinterpret_cast<const uint8_t*>(data) + y * row_pitch, row_size_in_bytes);
+            }
+        });
+    }
+
+    void GpuTexture2D::Upload(GpuSystem& gpu_system, GpuCommandList& cmd_list, uint32_t sub_resource,
+        const std::function<void(uint8_t* data, uint32_t row_pitch)>& fill)
+    {
         auto* d3d12_device = gpu_system.NativeDevice();
 
         D3D12_PLACED_SUBRESOURCE_FOOTPRINT layout;
-        uint32_t num_row = 0;
-        uint64_t row_size_in_bytes = 0;
         uint64_t required_size = 0;
-        d3d12_device->GetCopyableFootprints(&desc_, sub_resource, 1, 0, &layout, &num_row, &row_size_in_bytes, &required_size);
+        d3d12_device->GetCopyableFootprints(&desc_, sub_resource, 1, 0, &layout, nullptr, nullptr, &required_size);
 
         auto upload_mem_block =
             gpu_system.AllocUploadMemBlock(static_cast<uint32_t>(required_size), GpuMemoryAllocator::TextureDataAligment);
 
-        assert(row_size_in_bytes >= width * format_size);
-
-        uint8_t* tex_data = upload_mem_block.CpuAddress<uint8_t>();
-        for (uint32_t y = 0; y < height; ++y)
-        {
-            memcpy(tex_data + y * row_size_in_bytes, reinterpret_cast<const uint8_t*>(data) + y * width * format_size, width * format_size);
-        }
+        fill(upload_mem_block.CpuAddress<uint8_t>(), layout.Footprint.RowPitch);
 
         layout.Offset += upload_mem_block.Offset();
         D3D12_TEXTURE_COPY_LOCATION src;
@@ -276,8 +307,8 @@ namespace MotionToGo
         src_box.left = 0;
         src_box.top = 0;
         src_box.front = 0;
-        src_box.right = width;
-        src_box.bottom = height;
+        src_box.right = layout.Footprint.Width;
+        src_box.bottom = layout.Footprint.Height;
         src_box.back = 1;
 
         assert(cmd_list.Type() == GpuSystem::CmdQueueType::Compute);
@@ -293,13 +324,9 @@ namespace MotionToGo
         gpu_system.DeallocUploadMemBlock(std::move(upload_mem_block));
     }
 
-    void GpuTexture2D::Readback(GpuSystem& gpu_system, GpuCommandList& cmd_list, uint32_t sub_resource, void* data) const
+    void GpuTexture2D::Readback(
+        GpuSystem& gpu_system, GpuCommandList& cmd_list, uint32_t sub_resource, void* data, uint32_t row_pitch) const
     {
-        const uint32_t mip = sub_resource % this->MipLevels();
-        const uint32_t width = this->Width(mip);
-        const uint32_t height = this->Height(mip);
-        const uint32_t format_size = FormatSize(this->Format());
-
         auto* d3d12_device = gpu_system.NativeDevice();
 
         D3D12_PLACED_SUBRESOURCE_FOOTPRINT layout;
@@ -326,8 +353,8 @@ namespace MotionToGo
         src_box.left = 0;
         src_box.top = 0;
         src_box.front = 0;
-        src_box.right = width;
-        src_box.bottom = height;
+        src_box.right = layout.Footprint.Width;
+        src_box.bottom = layout.Footprint.Height;
         src_box.back = 1;
 
         assert(cmd_list.Type() == GpuSystem::CmdQueueType::Compute);
@@ -343,13 +370,17 @@ namespace MotionToGo
         gpu_system.ExecuteAndReset(cmd_list);
         gpu_system.WaitForGpu();
 
-        assert(row_size_in_bytes >= width * format_size);
+        if (row_pitch == 0)
+        {
+            row_pitch = static_cast<uint32_t>(row_size_in_bytes);
+        }
+        assert(row_pitch >= row_size_in_bytes);
 
         uint8_t* u8_data = reinterpret_cast<uint8_t*>(data);
         const uint8_t* tex_data = readback_mem_block.CpuAddress<uint8_t>();
-        for (uint32_t y = 0; y < height; ++y)
+        for (uint32_t y = 0; y < num_row; ++y)
         {
-            memcpy(&u8_data[y * width * format_size], tex_data + y * row_size_in_bytes, width * format_size);
+            memcpy(&u8_data[y * row_pitch], tex_data + y * layout.Footprint.RowPitch, row_size_in_bytes);
         }
 
         gpu_system.DeallocReadbackMemBlock(std::move(readback_mem_block));
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <functional>
+#include <memory>
 #include <string_view>
 
 #include "Noncopyable.hpp"
+#include "Trace/MemoryTracker.hpp"
 
 namespace MotionToGo
 {
@@ -16,7 +19,11 @@ namespace MotionToGo
     public:
         GpuTexture2D();
         GpuTexture2D(GpuSystem& gpu_system, uint32_t width, uint32_t height, uint32_t mip_levels, DXGI_FORMAT format,
-            D3D12_RESOURCE_FLAGS flags, D3D12_RESOURCE_STATES init_state, std::wstring_view name = L"");
+            D3D12_RESOURCE_FLAGS flags, D3D12_RESOURCE_STATES init_state, std::wstring_view name = L"",
+            MemoryCategory category = MemoryCategory::FrameTextures);
+        // Placed at heap_offset of the heap. It shares the memory with the other textures placed there.
+        GpuTexture2D(GpuSystem& gpu_system, ID3D12Heap* heap, uint64_t heap_offset, uint32_t width, uint32_t height, uint32_t mip_levels,
+            DXGI_FORMAT format, D3D12_RESOURCE_FLAGS flags, D3D12_RESOURCE_STATES init_state, std::wstring_view name = L"");
         GpuTexture2D(ID3D12Resource* native_resource, D3D12_RESOURCE_STATES curr_state, std::wstring_view name = L"") noexcept;
         ~GpuTexture2D() noexcept;
 
@@ -42,8 +49,11 @@ namespace MotionToGo
         void Transition(GpuCommandList& cmd_list, uint32_t sub_resource, D3D12_RESOURCE_STATES target_state) const;
         void Transition(GpuCommandList& cmd_list, D3D12_RESOURCE_STATES target_state) const;
 
-        void Upload(GpuSystem& gpu_system, GpuCommandList& cmd_list, uint32_t sub_resource, const void* data);
-        void Readback(GpuSystem& gpu_system, GpuCommandList& cmd_list, uint32_t sub_resource, void* data) const;
+        void Upload(GpuSystem& gpu_system, GpuCommandList& cmd_list, uint32_t sub_resource, const void* data, uint32_t row_pitch = 0);
+        // Lets the caller write the rows straight into the upload memory, at the row pitch it's given
+        void Upload(GpuSystem& gpu_system, GpuCommandList& cmd_list, uint32_t sub_resource,
+            const std::function<void(uint8_t* data, uint32_t row_pitch)>& fill);
+        void Readback(GpuSystem& gpu_system, GpuCommandList& cmd_list, uint32_t sub_resource, void* data, uint32_t row_pitch = 0) const;
         void CopyFrom(GpuSystem& gpu_system, GpuCommandList& cmd_list, const GpuTexture2D& other, uint32_t sub_resource, uint32_t dst_x,
             uint32_t dst_y, const D3D12_BOX& src_box);
 
@@ -51,9 +61,13 @@ namespace MotionToGo
         winrt::com_ptr<ID3D12Resource> resource_;
         D3D12_RESOURCE_DESC desc_{};
         mutable std::vector<D3D12_RESOURCE_STATES> curr_states_;
+        // Shared by the textures from Share(). Placed and native textures don't own their memory, they have none.
+        std::shared_ptr<TrackedMemory> tracked_memory_;
     };
 
     uint32_t FormatSize(DXGI_FORMAT fmt) noexcept;
+    D3D12_RESOURCE_DESC Texture2DDesc(
+        uint32_t width, uint32_t height, uint32_t mip_levels, DXGI_FORMAT format, D3D12_RESOURCE_FLAGS flags) noexcept;
     uint32_t NumPlanes(DXGI_FORMAT fmt) noexcept;
     void SubResourceToMipLevelPlane(uint32_t sub_resource, uint32_t num_mip_levels, uint32_t& mip, uint32_t& plane);
 } // namespace MotionToGo
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <directx/d3d12.h>
+
+#include "Noncopyable.hpp"
+
+namespace MotionToGo
+{
+    struct GpuTextureKey
+    {
+        uint32_t width;
+        uint32_t height;
+        DXGI_FORMAT format;
+        D3D12_RESOURCE_FLAGS flags;
+
+        bool operator==(const GpuTextureKey& other) const noexcept = default;
+    };
+
+    struct GpuTexturePoolStats
+    {
+        // Acquires served from the pool, and the ones that had to create a texture
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        // Held by the pool, waiting for their fence or a new owner
+        uint64_t resident_bytes = 0;
+        uint64_t peak_resident_bytes = 0;
+    };
+
+    // Recycles textures by (width, height, format, flags). A released texture goes back to an owner only once the fence value of the
+    // frame it was last used in completes. The pool knows nothing of the device, GpuSystem brings the fences and creates the
+    // textures, so any Texture type does.
+    template <typename Texture>
+    class GpuTexturePool final
+    {
+        DISALLOW_COPY_AND_ASSIGN(GpuTexturePool)
+
+    public:
+        GpuTexturePool() noexcept = default;
+
+        GpuTexturePool(GpuTexturePool&& other) noexcept = default;
+        GpuTexturePool& operator=(GpuTexturePool&& other) noexcept = default;
+
+        // create() makes a new texture on a miss. The content of a recycled one is undefined.
+        template <typename CreateFunc>
+        Texture Acquire(const GpuTextureKey& key, uint64_t completed_fence_value, CreateFunc&& create)
+        {
+            for (auto iter = entries_.begin(); iter != entries_.end(); ++iter)
+            {
+                if ((iter->key == key) && (iter->fence_value <= completed_fence_value))
+                {
+                    Texture texture = std::move(iter->texture);
+                    stats_.resident_bytes -= iter->size_in_bytes;
+                    entries_.erase(iter);
+                    ++stats_.hits;
+                    return texture;
+                }
+            }
+
+            ++stats_.misses;
+            return create();
+        }
+
+        // fence_value is of the last frame that used the texture.
+        void Release(const GpuTextureKey& key, Texture&& texture, uint64_t size_in_bytes, uint64_t fence_value)
+        {
+            entries_.push_back({key, std::move(texture), size_in_bytes, fence_value});
+            stats_.resident_bytes += size_in_bytes;
+            stats_.peak_resident_bytes = std::max(stats_.peak_resident_bytes, stats_.resident_bytes);
+        }
+
+        // Destroys the textures whose fence completed. The others are still in use by the GPU.
+        void Trim(uint64_t completed_fence_value)
+        {
+            std::erase_if(entries_, [this, completed_fence_value](const Entry& entry) {
+                if (entry.fence_value <= completed_fence_value)
+                {
+                    stats_.resident_bytes -= entry.size_in_bytes;
+                    return true;
+                }
+                return false;
+            });
+        }
+
+        // The peak starts again from what the pool holds now
+        void ResetPeak() noexcept
+        {
+            stats_.peak_resident_bytes = stats_.resident_bytes;
+        }
+
+        void Clear() noexcept
+        {
+            entries_.clear();
+            stats_.resident_bytes = 0;
+        }
+
+        const GpuTexturePoolStats& Stats() const noexcept
+        {
+            return stats_;
+        }
+
+    private:
+        struct Entry
+        {
+            GpuTextureKey key;
+            Texture texture;
+            uint64_t size_in_bytes;
+            uint64_t fence_value;
+        };
+        // Oldest first, so an acquire takes the one most likely done
+        std::vector<Entry> entries_;
+
+        GpuTexturePoolStats stats_;
+    };
+} // namespace MotionToGo
@@ -0,0 +1,116 @@
+#include "GpuTransientPlanner.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace
+{
+    constexpr uint64_t AlignUp(uint64_t value, uint64_t alignment) noexcept
+    {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+} // namespace
+
+namespace MotionToGo
+{
+    GpuTransientPlanner::GpuTransientPlanner() noexcept = default;
+    GpuTransientPlanner::~GpuTransientPlanner() noexcept = default;
+
+    GpuTransientPlanner::GpuTransientPlanner(GpuTransientPlanner&& other) noexcept = default;
+    GpuTransientPlanner& GpuTransientPlanner::operator=(GpuTransientPlanner&& other) noexcept = default;
+
+    uint32_t GpuTransientPlanner::AddResource(uint64_t size_in_bytes, uint64_t alignment)
+    {
+        assert((alignment != 0) && ((alignment & (alignment - 1)) == 0));
+
+        resources_.push_back({size_in_bytes, alignment, ~0U, 0, 0});
+        return static_cast<uint32_t>(resources_.size() - 1);
+    }
+
+    void GpuTransientPlanner::Use(uint32_t resource, uint32_t pass)
+    {
+        Resource& res = resources_[resource];
+        res.first_pass = std::min(res.first_pass, pass);
+        res.last_pass = std::max(res.last_pass, pass);
+    }
+
+    uint64_t GpuTransientPlanner::Plan()
+    {
+        std::vector<uint32_t> order;
+        for (uint32_t i = 0; i < resources_.size(); ++i)
+        {
+            if (this->Used(i))
+            {
+                order.push_back(i);
+            }
+        }
+        // The large ones first, the small ones fill the gaps between them
+        std::stable_sort(order.begin(), order.end(), [this](uint32_t lhs, uint32_t rhs) {
+            return resources_[lhs].size_in_bytes > resources_[rhs].size_in_bytes;
+        });
+
+        heap_size_ = 0;
+        std::vector<const Resource*> placed;
+        std::vector<const Resource*> live;
+        for (const uint32_t index : order)
+        {
+            Resource& res = resources_[index];
+
+            live.clear();
+            for (const Resource* other : placed)
+            {
+                if ((other->first_pass <= res.last_pass) && (res.first_pass <= other->last_pass))
+                {
+                    live.push_back(other);
+                }
+            }
+            std::sort(live.begin(), live.end(), [](const Resource* lhs, const Resource* rhs) { return lhs->offset < rhs->offset; });
+
+            // The lowest offset that doesn't touch the memory of the resources living at the same time
+            uint64_t offset = 0;
+            for (const Resource* other : live)
+            {
+                if (offset + res.size_in_bytes <= other->offset)
+                {
+                    break;
+                }
+                offset = std::max(offset, AlignUp(other->offset + other->size_in_bytes, res.alignment));
+            }
+
+            res.offset = offset;
+            heap_size_ = std::max(heap_size_, offset + res.size_in_bytes);
+            placed.push_back(&res);
+        }
+
+        return heap_size_;
+    }
+
+    bool GpuTransientPlanner::Used(uint32_t resource) const noexcept
+    {
+        return resources_[resource].first_pass <= resources_[resource].last_pass;
+    }
+
+    uint64_t GpuTransientPlanner::Offset(uint32_t resource) const noexcept
+    {
+        assert(this->Used(resource));
+        return resources_[resource].offset;
+    }
+
+    uint64_t GpuTransientPlanner::HeapSize() const noexcept
+    {
+        return heap_size_;
+    }
+
+    uint64_t GpuTransientPlanner::UnaliasedSize() const noexcept
+    {
+        uint64_t size = 0;
+        for (uint32_t i = 0; i < resources_.size(); ++i)
+        {
+            if (this->Used(i))
+            {
+                size += resources_[i].size_in_bytes;
+            }
+        }
+        return size;
+    }
+} // namespace MotionToGo
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Noncopyable.hpp"
+
+namespace MotionToGo
+{
+    // Places the transient textures of a sequence of passes in one heap. A texture lives from the first pass that uses it to the last,
+    // two of them can share memory if their lives don't overlap. Only sizes and pass numbers go in, so it plans without a GPU.
+    class GpuTransientPlanner final
+    {
+        DISALLOW_COPY_AND_ASSIGN(GpuTransientPlanner)
+
+    public:
+        GpuTransientPlanner() noexcept;
+        ~GpuTransientPlanner() noexcept;
+
+        GpuTransientPlanner(GpuTransientPlanner&& other) noexcept;
+        GpuTransientPlanner& operator=(GpuTransientPlanner&& other) noexcept;
+
+        // Returns the id of the resource. The alignment is a power of 2.
+        uint32_t AddResource(uint64_t size_in_bytes, uint64_t alignment);
+        // The passes are numbered in the order they run. A resource no pass uses takes no memory.
+        void Use(uint32_t resource, uint32_t pass);
+
+        // Assigns the offsets, returns the heap size
+        uint64_t Plan();
+
+        bool Used(uint32_t resource) const noexcept;
+        uint64_t Offset(uint32_t resource) const noexcept;
+        uint64_t HeapSize() const noexcept;
+        // The used resources, each in its own memory
+        uint64_t UnaliasedSize() const noexcept;
+
+    private:
+        struct Resource
+        {
+            uint64_t size_in_bytes;
+            uint64_t alignment;
+            uint32_t first_pass;
+            uint32_t last_pass;
+            uint64_t offset;
+        };
+        std::vector<Resource> resources_;
+        uint64_t heap_size_ = 0;
+    };
+} // namespace MotionToGo
@@ -0,0 +1,597 @@
+#include "FileWriteQueue.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <format>
+#include <fstream>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "Trace/Trace.hpp"
+
+using namespace MotionToGo;
+
+namespace
+{
+    uint64_t NowNs() noexcept
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+} // namespace
+
+namespace MotionToGo
+{
+#ifdef __linux__
+    // A ring with a table of direct descriptors, one per file in flight. Each file is an OPENAT into its slot, linked to a WRITE from
+    // the slot, hard linked to a CLOSE of it. The hard link closes the file even if the write fails.
+    class FileWriteQueue::IoUring final
+    {
+        DISALLOW_COPY_AND_ASSIGN(IoUring)
+
+    public:
+        static constexpr uint32_t MaxFiles = 32;
+        // One WRITE per file, the kernel caps a write at a bit under 2 GiB
+        static constexpr uint64_t MaxFileBytes = 1ULL << 30;
+
+        static std::unique_ptr<IoUring> Create()
+        {
+            auto ring = std::unique_ptr<IoUring>(new IoUring);
+            if (!ring->Init())
+            {
+                return nullptr;
+            }
+            return ring;
+        }
+
+        ~IoUring() noexcept
+        {
+            if (ring_mem_ != MAP_FAILED)
+            {
+                munmap(ring_mem_, ring_mem_size_);
+            }
+            if (sqes_ != MAP_FAILED)
+            {
+                munmap(sqes_, sqes_size_);
+            }
+            if (ring_fd_ >= 0)
+            {
+                close(ring_fd_);
+            }
+        }
+
+        uint32_t FreeSlots() const noexcept
+        {
+            return static_cast<uint32_t>(free_slots_.size());
+        }
+
+        uint32_t NumInFlight() const noexcept
+        {
+            return MaxFiles - FreeSlots();
+        }
+
+        bool IsInFlight(const std::filesystem::path& path) const noexcept
+        {
+            return std::any_of(
+                slots_.begin(), slots_.end(), [&path](const Slot& slot) { return (slot.pending_ops > 0) && (slot.request.path == path); });
+        }
+
+        // Submits the chains of the requests, at most FreeSlots of them, in one call. Waits for a completion if wait is true, and
+        // finishes the completed files on queue.
+        void Process(FileWriteQueue& queue, std::vector<Request>& requests, bool wait)
+        {
+            assert(requests.size() <= FreeSlots());
+
+            uint32_t to_submit = 0;
+            for (auto& request : requests)
+            {
+                const uint32_t slot = free_slots_.back();
+                free_slots_.pop_back();
+                slots_[slot] = {std::move(request), 3, {}};
+                this->PrepareChain(slot);
+                to_submit += 3;
+            }
+            requests.clear();
+
+            if ((to_submit > 0) || wait)
+            {
+                const uint32_t min_complete = wait ? 1 : 0;
+                for (;;)
+                {
+                    ++unreported_syscalls_;
+                    const int ret = this->Enter(to_submit, min_complete, wait ? IORING_ENTER_GETEVENTS : 0);
+                    if (ret >= 0)
+                    {
+                        to_submit -= std::min(to_submit, static_cast<uint32_t>(ret));
+                        if (to_submit == 0)
+                        {
+                            break;
+                        }
+                    }
+                    else if ((errno != EINTR) && (errno != EAGAIN) && (errno != EBUSY))
+                    {
+                        // Only a bug can get here, the ring is sized for every chain in flight
+                        assert(false);
+                        break;
+                    }
+                }
+            }
+
+            this->Reap(queue);
+        }
+
+    private:
+        IoUring() = default;
+
+        bool Init()
+        {
+            io_uring_params params{};
+            ring_fd_ = static_cast<int>(syscall(__NR_io_uring_setup, MaxFiles * 4, &params));
+            if ((ring_fd_ < 0) || !(params.features & IORING_FEAT_SINGLE_MMAP))
+            {
+                return false;
+            }
+
+            ring_mem_size_ = std::max(params.sq_off.array + params.sq_entries * sizeof(uint32_t),
+                params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+            ring_mem_ = mmap(nullptr, ring_mem_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+            sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+            sqes_ = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+            if ((ring_mem_ == MAP_FAILED) || (sqes_ == MAP_FAILED))
+            {
+                return false;
+            }
+
+            uint8_t* ring = static_cast<uint8_t*>(ring_mem_);
+            sq_tail_ = reinterpret_cast<uint32_t*>(ring + params.sq_off.tail);
+            sq_mask_ = *reinterpret_cast<uint32_t*>(ring + params.sq_off.ring_mask);
+            sq_array_ = reinterpret_cast<uint32_t*>(ring + params.sq_off.array);
+            cq_head_ = reinterpret_cast<uint32_t*>(ring + params.cq_off.head);
+            cq_tail_ = reinterpret_cast<uint32_t*>(ring + params.cq_off.tail);
+            cq_mask_ = *reinterpret_cast<uint32_t*>(ring + params.cq_off.ring_mask);
+            cqes_ = reinterpret_cast<io_uring_cqe*>(ring + params.cq_off.cqes);
+
+            std::array<int, MaxFiles> sparse_files;
+            sparse_files.fill(-1);
+            if (syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_FILES, sparse_files.data(), MaxFiles) < 0)
+            {
+                return false;
+            }
+
+            // Kernels before 5.15 have io_uring but can't open into a direct descriptor
+            io_uring_sqe* sqe = this->NextSqe();
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->flags = IOSQE_IO_LINK;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = reinterpret_cast<uint64_t>("/");
+            sqe->open_flags = O_RDONLY | O_DIRECTORY;
+            sqe->file_index = 1;
+            sqe = this->NextSqe();
+            sqe->opcode = IORING_OP_CLOSE;
+            sqe->file_index = 1;
+            if (this->Enter(2, 2, IORING_ENTER_GETEVENTS) != 2)
+            {
+                return false;
+            }
+
+            bool supported = true;
+            const uint32_t tail = std::atomic_ref<uint32_t>(*cq_tail_).load(std::memory_order_acquire);
+            for (uint32_t head = *cq_head_; head != tail; ++head)
+            {
+                supported &= (cqes_[head & cq_mask_].res >= 0);
+            }
+            std::atomic_ref<uint32_t>(*cq_head_).store(tail, std::memory_order_release);
+            if (!supported)
+            {
+                return false;
+            }
+
+            for (uint32_t slot = 0; slot < MaxFiles; ++slot)
+            {
+                free_slots_.push_back(MaxFiles - 1 - slot);
+            }
+            return true;
+        }
+
+        int Enter(uint32_t to_submit, uint32_t min_complete, uint32_t flags) noexcept
+        {
+            return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd_, to_submit, min_complete, flags, nullptr, 0));
+        }
+
+        io_uring_sqe* NextSqe() noexcept
+        {
+            // Only this thread moves the tail. Every call submits all it prepared, so there is always room.
+            const uint32_t tail = *sq_tail_;
+            const uint32_t index = tail & sq_mask_;
+            io_uring_sqe* sqe = &static_cast<io_uring_sqe*>(sqes_)[index];
+            std::memset(sqe, 0, sizeof(*sqe));
+            sq_array_[index] = index;
+            std::atomic_ref<uint32_t>(*sq_tail_).store(tail + 1, std::memory_order_release);
+            return sqe;
+        }
+
+        void PrepareChain(uint32_t slot) noexcept
+        {
+            const Request& request = slots_[slot].request;
+
+            io_uring_sqe* sqe = this->NextSqe();
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->flags = IOSQE_IO_LINK;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = reinterpret_cast<uint64_t>(request.path.c_str());
+            sqe->len = 0644;
+            // No O_CLOEXEC, a direct descriptor isn't in the fd table and the kernel rejects it
+            sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC;
+            sqe->file_index = slot + 1;
+            sqe->user_data = slot * 4 + 0;
+
+            sqe = this->NextSqe();
+            sqe->opcode = IORING_OP_WRITE;
+            sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+            sqe->fd = static_cast<int>(slot);
+            sqe->addr = reinterpret_cast<uint64_t>(request.data.data());
+            sqe->len = static_cast<uint32_t>(request.data.size());
+            sqe->off = 0;
+            sqe->user_data = slot * 4 + 1;
+
+            sqe = this->NextSqe();
+            sqe->opcode = IORING_OP_CLOSE;
+            sqe->file_index = slot + 1;
+            sqe->user_data = slot * 4 + 2;
+        }
+
+        void Reap(FileWriteQueue& queue)
+        {
+            const uint32_t tail = std::atomic_ref<uint32_t>(*cq_tail_).load(std::memory_order_acquire);
+            for (uint32_t head = *cq_head_; head != tail; ++head)
+            {
+                const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+                const uint32_t slot = static_cast<uint32_t>(cqe.user_data / 4);
+                const uint32_t op = static_cast<uint32_t>(cqe.user_data % 4);
+                Slot& file = slots_[slot];
+
+                // The ops after a failed one are canceled, the failure is the error
+                if (file.error.empty() && (cqe.res != -ECANCELED))
+                {
+                    if (cqe.res < 0)
+                    {
+                        file.error = std::format("COULDN'T write {}: {}", file.request.path.string(), std::strerror(-cqe.res));
+                    }
+                    else if ((op == 1) && (static_cast<uint32_t>(cqe.res) != file.request.data.size()))
+                    {
+                        file.error = std::format("COULDN'T write {}: short write", file.request.path.string());
+                    }
+                }
+
+                --file.pending_ops;
+                if (file.pending_ops == 0)
+                {
+                    queue.Finish(file.request, std::move(file.error), unreported_syscalls_);
+                    unreported_syscalls_ = 0;
+                    file = {};
+                    free_slots_.push_back(slot);
+                }
+            }
+            std::atomic_ref<uint32_t>(*cq_head_).store(tail, std::memory_order_release);
+        }
+
+    private:
+        int ring_fd_ = -1;
+        void* ring_mem_ = MAP_FAILED;
+        size_t ring_mem_size_ = 0;
+        void* sqes_ = MAP_FAILED;
+        size_t sqes_size_ = 0;
+
+        uint32_t* sq_tail_ = nullptr;
+        uint32_t sq_mask_ = 0;
+        uint32_t* sq_array_ = nullptr;
+        uint32_t* cq_head_ = nullptr;
+        uint32_t* cq_tail_ = nullptr;
+        uint32_t cq_mask_ = 0;
+        io_uring_cqe* cqes_ = nullptr;
+
+        // Counted with the next file to finish, so they are in the stats by the time Flush returns
+        uint64_t unreported_syscalls_ = 0;
+
+        struct Slot
+        {
+            Request request;
+            uint32_t pending_ops;
+            std::string error;
+        };
+        std::array<Slot, MaxFiles> slots_{};
+        std::vector<uint32_t> free_slots_;
+    };
+#else
+    class FileWriteQueue::IoUring final
+    {
+    public:
+        static constexpr uint64_t MaxFileBytes = 0;
+
+        static std::unique_ptr<IoUring> Create()
+        {
+            return nullptr;
+        }
+
+        uint32_t FreeSlots() const noexcept
+        {
+            return 0;
+        }
+
+        uint32_t NumInFlight() const noexcept
+        {
+            return 0;
+        }
+
+        bool IsInFlight([[maybe_unused]] const std::filesystem::path& path) const noexcept
+        {
+            return false;
+        }
+
+        void Process([[maybe_unused]] FileWriteQueue& queue, [[maybe_unused]] std::vector<Request>& requests, [[maybe_unused]] bool wait)
+        {
+        }
+    };
+#endif
+
+    const char* FileWriteBackendName(FileWriteBackend backend) noexcept
+    {
+        switch (backend)
+        {
+        case FileWriteBackend::Blocking:
+            return "Blocking";
+
+        case FileWriteBackend::IoUring:
+            return "IoUring";
+
+        default:
+            return "Unknown";
+        }
+    }
+
+    bool IsIoUringSupported()
+    {
+        static const bool supported = FileWriteQueue::IoUring::Create() != nullptr;
+        return supported;
+    }
+
+    uint32_t FileWriteLatencyPercentile(const FileWriteStats& stats, float percentile)
+    {
+        if (stats.latencies_us.empty())
+        {
+            return 0;
+        }
+
+        // Nearest rank
+        std::vector<uint32_t> latencies = stats.latencies_us;
+        const size_t rank = std::clamp<size_t>(static_cast<size_t>(std::ceil(percentile / 100 * latencies.size())), 1, latencies.size());
+        std::nth_element(latencies.begin(), latencies.begin() + (rank - 1), latencies.end());
+        return latencies[rank - 1];
+    }
+
+    FileWriteQueue::FileWriteQueue(FileWriteBackend backend)
+    {
+        if (backend == FileWriteBackend::IoUring)
+        {
+            io_uring_ = IoUring::Create();
+        }
+
+        write_thread_ = std::thread([this] { this->WriteThreadFunc(); });
+    }
+
+    FileWriteQueue::~FileWriteQueue() noexcept
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            quit_ = true;
+        }
+        queued_cv_.notify_one();
+        write_thread_.join();
+    }
+
+    FileWriteBackend FileWriteQueue::ActiveBackend() const noexcept
+    {
+        return io_uring_ ? FileWriteBackend::IoUring : FileWriteBackend::Blocking;
+    }
+
+    void FileWriteQueue::Write(std::filesystem::path path, std::vector<uint8_t>&& data)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queued_.push_back({std::move(path), std::move(data), NowNs(), {}});
+        }
+        queued_cv_.notify_one();
+    }
+
+    void FileWriteQueue::Link(std::filesystem::path path, std::filesystem::path target)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queued_.push_back({std::move(path), {}, NowNs(), std::move(target)});
+        }
+        queued_cv_.notify_one();
+    }
+
+    void FileWriteQueue::Flush()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        idle_cv_.wait(lock, [this] { return queued_.empty() && (in_flight_ == 0); });
+
+        if (!errors_.empty())
+        {
+            const std::string error = std::move(errors_.front());
+            errors_.clear();
+            throw std::runtime_error(error);
+        }
+    }
+
+    FileWriteStats FileWriteQueue::Stats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_;
+    }
+
+    void FileWriteQueue::WriteThreadFunc()
+    {
+        std::vector<Request> batch;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                const uint32_t ring_in_flight = io_uring_ ? io_uring_->NumInFlight() : 0;
+                queued_cv_.wait(lock, [this, ring_in_flight] { return quit_ || !queued_.empty() || (ring_in_flight > 0); });
+                if (quit_ && queued_.empty() && (ring_in_flight == 0))
+                {
+                    break;
+                }
+
+                // A link goes alone, once the files before it are done. A file already in the batch or in flight waits for that write
+                // to finish, the chains of one submission complete in any order.
+                const size_t max_batch = io_uring_ ? io_uring_->FreeSlots() : queued_.size();
+                while (!queued_.empty() && (batch.size() < max_batch))
+                {
+                    const Request& request = queued_.front();
+                    if (!request.link_target.empty() && (!batch.empty() || (ring_in_flight > 0)))
+                    {
+                        break;
+                    }
+                    if (std::any_of(batch.begin(), batch.end(), [&request](const Request& other) { return other.path == request.path; }) ||
+                        (io_uring_ && io_uring_->IsInFlight(request.path)))
+                    {
+                        break;
+                    }
+
+                    const bool link = !queued_.front().link_target.empty();
+                    batch.push_back(std::move(queued_.front()));
+                    queued_.pop_front();
+                    if (link)
+                    {
+                        break;
+                    }
+                }
+                in_flight_ += static_cast<uint32_t>(batch.size());
+            }
+
+            GO_MOTION_TRACE_SCOPE("WriteFiles");
+
+            // Open, write and close
+            constexpr uint32_t BlockingSyscalls = 3;
+            // Remove a stale temporary file, link or copy, rename, and remove what a rename to the same file leaves
+            constexpr uint32_t LinkSyscalls = 4;
+            if ((batch.size() == 1) && !batch[0].link_target.empty())
+            {
+                this->Finish(batch[0], LinkBlocking(batch[0]), LinkSyscalls);
+                batch.clear();
+            }
+            else if (io_uring_)
+            {
+                // Bigger files than a write takes go the blocking way
+                for (auto iter = batch.begin(); iter != batch.end();)
+                {
+                    if (iter->data.size() > IoUring::MaxFileBytes)
+                    {
+                        this->Finish(*iter, WriteBlocking(*iter), BlockingSyscalls);
+                        iter = batch.erase(iter);
+                    }
+                    else
+                    {
+                        ++iter;
+                    }
+                }
+
+                io_uring_->Process(*this, batch, batch.empty());
+            }
+            else
+            {
+                for (const auto& request : batch)
+                {
+                    this->Finish(request, WriteBlocking(request), BlockingSyscalls);
+                }
+                batch.clear();
+            }
+        }
+    }
+
+    std::string FileWriteQueue::WriteBlocking(const Request& request)
+    {
+        std::ofstream ofs(request.path, std::ios_base::binary);
+        if (ofs)
+        {
+            ofs.write(reinterpret_cast<const char*>(request.data.data()), request.data.size());
+            ofs.close();
+        }
+        if (!ofs)
+        {
+            return std::format("COULDN'T write {}", request.path.string());
+        }
+        return {};
+    }
+
+    std::string FileWriteQueue::LinkBlocking(const Request& request)
+    {
+        // Made next to the destination and renamed over it, so a failed link leaves the existing file as it was
+        std::filesystem::path temp_path = request.path;
+        temp_path += ".link.tmp";
+
+        // One left by a crash could be a hard link to another output, don't copy into it
+        std::error_code ec;
+        std::filesystem::remove(temp_path, ec);
+        std::filesystem::create_hard_link(request.link_target, temp_path, ec);
+        if (ec)
+        {
+            ec.clear();
+            std::filesystem::copy_file(request.link_target, temp_path, ec);
+        }
+        if (!ec)
+        {
+            std::filesystem::rename(temp_path, request.path, ec);
+        }
+
+        // Renaming over another link to the same file succeeds without removing the temporary one
+        std::error_code remove_ec;
+        std::filesystem::remove(temp_path, remove_ec);
+        if (ec)
+        {
+            return std::format("COULDN'T link {} to {}: {}", request.path.string(), request.link_target.string(), ec.message());
+        }
+        return {};
+    }
+
+    void FileWriteQueue::Finish(const Request& request, std::string error, uint64_t syscalls)
+    {
+        const uint64_t latency_us = (NowNs() - request.queued_ns) / 1000;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            ++stats_.files;
+            if (!request.link_target.empty())
+            {
+                ++stats_.links;
+            }
+            stats_.bytes += request.data.size();
+            stats_.syscalls += syscalls;
+            stats_.latencies_us.push_back(static_cast<uint32_t>(std::min<uint64_t>(latency_us, ~0U)));
+            if (!error.empty())
+            {
+                errors_.push_back(std::move(error));
+            }
+
+            --in_flight_;
+        }
+        idle_cv_.notify_all();
+    }
+} // namespace MotionToGo
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Noncopyable.hpp"
+
+namespace MotionToGo
+{
+    enum class FileWriteBackend : uint32_t
+    {
+        // Opens, writes and closes the files one by one on the queue's thread. Works everywhere.
+        Blocking,
+        // The open, write and close of each file are one linked io_uring chain, and a batch of files is one submission. Linux only.
+        IoUring,
+    };
+
+    const char* FileWriteBackendName(FileWriteBackend backend) noexcept;
+
+    // The kernel has io_uring, with the direct descriptors the chains need, and it isn't disabled.
+    bool IsIoUringSupported();
+
+    struct FileWriteStats
+    {
+        uint64_t files = 0;
+        // Of the files, the ones from Link
+        uint64_t links = 0;
+        uint64_t bytes = 0;
+        // Calls into the OS. The io_uring_enter for IoUring, the open, write and close of each file for Blocking.
+        uint64_t syscalls = 0;
+        // From Write to the file being closed, in microseconds, one per file.
+        std::vector<uint32_t> latencies_us;
+    };
+
+    // The latency below which percentile (in [0, 100]) of the files finished. 0 without files.
+    uint32_t FileWriteLatencyPercentile(const FileWriteStats& stats, float percentile);
+
+    // Writes whole files on a thread of its own, so the threads producing them never wait for the storage. The requests queued while
+    // a batch is in flight are submitted together.
+    class FileWriteQueue final
+    {
+        DISALLOW_COPY_AND_ASSIGN(FileWriteQueue)
+
+        friend bool IsIoUringSupported();
+
+    public:
+        // IoUring falls back to Blocking if it isn't supported.
+        explicit FileWriteQueue(FileWriteBackend backend);
+        // Finishes the queued writes, and drops their errors.
+        ~FileWriteQueue() noexcept;
+
+        FileWriteBackend ActiveBackend() const noexcept;
+
+        // Creates or replaces the file at path with data. Doesn't wait for the write. Writes to one path land in the order they are
+        // queued.
+        void Write(std::filesystem::path path, std::vector<uint8_t>&& data);
+        // Creates or replaces the file at path with a hard link to target, or a copy of it where hard links aren't supported. It
+        // waits for the requests queued before it, so target can be one of them. Doesn't wait for the link.
+        void Link(std::filesystem::path path, std::filesystem::path target);
+        // Waits for every queued write. Throws the first error since the last Flush.
+        void Flush();
+
+        FileWriteStats Stats() const;
+
+    private:
+        struct Request
+        {
+            std::filesystem::path path;
+            std::vector<uint8_t> data;
+            uint64_t queued_ns;
+            // Not empty for a Link
+            std::filesystem::path link_target;
+        };
+
+        class IoUring;
+
+        void WriteThreadFunc();
+        // Returns the error, empty on success
+        static std::string WriteBlocking(const Request& request);
+        static std::string LinkBlocking(const Request& request);
+        void Finish(const Request& request, std::string error, uint64_t syscalls);
+
+    private:
+        // Null with the Blocking backend
+        std::unique_ptr<IoUring> io_uring_;
+
+        mutable std::mutex mutex_;
+        std::condition_variable queued_cv_;
+        std::condition_variable idle_cv_;
+        std::deque<Request> queued_;
+        uint32_t in_flight_ = 0;
+        bool quit_ = false;
+        std::vector<std::string> errors_;
+        FileWriteStats stats_;
+
+        std::thread write_thread_;
+    };
+} // namespace MotionToGo
@@ -0,0 +1,267 @@
+#include "FrameBufferPool.hpp"
+
+#include <algorithm>
+#include <format>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "Trace/MemoryTracker.hpp"
+
+using namespace MotionToGo;
+
+namespace
+{
+    constexpr size_t HugePageSize = 2 * 1024 * 1024;
+
+    size_t PageSize() noexcept
+    {
+#ifdef _WIN32
+        SYSTEM_INFO info;
+        ::GetSystemInfo(&info);
+        return info.dwPageSize;
+#else
+        return static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+#endif
+    }
+
+    // Frame sized buffers round up to whole huge pages, the small ones to pages
+    size_t Capacity(size_t size) noexcept
+    {
+        const size_t granularity = size >= HugePageSize ? HugePageSize : PageSize();
+        return (std::max<size_t>(size, 1) + granularity - 1) / granularity * granularity;
+    }
+
+    uint8_t* AllocatePages(size_t capacity)
+    {
+        void* data;
+#ifdef _WIN32
+        // Large pages need the lock pages privilege, most processes don't have it
+        data = nullptr;
+        const size_t large_page_size = ::GetLargePageMinimum();
+        if ((large_page_size != 0) && (capacity % large_page_size == 0))
+        {
+            data = ::VirtualAlloc(nullptr, capacity, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        }
+        if (data == nullptr)
+        {
+            data = ::VirtualAlloc(nullptr, capacity, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+        }
+#else
+        data = ::mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (data == MAP_FAILED)
+        {
+            data = nullptr;
+        }
+#ifdef MADV_HUGEPAGE
+        else if (capacity >= HugePageSize)
+        {
+            // Only a hint, transparent huge pages can be off
+            ::madvise(data, capacity, MADV_HUGEPAGE);
+        }
+#endif
+#endif
+        if (data == nullptr)
+        {
+            throw std::runtime_error(std::format("COULDN'T allocate a {} byte frame buffer", capacity));
+        }
+        MemoryTracker::Allocate(MemoryCategory::CpuFrameBuffers, capacity);
+        return static_cast<uint8_t*>(data);
+    }
+
+    void FreePages(uint8_t* data, size_t capacity) noexcept
+    {
+#ifdef _WIN32
+        ::VirtualFree(data, 0, MEM_RELEASE);
+#else
+        ::munmap(data, capacity);
+#endif
+        MemoryTracker::Free(MemoryCategory::CpuFrameBuffers, capacity);
+    }
+} // namespace
+
+namespace MotionToGo
+{
+    struct FrameBuffer::Shared
+    {
+        std::mutex mutex;
+        // By capacity
+        std::unordered_map<size_t, std::vector<uint8_t*>> idle;
+        FrameBufferPoolStats stats;
+        // The pool is gone, the released buffers go back to the OS
+        bool closed = false;
+
+        void Trim() noexcept
+        {
+            for (auto& [capacity, buffers] : idle)
+            {
+                for (uint8_t* data : buffers)
+                {
+                    FreePages(data, capacity);
+                    stats.bytes -= capacity;
+                }
+            }
+            idle.clear();
+        }
+    };
+
+    FrameBuffer::FrameBuffer() noexcept = default;
+
+    FrameBuffer::FrameBuffer(std::shared_ptr<Shared> pool, uint8_t* data, size_t size, size_t capacity) noexcept
+        : pool_(std::move(pool)), data_(data), size_(size), capacity_(capacity)
+    {
+    }
+
+    FrameBuffer::~FrameBuffer() noexcept
+    {
+        this->Release();
+    }
+
+    FrameBuffer::FrameBuffer(FrameBuffer&& other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    FrameBuffer& FrameBuffer::operator=(FrameBuffer&& other) noexcept
+    {
+        if (this != &other)
+        {
+            this->Release();
+
+            pool_ = std::move(other.pool_);
+            data_ = std::exchange(other.data_, nullptr);
+            size_ = std::exchange(other.size_, 0);
+            capacity_ = std::exchange(other.capacity_, 0);
+        }
+        return *this;
+    }
+
+    FrameBuffer::operator bool() const noexcept
+    {
+        return data_ != nullptr;
+    }
+
+    uint8_t* FrameBuffer::Data() noexcept
+    {
+        return data_;
+    }
+
+    const uint8_t* FrameBuffer::Data() const noexcept
+    {
+        return data_;
+    }
+
+    size_t FrameBuffer::Size() const noexcept
+    {
+        return size_;
+    }
+
+    std::span<uint8_t> FrameBuffer::Span() noexcept
+    {
+        return {data_, size_};
+    }
+
+    std::span<const uint8_t> FrameBuffer::Span() const noexcept
+    {
+        return {data_, size_};
+    }
+
+    void FrameBuffer::Release() noexcept
+    {
+        if (data_ == nullptr)
+        {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(pool_->mutex);
+            if (pool_->closed)
+            {
+                FreePages(data_, capacity_);
+                pool_->stats.bytes -= capacity_;
+            }
+            else
+            {
+                try
+                {
+                    pool_->idle[capacity_].push_back(data_);
+                }
+                catch (...)
+                {
+                    FreePages(data_, capacity_);
+                    pool_->stats.bytes -= capacity_;
+                }
+            }
+        }
+
+        pool_.reset();
+        data_ = nullptr;
+        size_ = 0;
+        capacity_ = 0;
+    }
+
+    FrameBufferPool::FrameBufferPool() : shared_(std::make_shared<FrameBuffer::Shared>())
+    {
+    }
+
+    FrameBufferPool::~FrameBufferPool() noexcept
+    {
+        std::lock_guard<std::mutex> lock(shared_->mutex);
+        shared_->Trim();
+        shared_->closed = true;
+    }
+
+    FrameBuffer FrameBufferPool::Acquire(size_t size)
+    {
+        const size_t capacity = Capacity(size);
+
+        {
+            std::lock_guard<std::mutex> lock(shared_->mutex);
+            ++shared_->stats.acquires;
+
+            auto iter = shared_->idle.find(capacity);
+            if ((iter != shared_->idle.end()) && !iter->second.empty())
+            {
+                uint8_t* data = iter->second.back();
+                iter->second.pop_back();
+                ++shared_->stats.hits;
+                return FrameBuffer(shared_, data, size, capacity);
+            }
+        }
+
+        // Outside the lock, the OS zeroes the pages
+        uint8_t* data = AllocatePages(capacity);
+
+        std::lock_guard<std::mutex> lock(shared_->mutex);
+        shared_->stats.bytes += capacity;
+        shared_->stats.peak_bytes = std::max(shared_->stats.peak_bytes, shared_->stats.bytes);
+        return FrameBuffer(shared_, data, size, capacity);
+    }
+
+    void FrameBufferPool::Trim() noexcept
+    {
+        std::lock_guard<std::mutex> lock(shared_->mutex);
+        shared_->Trim();
+    }
+
+    FrameBufferPoolStats FrameBufferPool::Stats() const
+    {
+        std::lock_guard<std::mutex> lock(shared_->mutex);
+        return shared_->stats;
+    }
+} // namespace MotionToGo
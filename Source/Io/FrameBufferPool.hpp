@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <span>
+
+#include "Noncopyable.hpp"
+
+namespace MotionToGo
+{
+    struct FrameBufferPoolStats
+    {
+        uint64_t acquires = 0;
+        // Of the acquires, the ones that got a released buffer back
+        uint64_t hits = 0;
+        // Allocated from the OS, in use or idle in the pool
+        uint64_t bytes = 0;
+        uint64_t peak_bytes = 0;
+    };
+
+    class FrameBufferPool;
+
+    // A page aligned buffer of a FrameBufferPool. Destroying it, on any thread, gives the memory back to the pool for the next
+    // Acquire of the same size. It can outlive the pool.
+    class FrameBuffer final
+    {
+        DISALLOW_COPY_AND_ASSIGN(FrameBuffer)
+
+        friend class FrameBufferPool;
+
+    public:
+        FrameBuffer() noexcept;
+        ~FrameBuffer() noexcept;
+
+        FrameBuffer(FrameBuffer&& other) noexcept;
+        FrameBuffer& operator=(FrameBuffer&& other) noexcept;
+
+        explicit operator bool() const noexcept;
+
+        uint8_t* Data() noexcept;
+        const uint8_t* Data() const noexcept;
+        size_t Size() const noexcept;
+
+        std::span<uint8_t> Span() noexcept;
+        std::span<const uint8_t> Span() const noexcept;
+
+    private:
+        struct Shared;
+
+        FrameBuffer(std::shared_ptr<Shared> pool, uint8_t* data, size_t size, size_t capacity) noexcept;
+        void Release() noexcept;
+
+    private:
+        std::shared_ptr<Shared> pool_;
+        uint8_t* data_ = nullptr;
+        size_t size_ = 0;
+        size_t capacity_ = 0;
+    };
+
+    // Recycles the frame sized buffers that go from the readback to the writers, instead of allocating and faulting in tens of MB
+    // per frame. The buffers are allocated straight from the OS, so they're page aligned, and backed by huge pages where the OS
+    // gives them. Thread safe.
+    class FrameBufferPool final
+    {
+        DISALLOW_COPY_AND_ASSIGN(FrameBufferPool)
+
+    public:
+        FrameBufferPool();
+        ~FrameBufferPool() noexcept;
+
+        // The content is undefined, a buffer comes back as its last user left it.
+        FrameBuffer Acquire(size_t size);
+
+        // Frees the idle buffers, the ones in use go back to the OS when they're released.
+        void Trim() noexcept;
+
+        FrameBufferPoolStats Stats() const;
+
+    private:
+        std::shared_ptr<FrameBuffer::Shared> shared_;
+    };
+} // namespace MotionToGo
@@ -0,0 +1,191 @@
+#include "MappedFile.hpp"
+
+#include <algorithm>
+#include <format>
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace MotionToGo
+{
+    MappedFile::MappedFile() noexcept = default;
+
+    MappedFile::MappedFile(const std::filesystem::path& path)
+    {
+#ifdef _WIN32
+        HANDLE file =
+            ::CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            throw std::runtime_error(std::format("COULDN'T open {}", path.string()));
+        }
+
+        LARGE_INTEGER size;
+        if (!::GetFileSizeEx(file, &size))
+        {
+            ::CloseHandle(file);
+            throw std::runtime_error(std::format("COULDN'T open {}", path.string()));
+        }
+        size_ = size.QuadPart;
+
+        // A mapping can't be empty
+        if (size_ > 0)
+        {
+            // The mapping keeps the file open
+            mapping_ = ::CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            ::CloseHandle(file);
+            if (mapping_ != nullptr)
+            {
+                data_ = static_cast<const uint8_t*>(::MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+            }
+            if (data_ == nullptr)
+            {
+                this->Close();
+                throw std::runtime_error(std::format("COULDN'T map {}", path.string()));
+            }
+        }
+        else
+        {
+            ::CloseHandle(file);
+        }
+#else
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            throw std::runtime_error(std::format("COULDN'T open {}", path.string()));
+        }
+
+        struct stat file_stat;
+        if (::fstat(fd, &file_stat) != 0)
+        {
+            ::close(fd);
+            throw std::runtime_error(std::format("COULDN'T open {}", path.string()));
+        }
+        size_ = file_stat.st_size;
+
+        if (size_ > 0)
+        {
+            // The mapping keeps the file open
+            void* data = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (data == MAP_FAILED)
+            {
+                size_ = 0;
+                throw std::runtime_error(std::format("COULDN'T map {}", path.string()));
+            }
+            data_ = static_cast<const uint8_t*>(data);
+            ::madvise(data, size_, MADV_SEQUENTIAL);
+        }
+        else
+        {
+            ::close(fd);
+        }
+#endif
+    }
+
+    MappedFile::~MappedFile() noexcept
+    {
+        this->Close();
+    }
+
+    MappedFile::MappedFile(MappedFile&& other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+    {
+        if (this != &other)
+        {
+            this->Close();
+
+            data_ = std::exchange(other.data_, nullptr);
+            size_ = std::exchange(other.size_, 0);
+#ifdef _WIN32
+            mapping_ = std::exchange(other.mapping_, nullptr);
+#endif
+        }
+        return *this;
+    }
+
+    std::span<const uint8_t> MappedFile::Data() const noexcept
+    {
+        return {data_, static_cast<size_t>(size_)};
+    }
+
+    void MappedFile::WillNeed(uint64_t offset, uint64_t size) const noexcept
+    {
+        this->Advise(offset, size, false);
+    }
+
+    void MappedFile::Populate(uint64_t offset, uint64_t size) const noexcept
+    {
+        this->Advise(offset, size, true);
+    }
+
+    void MappedFile::Advise(uint64_t offset, uint64_t size, bool populate) const noexcept
+    {
+        if (offset >= size_)
+        {
+            return;
+        }
+        size = std::min(size, size_ - offset);
+
+#ifdef _WIN32
+        // Reads the pages in and maps them either way
+        (void)populate;
+        WIN32_MEMORY_RANGE_ENTRY range{const_cast<uint8_t*>(data_ + offset), static_cast<SIZE_T>(size)};
+        ::PrefetchVirtualMemory(::GetCurrentProcess(), 1, &range, 0);
+#else
+        // madvise wants a page aligned address
+        const uint64_t page_size = static_cast<uint64_t>(::sysconf(_SC_PAGESIZE));
+        const uint64_t aligned_offset = offset / page_size * page_size;
+        uint8_t* addr = const_cast<uint8_t*>(data_ + aligned_offset);
+        size += offset - aligned_offset;
+#ifdef MADV_POPULATE_READ
+        // Linux 5.14+, the older ones fault the pages in as they are touched
+        if (populate && (::madvise(addr, size, MADV_POPULATE_READ) == 0))
+        {
+            return;
+        }
+#endif
+        ::madvise(addr, size, MADV_WILLNEED);
+#endif
+    }
+
+    void MappedFile::Close() noexcept
+    {
+#ifdef _WIN32
+        if (data_ != nullptr)
+        {
+            ::UnmapViewOfFile(data_);
+        }
+        if (mapping_ != nullptr)
+        {
+            ::CloseHandle(mapping_);
+            mapping_ = nullptr;
+        }
+#else
+        if (data_ != nullptr)
+        {
+            ::munmap(const_cast<uint8_t*>(data_), size_);
+        }
+#endif
+        data_ = nullptr;
+        size_ = 0;
+    }
+} // namespace MotionToGo
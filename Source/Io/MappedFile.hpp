@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <span>
+
+#include "Noncopyable.hpp"
+
+namespace MotionToGo
+{
+    // A read only view of a whole file. The pages are read on first touch, and mapped for sequential reading, so the OS reads ahead
+    // and drops the pages behind.
+    class MappedFile final
+    {
+        DISALLOW_COPY_AND_ASSIGN(MappedFile)
+
+    public:
+        MappedFile() noexcept;
+        explicit MappedFile(const std::filesystem::path& path);
+        ~MappedFile() noexcept;
+
+        MappedFile(MappedFile&& other) noexcept;
+        MappedFile& operator=(MappedFile&& other) noexcept;
+
+        std::span<const uint8_t> Data() const noexcept;
+
+        // Starts reading the range in the background. Only a hint.
+        void WillNeed(uint64_t offset, uint64_t size) const noexcept;
+        // Reads the range in and maps it now, so touching it doesn't fault page by page.
+        void Populate(uint64_t offset, uint64_t size) const noexcept;
+
+    private:
+        void Advise(uint64_t offset, uint64_t size, bool populate) const noexcept;
+        void Close() noexcept;
+
+    private:
+        const uint8_t* data_ = nullptr;
+        uint64_t size_ = 0;
+#ifdef _WIN32
+        void* mapping_ = nullptr;
+#endif
+    };
+} // namespace MotionToGo
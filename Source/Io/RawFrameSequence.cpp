@@ -0,0 +1,160 @@
+#include "RawFrameSequence.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <format>
+#include <stdexcept>
+#include <string>
+
+#include "Trace/Trace.hpp"
+
+namespace MotionToGo
+{
+    bool RawPixelFormatFromPath(const std::filesystem::path& path, RawPixelFormat& format)
+    {
+        std::string ext = path.extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), [](char ch) { return static_cast<char>(std::tolower(ch)); });
+        if (ext == ".rgba")
+        {
+            format = RawPixelFormat::Rgba8;
+            return true;
+        }
+        if (ext == ".nv12")
+        {
+            format = RawPixelFormat::Nv12;
+            return true;
+        }
+        return false;
+    }
+
+    uint64_t RawFrameBytes(RawPixelFormat format, uint32_t width, uint32_t height) noexcept
+    {
+        const uint64_t pixels = static_cast<uint64_t>(width) * height;
+        return format == RawPixelFormat::Rgba8 ? pixels * 4 : pixels * 3 / 2;
+    }
+
+    RawFrameSequence::RawFrameSequence(const std::filesystem::path& path, uint32_t width, uint32_t height)
+        : width_(width), height_(height)
+    {
+        if ((width == 0) || (height == 0))
+        {
+            throw std::runtime_error(std::format("Invalid raw frame size {}x{}", width, height));
+        }
+
+        if (std::filesystem::is_directory(path))
+        {
+            bool has_format = false;
+            for (const auto& entry : std::filesystem::directory_iterator(path))
+            {
+                RawPixelFormat format;
+                if (!entry.is_directory() && RawPixelFormatFromPath(entry.path(), format))
+                {
+                    if (has_format && (format != format_))
+                    {
+                        throw std::runtime_error(std::format("{} has both .rgba and .nv12 frames", path.string()));
+                    }
+                    format_ = format;
+                    has_format = true;
+                    frame_files_.push_back(entry.path());
+                }
+            }
+            if (frame_files_.empty())
+            {
+                throw std::runtime_error(std::format("{} has no .rgba or .nv12 frames", path.string()));
+            }
+            std::sort(frame_files_.begin(), frame_files_.end());
+
+            frame_bytes_ = RawFrameBytes(format_, width, height);
+            for (const auto& file : frame_files_)
+            {
+                if (std::filesystem::file_size(file) != frame_bytes_)
+                {
+                    throw std::runtime_error(std::format("{} isn't a {}x{} frame", file.string(), width, height));
+                }
+            }
+            num_frames_ = static_cast<uint32_t>(frame_files_.size());
+        }
+        else
+        {
+            if (!RawPixelFormatFromPath(path, format_))
+            {
+                throw std::runtime_error(std::format("{} isn't a .rgba or .nv12 file", path.string()));
+            }
+
+            frame_bytes_ = RawFrameBytes(format_, width, height);
+            concatenated_ = MappedFile(path);
+            const uint64_t size = concatenated_.Data().size();
+            if ((size == 0) || (size % frame_bytes_ != 0))
+            {
+                throw std::runtime_error(std::format("{} isn't a sequence of {}x{} frames", path.string(), width, height));
+            }
+            num_frames_ = static_cast<uint32_t>(size / frame_bytes_);
+            concatenated_.WillNeed(0, frame_bytes_ * (1 + ReadAheadFrames));
+        }
+
+        if ((format_ == RawPixelFormat::Nv12) && ((width & 1) || (height & 1)))
+        {
+            throw std::runtime_error(std::format("NV12 frames MUST have even width and height, not {}x{}", width, height));
+        }
+    }
+
+    RawFrameSequence::~RawFrameSequence() noexcept = default;
+
+    RawPixelFormat RawFrameSequence::Format() const noexcept
+    {
+        return format_;
+    }
+
+    uint32_t RawFrameSequence::Width() const noexcept
+    {
+        return width_;
+    }
+
+    uint32_t RawFrameSequence::Height() const noexcept
+    {
+        return height_;
+    }
+
+    uint32_t RawFrameSequence::NumFrames() const noexcept
+    {
+        return num_frames_;
+    }
+
+    std::span<const uint8_t> RawFrameSequence::Frame(uint32_t index)
+    {
+        GO_MOTION_TRACE_SCOPE("MapRawFrame");
+
+        assert(index < num_frames_);
+
+        const uint32_t last_ahead = std::min(index + ReadAheadFrames, num_frames_ - 1);
+        if (frame_files_.empty())
+        {
+            concatenated_.Populate(index * frame_bytes_, frame_bytes_);
+            concatenated_.WillNeed((index + 1) * frame_bytes_, (last_ahead - index) * frame_bytes_);
+            return concatenated_.Data().subspan(index * frame_bytes_, frame_bytes_);
+        }
+
+        // Slide the window of mapped files to start at index
+        if ((index < first_mapped_frame_) || (index >= first_mapped_frame_ + mapped_frames_.size()))
+        {
+            mapped_frames_.clear();
+            first_mapped_frame_ = index;
+        }
+        mapped_frames_.erase(mapped_frames_.begin(), mapped_frames_.begin() + (index - first_mapped_frame_));
+        first_mapped_frame_ = index;
+        while (first_mapped_frame_ + mapped_frames_.size() <= last_ahead)
+        {
+            const std::filesystem::path& file = frame_files_[first_mapped_frame_ + mapped_frames_.size()];
+            MappedFile& mapped = mapped_frames_.emplace_back(file);
+            if (mapped.Data().size() != frame_bytes_)
+            {
+                throw std::runtime_error(std::format("{} isn't a {}x{} frame", file.string(), width_, height_));
+            }
+            mapped.WillNeed(0, frame_bytes_);
+        }
+
+        mapped_frames_.front().Populate(0, frame_bytes_);
+        return mapped_frames_.front().Data();
+    }
+} // namespace MotionToGo
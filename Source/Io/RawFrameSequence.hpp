@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <vector>
+
+#include "Io/MappedFile.hpp"
+#include "Noncopyable.hpp"
+
+namespace MotionToGo
+{
+    enum class RawPixelFormat : uint32_t
+    {
+        // Tightly packed RGBA8, .rgba files
+        Rgba8,
+        // Tightly packed Y, then the interleaved half resolution UV, .nv12 files
+        Nv12,
+    };
+
+    // The format of .rgba and .nv12 files, in any case. False for the other extensions.
+    bool RawPixelFormatFromPath(const std::filesystem::path& path, RawPixelFormat& format);
+
+    uint64_t RawFrameBytes(RawPixelFormat format, uint32_t width, uint32_t height) noexcept;
+
+    // Already decoded frames, read through memory maps without copying. Either one file of concatenated frames, or a directory of one
+    // file per frame in name order.
+    class RawFrameSequence final
+    {
+        DISALLOW_COPY_AND_ASSIGN(RawFrameSequence)
+
+    public:
+        // Of the frames after the one read, the OS is asked to read ahead these
+        static constexpr uint32_t ReadAheadFrames = 2;
+
+        RawFrameSequence(const std::filesystem::path& path, uint32_t width, uint32_t height);
+        ~RawFrameSequence() noexcept;
+
+        RawPixelFormat Format() const noexcept;
+        uint32_t Width() const noexcept;
+        uint32_t Height() const noexcept;
+        uint32_t NumFrames() const noexcept;
+
+        // Points into the mapping, valid until the next call.
+        std::span<const uint8_t> Frame(uint32_t index);
+
+    private:
+        RawPixelFormat format_ = RawPixelFormat::Rgba8;
+        uint32_t width_;
+        uint32_t height_;
+        uint64_t frame_bytes_ = 0;
+        uint32_t num_frames_ = 0;
+
+        // All the frames
+        MappedFile concatenated_;
+
+        // One file per frame, only the one read and the ones ahead are mapped
+        std::vector<std::filesystem::path> frame_files_;
+        std::vector<MappedFile> mapped_frames_;
+        uint32_t first_mapped_frame_ = 0;
+    };
+} // namespace MotionToGo
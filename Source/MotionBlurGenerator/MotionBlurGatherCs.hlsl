@@ -7,6 +7,10 @@ cbuffer param_cb : register(b0)
     float half_exposure;
     uint reconstruction_samples;
     float max_sample_tap_distance;
+    uint2 tile_width_height;
+    uint use_tile_lists;
+    uint min_reconstruction_samples;
+    uint first_tile_row;
 };
 
 SamplerState point_sampler : register(s0);
@@ -16,6 +20,8 @@ Texture2D frame_tex : register(t0);
 Texture2D<float2> motion_vector_tex : register(t1);
 Texture2D<float2> motion_vector_neighbor_max_tex : register(t2);
 Texture2D<float> random_tex : register(t3);
+Texture2D<uint> tile_list_tex : register(t4);
+Texture2D<uint> tile_count_tex : register(t5);
 
 RWTexture2D<unorm float4> motion_blurred_tex : register(u0);
 
@@ -31,8 +37,48 @@ float Cylinder(float mag_diff, float mag_v)
     return 1 - smoothstep(CylinderCorner1 * mag_v, CylinderCorner2 * mag_v, abs(mag_diff));
 }
 
+// Scales with the length of the blur over the tile, the same for the whole group. Matches MotionBlurTileSamples in CpuMotionBlur.cpp.
+uint TileSamples(uint2 tile)
+{
+    const float Margin = 1e-3f;
+    const float TapsPerBlurPixel = 1;
+
+    [branch]
+    if ((min_reconstruction_samples == 0) || (min_reconstruction_samples >= reconstruction_samples))
+    {
+        return reconstruction_samples;
+    }
+
+    uint2 frame_width_height;
+    frame_tex.GetDimensions(frame_width_height.x, frame_width_height.y);
+    uint2 neighbor_max_width_height;
+    motion_vector_neighbor_max_tex.GetDimensions(neighbor_max_width_height.x, neighbor_max_width_height.y);
+
+    // The texels the point sampler picks for the pixels of the tile
+    uint2 first_pixel = tile * BLOCK_DIM;
+    uint2 last_pixel = min(first_pixel + BLOCK_DIM, frame_width_height) - 1;
+    float2 texel_per_pixel = float2(neighbor_max_width_height) / frame_width_height;
+    uint2 first_texel = uint2(max(floor((first_pixel + 0.5f) * texel_per_pixel - Margin), 0));
+    uint2 last_texel = min(uint2(floor((last_pixel + 0.5f) * texel_per_pixel + Margin)), neighbor_max_width_height - 1);
+
+    float max_len_vel = 0;
+    for (uint y = first_texel.y; y <= last_texel.y; ++y)
+    {
+        for (uint x = first_texel.x; x <= last_texel.x; ++x)
+        {
+            max_len_vel = max(max_len_vel, length(motion_vector_neighbor_max_tex.Load(uint3(x, y, 0)) * 2 - 1));
+        }
+    }
+
+    // The taps along the neighbor max spread over 2 * max_sample_tap_distance pixels per unit of its length
+    float len_blur = clamp(max_len_vel * half_exposure, 0.1f, blur_radius);
+    float blur_pixels = 2 * max_sample_tap_distance * len_blur;
+    uint num_samples = uint(ceil(blur_pixels * TapsPerBlurPixel)) | 1;
+    return clamp(num_samples, min_reconstruction_samples, reconstruction_samples);
+}
+
 [numthreads(BLOCK_DIM, BLOCK_DIM, 1)]
-void main(uint3 dtid : SV_DispatchThreadID)
+void main(uint3 gid : SV_GroupID, uint3 gtid : SV_GroupThreadID)
 {
     const float Epsilon = 0.01f;
     //const float HalfVelocityCutoff = 0.25f;
@@ -40,10 +86,50 @@ void main(uint3 dtid : SV_DispatchThreadID)
     const float VarianceThreshold = 1.5f;
     const float WeightCorrectionFactor = 60;
 
-    float2 tex_coord = (dtid.xy + 0.5f) * inv_frame_width_height;
+    // Without the tile lists, the groups cover the rows from first_tile_row on
+    uint2 tile = gid.xy + uint2(0, first_tile_row);
+    bool static_tile = false;
+    [branch]
+    if (use_tile_lists)
+    {
+        // One group per tile, the static ones go first, then the uniform motion ones and the complex ones
+        uint slot = gid.y * tile_width_height.x + gid.x;
+        uint num_static = tile_count_tex.Load(uint3(0, 0, 0));
+        uint num_uniform = tile_count_tex.Load(uint3(1, 0, 0));
+        uint tile_class;
+        if (slot < num_static)
+        {
+            tile_class = 0;
+        }
+        else if (slot < num_static + num_uniform)
+        {
+            tile_class = 1;
+            slot -= num_static;
+        }
+        else
+        {
+            tile_class = 2;
+            slot -= num_static + num_uniform;
+        }
+
+        uint2 list_coord = uint2(slot % tile_width_height.x, tile_class * tile_width_height.y + slot / tile_width_height.x);
+        uint packed_tile = tile_list_tex.Load(uint3(list_coord, 0));
+        tile = uint2(packed_tile & 0xFFFF, packed_tile >> 16);
+        static_tile = (tile_class == 0);
+    }
+
+    uint2 coord = tile * BLOCK_DIM + gtid.xy;
+    float2 tex_coord = (coord + 0.5f) * inv_frame_width_height;
 
     float4 color = frame_tex.SampleLevel(linear_sampler, tex_coord, 0);
 
+    [branch]
+    if (static_tile)
+    {
+        motion_blurred_tex[coord] = color;
+        return;
+    }
+
     float2 neighbor_vel = motion_vector_neighbor_max_tex.SampleLevel(point_sampler, tex_coord, 0) * 2 - 1;
     float len_neighbor_vel = length(neighbor_vel);
 
@@ -54,7 +140,7 @@ void main(uint3 dtid : SV_DispatchThreadID)
     [branch]
     if (temp_neighbor_vel < HalfVelocityCutoff)
     {
-        motion_blurred_tex[dtid.xy] = color;
+        motion_blurred_tex[coord] = color;
         return;
     }
 
@@ -77,20 +163,22 @@ void main(uint3 dtid : SV_DispatchThreadID)
 
     float rand = random_tex.SampleLevel(point_sampler, tex_coord * blur_radius, 0) - 0.5f;
 
+    uint num_samples = TileSamples(tile);
+
     // If current velocity is too small, then we use neighbor velocity
     float2 corrected_vel = normalize((len_curr_vel < VarianceThreshold) ? neighbor_vel : curr_vel);
 
     // Weight value (suggested by the article authors' implementation)
-    float weight = reconstruction_samples / WeightCorrectionFactor / temp_curr_vel;
+    float weight = num_samples / WeightCorrectionFactor / temp_curr_vel;
 
     float4 sum = float4(color.xyz, 1) * weight;
 
-    uint self_index = (reconstruction_samples - 1) / 2;
+    uint self_index = (num_samples - 1) / 2;
 
     float max_distance = max_sample_tap_distance * inv_frame_width_height.x;
     float2 half_texel = 0.5f * inv_frame_width_height.x;
 
-    for (uint i = 0; i < reconstruction_samples; ++i)
+    for (uint i = 0; i < num_samples; ++i)
     {
         [branch]
         if (i != self_index)
@@ -98,7 +186,7 @@ void main(uint3 dtid : SV_DispatchThreadID)
             // t is distance between current fragment and sample tap.
             // NOTE: we are not sampling adjacent ones; we are extending our taps
             //       a little further
-            float lerp_amount = (i + rand + 1) / (reconstruction_samples + 1);
+            float lerp_amount = (i + rand + 1) / (num_samples + 1);
             float t = lerp(-max_distance, max_distance, lerp_amount);
 
             // The authors' implementation suggests alternating between the corrected velocity and the neighborhood's
@@ -126,5 +214,5 @@ void main(uint3 dtid : SV_DispatchThreadID)
         }
     }
 
-    motion_blurred_tex[dtid.xy] = float4(sum.xyz / sum.w, 1);
+    motion_blurred_tex[coord] = float4(sum.xyz / sum.w, 1);
 }
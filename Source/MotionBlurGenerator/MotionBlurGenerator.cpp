@@ -1,14 +1,22 @@
 #include "MotionBlurGenerator.hpp"
 
+#include <algorithm>
+#include <chrono>
 #include <format>
-#include <random>
 
 #include "ErrorHandling.hpp"
 #include "Gpu/GpuCommandList.hpp"
 #include "Gpu/GpuResourceViews.hpp"
+#include "Gpu/GpuTransientPlanner.hpp"
+#include "Trace/Trace.hpp"
 
 #include "CompiledShaders/MotionBlurGatherCs.h"
+#include "CompiledShaders/MotionBlurNeighborMax3x3Cs.h"
 #include "CompiledShaders/MotionBlurNeighborMaxCs.h"
+#include "CompiledShaders/MotionBlurPreviewDownsampleCs.h"
+#include "CompiledShaders/MotionBlurPreviewUpsampleCs.h"
+#include "CompiledShaders/MotionBlurTileClassifyCs.h"
+#include "CompiledShaders/MotionBlurTileMaxCs.h"
 #include "CompiledShaders/Nv12ToRgbCs.h"
 #include "CompiledShaders/OverlayMotionVectorCs.h"
 #include "CompiledShaders/RgbToNv12Cs.h"
@@ -124,23 +132,13 @@ namespace MotionToGo
         }
 
         {
-            const uint32_t tile_width = 128;
-            const uint32_t tile_height = 128;
-            std::ranlux24_base gen;
-            std::uniform_int_distribution<> random_dis(0, 255);
-            auto rand_data = std::make_unique<uint8_t[]>(tile_width * tile_height);
-            for (uint32_t j = 0; j < tile_height; ++j)
-            {
-                for (uint32_t i = 0; i < tile_width; ++i)
-                {
-                    rand_data[j * tile_width + i] = static_cast<uint8_t>(random_dis(gen));
-                }
-            }
+            const std::vector<uint8_t> rand_data = GenerateMotionBlurRandomTile();
 
-            random_tex_ = GpuTexture2D(gpu_system_, tile_width, tile_height, 1, DXGI_FORMAT_R8_UNORM,
-                D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COMMON, L"random_tex");
+            random_tex_ = GpuTexture2D(gpu_system_, MotionBlurRandomTileSize, MotionBlurRandomTileSize, 1, DXGI_FORMAT_R8_UNORM,
+                D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COMMON, L"random_tex",
+                MemoryCategory::IntermediateTextures);
             auto cmd_list = gpu_system_.CreateCommandList(GpuSystem::CmdQueueType::Compute);
-            random_tex_.Upload(gpu_system_, cmd_list, 0, rand_data.get());
+            random_tex_.Upload(gpu_system_, cmd_list, 0, rand_data.data());
             gpu_system_.Execute(std::move(cmd_list));
         }
 
@@ -153,27 +151,65 @@ namespace MotionToGo
                 d3d12_device.get(), rgb_to_nv12_cs_, RgbToNv12Cs_shader, std::span(sampler_desc, std::size(sampler_desc)));
         }
         {
-            nv12_to_rgb_cs_.cb = ConstantBuffer<ColorSpaceConstantBuffer>(gpu_system_, 1, L"nv12_to_rgb_cb");
+            nv12_to_rgb_cs_.num_slots = 1 + Strips::NumSlots;
+            nv12_to_rgb_cs_.cb = ConstantBuffer<ColorSpaceConstantBuffer>(gpu_system_, nv12_to_rgb_cs_.num_slots, L"nv12_to_rgb_cb");
             nv12_to_rgb_cs_.num_srvs = 2;
             nv12_to_rgb_cs_.num_uavs = 1;
 
             this->CreateComputeShader(d3d12_device.get(), nv12_to_rgb_cs_, Nv12ToRgbCs_shader);
         }
         {
-            neighbor_max_cs_.cb = ConstantBuffer<NeighborMaxConstantBuffer>(gpu_system_, 1, L"neighbor_max_cb");
-            neighbor_max_cs_.num_srvs = 1;
-            neighbor_max_cs_.num_uavs = 2;
+            tile_max_cs_.cb = ConstantBuffer<TileMaxConstantBuffer>(gpu_system_, 1, L"tile_max_cb");
+            tile_max_cs_.num_srvs = 1;
+            tile_max_cs_.num_uavs = 2;
 
-            this->CreateComputeShader(d3d12_device.get(), neighbor_max_cs_, MotionBlurNeighborMaxCs_shader);
+            this->CreateComputeShader(d3d12_device.get(), tile_max_cs_, MotionBlurTileMaxCs_shader);
         }
         {
-            gather_cs_.cb = ConstantBuffer<GatherConstantBuffer>(gpu_system_, 1, L"gather_cb");
-            gather_cs_.num_srvs = 4;
+            neighbor_max_3x3_cs_.cb = ConstantBuffer<TileMaxConstantBuffer>(gpu_system_, 1, L"neighbor_max_3x3_cb");
+            neighbor_max_3x3_cs_.num_srvs = 1;
+            neighbor_max_3x3_cs_.num_uavs = 2;
+
+            this->CreateComputeShader(d3d12_device.get(), neighbor_max_3x3_cs_, MotionBlurNeighborMax3x3Cs_shader);
+        }
+        for (uint32_t i = 0; i < neighbor_max_cs_.size(); ++i)
+        {
+            neighbor_max_cs_[i].cb = ConstantBuffer<NeighborMaxConstantBuffer>(gpu_system_, 1, std::format(L"neighbor_max_cb {}", i));
+            neighbor_max_cs_[i].num_srvs = 1;
+            neighbor_max_cs_[i].num_uavs = 1;
+
+            this->CreateComputeShader(d3d12_device.get(), neighbor_max_cs_[i], MotionBlurNeighborMaxCs_shader);
+        }
+        {
+            tile_classify_cs_.cb = ConstantBuffer<TileClassifyConstantBuffer>(gpu_system_, 1, L"tile_classify_cb");
+            tile_classify_cs_.num_srvs = 2;
+            tile_classify_cs_.num_uavs = 2;
+
+            this->CreateComputeShader(d3d12_device.get(), tile_classify_cs_, MotionBlurTileClassifyCs_shader);
+        }
+        {
+            gather_cs_.num_slots = 1 + Strips::NumSlots;
+            gather_cs_.cb = ConstantBuffer<GatherConstantBuffer>(gpu_system_, gather_cs_.num_slots, L"gather_cb");
+            gather_cs_.num_srvs = 6;
             gather_cs_.num_uavs = 1;
 
             this->CreateComputeShader(
                 d3d12_device.get(), gather_cs_, MotionBlurGatherCs_shader, std::span(sampler_desc, std::size(sampler_desc)));
         }
+        {
+            preview_downsample_cs_.cb = ConstantBuffer<PreviewDownsampleConstantBuffer>(gpu_system_, 1, L"preview_downsample_cb");
+            preview_downsample_cs_.num_srvs = 1;
+            preview_downsample_cs_.num_uavs = 1;
+
+            this->CreateComputeShader(d3d12_device.get(), preview_downsample_cs_, MotionBlurPreviewDownsampleCs_shader);
+        }
+        {
+            preview_upsample_cs_.cb = ConstantBuffer<PreviewUpsampleConstantBuffer>(gpu_system_, 1, L"preview_upsample_cb");
+            preview_upsample_cs_.num_srvs = 4;
+            preview_upsample_cs_.num_uavs = 1;
+
+            this->CreateComputeShader(d3d12_device.get(), preview_upsample_cs_, MotionBlurPreviewUpsampleCs_shader);
+        }
         {
             overlay_cs_.cb = ConstantBuffer<OverlayConstantBuffer>(gpu_system_, 1, L"overlay_cb");
             overlay_cs_.num_srvs = 1;
@@ -187,8 +223,16 @@ namespace MotionToGo
     {
         gpu_system_.DeallocCbvSrvUavDescBlock(std::move(rgb_to_nv12_cs_.desc_block));
         gpu_system_.DeallocCbvSrvUavDescBlock(std::move(nv12_to_rgb_cs_.desc_block));
-        gpu_system_.DeallocCbvSrvUavDescBlock(std::move(neighbor_max_cs_.desc_block));
+        gpu_system_.DeallocCbvSrvUavDescBlock(std::move(tile_max_cs_.desc_block));
+        gpu_system_.DeallocCbvSrvUavDescBlock(std::move(neighbor_max_3x3_cs_.desc_block));
+        for (auto& cs : neighbor_max_cs_)
+        {
+            gpu_system_.DeallocCbvSrvUavDescBlock(std::move(cs.desc_block));
+        }
+        gpu_system_.DeallocCbvSrvUavDescBlock(std::move(tile_classify_cs_.desc_block));
         gpu_system_.DeallocCbvSrvUavDescBlock(std::move(gather_cs_.desc_block));
+        gpu_system_.DeallocCbvSrvUavDescBlock(std::move(preview_downsample_cs_.desc_block));
+        gpu_system_.DeallocCbvSrvUavDescBlock(std::move(preview_upsample_cs_.desc_block));
         gpu_system_.DeallocCbvSrvUavDescBlock(std::move(overlay_cs_.desc_block));
     }
 
@@ -198,8 +242,20 @@ namespace MotionToGo
           max_mv_height_(std::exchange(other.max_mv_height_, 0)), min_mv_width_(std::exchange(other.min_mv_width_, 0)),
           min_mv_height_(std::exchange(other.min_mv_height_, 0)), mv_block_size_(std::exchange(other.mv_block_size_, 0)),
           rgb_to_nv12_cs_(std::move(other.rgb_to_nv12_cs_)), nv12_to_rgb_cs_(std::move(other.nv12_to_rgb_cs_)),
-          neighbor_max_cs_(std::move(other.neighbor_max_cs_)), gather_cs_(std::move(other.gather_cs_)),
-          overlay_cs_(std::move(other.overlay_cs_)), frames_(std::move(other.frames_))
+          tile_max_cs_(std::move(other.tile_max_cs_)), neighbor_max_3x3_cs_(std::move(other.neighbor_max_3x3_cs_)), neighbor_max_cs_(std::move(other.neighbor_max_cs_)),
+          tile_classify_cs_(std::move(other.tile_classify_cs_)), gather_cs_(std::move(other.gather_cs_)),
+          preview_downsample_cs_(std::move(other.preview_downsample_cs_)), preview_upsample_cs_(std::move(other.preview_upsample_cs_)),
+          overlay_cs_(std::move(other.overlay_cs_)), frames_(std::move(other.frames_)), transients_(std::move(other.transients_)),
+          transient_heap_(std::move(other.transient_heap_)), transient_heap_memory_(std::move(other.transient_heap_memory_)),
+          placed_transients_(std::move(other.placed_transients_)),
+          active_transients_(std::move(other.active_transients_)), texture_memory_(std::exchange(other.texture_memory_, {})),
+          strips_(std::move(other.strips_)), profile_stages_(std::exchange(other.profile_stages_, false)),
+          stage_times_(other.stage_times_), exposure_(other.exposure_),
+          blur_radius_(other.blur_radius_), reconstruction_samples_(other.reconstruction_samples_),
+          min_reconstruction_samples_(other.min_reconstruction_samples_),
+          neighbor_max_tile_size_(other.neighbor_max_tile_size_), neighbor_max_radius_(other.neighbor_max_radius_),
+          preview_scale_(other.preview_scale_), strip_rows_(other.strip_rows_),
+          skip_static_tiles_(std::exchange(other.skip_static_tiles_, true)), tile_counts_(other.tile_counts_)
     {
     }
 
@@ -218,10 +274,34 @@ namespace MotionToGo
             mv_block_size_ = std::exchange(other.mv_block_size_, 0);
             rgb_to_nv12_cs_ = std::move(other.rgb_to_nv12_cs_);
             nv12_to_rgb_cs_ = std::move(other.nv12_to_rgb_cs_);
+            tile_max_cs_ = std::move(other.tile_max_cs_);
+            neighbor_max_3x3_cs_ = std::move(other.neighbor_max_3x3_cs_);
             neighbor_max_cs_ = std::move(other.neighbor_max_cs_);
+            tile_classify_cs_ = std::move(other.tile_classify_cs_);
             gather_cs_ = std::move(other.gather_cs_);
+            preview_downsample_cs_ = std::move(other.preview_downsample_cs_);
+            preview_upsample_cs_ = std::move(other.preview_upsample_cs_);
             overlay_cs_ = std::move(other.overlay_cs_);
             frames_ = std::move(other.frames_);
+            transients_ = std::move(other.transients_);
+            transient_heap_ = std::move(other.transient_heap_);
+            transient_heap_memory_ = std::move(other.transient_heap_memory_);
+            placed_transients_ = std::move(other.placed_transients_);
+            active_transients_ = std::move(other.active_transients_);
+            texture_memory_ = std::exchange(other.texture_memory_, {});
+            strips_ = std::move(other.strips_);
+            profile_stages_ = std::exchange(other.profile_stages_, false);
+            stage_times_ = other.stage_times_;
+            exposure_ = other.exposure_;
+            blur_radius_ = other.blur_radius_;
+            reconstruction_samples_ = other.reconstruction_samples_;
+            min_reconstruction_samples_ = other.min_reconstruction_samples_;
+            neighbor_max_tile_size_ = other.neighbor_max_tile_size_;
+            neighbor_max_radius_ = other.neighbor_max_radius_;
+            preview_scale_ = other.preview_scale_;
+            strip_rows_ = other.strip_rows_;
+            skip_static_tiles_ = std::exchange(other.skip_static_tiles_, true);
+            tile_counts_ = other.tile_counts_;
         }
 
         return *this;
@@ -252,10 +332,12 @@ namespace MotionToGo
     uint64_t MotionBlurGenerator::AddFrame(
         GpuTexture2D& motion_blurred_tex, const GpuTexture2D& frame_tex, float time_span, bool overlay_mv)
     {
+        GO_MOTION_TRACE_SCOPE("AddFrame");
+
         const uint32_t this_frame = gpu_system_.FrameIndex() % GpuSystem::FrameCount;
         const uint32_t prev_frame = (gpu_system_.FrameIndex() + GpuSystem::FrameCount - 1) % GpuSystem::FrameCount;
 
-        const bool first_frame = !static_cast<bool>(frames_[prev_frame].frame_rgb_tex);
+        const bool first_frame = !static_cast<bool>(frames_[prev_frame].scaled_frame_nv12_tex);
         if (first_frame)
         {
             const uint32_t width = frame_tex.Width(0);
@@ -293,38 +375,7 @@ namespace MotionToGo
             scaled_width &= ~1u;
             scaled_height &= ~1u;
 
-            for (uint32_t i = 0; i < GpuSystem::FrameCount; ++i)
-            {
-                DXGI_FORMAT rgb_fmt;
-                if (frame_tex.Format() != DXGI_FORMAT_NV12)
-                {
-                    rgb_fmt = frame_tex.Format();
-                }
-                else
-                {
-                    rgb_fmt = DXGI_FORMAT_R8G8B8A8_UNORM;
-                }
-                frames_[i].frame_rgb_tex = GpuTexture2D(gpu_system_, width, height, 1, rgb_fmt, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
-                    D3D12_RESOURCE_STATE_COMMON, std::format(L"frame_rgb {}", i));
-                frames_[i].frame_nv12_tex = GpuTexture2D(gpu_system_, width, height, 1, DXGI_FORMAT_NV12,
-                    D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COMMON, std::format(L"frame_nv12 {}", i));
-
-                frames_[i].scaled_frame_nv12_tex = GpuTexture2D(gpu_system_, scaled_width, scaled_height, 1, DXGI_FORMAT_NV12,
-                    D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COMMON, std::format(L"scaled_frame_nv12 {}", i));
-
-                frames_[i].raw_motion_vector_tex =
-                    GpuTexture2D(gpu_system_, DivUp(scaled_width, mv_block_size_), DivUp(scaled_height, mv_block_size_), 1,
-                        DXGI_FORMAT_R16G16_SINT, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS | D3D12_RESOURCE_FLAG_ALLOW_SIMULTANEOUS_ACCESS,
-                        D3D12_RESOURCE_STATE_COMMON, std::format(L"raw_motion_vector_tex {}", i));
-
-                // Always scale to 16x16 block size
-                const DXGI_FORMAT motion_vector_fmt = DXGI_FORMAT_R8G8_UNORM;
-                frames_[i].motion_vector_tex = GpuTexture2D(gpu_system_, DivUp(width, 16), DivUp(height, 16), 1, motion_vector_fmt,
-                    D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COMMON, std::format(L"motion_vector_tex {}", i));
-                frames_[i].motion_vector_neighbor_max_tex = GpuTexture2D(gpu_system_, frames_[i].motion_vector_tex.Width(0),
-                    frames_[i].motion_vector_tex.Height(0), 1, motion_vector_fmt, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
-                    D3D12_RESOURCE_STATE_COMMON, std::format(L"motion_vector_neighbor_max_tex {}", i));
-            }
+            this->CreateTextures(width, height, scaled_width, scaled_height, frame_tex.Format());
 
             {
                 rgb_to_nv12_cs_.cb->frame_width_height = {scaled_width, scaled_height};
@@ -334,23 +385,45 @@ namespace MotionToGo
                 nv12_to_rgb_cs_.cb->frame_width_height = {width, height};
                 nv12_to_rgb_cs_.cb.UploadToGpu();
             }
+            for (auto* cs : {&tile_max_cs_, &neighbor_max_3x3_cs_})
+            {
+                cs->cb->inv_half_frame_width_height = {2.0f / width, 2.0f / height};
+                cs->cb->motion_vector_width_height = {transients_.motion_vector_tex.Width(0), transients_.motion_vector_tex.Height(0)};
+                cs->cb->raw_motion_vector_width_height = {
+                    transients_.raw_motion_vector_tex.Width(0), transients_.raw_motion_vector_tex.Height(0)};
+                cs->cb->tile_max_width_height = {
+                    transients_.motion_vector_tile_max_tex.Width(0), transients_.motion_vector_tile_max_tex.Height(0)};
+                cs->cb->size_scale = static_cast<float>(width) / scaled_width;
+                cs->cb->tiles_per_tile_max = neighbor_max_tile_size_ / MotionBlurTileSize;
+                // Upload later
+            }
+            {
+                tile_classify_cs_.cb->frame_width_height = {width, height};
+                tile_classify_cs_.cb->tile_width_height = {transients_.motion_vector_tex.Width(0), transients_.motion_vector_tex.Height(0)};
+                tile_classify_cs_.cb->neighbor_max_width_height = {
+                    transients_.motion_vector_neighbor_max_tex.Width(0), transients_.motion_vector_neighbor_max_tex.Height(0)};
+                // Upload later
+            }
             {
-                neighbor_max_cs_.cb->inv_half_frame_width_height = {2.0f / width, 2.0f / height};
-                neighbor_max_cs_.cb->motion_vector_width_height = {
-                    frames_[0].motion_vector_tex.Width(0), frames_[0].motion_vector_tex.Height(0)};
-                neighbor_max_cs_.cb->raw_motion_vector_width_height = {
-                    frames_[0].raw_motion_vector_tex.Width(0), frames_[0].raw_motion_vector_tex.Height(0)};
-                neighbor_max_cs_.cb->blur_radius = BlurRadius;
-                neighbor_max_cs_.cb->size_scale = static_cast<float>(width) / scaled_width;
+                // In preview, the gather runs on the preview frame. The tap distance is in its pixels.
+                const uint32_t gather_scale = transients_.preview_frame_rgb_tex ? preview_scale_ : 1;
+                gather_cs_.cb->inv_frame_width_height = {
+                    1.0f / MotionBlurPreviewSize(width, gather_scale), 1.0f / MotionBlurPreviewSize(height, gather_scale)};
+                gather_cs_.cb->max_sample_tap_distance = (2 * height + 1056) / 416.0f / gather_scale;
+                gather_cs_.cb->tile_width_height = {transients_.motion_vector_tex.Width(0), transients_.motion_vector_tex.Height(0)};
                 // Upload later
             }
+            if (transients_.preview_frame_rgb_tex)
             {
-                gather_cs_.cb->inv_frame_width_height = {1.0f / width, 1.0f / height};
-                gather_cs_.cb->blur_radius = BlurRadius;
-                gather_cs_.cb->half_exposure = Exposure / 2;
-                gather_cs_.cb->reconstruction_samples = ReconstructionSamples;
-                gather_cs_.cb->max_sample_tap_distance = (2 * height + 1056) / 416.0f;
-                gather_cs_.cb.UploadToGpu();
+                preview_downsample_cs_.cb->frame_width_height = {width, height};
+                preview_downsample_cs_.cb->scale = preview_scale_;
+                preview_downsample_cs_.cb.UploadToGpu();
+
+                preview_upsample_cs_.cb->frame_width_height = {width, height};
+                preview_upsample_cs_.cb->preview_width_height = {
+                    transients_.preview_frame_rgb_tex.Width(0), transients_.preview_frame_rgb_tex.Height(0)};
+                preview_upsample_cs_.cb->scale = preview_scale_;
+                // Upload later
             }
             {
                 overlay_cs_.cb->max_sample_tap_distance = (2 * height + 1056) / 416.0f;
@@ -360,64 +433,489 @@ namespace MotionToGo
         }
         else
         {
-            assert(frames_[prev_frame].frame_rgb_tex.Width(0) == frame_tex.Width(0));
-            assert(frames_[prev_frame].frame_rgb_tex.Height(0) == frame_tex.Height(0));
+            assert(transients_.frame_rgb_tex.Width(0) == frame_tex.Width(0));
+            assert(transients_.frame_rgb_tex.Height(0) == frame_tex.Height(0));
         }
 
+        stage_times_.fill(0);
+        active_transients_.clear();
+
+        const bool strips = strips_.rows != 0;
+
         uint64_t fence_value;
-        if (frame_tex.Format() == DXGI_FORMAT_NV12)
+        if (strips)
         {
-            auto cmd_list = gpu_system_.CreateCommandList(GpuSystem::CmdQueueType::Compute);
-            for (uint32_t p = 0; p < frame_tex.Planes(); ++p)
+            // The strips fill the RGB frame a strip at a time, the estimation input comes from the frame itself. An NV12 frame goes
+            // through RGB like the whole frame path, in the output, which the gather overwrites later on the same queue.
+            if (frame_tex.Format() == DXGI_FORMAT_NV12)
             {
-                const D3D12_BOX src_box{0, 0, 0, frame_tex.Width(0) / (1U << p), frame_tex.Height(0) / (1U << p), 1};
-                frames_[this_frame].frame_nv12_tex.CopyFrom(gpu_system_, cmd_list, frame_tex, p, 0, 0, src_box);
+                this->RunStage(
+                    Stage::ConvertToRgb, [&] { return this->ConvertToRgb(frame_tex, motion_blurred_tex, 0, frame_tex.Height(0), 0); });
+                fence_value = this->RunStage(Stage::ConvertToNv12,
+                    [&] { return this->ConvertToNv12(motion_blurred_tex, frames_[this_frame].scaled_frame_nv12_tex); });
             }
-            gpu_system_.Execute(std::move(cmd_list));
-
-            fence_value = this->ConvertToRgb(frames_[this_frame].frame_nv12_tex, frames_[this_frame].frame_rgb_tex);
-            fence_value = this->ConvertToNv12(frames_[this_frame].frame_rgb_tex, frames_[this_frame].scaled_frame_nv12_tex);
+            else
+            {
+                fence_value = this->RunStage(
+                    Stage::ConvertToNv12, [&] { return this->ConvertToNv12(frame_tex, frames_[this_frame].scaled_frame_nv12_tex); });
+            }
+        }
+        else if (frame_tex.Format() == DXGI_FORMAT_NV12)
+        {
+            this->RunStage(Stage::CopyFrame, [&] {
+                auto cmd_list = gpu_system_.CreateCommandList(GpuSystem::CmdQueueType::Compute);
+                this->ActivateTransient(cmd_list, transients_.frame_nv12_tex);
+                for (uint32_t p = 0; p < frame_tex.Planes(); ++p)
+                {
+                    const D3D12_BOX src_box{0, 0, 0, frame_tex.Width(0) / (1U << p), frame_tex.Height(0) / (1U << p), 1};
+                    transients_.frame_nv12_tex.CopyFrom(gpu_system_, cmd_list, frame_tex, p, 0, 0, src_box);
+                }
+                return gpu_system_.Execute(std::move(cmd_list));
+            });
+
+            this->RunStage(Stage::ConvertToRgb, [&] {
+                return this->ConvertToRgb(transients_.frame_nv12_tex, transients_.frame_rgb_tex, 0, transients_.frame_rgb_tex.Height(0), 0);
+            });
+            fence_value = this->RunStage(Stage::ConvertToNv12,
+                [&] { return this->ConvertToNv12(transients_.frame_rgb_tex, frames_[this_frame].scaled_frame_nv12_tex); });
         }
         else
         {
-            auto cmd_list = gpu_system_.CreateCommandList(GpuSystem::CmdQueueType::Compute);
-            for (uint32_t p = 0; p < frame_tex.Planes(); ++p)
-            {
-                const D3D12_BOX src_box{0, 0, 0, frame_tex.Width(0) / (1U << p), frame_tex.Height(0) / (1U << p), 1};
-                frames_[this_frame].frame_rgb_tex.CopyFrom(gpu_system_, cmd_list, frame_tex, p, 0, 0, src_box);
-            }
-            gpu_system_.Execute(std::move(cmd_list));
+            this->RunStage(Stage::CopyFrame, [&] {
+                auto cmd_list = gpu_system_.CreateCommandList(GpuSystem::CmdQueueType::Compute);
+                this->ActivateTransient(cmd_list, transients_.frame_rgb_tex);
+                for (uint32_t p = 0; p < frame_tex.Planes(); ++p)
+                {
+                    const D3D12_BOX src_box{0, 0, 0, frame_tex.Width(0) / (1U << p), frame_tex.Height(0) / (1U << p), 1};
+                    transients_.frame_rgb_tex.CopyFrom(gpu_system_, cmd_list, frame_tex, p, 0, 0, src_box);
+                }
+                return gpu_system_.Execute(std::move(cmd_list));
+            });
 
-            fence_value = this->ConvertToNv12(frames_[this_frame].frame_rgb_tex, frames_[this_frame].scaled_frame_nv12_tex);
+            fence_value = this->RunStage(Stage::ConvertToNv12,
+                [&] { return this->ConvertToNv12(transients_.frame_rgb_tex, frames_[this_frame].scaled_frame_nv12_tex); });
         }
 
         if (first_frame)
         {
-            auto cmd_list = gpu_system_.CreateCommandList(GpuSystem::CmdQueueType::Compute);
-            const D3D12_BOX src_box{0, 0, 0, frame_tex.Width(0), frame_tex.Height(0), 1};
-            motion_blurred_tex.CopyFrom(gpu_system_, cmd_list, frames_[this_frame].frame_rgb_tex, 0, 0, 0, src_box);
-            fence_value = gpu_system_.Execute(std::move(cmd_list));
+            // In strips, an NV12 frame is already converted to the output
+            if (!strips || (frame_tex.Format() != DXGI_FORMAT_NV12))
+            {
+                auto cmd_list = gpu_system_.CreateCommandList(GpuSystem::CmdQueueType::Compute);
+                const D3D12_BOX src_box{0, 0, 0, frame_tex.Width(0), frame_tex.Height(0), 1};
+                motion_blurred_tex.CopyFrom(gpu_system_, cmd_list, strips ? frame_tex : transients_.frame_rgb_tex, 0, 0, 0, src_box);
+                fence_value = gpu_system_.Execute(std::move(cmd_list));
+            }
         }
         else
         {
-            fence_value = this->EstimateMotionVectors(frames_[prev_frame].scaled_frame_nv12_tex, frames_[this_frame].scaled_frame_nv12_tex,
-                frames_[this_frame].raw_motion_vector_tex, frames_[this_frame].video_motion_vector_heap.get(), fence_value);
-            fence_value = this->PropagateMotionBlur(time_span, frames_[this_frame].raw_motion_vector_tex,
-                frames_[this_frame].motion_vector_tex, frames_[this_frame].motion_vector_neighbor_max_tex, fence_value);
-            fence_value = this->GatherMotionBlur(frames_[this_frame].frame_rgb_tex, frames_[this_frame].motion_vector_tex,
-                frames_[this_frame].motion_vector_neighbor_max_tex, motion_blurred_tex);
+            fence_value = this->RunStage(Stage::EstimateMotionVectors, [&] {
+                return this->EstimateMotionVectors(frames_[prev_frame].scaled_frame_nv12_tex, frames_[this_frame].scaled_frame_nv12_tex,
+                    transients_.raw_motion_vector_tex, frames_[this_frame].video_motion_vector_heap.get(), fence_value);
+            });
+            fence_value = this->RunStage(Stage::PropagateMotionBlur, [&] {
+                return this->PropagateMotionBlur(time_span, transients_.raw_motion_vector_tex, transients_.motion_vector_tex,
+                    transients_.motion_vector_tile_max_tex, transients_.motion_vector_neighbor_max_transposed_tex,
+                    transients_.motion_vector_neighbor_max_tex, fence_value);
+            });
+            const bool preview = static_cast<bool>(transients_.preview_frame_rgb_tex);
+            const bool use_tile_lists = skip_static_tiles_ && !preview && !strips;
+            if (use_tile_lists)
+            {
+                fence_value = this->RunStage(Stage::ClassifyTiles, [&] {
+                    return this->ClassifyTiles(transients_.motion_vector_tex, transients_.motion_vector_neighbor_max_tex,
+                        transients_.tile_list_tex, transients_.tile_count_tex);
+                });
+
+                if (profile_stages_)
+                {
+                    auto cmd_list = gpu_system_.CreateCommandList(GpuSystem::CmdQueueType::Compute);
+                    transients_.tile_count_tex.Readback(gpu_system_, cmd_list, 0, tile_counts_.data());
+                    gpu_system_.Execute(std::move(cmd_list));
+                }
+            }
+            if (preview)
+            {
+                this->RunStage(Stage::DownsamplePreview,
+                    [&] { return this->DownsamplePreview(transients_.frame_rgb_tex, transients_.preview_frame_rgb_tex); });
+                this->RunStage(Stage::GatherMotionBlur, [&] {
+                    return this->GatherMotionBlur(transients_.preview_frame_rgb_tex, transients_.motion_vector_tex,
+                        transients_.motion_vector_neighbor_max_tex, transients_.tile_list_tex, transients_.tile_count_tex, false, 0,
+                        transients_.preview_frame_rgb_tex.Height(0), transients_.preview_blurred_tex, 0);
+                });
+                fence_value = this->RunStage(Stage::UpsamplePreview, [&] {
+                    return this->UpsamplePreview(transients_.frame_rgb_tex, transients_.preview_frame_rgb_tex,
+                        transients_.preview_blurred_tex, transients_.motion_vector_neighbor_max_tex, motion_blurred_tex);
+                });
+            }
+            else if (strips)
+            {
+                fence_value = this->GatherMotionBlurInStrips(frame_tex, motion_blurred_tex);
+            }
+            else
+            {
+                fence_value = this->RunStage(Stage::GatherMotionBlur, [&] {
+                    return this->GatherMotionBlur(transients_.frame_rgb_tex, transients_.motion_vector_tex,
+                        transients_.motion_vector_neighbor_max_tex, transients_.tile_list_tex, transients_.tile_count_tex, use_tile_lists,
+                        0, frame_tex.Height(0), motion_blurred_tex, 0);
+                });
+            }
 
             if (overlay_mv)
             {
-                fence_value = this->OverlayMotionVector(frames_[this_frame].motion_vector_tex, motion_blurred_tex);
+                fence_value = this->RunStage(Stage::OverlayMotionVector,
+                    [&] { return this->OverlayMotionVector(transients_.motion_vector_tex, motion_blurred_tex); });
             }
         }
 
         return fence_value;
     }
 
-    uint64_t MotionBlurGenerator::ConvertToNv12(GpuTexture2D& frame_rgb_tex, GpuTexture2D& output_frame_nv12_tex)
+    void MotionBlurGenerator::Reset()
+    {
+        // The next frame becomes the first frame of a new sequence, which can have a different size.
+        for (auto& frame : frames_)
+        {
+            frame.scaled_frame_nv12_tex.Reset();
+        }
+        // The placed textures before their heap
+        transients_ = Transients();
+        transient_heap_ = nullptr;
+        transient_heap_memory_.Reset();
+        placed_transients_.clear();
+        strips_ = Strips();
+        texture_memory_ = {};
+    }
+
+    void MotionBlurGenerator::BlurParameters(float exposure, float blur_radius, uint32_t reconstruction_samples) noexcept
+    {
+        assert(exposure > 0);
+        assert(blur_radius >= 0.1f);
+        assert((reconstruction_samples > 0) && (reconstruction_samples <= MaxReconstructionSamples));
+
+        exposure_ = exposure;
+        blur_radius_ = blur_radius;
+        reconstruction_samples_ = reconstruction_samples;
+    }
+
+    void MotionBlurGenerator::MinReconstructionSamples(uint32_t samples) noexcept
+    {
+        assert(samples <= MaxReconstructionSamples);
+        min_reconstruction_samples_ = samples;
+    }
+
+    void MotionBlurGenerator::NeighborMaxParameters(uint32_t tile_size, uint32_t radius) noexcept
+    {
+        assert((tile_size >= MotionBlurTileSize) && (tile_size % MotionBlurTileSize == 0));
+        assert(radius <= MaxMotionBlurNeighborMaxRadius);
+
+        neighbor_max_tile_size_ = tile_size;
+        neighbor_max_radius_ = radius;
+    }
+
+    void MotionBlurGenerator::PreviewScale(uint32_t scale) noexcept
+    {
+        assert((scale == 1) || (scale == 2) || (scale == MaxPreviewScale));
+        preview_scale_ = scale;
+    }
+
+    void MotionBlurGenerator::StripRows(uint32_t rows) noexcept
+    {
+        assert(rows % MotionBlurTileSize == 0);
+        strip_rows_ = rows;
+    }
+
+    void MotionBlurGenerator::ProfileStages(bool enable) noexcept
+    {
+        profile_stages_ = enable;
+    }
+
+    std::span<const double> MotionBlurGenerator::StageTimes() const noexcept
+    {
+        return stage_times_;
+    }
+
+    void MotionBlurGenerator::SkipStaticTiles(bool enable) noexcept
+    {
+        skip_static_tiles_ = enable;
+    }
+
+    std::span<const uint32_t> MotionBlurGenerator::TileCounts() const noexcept
+    {
+        return tile_counts_;
+    }
+
+    const GpuTexture2D& MotionBlurGenerator::RawMotionVectorTexture() const noexcept
+    {
+        return transients_.raw_motion_vector_tex;
+    }
+
+    uint32_t MotionBlurGenerator::MotionVectorBlockSize() const noexcept
+    {
+        return mv_block_size_;
+    }
+
+    uint32_t MotionBlurGenerator::EstimationWidth() const noexcept
+    {
+        return frames_[0].scaled_frame_nv12_tex.Width(0);
+    }
+
+    MotionBlurTextureMemory MotionBlurGenerator::TextureMemory() const noexcept
+    {
+        return texture_memory_;
+    }
+
+    void MotionBlurGenerator::CreateTextures(
+        uint32_t width, uint32_t height, uint32_t scaled_width, uint32_t scaled_height, DXGI_FORMAT frame_format)
+    {
+        ID3D12Device* device = gpu_system_.NativeDevice();
+        const auto allocation_size = [device](const GpuTexture2D& tex) {
+            const D3D12_RESOURCE_DESC desc = tex.NativeTexture()->GetDesc();
+            return device->GetResourceAllocationInfo(0, 1, &desc).SizeInBytes;
+        };
+
+        // The history, the next frame estimates the motion against it
+        uint64_t history_size = 0;
+        for (uint32_t i = 0; i < GpuSystem::FrameCount; ++i)
+        {
+            frames_[i].scaled_frame_nv12_tex = GpuTexture2D(gpu_system_, scaled_width, scaled_height, 1, DXGI_FORMAT_NV12,
+                D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COMMON, std::format(L"scaled_frame_nv12 {}", i),
+                MemoryCategory::IntermediateTextures);
+            history_size += allocation_size(frames_[i].scaled_frame_nv12_tex);
+        }
+
+        // Written on the video encode queue and handed out by RawMotionVectorTexture, so it isn't placed with the others. One is
+        // enough, the estimation of the next frame waits for the compute work of this one.
+        transients_.raw_motion_vector_tex = GpuTexture2D(gpu_system_, DivUp(scaled_width, mv_block_size_),
+            DivUp(scaled_height, mv_block_size_), 1, DXGI_FORMAT_R16G16_SINT,
+            D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS | D3D12_RESOURCE_FLAG_ALLOW_SIMULTANEOUS_ACCESS, D3D12_RESOURCE_STATE_COMMON,
+            L"raw_motion_vector_tex", MemoryCategory::IntermediateTextures);
+        const uint64_t raw_motion_vector_size = allocation_size(transients_.raw_motion_vector_tex);
+
+        const bool nv12_input = frame_format == DXGI_FORMAT_NV12;
+        const DXGI_FORMAT rgb_fmt = nv12_input ? DXGI_FORMAT_R8G8B8A8_UNORM : frame_format;
+        const bool preview = preview_scale_ > 1;
+
+        strips_ = Strips();
+        if ((strip_rows_ != 0) && (strip_rows_ < height) && !preview)
+        {
+            this->CreateStripFrame(width, height, rgb_fmt);
+        }
+        const bool strips = strips_.rows != 0;
+
+        // Always scale to 16x16 block size
+        const DXGI_FORMAT motion_vector_fmt = DXGI_FORMAT_R8G8_UNORM;
+        const uint32_t mv_width = DivUp(width, 16);
+        const uint32_t mv_height = DivUp(height, 16);
+        const uint32_t tile_max_width = MotionBlurTileMaxSize(mv_width, neighbor_max_tile_size_);
+        const uint32_t tile_max_height = MotionBlurTileMaxSize(mv_height, neighbor_max_tile_size_);
+        constexpr uint32_t NumTileClasses = static_cast<uint32_t>(MotionBlurTileClass::Num);
+
+        // The rest only live within an AddFrame, from the first stage that uses them to the last. The stages that can be toggled
+        // between frames are counted as running.
+        struct TransientDesc
+        {
+            GpuTexture2D* tex;
+            std::wstring_view name;
+            uint32_t width;
+            uint32_t height;
+            DXGI_FORMAT format;
+            Stage first_stage;
+            Stage last_stage;
+        };
+        const Stage last_frame_rgb_stage = preview ? Stage::UpsamplePreview : Stage::GatherMotionBlur;
+        std::vector<TransientDesc> transient_descs = {
+            {&transients_.motion_vector_tex, L"motion_vector_tex", mv_width, mv_height, motion_vector_fmt, Stage::PropagateMotionBlur,
+                Stage::OverlayMotionVector},
+            {&transients_.motion_vector_tile_max_tex, L"motion_vector_tile_max_tex", tile_max_width, tile_max_height, motion_vector_fmt,
+                Stage::PropagateMotionBlur, Stage::PropagateMotionBlur},
+            {&transients_.motion_vector_neighbor_max_transposed_tex, L"motion_vector_neighbor_max_transposed_tex", tile_max_height,
+                tile_max_width, motion_vector_fmt, Stage::PropagateMotionBlur, Stage::PropagateMotionBlur},
+            {&transients_.motion_vector_neighbor_max_tex, L"motion_vector_neighbor_max_tex", tile_max_width, tile_max_height,
+                motion_vector_fmt, Stage::PropagateMotionBlur, last_frame_rgb_stage},
+            // A list per tile class, each as large as the tile grid
+            {&transients_.tile_list_tex, L"tile_list_tex", mv_width, mv_height * NumTileClasses, DXGI_FORMAT_R32_UINT,
+                Stage::ClassifyTiles, Stage::GatherMotionBlur},
+            {&transients_.tile_count_tex, L"tile_count_tex", NumTileClasses, 1, DXGI_FORMAT_R32_UINT, Stage::ClassifyTiles,
+                Stage::GatherMotionBlur},
+        };
+        if (!strips)
+        {
+            transient_descs.push_back({&transients_.frame_rgb_tex, L"frame_rgb", width, height, rgb_fmt,
+                nv12_input ? Stage::ConvertToRgb : Stage::CopyFrame, last_frame_rgb_stage});
+            if (nv12_input)
+            {
+                transient_descs.push_back(
+                    {&transients_.frame_nv12_tex, L"frame_nv12", width, height, DXGI_FORMAT_NV12, Stage::CopyFrame, Stage::ConvertToRgb});
+            }
+        }
+        if (preview)
+        {
+            const uint32_t preview_width = MotionBlurPreviewSize(width, preview_scale_);
+            const uint32_t preview_height = MotionBlurPreviewSize(height, preview_scale_);
+            transient_descs.push_back({&transients_.preview_frame_rgb_tex, L"preview_frame_rgb", preview_width, preview_height, rgb_fmt,
+                Stage::DownsamplePreview, Stage::UpsamplePreview});
+            transient_descs.push_back({&transients_.preview_blurred_tex, L"preview_blurred", preview_width, preview_height, rgb_fmt,
+                Stage::GatherMotionBlur, Stage::UpsamplePreview});
+        }
+
+        GpuTransientPlanner planner;
+        for (const auto& desc : transient_descs)
+        {
+            const D3D12_RESOURCE_DESC tex_desc =
+                Texture2DDesc(desc.width, desc.height, 1, desc.format, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+            const D3D12_RESOURCE_ALLOCATION_INFO info = device->GetResourceAllocationInfo(0, 1, &tex_desc);
+            const uint32_t id = planner.AddResource(info.SizeInBytes, info.Alignment);
+            planner.Use(id, static_cast<uint32_t>(desc.first_stage));
+            planner.Use(id, static_cast<uint32_t>(desc.last_stage));
+        }
+        const uint64_t heap_size = planner.Plan();
+
+        const D3D12_HEAP_DESC heap_desc = {heap_size,
+            {D3D12_HEAP_TYPE_DEFAULT, D3D12_CPU_PAGE_PROPERTY_UNKNOWN, D3D12_MEMORY_POOL_UNKNOWN, 1, 1},
+            D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT, D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES};
+        TIFHR(device->CreateHeap(&heap_desc, winrt::guid_of<ID3D12Heap>(), transient_heap_.put_void()));
+        transient_heap_memory_ = TrackedMemory(MemoryCategory::IntermediateTextures, heap_size);
+
+        placed_transients_.clear();
+        for (uint32_t i = 0; i < transient_descs.size(); ++i)
+        {
+            const auto& desc = transient_descs[i];
+            *desc.tex = GpuTexture2D(gpu_system_, transient_heap_.get(), planner.Offset(i), desc.width, desc.height, 1, desc.format,
+                D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COMMON, desc.name);
+            placed_transients_.push_back(desc.tex->NativeTexture());
+        }
+        if (strips)
+        {
+            placed_transients_.push_back(transients_.frame_rgb_tex.NativeTexture());
+        }
+
+        // The strip heap is added by the first gather
+        texture_memory_.resident_bytes = history_size + raw_motion_vector_size + heap_size;
+        texture_memory_.unaliased_bytes = history_size + GpuSystem::FrameCount * (raw_motion_vector_size + planner.UnaliasedSize());
+        texture_memory_.frame_bytes = static_cast<uint64_t>(width) * height * FormatSize(rgb_fmt);
+    }
+
+    void MotionBlurGenerator::CreateStripFrame(uint32_t width, uint32_t height, DXGI_FORMAT format)
+    {
+        ID3D12Device* device = gpu_system_.NativeDevice();
+
+        D3D12_FEATURE_DATA_D3D12_OPTIONS options{};
+        TIFHR(device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS, &options, sizeof(options)));
+        if (options.TiledResourcesTier == D3D12_TILED_RESOURCES_TIER_NOT_SUPPORTED)
+        {
+            ::OutputDebugStringW(L"WARNING: No tiled resources, processing whole frames instead of strips\n");
+            return;
+        }
+
+        // The same size as the frame, so the gather samples it at the same coordinates as a whole one
+        D3D12_RESOURCE_DESC desc = Texture2DDesc(width, height, 1, format, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+        desc.Layout = D3D12_TEXTURE_LAYOUT_64KB_UNDEFINED_SWIZZLE;
+        winrt::com_ptr<ID3D12Resource> resource;
+        TIFHR(device->CreateReservedResource(
+            &desc, D3D12_RESOURCE_STATE_COMMON, nullptr, winrt::guid_of<ID3D12Resource>(), resource.put_void()));
+
+        uint32_t num_tiles;
+        D3D12_PACKED_MIP_INFO packed_mip_info;
+        D3D12_TILE_SHAPE tile_shape;
+        uint32_t num_subresource_tilings = 1;
+        D3D12_SUBRESOURCE_TILING subresource_tiling;
+        device->GetResourceTiling(
+            resource.get(), &num_tiles, &packed_mip_info, &tile_shape, &num_subresource_tilings, 0, &subresource_tiling);
+        if (packed_mip_info.NumPackedMips != 0)
+        {
+            // Smaller than a tile, nothing to save
+            return;
+        }
+
+        // Whole tiles are filled, their rows must be whole rows of groups
+        assert(tile_shape.HeightInTexels % MotionBlurTileSize == 0);
+
+        transients_.frame_rgb_tex = GpuTexture2D(resource.detach(), D3D12_RESOURCE_STATE_COMMON, L"frame_rgb");
+        strips_.rows = strip_rows_;
+        strips_.num_tiles = num_tiles;
+        strips_.tiles_x = subresource_tiling.WidthInTiles;
+        strips_.tile_height = tile_shape.HeightInTexels;
+    }
+
+    void MotionBlurGenerator::CreateStripHeap(uint32_t tile_rows)
+    {
+        ID3D12Device* device = gpu_system_.NativeDevice();
+
+        if (strips_.heap)
+        {
+            // No tile may be left on the old heap
+            this->MapStripTiles(0, 0);
+            gpu_system_.WaitForGpu();
+        }
+
+        const uint64_t heap_size = static_cast<uint64_t>(tile_rows) * strips_.tiles_x * D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES;
+        const D3D12_HEAP_DESC heap_desc = {heap_size,
+            {D3D12_HEAP_TYPE_DEFAULT, D3D12_CPU_PAGE_PROPERTY_UNKNOWN, D3D12_MEMORY_POOL_UNKNOWN, 1, 1},
+            D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT, D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES};
+        strips_.heap = nullptr;
+        TIFHR(device->CreateHeap(&heap_desc, winrt::guid_of<ID3D12Heap>(), strips_.heap.put_void()));
+
+        const uint64_t added_size = heap_size - strips_.heap_memory.Bytes();
+        strips_.heap_memory = TrackedMemory(MemoryCategory::IntermediateTextures, heap_size);
+        strips_.heap_tile_rows = tile_rows;
+
+        texture_memory_.resident_bytes += added_size;
+        texture_memory_.unaliased_bytes += GpuSystem::FrameCount * added_size;
+    }
+
+    void MotionBlurGenerator::MapStripTiles(uint32_t first_tile_row, uint32_t end_tile_row)
+    {
+        ID3D12CommandQueue* cmd_queue = gpu_system_.NativeCommandQueue(GpuSystem::CmdQueueType::Compute);
+        ID3D12Resource* resource = transients_.frame_rgb_tex.NativeTexture();
+
+        // Unmaps the rows of the last strip, then maps these to the start of the heap. In queue order with the stages.
+        {
+            const D3D12_TILED_RESOURCE_COORDINATE coord{0, 0, 0, 0};
+            const D3D12_TILE_REGION_SIZE region_size{strips_.num_tiles, FALSE, 0, 0, 0};
+            const D3D12_TILE_RANGE_FLAGS range_flags = D3D12_TILE_RANGE_FLAG_NULL;
+            cmd_queue->UpdateTileMappings(resource, 1, &coord, &region_size, nullptr, 1, &range_flags, nullptr, &strips_.num_tiles,
+                D3D12_TILE_MAPPING_FLAG_NONE);
+        }
+        if (end_tile_row > first_tile_row)
+        {
+            assert(end_tile_row - first_tile_row <= strips_.heap_tile_rows);
+
+            const uint32_t num_tile_rows = end_tile_row - first_tile_row;
+            const uint32_t num_tiles = strips_.tiles_x * num_tile_rows;
+            const D3D12_TILED_RESOURCE_COORDINATE coord{0, first_tile_row, 0, 0};
+            const D3D12_TILE_REGION_SIZE region_size{num_tiles, TRUE, strips_.tiles_x, static_cast<uint16_t>(num_tile_rows), 1};
+            const D3D12_TILE_RANGE_FLAGS range_flags = D3D12_TILE_RANGE_FLAG_NONE;
+            const uint32_t heap_offset = 0;
+            cmd_queue->UpdateTileMappings(resource, 1, &coord, &region_size, strips_.heap.get(), 1, &range_flags, &heap_offset,
+                &num_tiles, D3D12_TILE_MAPPING_FLAG_NONE);
+        }
+    }
+
+    void MotionBlurGenerator::ActivateTransient(GpuCommandList& cmd_list, const GpuTexture2D& tex)
     {
+        ID3D12Resource* resource = tex.NativeTexture();
+        if ((std::find(placed_transients_.begin(), placed_transients_.end(), resource) == placed_transients_.end()) ||
+            (std::find(active_transients_.begin(), active_transients_.end(), resource) != active_transients_.end()))
+        {
+            return;
+        }
+
+        // The first write of a frame. Another texture placed at the same memory could have been the last to use it.
+        D3D12_RESOURCE_BARRIER barrier;
+        barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_ALIASING;
+        barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+        barrier.Aliasing.pResourceBefore = nullptr;
+        barrier.Aliasing.pResourceAfter = resource;
+        cmd_list.Transition(std::span(&barrier, 1));
+
+        active_transients_.push_back(resource);
+    }
+
+    uint64_t MotionBlurGenerator::ConvertToNv12(const GpuTexture2D& frame_rgb_tex, GpuTexture2D& output_frame_nv12_tex)
+    {
+        GO_MOTION_TRACE_SCOPE("ConvertToNv12");
+
         const SrvHelper srv_texs[] = {
             {&frame_rgb_tex},
         };
@@ -429,8 +927,16 @@ namespace MotionToGo
             srv_texs, uav_texs, rgb_to_nv12_cs_, output_frame_nv12_tex.Width(0) / 2, output_frame_nv12_tex.Height(0) / 2);
     }
 
-    uint64_t MotionBlurGenerator::ConvertToRgb(GpuTexture2D& frame_nv12_tex, GpuTexture2D& output_frame_rgb_tex)
+    uint64_t MotionBlurGenerator::ConvertToRgb(const GpuTexture2D& frame_nv12_tex, GpuTexture2D& output_frame_rgb_tex, uint32_t first_row,
+        uint32_t num_rows, uint32_t slot)
     {
+        GO_MOTION_TRACE_SCOPE("ConvertToRgb");
+
+        {
+            nv12_to_rgb_cs_.cb->first_row = first_row;
+            nv12_to_rgb_cs_.cb.UploadToGpu(slot);
+        }
+
         const SrvHelper srv_texs[] = {
             {&frame_nv12_tex, 0, DXGI_FORMAT_R8_UNORM},
             {&frame_nv12_tex, 1, DXGI_FORMAT_R8G8_UNORM},
@@ -438,12 +944,15 @@ namespace MotionToGo
         const UavHelper uav_texs[] = {
             {&output_frame_rgb_tex},
         };
-        return this->RunComputeShader(srv_texs, uav_texs, nv12_to_rgb_cs_, output_frame_rgb_tex.Width(0), output_frame_rgb_tex.Height(0));
+        return this->RunComputeShader(
+            srv_texs, uav_texs, nv12_to_rgb_cs_, output_frame_rgb_tex.Width(0), num_rows, GpuSystem::MaxFenceValue, slot);
     }
 
     uint64_t MotionBlurGenerator::EstimateMotionVectors(GpuTexture2D& ref_frame_nv12_tex, GpuTexture2D& input_frame_nv12_tex,
         GpuTexture2D& output_motion_vector_tex, ID3D12VideoMotionVectorHeap* video_mv_heap, uint64_t wait_fence_value)
     {
+        GO_MOTION_TRACE_SCOPE("EstimateMotionVectors");
+
         GpuCommandList cmd_list = gpu_system_.CreateCommandList(GpuSystem::CmdQueueType::VideoEncode);
         auto* video_cmd_list = cmd_list.NativeCommandList<ID3D12VideoEncodeCommandList>();
 
@@ -475,41 +984,249 @@ namespace MotionToGo
     }
 
     uint64_t MotionBlurGenerator::PropagateMotionBlur(float time_span, GpuTexture2D& raw_motion_vector_tex,
-        GpuTexture2D& output_motion_vector_tex, GpuTexture2D& output_motion_vector_neighbor_max_tex, uint64_t wait_fence_value)
+        GpuTexture2D& output_motion_vector_tex, GpuTexture2D& output_motion_vector_tile_max_tex,
+        GpuTexture2D& output_motion_vector_neighbor_max_transposed_tex, GpuTexture2D& output_motion_vector_neighbor_max_tex,
+        uint64_t wait_fence_value)
+    {
+        GO_MOTION_TRACE_SCOPE("PropagateMotionBlur");
+
+        // The default, kept to the output of the original 3x3 kernel
+        const bool single_pass = (tile_max_cs_.cb->tiles_per_tile_max == 1) && (neighbor_max_radius_ == 1);
+
+        {
+            auto& cs = single_pass ? neighbor_max_3x3_cs_ : tile_max_cs_;
+            cs.cb->blur_radius = blur_radius_;
+            cs.cb->half_exposure_x_framerate = exposure_ / 2 / time_span;
+            cs.cb.UploadToGpu();
+        }
+
+        if (single_pass)
+        {
+            const SrvHelper srv_texs[] = {
+                {&raw_motion_vector_tex},
+            };
+            const UavHelper uav_texs[] = {
+                {&output_motion_vector_tex},
+                {&output_motion_vector_neighbor_max_tex},
+            };
+            return this->RunComputeShader(srv_texs, uav_texs, neighbor_max_3x3_cs_, output_motion_vector_tex.Width(0),
+                output_motion_vector_tex.Height(0), wait_fence_value);
+        }
+
+        for (auto& cs : neighbor_max_cs_)
+        {
+            cs.cb->radius = neighbor_max_radius_;
+            cs.cb.UploadToGpu();
+        }
+
+        {
+            const SrvHelper srv_texs[] = {
+                {&raw_motion_vector_tex},
+            };
+            const UavHelper uav_texs[] = {
+                {&output_motion_vector_tex},
+                {&output_motion_vector_tile_max_tex},
+            };
+            this->RunComputeShader(srv_texs, uav_texs, tile_max_cs_, output_motion_vector_tile_max_tex.Width(0),
+                output_motion_vector_tile_max_tex.Height(0), wait_fence_value);
+        }
+
+        // Separable, each pass dilates along x and transposes
+        const uint32_t window = neighbor_max_radius_ * 2 + 1;
+        {
+            const SrvHelper srv_texs[] = {
+                {&output_motion_vector_tile_max_tex},
+            };
+            const UavHelper uav_texs[] = {
+                {&output_motion_vector_neighbor_max_transposed_tex},
+            };
+            this->RunComputeShader(srv_texs, uav_texs, neighbor_max_cs_[0], DivUp(output_motion_vector_tile_max_tex.Width(0), window),
+                output_motion_vector_tile_max_tex.Height(0));
+        }
+        {
+            const SrvHelper srv_texs[] = {
+                {&output_motion_vector_neighbor_max_transposed_tex},
+            };
+            const UavHelper uav_texs[] = {
+                {&output_motion_vector_neighbor_max_tex},
+            };
+            return this->RunComputeShader(srv_texs, uav_texs, neighbor_max_cs_[1],
+                DivUp(output_motion_vector_neighbor_max_transposed_tex.Width(0), window),
+                output_motion_vector_neighbor_max_transposed_tex.Height(0));
+        }
+    }
+
+    uint64_t MotionBlurGenerator::ClassifyTiles(GpuTexture2D& motion_vector_tex, GpuTexture2D& motion_vector_neighbor_max_tex,
+        GpuTexture2D& output_tile_list_tex, GpuTexture2D& output_tile_count_tex)
     {
+        GO_MOTION_TRACE_SCOPE("ClassifyTiles");
+
         {
-            neighbor_max_cs_.cb->half_exposure_x_framerate = Exposure / 2 / time_span;
-            neighbor_max_cs_.cb.UploadToGpu();
+            tile_classify_cs_.cb->blur_radius = blur_radius_;
+            tile_classify_cs_.cb->half_exposure = exposure_ / 2;
+            tile_classify_cs_.cb.UploadToGpu();
         }
+        {
+            const uint32_t zeros[static_cast<uint32_t>(MotionBlurTileClass::Num)]{};
+            auto cmd_list = gpu_system_.CreateCommandList(GpuSystem::CmdQueueType::Compute);
+            this->ActivateTransient(cmd_list, output_tile_count_tex);
+            output_tile_count_tex.Upload(gpu_system_, cmd_list, 0, zeros);
+            gpu_system_.Execute(std::move(cmd_list));
+        }
+
+        const SrvHelper srv_texs[] = {
+            {&motion_vector_tex},
+            {&motion_vector_neighbor_max_tex},
+        };
+        const UavHelper uav_texs[] = {
+            {&output_tile_list_tex},
+            {&output_tile_count_tex},
+        };
+        return this->RunComputeShader(
+            srv_texs, uav_texs, tile_classify_cs_, motion_vector_tex.Width(0), motion_vector_tex.Height(0));
+    }
+
+    uint64_t MotionBlurGenerator::DownsamplePreview(GpuTexture2D& frame_tex, GpuTexture2D& output_preview_tex)
+    {
+        GO_MOTION_TRACE_SCOPE("DownsamplePreview");
 
         const SrvHelper srv_texs[] = {
-            {&raw_motion_vector_tex},
+            {&frame_tex},
         };
         const UavHelper uav_texs[] = {
-            {&output_motion_vector_tex},
-            {&output_motion_vector_neighbor_max_tex},
+            {&output_preview_tex},
         };
         return this->RunComputeShader(
-            srv_texs, uav_texs, neighbor_max_cs_, output_motion_vector_tex.Width(0), output_motion_vector_tex.Height(0), wait_fence_value);
+            srv_texs, uav_texs, preview_downsample_cs_, output_preview_tex.Width(0), output_preview_tex.Height(0));
     }
 
     uint64_t MotionBlurGenerator::GatherMotionBlur(GpuTexture2D& frame_tex, GpuTexture2D& motion_vector_tex,
-        GpuTexture2D& motion_vector_neighbor_max_tex, GpuTexture2D& output_motion_blurred_tex)
+        GpuTexture2D& motion_vector_neighbor_max_tex, GpuTexture2D& tile_list_tex, GpuTexture2D& tile_count_tex, bool use_tile_lists,
+        uint32_t first_row, uint32_t num_rows, GpuTexture2D& output_motion_blurred_tex, uint32_t slot)
     {
+        GO_MOTION_TRACE_SCOPE("GatherMotionBlur");
+
+        {
+            gather_cs_.cb->blur_radius = blur_radius_;
+            gather_cs_.cb->half_exposure = exposure_ / 2;
+            gather_cs_.cb->reconstruction_samples = reconstruction_samples_;
+            gather_cs_.cb->use_tile_lists = use_tile_lists;
+            gather_cs_.cb->min_reconstruction_samples = min_reconstruction_samples_;
+            gather_cs_.cb->first_tile_row = first_row / MotionBlurTileSize;
+            gather_cs_.cb.UploadToGpu(slot);
+        }
+
         const SrvHelper srv_texs[] = {
             {&frame_tex},
             {&motion_vector_tex},
             {&motion_vector_neighbor_max_tex},
             {&random_tex_},
+            {&tile_list_tex},
+            {&tile_count_tex},
+        };
+        const UavHelper uav_texs[] = {
+            {&output_motion_blurred_tex},
+        };
+        return this->RunComputeShader(srv_texs, uav_texs, gather_cs_, frame_tex.Width(0), num_rows, GpuSystem::MaxFenceValue, slot);
+    }
+
+    uint64_t MotionBlurGenerator::GatherMotionBlurInStrips(const GpuTexture2D& frame_tex, GpuTexture2D& output_motion_blurred_tex)
+    {
+        GO_MOTION_TRACE_SCOPE("GatherMotionBlurInStrips");
+
+        GpuTexture2D& frame_rgb_tex = transients_.frame_rgb_tex;
+        const uint32_t width = frame_rgb_tex.Width(0);
+        const uint32_t height = frame_rgb_tex.Height(0);
+        const uint32_t tile_height = strips_.tile_height;
+
+        CpuMotionBlurParams params{};
+        params.width = width;
+        params.height = height;
+        params.blur_radius = blur_radius_;
+        params.max_sample_tap_distance = gather_cs_.cb->max_sample_tap_distance;
+        const uint32_t halo_rows = MotionBlurGatherHaloRows(params);
+
+        // The most rows of tiles a strip and its halo cover. The halo grows with the blur radius, and the heap with it.
+        const uint32_t window_tile_rows = std::min(DivUp(strips_.rows + 2 * halo_rows, tile_height) + 1, DivUp(height, tile_height));
+        if (window_tile_rows > strips_.heap_tile_rows)
+        {
+            gpu_system_.WaitForGpu();
+            this->CreateStripHeap(window_tile_rows);
+        }
+
+        uint64_t fence_value = GpuSystem::MaxFenceValue;
+        for (uint32_t first_row = 0, strip = 0; first_row < height; first_row += strips_.rows, ++strip)
+        {
+            const uint32_t end_row = std::min(first_row + strips_.rows, height);
+            const uint32_t first_tile_row = (std::max(first_row, halo_rows) - halo_rows) / tile_height;
+            const uint32_t end_tile_row = DivUp(std::min(end_row + halo_rows, height), tile_height);
+            const uint32_t window_first_row = first_tile_row * tile_height;
+            const uint32_t window_end_row = std::min(end_tile_row * tile_height, height);
+
+            // The heap tiles are remapped in queue order after the last strip. Only the constant buffers and the descriptors of a slot
+            // wait for the strip that used it before.
+            const uint32_t slot_index = strip % Strips::NumSlots;
+            const uint32_t slot = 1 + slot_index;
+            gpu_system_.WaitForFence(strips_.slot_fences[slot_index]);
+
+            this->MapStripTiles(first_tile_row, end_tile_row);
+            std::erase(active_transients_, frame_rgb_tex.NativeTexture());
+
+            if (frame_tex.Format() == DXGI_FORMAT_NV12)
+            {
+                this->RunStage(Stage::ConvertToRgb, [&] {
+                    return this->ConvertToRgb(frame_tex, frame_rgb_tex, window_first_row, window_end_row - window_first_row, slot);
+                });
+            }
+            else
+            {
+                this->RunStage(Stage::CopyFrame, [&] {
+                    auto cmd_list = gpu_system_.CreateCommandList(GpuSystem::CmdQueueType::Compute);
+                    this->ActivateTransient(cmd_list, frame_rgb_tex);
+                    const D3D12_BOX src_box{0, window_first_row, 0, width, window_end_row, 1};
+                    frame_rgb_tex.CopyFrom(gpu_system_, cmd_list, frame_tex, 0, 0, window_first_row, src_box);
+                    return gpu_system_.Execute(std::move(cmd_list));
+                });
+            }
+
+            fence_value = this->RunStage(Stage::GatherMotionBlur, [&] {
+                return this->GatherMotionBlur(frame_rgb_tex, transients_.motion_vector_tex, transients_.motion_vector_neighbor_max_tex,
+                    transients_.tile_list_tex, transients_.tile_count_tex, false, first_row, end_row - first_row,
+                    output_motion_blurred_tex, slot);
+            });
+            strips_.slot_fences[slot_index] = fence_value;
+        }
+
+        return fence_value;
+    }
+
+    uint64_t MotionBlurGenerator::UpsamplePreview(GpuTexture2D& frame_tex, GpuTexture2D& preview_tex, GpuTexture2D& blurred_preview_tex,
+        GpuTexture2D& motion_vector_neighbor_max_tex, GpuTexture2D& output_motion_blurred_tex)
+    {
+        GO_MOTION_TRACE_SCOPE("UpsamplePreview");
+
+        {
+            preview_upsample_cs_.cb->blur_radius = blur_radius_;
+            preview_upsample_cs_.cb->half_exposure = exposure_ / 2;
+            preview_upsample_cs_.cb.UploadToGpu();
+        }
+
+        const SrvHelper srv_texs[] = {
+            {&frame_tex},
+            {&preview_tex},
+            {&blurred_preview_tex},
+            {&motion_vector_neighbor_max_tex},
         };
         const UavHelper uav_texs[] = {
             {&output_motion_blurred_tex},
         };
-        return this->RunComputeShader(srv_texs, uav_texs, gather_cs_, frame_tex.Width(0), frame_tex.Height(0));
+        return this->RunComputeShader(srv_texs, uav_texs, preview_upsample_cs_, frame_tex.Width(0), frame_tex.Height(0));
     }
 
     uint64_t MotionBlurGenerator::OverlayMotionVector(GpuTexture2D& motion_vector_tex, GpuTexture2D& output_overlaid_tex)
     {
+        GO_MOTION_TRACE_SCOPE("OverlayMotionVector");
+
         const SrvHelper srv_texs[] = {
             {&motion_vector_tex},
         };
@@ -519,11 +1236,29 @@ namespace MotionToGo
         return this->RunComputeShader(srv_texs, uav_texs, overlay_cs_, motion_vector_tex.Width(0), motion_vector_tex.Height(0));
     }
 
+    template <typename Func>
+    uint64_t MotionBlurGenerator::RunStage(Stage stage, Func&& func)
+    {
+        if (!profile_stages_)
+        {
+            return func();
+        }
+
+        const auto start = std::chrono::high_resolution_clock::now();
+        const uint64_t fence_value = func();
+        gpu_system_.WaitForGpu();
+        // Summed, the strips run some stages once each
+        stage_times_[static_cast<uint32_t>(stage)] +=
+            std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+        return fence_value;
+    }
+
     template <typename CbType, size_t ShaderSize>
     void MotionBlurGenerator::CreateComputeShader(ID3D12Device* device, ComputeShaderHelper<CbType>& cs,
         const unsigned char (&shader)[ShaderSize], std::span<const D3D12_STATIC_SAMPLER_DESC> samplers)
     {
-        cs.desc_block = gpu_system_.AllocCbvSrvUavDescBlock((cs.num_srvs + cs.num_uavs) * GpuSystem::FrameCount);
+        cs.desc_block = gpu_system_.AllocCbvSrvUavDescBlock((cs.num_srvs + cs.num_uavs) * cs.num_slots * GpuSystem::FrameCount);
 
         const D3D12_DESCRIPTOR_RANGE ranges[] = {
             {D3D12_DESCRIPTOR_RANGE_TYPE_SRV, cs.num_srvs, 0, 0, D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND},
@@ -566,10 +1301,12 @@ namespace MotionToGo
 
     template <typename CbType>
     uint64_t MotionBlurGenerator::RunComputeShader(const SrvHelper srv_texs[], const UavHelper uav_texs[],
-        const ComputeShaderHelper<CbType>& cs, uint32_t dispatch_x, uint32_t dispatch_y, uint64_t wait_fence_value)
+        const ComputeShaderHelper<CbType>& cs, uint32_t dispatch_x, uint32_t dispatch_y, uint64_t wait_fence_value, uint32_t slot)
     {
+        assert(slot < cs.num_slots);
+
         const uint32_t descriptor_size = gpu_system_.CbvSrvUavDescSize();
-        const uint32_t desc_block_base = (cs.num_srvs + cs.num_uavs) * gpu_system_.FrameIndex();
+        const uint32_t desc_block_base = (cs.num_srvs + cs.num_uavs) * (gpu_system_.FrameIndex() * cs.num_slots + slot);
 
         auto srvs = std::make_unique<GpuShaderResourceView[]>(cs.num_srvs);
         for (uint32_t i = 0; i < cs.num_srvs; ++i)
@@ -604,7 +1341,7 @@ namespace MotionToGo
         d3d12_cmd_list->SetComputeRootDescriptorTable(0, OffsetHandle(cs.desc_block.GpuHandle(), desc_block_base + 0, descriptor_size));
         d3d12_cmd_list->SetComputeRootDescriptorTable(
             1, OffsetHandle(cs.desc_block.GpuHandle(), desc_block_base + cs.num_srvs, descriptor_size));
-        d3d12_cmd_list->SetComputeRootConstantBufferView(2, cs.cb.GpuVirtualAddress());
+        d3d12_cmd_list->SetComputeRootConstantBufferView(2, cs.cb.GpuVirtualAddress(slot));
 
         for (uint32_t i = 0; i < cs.num_srvs; ++i)
         {
@@ -612,6 +1349,7 @@ namespace MotionToGo
         }
         for (uint32_t i = 0; i < cs.num_uavs; ++i)
         {
+            this->ActivateTransient(cmd_list, *uav_texs[i].tex);
             uav_texs[i].tex->Transition(cmd_list, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
         }
 
@@ -2,11 +2,13 @@
 
 #include <array>
 #include <span>
+#include <vector>
 
 #include <DirectXMath.h>
 #include <directx/d3d12.h>
 #include <winrt/base.h>
 
+#include "Cpu/CpuMotionBlur.hpp"
 #include "Gpu/GpuBufferHelper.hpp"
 #include "Gpu/GpuSystem.hpp"
 #include "Gpu/GpuTexture2D.hpp"
@@ -14,10 +16,46 @@
 
 namespace MotionToGo
 {
+    struct MotionBlurTextureMemory
+    {
+        // Allocated for the textures of the current sequence
+        uint64_t resident_bytes = 0;
+        // What they would take with a set of their own per frame in flight, none sharing memory
+        uint64_t unaliased_bytes = 0;
+        // Of the full resolution RGB frame the gather reads. In strips, only a strip and its halo of it are in resident_bytes.
+        uint64_t frame_bytes = 0;
+    };
+
     class MotionBlurGenerator final
     {
         DISALLOW_COPY_AND_ASSIGN(MotionBlurGenerator)
 
+    public:
+        enum class Stage : uint32_t
+        {
+            CopyFrame,
+            ConvertToRgb,
+            ConvertToNv12,
+            EstimateMotionVectors,
+            PropagateMotionBlur,
+            ClassifyTiles,
+            DownsamplePreview,
+            GatherMotionBlur,
+            UpsamplePreview,
+            OverlayMotionVector,
+
+            Num,
+        };
+
+        static constexpr float DefaultExposure = 1;
+        static constexpr float DefaultBlurRadius = 1;
+        static constexpr uint32_t DefaultReconstructionSamples = 15;
+        static constexpr uint32_t MaxReconstructionSamples = MaxMotionBlurReconstructionSamples;
+        static constexpr uint32_t DefaultMinReconstructionSamples = 0;
+        static constexpr uint32_t DefaultNeighborMaxTileSize = MotionBlurTileSize;
+        static constexpr uint32_t DefaultNeighborMaxRadius = 1;
+        static constexpr uint32_t MaxPreviewScale = 4;
+
     public:
         explicit MotionBlurGenerator(GpuSystem& gpu_system);
         ~MotionBlurGenerator() noexcept;
@@ -28,16 +66,78 @@ namespace MotionToGo
         static bool ConfirmDeviceFunc(ID3D12Device* device);
 
         uint64_t AddFrame(GpuTexture2D& motion_blurred_tex, const GpuTexture2D& frame_tex, float time_span, bool overlay_mv);
+        void Reset();
+
+        // Exposure is the fraction of the frame time the shutter is open. Blur radius limits the blur, in the normalized motion
+        // vector units. More reconstruction samples give smoother blur for more time. Takes effect from the next AddFrame.
+        void BlurParameters(float exposure, float blur_radius, uint32_t reconstruction_samples) noexcept;
+        // The tiles with short blur take fewer reconstruction samples, down to this. 0, the default, keeps every tile at the
+        // reconstruction samples.
+        void MinReconstructionSamples(uint32_t samples) noexcept;
+
+        // The motion vectors are reduced to their max per tile of tile_size pixels, a multiple of MotionBlurTileSize, then dilated by
+        // radius tiles. Motion longer than (radius + 1) * tile_size pixels gets truncated. The tile size takes effect from the first
+        // AddFrame after Reset, the radius from the next AddFrame. The defaults run the original single pass 3x3 kernel, which also
+        // skips the neighbors moving away from a tile.
+        void NeighborMaxParameters(uint32_t tile_size, uint32_t radius) noexcept;
+
+        // 2 or 4 gathers the blur on a frame scaled down by that, and upsamples it guided by the full resolution frame. The pixels
+        // without motion stay at full resolution. Faster, for previews. 1 gathers at full resolution. Takes effect from the first
+        // AddFrame after Reset, and doesn't skip static tiles.
+        void PreviewScale(uint32_t scale) noexcept;
+
+        // Rows per strip, a multiple of MotionBlurTileSize. The gather runs a strip at a time, and only the tiles of a strip and
+        // its halo, MotionBlurGatherHaloRows, of the full resolution RGB frame are backed by memory. For frames too large to hold,
+        // slower, the output is the same. 0, the default, processes whole frames, and so does a device without tiled resources.
+        // Takes effect from the first AddFrame after Reset. Not in preview, and the static tiles aren't skipped.
+        void StripRows(uint32_t rows) noexcept;
+
+        // When enabled, AddFrame waits for the GPU after every stage and records how long each one took, from submission to
+        // completion. This serializes the GPU work, so only use it for profiling.
+        void ProfileStages(bool enable) noexcept;
+        // In milliseconds, of the last AddFrame. Stages that didn't run are 0.
+        std::span<const double> StageTimes() const noexcept;
+
+        // When enabled (the default), the tiles are classified before the gather. Static tiles are copied, only the others run the
+        // reconstruction. The result is the same either way.
+        void SkipStaticTiles(bool enable) noexcept;
+        // Number of tiles in each MotionBlurTileClass, of the last AddFrame that profiled the stages and skipped static tiles.
+        std::span<const uint32_t> TileCounts() const noexcept;
+
+        // The R16G16_SINT motion vectors estimated by the last AddFrame, in quarter pixels of the scaled frame, one per block of
+        // MotionVectorBlockSize() pixels. Only valid until GpuSystem::MoveToNextFrame.
+        const GpuTexture2D& RawMotionVectorTexture() const noexcept;
+        uint32_t MotionVectorBlockSize() const noexcept;
+        // Width of the frames the motion is estimated on. Large frames are scaled down first.
+        uint32_t EstimationWidth() const noexcept;
+
+        // Of the textures allocated since Reset
+        MotionBlurTextureMemory TextureMemory() const noexcept;
 
     private:
-        uint64_t ConvertToNv12(GpuTexture2D& frame_rgb_tex, GpuTexture2D& output_frame_nv12_tex);
-        uint64_t ConvertToRgb(GpuTexture2D& frame_nv12_tex, GpuTexture2D& output_frame_rgb_tex);
+        void CreateTextures(uint32_t width, uint32_t height, uint32_t scaled_width, uint32_t scaled_height, DXGI_FORMAT frame_format);
+        void CreateStripFrame(uint32_t width, uint32_t height, DXGI_FORMAT format);
+        void CreateStripHeap(uint32_t tile_rows);
+        void MapStripTiles(uint32_t first_tile_row, uint32_t end_tile_row);
+        void ActivateTransient(GpuCommandList& cmd_list, const GpuTexture2D& tex);
+
+        uint64_t ConvertToNv12(const GpuTexture2D& frame_rgb_tex, GpuTexture2D& output_frame_nv12_tex);
+        uint64_t ConvertToRgb(const GpuTexture2D& frame_nv12_tex, GpuTexture2D& output_frame_rgb_tex, uint32_t first_row,
+            uint32_t num_rows, uint32_t slot);
         uint64_t EstimateMotionVectors(GpuTexture2D& ref_frame_nv12_tex, GpuTexture2D& input_frame_nv12_tex,
             GpuTexture2D& output_motion_vector_tex, ID3D12VideoMotionVectorHeap* video_mv_heap, uint64_t wait_fence_value);
         uint64_t PropagateMotionBlur(float time_span, GpuTexture2D& raw_motion_vector_tex, GpuTexture2D& output_motion_vector_tex,
+            GpuTexture2D& output_motion_vector_tile_max_tex, GpuTexture2D& output_motion_vector_neighbor_max_transposed_tex,
             GpuTexture2D& output_motion_vector_neighbor_max_tex, uint64_t wait_fence_value);
+        uint64_t ClassifyTiles(GpuTexture2D& motion_vector_tex, GpuTexture2D& motion_vector_neighbor_max_tex,
+            GpuTexture2D& output_tile_list_tex, GpuTexture2D& output_tile_count_tex);
+        uint64_t DownsamplePreview(GpuTexture2D& frame_tex, GpuTexture2D& output_preview_tex);
         uint64_t GatherMotionBlur(GpuTexture2D& frame_tex, GpuTexture2D& motion_vector_tex, GpuTexture2D& motion_vector_neighbor_max_tex,
-            GpuTexture2D& output_motion_blurred_tex);
+            GpuTexture2D& tile_list_tex, GpuTexture2D& tile_count_tex, bool use_tile_lists, uint32_t first_row, uint32_t num_rows,
+            GpuTexture2D& output_motion_blurred_tex, uint32_t slot);
+        uint64_t GatherMotionBlurInStrips(const GpuTexture2D& frame_tex, GpuTexture2D& output_motion_blurred_tex);
+        uint64_t UpsamplePreview(GpuTexture2D& frame_tex, GpuTexture2D& preview_tex, GpuTexture2D& blurred_preview_tex,
+            GpuTexture2D& motion_vector_neighbor_max_tex, GpuTexture2D& output_motion_blurred_tex);
         uint64_t OverlayMotionVector(GpuTexture2D& motion_vector_tex, GpuTexture2D& output_overlaid_tex);
 
         template <typename T>
@@ -50,11 +150,13 @@ namespace MotionToGo
 
             uint32_t num_srvs;
             uint32_t num_uavs;
+            // Constant buffers and descriptors of as many dispatches in flight at once, in a frame
+            uint32_t num_slots = 1;
         };
 
         struct SrvHelper
         {
-            GpuTexture2D* tex;
+            const GpuTexture2D* tex;
             uint32_t sub_resource = ~0u;
             DXGI_FORMAT format = DXGI_FORMAT_UNKNOWN;
         };
@@ -66,19 +168,18 @@ namespace MotionToGo
             DXGI_FORMAT format = DXGI_FORMAT_UNKNOWN;
         };
 
+        template <typename Func>
+        uint64_t RunStage(Stage stage, Func&& func);
+
         template <typename CbType, size_t ShaderSize>
         void CreateComputeShader(ID3D12Device* device, ComputeShaderHelper<CbType>& cs, const unsigned char (&shader)[ShaderSize],
             std::span<const D3D12_STATIC_SAMPLER_DESC> samplers = {});
 
         template <typename CbType>
         uint64_t RunComputeShader(const SrvHelper srv_texs[], const UavHelper uav_texs[], const ComputeShaderHelper<CbType>& cs,
-            uint32_t dispatch_x, uint32_t dispatch_y, uint64_t wait_fence_value = GpuSystem::MaxFenceValue);
+            uint32_t dispatch_x, uint32_t dispatch_y, uint64_t wait_fence_value = GpuSystem::MaxFenceValue, uint32_t slot = 0);
 
     private:
-        static constexpr float Exposure = 1;
-        static constexpr uint32_t BlurRadius = 1;
-        static constexpr uint32_t ReconstructionSamples = 15;
-
         GpuSystem& gpu_system_;
 
         GpuTexture2D random_tex_;
@@ -93,20 +194,43 @@ namespace MotionToGo
         struct ColorSpaceConstantBuffer
         {
             DirectX::XMUINT2 frame_width_height;
+            // Only of nv12_to_rgb, the row its dispatch starts at
+            uint32_t first_row;
         };
         ComputeShaderHelper<ColorSpaceConstantBuffer> rgb_to_nv12_cs_;
         ComputeShaderHelper<ColorSpaceConstantBuffer> nv12_to_rgb_cs_;
 
-        struct NeighborMaxConstantBuffer
+        struct TileMaxConstantBuffer
         {
             DirectX::XMFLOAT2 inv_half_frame_width_height;
             DirectX::XMUINT2 motion_vector_width_height;
             DirectX::XMUINT2 raw_motion_vector_width_height;
+            DirectX::XMUINT2 tile_max_width_height;
             float blur_radius;
             float half_exposure_x_framerate;
             float size_scale;
+            uint32_t tiles_per_tile_max;
+        };
+        ComputeShaderHelper<TileMaxConstantBuffer> tile_max_cs_;
+        // Replaces the tile max and the separable passes for 16 pixel tiles and radius 1
+        ComputeShaderHelper<TileMaxConstantBuffer> neighbor_max_3x3_cs_;
+
+        struct NeighborMaxConstantBuffer
+        {
+            uint32_t radius;
+        };
+        // A pass per axis, the descriptors of one dispatch can't be rewritten before it runs
+        std::array<ComputeShaderHelper<NeighborMaxConstantBuffer>, 2> neighbor_max_cs_;
+
+        struct TileClassifyConstantBuffer
+        {
+            DirectX::XMUINT2 frame_width_height;
+            DirectX::XMUINT2 tile_width_height;
+            DirectX::XMUINT2 neighbor_max_width_height;
+            float blur_radius;
+            float half_exposure;
         };
-        ComputeShaderHelper<NeighborMaxConstantBuffer> neighbor_max_cs_;
+        ComputeShaderHelper<TileClassifyConstantBuffer> tile_classify_cs_;
 
         struct GatherConstantBuffer
         {
@@ -115,9 +239,30 @@ namespace MotionToGo
             float half_exposure;
             uint32_t reconstruction_samples;
             float max_sample_tap_distance;
+            DirectX::XMUINT2 tile_width_height;
+            uint32_t use_tile_lists;
+            uint32_t min_reconstruction_samples;
+            uint32_t first_tile_row;
         };
         ComputeShaderHelper<GatherConstantBuffer> gather_cs_;
 
+        struct PreviewDownsampleConstantBuffer
+        {
+            DirectX::XMUINT2 frame_width_height;
+            uint32_t scale;
+        };
+        ComputeShaderHelper<PreviewDownsampleConstantBuffer> preview_downsample_cs_;
+
+        struct PreviewUpsampleConstantBuffer
+        {
+            DirectX::XMUINT2 frame_width_height;
+            DirectX::XMUINT2 preview_width_height;
+            uint32_t scale;
+            float blur_radius;
+            float half_exposure;
+        };
+        ComputeShaderHelper<PreviewUpsampleConstantBuffer> preview_upsample_cs_;
+
         struct OverlayConstantBuffer
         {
             float max_sample_tap_distance;
@@ -129,13 +274,70 @@ namespace MotionToGo
         {
             winrt::com_ptr<ID3D12VideoMotionVectorHeap> video_motion_vector_heap;
 
+            GpuTexture2D scaled_frame_nv12_tex;
+        };
+        std::array<Frame, GpuSystem::FrameCount> frames_;
+
+        // Only live within an AddFrame. One set is shared by the frames in flight, their stages run in order on the compute queue.
+        struct Transients
+        {
+            // Reserved in strips
             GpuTexture2D frame_rgb_tex;
+            // Not in strips, they read the NV12 frame itself
             GpuTexture2D frame_nv12_tex;
-            GpuTexture2D scaled_frame_nv12_tex;
             GpuTexture2D raw_motion_vector_tex;
             GpuTexture2D motion_vector_tex;
+            GpuTexture2D motion_vector_tile_max_tex;
+            GpuTexture2D motion_vector_neighbor_max_transposed_tex;
             GpuTexture2D motion_vector_neighbor_max_tex;
+            GpuTexture2D tile_list_tex;
+            GpuTexture2D tile_count_tex;
+            // Only in preview
+            GpuTexture2D preview_frame_rgb_tex;
+            GpuTexture2D preview_blurred_tex;
         };
-        std::array<Frame, GpuSystem::FrameCount> frames_;
+        Transients transients_;
+        // The textures whose lives don't overlap are placed at the same memory in it
+        winrt::com_ptr<ID3D12Heap> transient_heap_;
+        TrackedMemory transient_heap_memory_;
+        // And the reserved frame_rgb_tex in strips, its tiles move to other memory each strip
+        std::vector<ID3D12Resource*> placed_transients_;
+        // Written since the start of this AddFrame
+        std::vector<ID3D12Resource*> active_transients_;
+        MotionBlurTextureMemory texture_memory_;
+
+        // Of the sequence, the rows are 0 if it processes whole frames. The tiles of frame_rgb_tex a strip reads are mapped to the
+        // start of the heap, each strip remaps them.
+        struct Strips
+        {
+            uint32_t rows = 0;
+            uint32_t num_tiles = 0;
+            uint32_t tiles_x = 0;
+            uint32_t tile_height = 0;
+            uint32_t heap_tile_rows = 0;
+            winrt::com_ptr<ID3D12Heap> heap;
+            TrackedMemory heap_memory;
+
+            // Strips in flight, each with its slot of the color conversion and the gather. Slot 0 is the whole frame's.
+            static constexpr uint32_t NumSlots = 4;
+            // The gather fence of the last strip in each slot
+            std::array<uint64_t, NumSlots> slot_fences{};
+        };
+        Strips strips_;
+
+        bool profile_stages_ = false;
+        std::array<double, static_cast<uint32_t>(Stage::Num)> stage_times_{};
+
+        float exposure_ = DefaultExposure;
+        float blur_radius_ = DefaultBlurRadius;
+        uint32_t reconstruction_samples_ = DefaultReconstructionSamples;
+        uint32_t min_reconstruction_samples_ = DefaultMinReconstructionSamples;
+        uint32_t neighbor_max_tile_size_ = DefaultNeighborMaxTileSize;
+        uint32_t neighbor_max_radius_ = DefaultNeighborMaxRadius;
+        uint32_t preview_scale_ = 1;
+        uint32_t strip_rows_ = 0;
+
+        bool skip_static_tiles_ = true;
+        std::array<uint32_t, static_cast<uint32_t>(MotionBlurTileClass::Num)> tile_counts_{};
     };
 } // namespace MotionToGo
@@ -1,80 +1,65 @@
 #define BLOCK_DIM 16
-#define KERNEL_RADIUS 1
+#define MAX_RADIUS 8
 
 cbuffer param_cb : register(b0)
 {
-    float2 inv_half_frame_width_height;
-    uint2 motion_vector_width_height;
-    uint2 raw_motion_vector_width_height;
-    float blur_radius;
-    float half_exposure_x_framerate;
-    float size_scale;
+    uint radius;
 };
 
-Texture2D<int2> raw_motion_vector_tex : register(t0);
+Texture2D<float2> input_tex : register(t0);
 
-RWTexture2D<unorm float2> motion_vector_tex : register(u0);
-RWTexture2D<unorm float2> motion_vector_neighbor_max_tex : register(u1);
+// Transposed, so the same pass on its output does the other axis
+RWTexture2D<unorm float2> transposed_output_tex : register(u0);
 
-groupshared float2 sh_mv_tile[BLOCK_DIM + KERNEL_RADIUS * 2][BLOCK_DIM + KERNEL_RADIUS * 2];
-
-[numthreads(BLOCK_DIM, BLOCK_DIM, 1)]
-void main(uint3 gid : SV_GroupID, uint3 gtid : SV_GroupThreadID, uint3 dtid : SV_DispatchThreadID, uint gi : SV_GroupIndex)
+// Orders the quantized vectors by length, 128 as 0, then by value. Matches VelocityKey in CpuMotionBlur.cpp.
+uint VelocityKey(uint2 texel)
 {
-    const float Epsilon = 0.01f;
+    int2 d = int2(texel) - 128;
+    return (uint(dot(d, d)) << 16) | (texel.x << 8) | texel.y;
+}
 
-    int2 start_coord = gid.xy * BLOCK_DIM - KERNEL_RADIUS;
-    for (uint i = gi; i < (BLOCK_DIM + KERNEL_RADIUS * 2) * (BLOCK_DIM + KERNEL_RADIUS * 2); i += BLOCK_DIM * BLOCK_DIM)
+uint KeyAt(int x, uint y, uint width)
+{
+    [branch]
+    if ((x < 0) || (x >= (int)width))
     {
-        uint offset_y = i / (BLOCK_DIM + KERNEL_RADIUS * 2);
-        uint offset_x = i - offset_y * (BLOCK_DIM + KERNEL_RADIUS * 2);
-        uint2 coord = start_coord + uint2(offset_x, offset_y);
-        uint2 input_coord = uint2((coord + 0.5f) / motion_vector_width_height * raw_motion_vector_width_height);
-        float2 mv;
-        if (any(input_coord == 0) || (input_coord.x >= raw_motion_vector_width_height.x - 1) || (input_coord.y >= raw_motion_vector_width_height.y - 1))
-        {
-            mv = 0;
-        }
-        else
-        {
-            mv = -raw_motion_vector_tex.Load(int3(input_coord, 0)) * size_scale / 4.0f * inv_half_frame_width_height;
+        return 0;
+    }
+    return VelocityKey(uint2(input_tex.Load(int3(x, y, 0)) * 255 + 0.5f));
+}
 
-            mv *= half_exposure_x_framerate;
-            float len_mv = length(mv);
+// A van Herk / Gil-Werman running max along x. Each thread does a block of 2 * radius + 1 outputs. Their windows span 2 blocks of
+// inputs, so each output is the max of a suffix of the first and a prefix of the second. 2 loads per output for any radius.
+[numthreads(BLOCK_DIM, BLOCK_DIM, 1)]
+void main(uint3 dtid : SV_DispatchThreadID)
+{
+    uint width;
+    uint height;
+    input_tex.GetDimensions(width, height);
 
-            float weight = max(0.5f, min(len_mv, blur_radius));
-            weight /= max(len_mv, Epsilon);
-            mv *= weight;
-        }
+    uint window = radius * 2 + 1;
+    uint block = dtid.x * window;
 
-        sh_mv_tile[offset_y][offset_x] = mv;
+    [branch]
+    if ((block >= width) || (dtid.y >= height))
+    {
+        return;
     }
-    GroupMemoryBarrierWithGroupSync();
 
-    motion_vector_tex[dtid.xy] = sh_mv_tile[gtid.y + KERNEL_RADIUS][gtid.x + KERNEL_RADIUS] * 0.5f + 0.5f;
+    int first = (int)block - (int)radius;
 
-    float2 max_mv = 0;
-    float max_magnitude_squared = 0;
-    for (int s = -KERNEL_RADIUS; s <= KERNEL_RADIUS; ++s)
+    uint suffix_max[MAX_RADIUS * 2 + 1];
+    suffix_max[window - 1] = KeyAt(first + (int)window - 1, dtid.y, width);
+    for (int i = (int)window - 2; i >= 0; --i)
     {
-        for (int t = -KERNEL_RADIUS; t <= KERNEL_RADIUS; ++t)
-        {
-            float2 mv = sh_mv_tile[gtid.y + t + KERNEL_RADIUS][gtid.x + s + KERNEL_RADIUS];
-
-            float magnitude_squared = dot(mv, mv);
-            if (max_magnitude_squared < magnitude_squared)
-            {
-                float displacement = abs(s) + abs(t);
-                float2 orientation = sign(float2(s, t) * mv);
-                float distance = orientation.x + orientation.y;
-                if (abs(distance) == displacement)
-                {
-                    max_mv = mv;
-                    max_magnitude_squared = magnitude_squared;
-                }
-            }
-        }
+        suffix_max[i] = max(suffix_max[i + 1], KeyAt(first + i, dtid.y, width));
     }
 
-    motion_vector_neighbor_max_tex[dtid.xy] = max_mv * 0.5f + 0.5f;
+    uint prefix_max = 0;
+    for (uint j = 0; (j < window) && (block + j < width); ++j)
+    {
+        uint max_key = max(suffix_max[j], prefix_max);
+        transposed_output_tex[uint2(dtid.y, block + j)] = uint2((max_key >> 8) & 0xFF, max_key & 0xFF) / 255.0f;
+        prefix_max = max(prefix_max, KeyAt(first + (int)(window + j), dtid.y, width));
+    }
 }
@@ -0,0 +1,40 @@
+#define BLOCK_DIM 16
+
+cbuffer param_cb : register(b0)
+{
+    uint2 frame_width_height;
+    uint scale;
+};
+
+Texture2D frame_tex : register(t0);
+
+RWTexture2D<unorm float4> preview_tex : register(u0);
+
+// Box filter of the scale x scale pixels, the partial ones on the right and bottom average what they have.
+// Matches DownsampleMotionBlurPreview in CpuMotionBlur.cpp.
+[numthreads(BLOCK_DIM, BLOCK_DIM, 1)]
+void main(uint3 dtid : SV_DispatchThreadID)
+{
+    uint2 preview_width_height;
+    preview_tex.GetDimensions(preview_width_height.x, preview_width_height.y);
+
+    [branch]
+    if (any(dtid.xy >= preview_width_height))
+    {
+        return;
+    }
+
+    uint2 first_pixel = dtid.xy * scale;
+    uint2 end_pixel = min(first_pixel + scale, frame_width_height);
+    float4 sum = 0;
+    for (uint y = first_pixel.y; y < end_pixel.y; ++y)
+    {
+        for (uint x = first_pixel.x; x < end_pixel.x; ++x)
+        {
+            sum += frame_tex.Load(uint3(x, y, 0));
+        }
+    }
+
+    uint2 num_pixels = end_pixel - first_pixel;
+    preview_tex[dtid.xy] = sum / (num_pixels.x * num_pixels.y);
+}
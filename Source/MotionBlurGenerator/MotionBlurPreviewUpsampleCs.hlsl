@@ -0,0 +1,81 @@
+#define BLOCK_DIM 16
+
+cbuffer param_cb : register(b0)
+{
+    uint2 frame_width_height;
+    uint2 preview_width_height;
+    uint scale;
+    float blur_radius;
+    float half_exposure;
+};
+
+Texture2D frame_tex : register(t0);
+Texture2D preview_tex : register(t1);
+Texture2D blurred_preview_tex : register(t2);
+Texture2D<float2> motion_vector_neighbor_max_tex : register(t3);
+
+RWTexture2D<unorm float4> motion_blurred_tex : register(u0);
+
+bool IsStaticVelocity(float2 vel)
+{
+    const float HalfVelocityCutoff = 0.2f;
+    return clamp(length(vel * 2 - 1) * half_exposure, 0.1f, blur_radius) < HalfVelocityCutoff;
+}
+
+// Joint bilateral upsampling of the blur the preview gather added, guided by the full resolution frame. The pixels without motion
+// keep the frame. Matches UpsampleMotionBlurPreview in CpuMotionBlur.cpp.
+[numthreads(BLOCK_DIM, BLOCK_DIM, 1)]
+void main(uint3 dtid : SV_DispatchThreadID)
+{
+    // Of the color difference between the frame and a preview texel
+    const float RangeSigma = 0.1f;
+    const float RangeScale = -1 / (2 * RangeSigma * RangeSigma);
+    const float MinWeight = 1e-4f;
+
+    [branch]
+    if (any(dtid.xy >= frame_width_height))
+    {
+        return;
+    }
+
+    float4 color = frame_tex.Load(uint3(dtid.xy, 0));
+
+    uint2 neighbor_max_width_height;
+    motion_vector_neighbor_max_tex.GetDimensions(neighbor_max_width_height.x, neighbor_max_width_height.y);
+    uint2 neighbor_max_coord = min(uint2((dtid.xy + 0.5f) / frame_width_height * neighbor_max_width_height), neighbor_max_width_height - 1);
+
+    [branch]
+    if (IsStaticVelocity(motion_vector_neighbor_max_tex.Load(uint3(neighbor_max_coord, 0))))
+    {
+        motion_blurred_tex[dtid.xy] = color;
+        return;
+    }
+
+    float2 preview_coord = (dtid.xy + 0.5f) / scale - 0.5f;
+    int2 first_texel = int2(floor(preview_coord));
+    float2 t = preview_coord - first_texel;
+
+    float3 delta = 0;
+    float3 bilinear_delta = 0;
+    float sum_weight = 0;
+    for (int dy = 0; dy < 2; ++dy)
+    {
+        for (int dx = 0; dx < 2; ++dx)
+        {
+            uint3 texel = uint3(clamp(first_texel + int2(dx, dy), 0, int2(preview_width_height) - 1), 0);
+            float3 preview_color = preview_tex.Load(texel).xyz;
+            float3 texel_delta = blurred_preview_tex.Load(texel).xyz - preview_color;
+
+            float3 diff = color.xyz - preview_color;
+            float spatial_weight = (dx ? t.x : 1 - t.x) * (dy ? t.y : 1 - t.y);
+            float weight = spatial_weight * exp(dot(diff, diff) * RangeScale);
+            delta += texel_delta * weight;
+            bilinear_delta += texel_delta * spatial_weight;
+            sum_weight += weight;
+        }
+    }
+
+    // No preview texel is close, fall back to bilinear
+    float3 pixel_delta = (sum_weight > MinWeight) ? delta / sum_weight : bilinear_delta;
+    motion_blurred_tex[dtid.xy] = float4(color.xyz + pixel_delta, 1);
+}
@@ -0,0 +1,85 @@
+#define BLOCK_DIM 16
+
+#define STATIC_TILE 0
+#define UNIFORM_MOTION_TILE 1
+#define COMPLEX_TILE 2
+
+cbuffer param_cb : register(b0)
+{
+    uint2 frame_width_height;
+    uint2 tile_width_height;
+    uint2 neighbor_max_width_height;
+    float blur_radius;
+    float half_exposure;
+};
+
+Texture2D<float2> motion_vector_tex : register(t0);
+Texture2D<float2> motion_vector_neighbor_max_tex : register(t1);
+
+// Row tile_class * tile_width_height.y onward is the list of that class, (y << 16) | x per tile
+RWTexture2D<uint> tile_list_tex : register(u0);
+RWTexture2D<uint> tile_count_tex : register(u1);
+
+bool IsStaticVelocity(float2 vel)
+{
+    const float HalfVelocityCutoff = 0.2f;
+    return clamp(length(vel * 2 - 1) * half_exposure, 0.1f, blur_radius) < HalfVelocityCutoff;
+}
+
+// The texels the gather's point sampler picks for pixels [first_pixel, last_pixel]. The margin keeps it conservative.
+void TexelRange(uint2 first_pixel, uint2 last_pixel, uint2 texture_width_height, out uint2 first_texel, out uint2 last_texel)
+{
+    const float Margin = 1e-3f;
+    float2 texel_per_pixel = float2(texture_width_height) / frame_width_height;
+    first_texel = uint2(max(floor((first_pixel + 0.5f) * texel_per_pixel - Margin), 0));
+    last_texel = min(uint2(floor((last_pixel + 0.5f) * texel_per_pixel + Margin)), texture_width_height - 1);
+}
+
+[numthreads(BLOCK_DIM, BLOCK_DIM, 1)]
+void main(uint3 dtid : SV_DispatchThreadID)
+{
+    [branch]
+    if (any(dtid.xy >= tile_width_height))
+    {
+        return;
+    }
+
+    uint2 first_pixel = dtid.xy * BLOCK_DIM;
+    uint2 last_pixel = min(first_pixel + BLOCK_DIM, frame_width_height) - 1;
+    uint2 first_texel;
+    uint2 last_texel;
+    TexelRange(first_pixel, last_pixel, tile_width_height, first_texel, last_texel);
+    uint2 first_neighbor_max;
+    uint2 last_neighbor_max;
+    TexelRange(first_pixel, last_pixel, neighbor_max_width_height, first_neighbor_max, last_neighbor_max);
+
+    float2 vel = motion_vector_neighbor_max_tex.Load(uint3(first_neighbor_max, 0));
+    bool is_static = true;
+    bool is_uniform = true;
+    for (uint y = first_neighbor_max.y; y <= last_neighbor_max.y; ++y)
+    {
+        for (uint x = first_neighbor_max.x; x <= last_neighbor_max.x; ++x)
+        {
+            float2 neighbor_vel = motion_vector_neighbor_max_tex.Load(uint3(x, y, 0));
+            is_static = is_static && IsStaticVelocity(neighbor_vel);
+            is_uniform = is_uniform && all(neighbor_vel == vel);
+        }
+    }
+
+    // The reconstruction taps reach into the neighbor tiles
+    uint2 first_neighbor = max(first_texel, 1) - 1;
+    uint2 last_neighbor = min(last_texel + 1, tile_width_height - 1);
+    for (uint y = first_neighbor.y; is_uniform && (y <= last_neighbor.y); ++y)
+    {
+        for (uint x = first_neighbor.x; x <= last_neighbor.x; ++x)
+        {
+            is_uniform = is_uniform && all(motion_vector_tex.Load(uint3(x, y, 0)) == vel);
+        }
+    }
+
+    uint tile_class = is_static ? STATIC_TILE : (is_uniform ? UNIFORM_MOTION_TILE : COMPLEX_TILE);
+    uint slot;
+    InterlockedAdd(tile_count_tex[uint2(tile_class, 0)], 1, slot);
+    uint2 list_coord = uint2(slot % tile_width_height.x, tile_class * tile_width_height.y + slot / tile_width_height.x);
+    tile_list_tex[list_coord] = (dtid.y << 16) | dtid.x;
+}
@@ -0,0 +1,73 @@
+#define BLOCK_DIM 16
+
+cbuffer param_cb : register(b0)
+{
+    float2 inv_half_frame_width_height;
+    uint2 motion_vector_width_height;
+    uint2 raw_motion_vector_width_height;
+    uint2 tile_max_width_height;
+    float blur_radius;
+    float half_exposure_x_framerate;
+    float size_scale;
+    uint tiles_per_tile_max;
+};
+
+Texture2D<int2> raw_motion_vector_tex : register(t0);
+
+RWTexture2D<unorm float2> motion_vector_tex : register(u0);
+RWTexture2D<unorm float2> motion_vector_tile_max_tex : register(u1);
+
+float2 MotionVector(uint2 coord)
+{
+    const float Epsilon = 0.01f;
+
+    uint2 input_coord = uint2((coord + 0.5f) / motion_vector_width_height * raw_motion_vector_width_height);
+    if (any(input_coord == 0) || (input_coord.x >= raw_motion_vector_width_height.x - 1) ||
+        (input_coord.y >= raw_motion_vector_width_height.y - 1))
+    {
+        return 0;
+    }
+
+    float2 mv = -raw_motion_vector_tex.Load(int3(input_coord, 0)) * size_scale / 4.0f * inv_half_frame_width_height;
+
+    mv *= half_exposure_x_framerate;
+    float len_mv = length(mv);
+
+    float weight = max(0.5f, min(len_mv, blur_radius));
+    weight /= max(len_mv, Epsilon);
+    return mv * weight;
+}
+
+// Orders the quantized vectors by length, 128 as 0, then by value. Matches VelocityKey in CpuMotionBlur.cpp.
+uint VelocityKey(uint2 texel)
+{
+    int2 d = int2(texel) - 128;
+    return (uint(dot(d, d)) << 16) | (texel.x << 8) | texel.y;
+}
+
+// One thread per tile max texel, it writes the motion vectors of its tiles too
+[numthreads(BLOCK_DIM, BLOCK_DIM, 1)]
+void main(uint3 dtid : SV_DispatchThreadID)
+{
+    [branch]
+    if (any(dtid.xy >= tile_max_width_height))
+    {
+        return;
+    }
+
+    uint2 first_tile = dtid.xy * tiles_per_tile_max;
+    uint2 last_tile = min(first_tile + tiles_per_tile_max, motion_vector_width_height) - 1;
+    uint max_key = 0;
+    for (uint y = first_tile.y; y <= last_tile.y; ++y)
+    {
+        for (uint x = first_tile.x; x <= last_tile.x; ++x)
+        {
+            // Quantized here, so the max is exactly one of the stored vectors
+            uint2 texel = uint2(saturate(MotionVector(uint2(x, y)) * 0.5f + 0.5f) * 255 + 0.5f);
+            motion_vector_tex[uint2(x, y)] = texel / 255.0f;
+            max_key = max(max_key, VelocityKey(texel));
+        }
+    }
+
+    motion_vector_tile_max_tex[dtid.xy] = uint2((max_key >> 8) & 0xFF, max_key & 0xFF) / 255.0f;
+}
@@ -3,6 +3,7 @@
 cbuffer param_cb : register(b0)
 {
     uint2 frame_width_height;
+    uint first_row;
 };
 
 Texture2D<float> luma_tex : register(t0);
@@ -24,8 +25,10 @@ float3 YCbCrToRgb(float3 ycbcr)
 [numthreads(BLOCK_DIM, BLOCK_DIM, 1)]
 void main(uint3 dtid : SV_DispatchThreadID)
 {
+    uint2 coord = dtid.xy + uint2(0, first_row);
+
     float3 ycbcr;
-    ycbcr.x = (luma_tex.Load(int3(clamp(dtid.xy, 0, frame_width_height), 0)) * 255 - 16) / 219.0f;
-    ycbcr.yz = (chroma_tex.Load(int3(clamp(dtid.xy / 2, 0, frame_width_height / 2), 0)) * 255 - 128) / 224.0f;
-    rgb_tex[dtid.xy] = float4(YCbCrToRgb(ycbcr), 1);
+    ycbcr.x = (luma_tex.Load(int3(clamp(coord, 0, frame_width_height), 0)) * 255 - 16) / 219.0f;
+    ycbcr.yz = (chroma_tex.Load(int3(clamp(coord / 2, 0, frame_width_height / 2), 0)) * 255 - 128) / 224.0f;
+    rgb_tex[coord] = float4(YCbCrToRgb(ycbcr), 1);
 }
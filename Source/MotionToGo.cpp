@@ -1,75 +1,65 @@
+#include <charconv>
 #include <chrono>
 #include <filesystem>
 #include <format>
-#include <future>
 #include <iostream>
 #include <string>
 #include <string_view>
+#include <utility>
 
 #ifndef _DEBUG
 #define CXXOPTS_NO_RTTI
 #endif
 #include <cxxopts.hpp>
 
-namespace
-{
-    unsigned char* StbiZlibCompress(unsigned char* data, int data_len, int* out_len, int quality);
-}
-
-#define STBIW_ZLIB_COMPRESS StbiZlibCompress
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include <stb_image_write.h>
-
-#include <zlib.h>
-
-#include "ErrorHandling.hpp"
-#include "Gpu/GpuCommandList.hpp"
-#include "Gpu/GpuSystem.hpp"
-#include "MotionBlurGenerator/MotionBlurGenerator.hpp"
-#include "Reader/Reader.hpp"
-
-using namespace MotionToGo;
+#include "Api/MotionToGo.h"
+#include "Server/JobServer.hpp"
 
 namespace
 {
-    // Port from https://blog.gibson.sh/2015/07/18/comparing-png-compression-ratios-of-stb_image_write-lodepng-miniz-and-libpng/
-    unsigned char* StbiZlibCompress(unsigned char* data, int data_len, int* out_len, int quality)
+    std::string PathToUtf8(const std::filesystem::path& path)
     {
-        uLong buff_len = compressBound(data_len);
-        uint8_t* buf = reinterpret_cast<uint8_t*>(std::malloc(buff_len));
-        if ((buf == nullptr) || (compress2(buf, &buff_len, data, data_len, quality) != 0))
-        {
-            free(buf);
-            return nullptr;
-        }
-        *out_len = buff_len;
-        return buf;
+        const std::u8string u8_path = path.u8string();
+        return std::string(reinterpret_cast<const char*>(u8_path.data()), u8_path.size());
     }
 
-    std::future<void> SaveTexture(GpuSystem& gpu_system, const GpuTexture2D& texture, const std::filesystem::path& file_path)
+    bool EndTrace(const std::string& trace_path)
     {
-        assert(texture);
+        if (trace_path.empty())
+        {
+            return true;
+        }
 
-        const uint32_t width = texture.Width(0);
-        const uint32_t height = texture.Height(0);
-        const uint32_t format_size = FormatSize(texture.Format());
+        if (MtgEndTrace(trace_path.c_str()) != MTG_RESULT_OK)
+        {
+            std::cerr << std::format("ERROR: {}\n", MtgGetLastError(nullptr));
+            return false;
+        }
 
-        std::vector<uint8_t> data(width * height * format_size);
-        auto cmd_list = gpu_system.CreateCommandList(GpuSystem::CmdQueueType::Compute);
-        texture.Readback(gpu_system, cmd_list, 0, data.data());
-        gpu_system.Execute(std::move(cmd_list));
+        std::cout << std::format("Trace is saved to {}.\n", trace_path);
+        return true;
+    }
 
-        return std::async(std::launch::async, [file_path = file_path.string(), width, height, format_size, data = std::move(data)]() {
-            stbi_write_png(
-                file_path.c_str(), static_cast<int>(width), static_cast<int>(height), 4, data.data(), static_cast<int>(width * format_size));
-            });
+    // <width>x<height>, both positive. No signs, no wrap around on overflow.
+    bool ParseFrameSize(std::string_view str, uint32_t& width, uint32_t& height)
+    {
+        const size_t x = str.find('x');
+        if (x == std::string_view::npos)
+        {
+            return false;
+        }
+
+        const std::string_view width_str = str.substr(0, x);
+        const std::string_view height_str = str.substr(x + 1);
+        const auto [width_end, width_ec] = std::from_chars(width_str.data(), width_str.data() + width_str.size(), width);
+        const auto [height_end, height_ec] = std::from_chars(height_str.data(), height_str.data() + height_str.size(), height);
+        return (width_ec == std::errc()) && (width_end == width_str.data() + width_str.size()) && (height_ec == std::errc()) &&
+               (height_end == height_str.data() + height_str.size()) && (width != 0) && (height != 0);
     }
-}
+} // namespace
 
 int main(int argc, char* argv[])
 {
-    stbi_write_png_compression_level = 5;
-
     cxxopts::Options options("MotionToGo", "MotionToGo: Add motion blur to a image sequence.");
     // clang-format off
     options.add_options()
@@ -78,6 +68,18 @@ int main(int argc, char* argv[])
         ("O,output-directory", "The output directory (\"<input-dir>/Output\" by default).", cxxopts::value<std::string>())
         ("F,framerate", "The framerate of the image sequence (24 by default).", cxxopts::value<float>())
         ("L,overlay", "Overlay motion vector to outputs (Off by default).", cxxopts::value<bool>())
+        ("E,exposure", "The fraction of the frame time the shutter is open, in (0, 1] (1 by default).", cxxopts::value<float>())
+        ("R,blur-radius", "The largest blur, at least 0.1 (1 by default).", cxxopts::value<float>())
+        ("N,samples", "The reconstruction samples per pixel, at most 64. Fewer is faster (15 by default).", cxxopts::value<uint32_t>())
+        ("P,preview", "Compute the blur at 1/2 or 1/4 of the resolution, for fast previews (Off by default).", cxxopts::value<uint32_t>())
+        ("M,min-samples", "Let short blur take fewer samples, down to this. 5 is ~3x faster (Off by default).", cxxopts::value<uint32_t>())
+        ("D,neighbor-radius", "Blur reach in 16 pixel tiles, at most 8. Raise for fast motion (1 by default).", cxxopts::value<uint32_t>())
+        ("G,strip-rows", "Blur this many rows at a time, a multiple of 16, for 8K+ frames (Off by default).", cxxopts::value<uint32_t>())
+        ("A,archive", "Write one Frames.mtga instead of PNGs, \"lz4\" or \"delta\" (Off by default).", cxxopts::value<std::string>())
+        ("W,raw-size", "The input is raw .rgba / .nv12 frames of <width>x<height>, mapped, not decoded.", cxxopts::value<std::string>())
+        ("S,serve", "Run as a server that accepts jobs on the given Unix domain socket.", cxxopts::value<std::string>())
+        ("J,max-jobs", "The maximum number of concurrent jobs in server mode (1 by default).", cxxopts::value<uint32_t>())
+        ("T,trace", "Write a Chrome trace / Perfetto JSON timeline of the processing to the given file.", cxxopts::value<std::string>())
         ("v,version", "Version.");
     // clang-format on
 
@@ -90,10 +92,35 @@ int main(int argc, char* argv[])
     }
     if (vm.count("version") > 0)
     {
-        std::cout << "MotionToGo, Version 0.1.0\n";
+        uint32_t major, minor, patch;
+        MtgGetVersion(&major, &minor, &patch);
+        std::cout << std::format("MotionToGo, Version {}.{}.{}\n", major, minor, patch);
         return 0;
     }
 
+    std::string trace_path;
+    if (vm.count("trace") > 0)
+    {
+        trace_path = PathToUtf8(vm["trace"].as<std::string>());
+        MtgBeginTrace();
+    }
+
+    if (vm.count("serve") > 0)
+    {
+        const uint32_t max_jobs = vm.count("max-jobs") > 0 ? vm["max-jobs"].as<uint32_t>() : 1;
+        try
+        {
+            MotionToGo::JobServer server(vm["serve"].as<std::string>(), max_jobs);
+            server.Run();
+        }
+        catch (const std::exception& ex)
+        {
+            std::cerr << std::format("ERROR: {}\n", ex.what());
+            return 1;
+        }
+        return EndTrace(trace_path) ? 0 : 1;
+    }
+
     std::filesystem::path input_path;
     if (vm.count("input-path") > 0)
     {
@@ -155,98 +182,151 @@ int main(int argc, char* argv[])
         overlay_mv = false;
     }
 
-    TIFHR(CoInitializeEx(0, COINIT_MULTITHREADED));
-
-    GpuSystem gpu_system(MotionBlurGenerator::ConfirmDeviceFunc);
-
-    std::unique_ptr<Reader> reader;
-    if (image_seq)
+    // 0 takes the default
+    MtgBlurParams blur{};
+    if (vm.count("exposure") > 0)
     {
-        reader = CreateImageSeqReader(gpu_system, input_path, framerate);
+        blur.exposure = vm["exposure"].as<float>();
     }
-    else
+    if (vm.count("blur-radius") > 0)
     {
-        reader = CreateVideoReader(gpu_system, input_path);
+        blur.blur_radius = vm["blur-radius"].as<float>();
+    }
+    if (vm.count("samples") > 0)
+    {
+        blur.reconstruction_samples = vm["samples"].as<uint32_t>();
+    }
+    if (vm.count("preview") > 0)
+    {
+        blur.preview_scale = vm["preview"].as<uint32_t>();
+    }
+    uint32_t min_reconstruction_samples = 0;
+    if (vm.count("min-samples") > 0)
+    {
+        min_reconstruction_samples = vm["min-samples"].as<uint32_t>();
+    }
+    uint32_t neighbor_max_radius = 0;
+    if (vm.count("neighbor-radius") > 0)
+    {
+        neighbor_max_radius = vm["neighbor-radius"].as<uint32_t>();
+    }
+    uint32_t strip_rows = 0;
+    if (vm.count("strip-rows") > 0)
+    {
+        strip_rows = vm["strip-rows"].as<uint32_t>();
     }
 
-    MotionBlurGenerator motion_blur_gen(gpu_system);
-
-    std::filesystem::create_directories(output_dir);
-
-    GpuTexture2D frame_texs[GpuSystem::FrameCount];
-    GpuTexture2D motion_blurred_texs[GpuSystem::FrameCount];
-    std::vector<std::future<void>> saving_threads;
-
-    uint32_t total_frames = 0;
-    const auto start = std::chrono::high_resolution_clock::now();
-    for (uint32_t i = 0;; ++i)
+    MtgOutputFormat output_format = MTG_OUTPUT_FORMAT_PNG_SEQUENCE;
+    if (vm.count("archive") > 0)
     {
-        if (total_frames == 0)
+        const std::string archive = vm["archive"].as<std::string>();
+        if (archive == "lz4")
         {
-            const uint32_t this_frame = gpu_system.FrameIndex() % GpuSystem::FrameCount;
-            float timespan;
-            if (reader->ReadFrame(frame_texs[this_frame], timespan))
-            {
-                std::cout << std::format("Processing frame {}\n", i + 1);
-
-                if (!motion_blurred_texs[this_frame])
-                {
-                    motion_blurred_texs[this_frame] = GpuTexture2D(gpu_system, frame_texs[this_frame].Width(0),
-                        frame_texs[this_frame].Height(0), 1, DXGI_FORMAT_R8G8B8A8_UNORM, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
-                        D3D12_RESOURCE_STATE_COMMON, std::format(L"motion_blurred_tex {}", this_frame));
-                }
-
-                motion_blur_gen.AddFrame(motion_blurred_texs[this_frame], frame_texs[this_frame], timespan, overlay_mv);
-
-                gpu_system.MoveToNextFrame();
-            }
-            else
-            {
-                total_frames = i;
-            }
+            output_format = MTG_OUTPUT_FORMAT_ARCHIVE;
         }
-
-        if (i >= GpuSystem::FrameCount - 1)
+        else if (archive == "delta")
+        {
+            output_format = MTG_OUTPUT_FORMAT_DELTA_ARCHIVE;
+        }
+        else
         {
-            for (auto iter = saving_threads.begin(); iter != saving_threads.end();)
-            {
-                auto& th = *iter;
-                if (th.wait_for(std::chrono::milliseconds(0)) == std::future_status::ready)
-                {
-                    iter = saving_threads.erase(iter);
-                }
-                else
-                {
-                    ++iter;
-                }
-            }
-
-            const size_t saving_index = i - (GpuSystem::FrameCount - 1);
-            saving_threads.push_back(SaveTexture(gpu_system, motion_blurred_texs[saving_index % GpuSystem::FrameCount],
-                output_dir / std::format("Frame_{}.png", saving_index + 1)));
+            std::cerr << std::format("ERROR: Unknown archive compression {}\n", archive);
+            return 1;
         }
+    }
 
-        if ((total_frames != 0) && (i == total_frames - 1 + GpuSystem::FrameCount - 1))
+    uint32_t raw_width = 0;
+    uint32_t raw_height = 0;
+    if (vm.count("raw-size") > 0)
+    {
+        const std::string raw_size = vm["raw-size"].as<std::string>();
+        if (!ParseFrameSize(raw_size, raw_width, raw_height))
         {
-            break;
+            std::cerr << std::format("ERROR: Invalid raw frame size {}\n", raw_size);
+            return 1;
         }
     }
 
-    for (auto& th : saving_threads)
+    MtgContext* context;
+    if (MtgCreateContext(&context) != MTG_RESULT_OK)
     {
-        th.wait();
+        std::cerr << std::format("ERROR: {}\n", MtgGetLastError(nullptr));
+        return 1;
     }
 
-    const auto duration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start);
+    const std::string input_path_utf8 = PathToUtf8(input_path);
+    const std::string output_dir_utf8 = PathToUtf8(output_dir);
+
+    MtgJobDesc job_desc{};
+    job_desc.struct_size = sizeof(job_desc);
+    job_desc.input_path = input_path_utf8.c_str();
+    job_desc.output_dir = output_dir_utf8.c_str();
+    job_desc.framerate = framerate;
+    job_desc.overlay_motion_vectors = overlay_mv;
+    job_desc.blur = blur;
+    job_desc.output_format = output_format;
+    job_desc.raw_width = raw_width;
+    job_desc.raw_height = raw_height;
+    job_desc.neighbor_max_radius = neighbor_max_radius;
+    job_desc.min_reconstruction_samples = min_reconstruction_samples;
+    job_desc.strip_rows = strip_rows;
+    job_desc.progress_callback = []([[maybe_unused]] void* user_data, uint32_t frame_index) {
+        std::cout << std::format("Processing frame {}\n", frame_index + 1);
+    };
+
+    MtgJobStats job_stats{};
+    job_stats.struct_size = sizeof(job_stats);
+
+    const MtgResult result = MtgProcessJob(context, &job_desc, &job_stats);
+    if (result != MTG_RESULT_OK)
+    {
+        std::cerr << std::format("ERROR: {}\n", MtgGetLastError(context));
+        MtgDestroyContext(context);
+        return 1;
+    }
 
     std::cout << std::format("\nDone. Outputs are saved to {}.\n", output_dir.string());
-    std::cout << std::format(
-        "Processing time per frame: {}\n", std::chrono::duration_cast<std::chrono::duration<float, std::milli>>(duration / total_frames));
+    std::cout << std::format("Processing time per frame: {}\n", std::chrono::duration<float, std::milli>(job_stats.ms_per_frame));
+    if (job_stats.frames > job_stats.deduplicated_frames)
+    {
+        std::cout << std::format("Encoding time per frame: {}\n",
+            std::chrono::duration<float, std::milli>(job_stats.encode_ms / (job_stats.frames - job_stats.deduplicated_frames)));
+    }
+    if (job_stats.frame_buffer_acquires > 0)
+    {
+        std::cout << std::format("Frame buffers: {:.1f}% reused, {:.1f} MiB at peak\n",
+            100.0 * job_stats.frame_buffer_hits / job_stats.frame_buffer_acquires, job_stats.frame_buffer_peak_bytes / (1024.0 * 1024.0));
+    }
+    if (job_stats.texture_hits + job_stats.texture_misses > 0)
+    {
+        std::cout << std::format("Textures: {} reused, {} created, {:.1f} MiB pooled at peak\n", job_stats.texture_hits,
+            job_stats.texture_misses, job_stats.texture_pool_peak_bytes / (1024.0 * 1024.0));
+    }
+    if (job_stats.deduplicated_frames > 0)
+    {
+        std::cout << std::format(
+            "Duplicate frames: {}, {} KiB saved\n", job_stats.deduplicated_frames, job_stats.deduplicated_bytes / 1024);
+    }
 
-    gpu_system.WaitForGpu();
-    reader.reset();
+    constexpr double MiB = 1024.0 * 1024.0;
+    const std::pair<std::string_view, uint64_t> memory_peaks[] = {
+        {"Upload staging", job_stats.process_upload_staging_peak_bytes},
+        {"Readback staging", job_stats.process_readback_staging_peak_bytes},
+        {"Descriptors", job_stats.process_descriptor_peak_bytes},
+        {"Frame textures", job_stats.process_frame_texture_peak_bytes},
+        {"Intermediate textures", job_stats.process_intermediate_texture_peak_bytes},
+        {"CPU frame buffers", job_stats.process_cpu_frame_buffer_peak_bytes},
+        {"Total", job_stats.process_memory_peak_bytes},
+    };
+    std::cout << "Process memory at peak:\n";
+    for (const auto& [name, bytes] : memory_peaks)
+    {
+        std::cout << std::format("  {:<22}{:>10.1f} MiB\n", name, bytes / MiB);
+    }
+    std::cout << std::format("Motion blur textures at peak: {:.1f} MiB, for a {:.1f} MiB frame\n", job_stats.motion_blur_peak_bytes / MiB,
+        job_stats.frame_bytes / MiB);
 
-    CoUninitialize();
+    MtgDestroyContext(context);
 
-    return 0;
+    return EndTrace(trace_path) ? 0 : 1;
 }
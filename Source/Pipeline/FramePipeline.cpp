@@ -0,0 +1,115 @@
+#include "FramePipeline.hpp"
+
+#include <cassert>
+#include <format>
+
+#include "Gpu/GpuCommandList.hpp"
+#include "Trace/Trace.hpp"
+
+namespace MotionToGo
+{
+    FramePipeline::FramePipeline(GpuSystem& gpu_system, MotionBlurGenerator& motion_blur_gen)
+        : gpu_system_(gpu_system), motion_blur_gen_(motion_blur_gen)
+    {
+    }
+
+    FramePipeline::~FramePipeline() noexcept = default;
+
+    void FramePipeline::Begin(bool overlay_mv, OutputFunc output_func)
+    {
+        overlay_mv_ = overlay_mv;
+        output_func_ = std::move(output_func);
+
+        first_slot_ = gpu_system_.FrameIndex() % GpuSystem::FrameCount;
+        submitted_frames_ = 0;
+        emitted_frames_ = 0;
+        motion_blur_memory_ = {};
+    }
+
+    void FramePipeline::End()
+    {
+        while (emitted_frames_ < submitted_frames_)
+        {
+            this->EmitFrame(emitted_frames_);
+        }
+
+        gpu_system_.WaitForGpu();
+        const MotionBlurTextureMemory motion_blur_memory = motion_blur_gen_.TextureMemory();
+        if (motion_blur_memory.resident_bytes > motion_blur_memory_.resident_bytes)
+        {
+            motion_blur_memory_ = motion_blur_memory;
+        }
+        motion_blur_gen_.Reset();
+
+        output_func_ = nullptr;
+    }
+
+    GpuTexture2D& FramePipeline::InputTexture() noexcept
+    {
+        return frame_texs_[gpu_system_.FrameIndex() % GpuSystem::FrameCount];
+    }
+
+    void FramePipeline::SubmitFrame(float time_span)
+    {
+        const uint32_t this_frame = gpu_system_.FrameIndex() % GpuSystem::FrameCount;
+        const GpuTexture2D& frame_tex = frame_texs_[this_frame];
+        GpuTexture2D& motion_blurred_tex = motion_blurred_texs_[this_frame];
+
+        gpu_system_.RecycleTexture(motion_blurred_tex, frame_tex.Width(0), frame_tex.Height(0), DXGI_FORMAT_R8G8B8A8_UNORM,
+            D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, std::format(L"motion_blurred_tex {}", this_frame));
+
+        motion_blur_gen_.AddFrame(motion_blurred_tex, frame_tex, time_span, overlay_mv_);
+
+        gpu_system_.MoveToNextFrame();
+        ++submitted_frames_;
+
+        // Keep FrameCount - 1 frames in flight, read back the oldest one.
+        if (submitted_frames_ >= GpuSystem::FrameCount)
+        {
+            this->EmitFrame(submitted_frames_ - GpuSystem::FrameCount);
+        }
+    }
+
+    uint32_t FramePipeline::SubmittedFrames() const noexcept
+    {
+        return submitted_frames_;
+    }
+
+    FrameBufferPoolStats FramePipeline::FrameBufferStats() const
+    {
+        return frame_buffer_pool_.Stats();
+    }
+
+    MotionBlurTextureMemory FramePipeline::MotionBlurMemory() const noexcept
+    {
+        return motion_blur_memory_;
+    }
+
+    void FramePipeline::EmitFrame(uint32_t frame_index)
+    {
+        assert(frame_index == emitted_frames_);
+
+        const GpuTexture2D& texture = motion_blurred_texs_[(first_slot_ + frame_index) % GpuSystem::FrameCount];
+
+        const uint32_t width = texture.Width(0);
+        const uint32_t height = texture.Height(0);
+        const uint32_t format_size = FormatSize(texture.Format());
+
+        FrameBuffer data = frame_buffer_pool_.Acquire(width * height * format_size);
+        {
+            // Includes waiting for the GPU to finish this frame.
+            GO_MOTION_TRACE_SCOPE("Readback");
+
+            auto cmd_list = gpu_system_.CreateCommandList(GpuSystem::CmdQueueType::Compute);
+            texture.Readback(gpu_system_, cmd_list, 0, data.Data());
+            gpu_system_.Execute(std::move(cmd_list));
+        }
+
+        ++emitted_frames_;
+
+        if (output_func_)
+        {
+            output_func_(frame_index, width, height, std::move(data));
+        }
+    }
+} // namespace MotionToGo
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <functional>
+
+#include "Gpu/GpuSystem.hpp"
+#include "Gpu/GpuTexture2D.hpp"
+#include "Io/FrameBufferPool.hpp"
+#include "MotionBlurGenerator/MotionBlurGenerator.hpp"
+#include "Noncopyable.hpp"
+
+namespace MotionToGo
+{
+    class FramePipeline final
+    {
+        DISALLOW_COPY_AND_ASSIGN(FramePipeline)
+
+    public:
+        // data goes back to the pool when the last owner releases it
+        using OutputFunc = std::function<void(uint32_t frame_index, uint32_t width, uint32_t height, FrameBuffer&& data)>;
+
+    public:
+        FramePipeline(GpuSystem& gpu_system, MotionBlurGenerator& motion_blur_gen);
+        ~FramePipeline() noexcept;
+
+        void Begin(bool overlay_mv, OutputFunc output_func);
+        void End();
+
+        GpuTexture2D& InputTexture() noexcept;
+        void SubmitFrame(float time_span);
+
+        uint32_t SubmittedFrames() const noexcept;
+
+        // Of the read back frames, since the pipeline was created
+        FrameBufferPoolStats FrameBufferStats() const;
+        // Of the motion blur textures, the most resident of the sequences since Begin
+        MotionBlurTextureMemory MotionBlurMemory() const noexcept;
+
+    private:
+        void EmitFrame(uint32_t frame_index);
+
+    private:
+        GpuSystem& gpu_system_;
+        MotionBlurGenerator& motion_blur_gen_;
+
+        bool overlay_mv_ = false;
+        OutputFunc output_func_;
+
+        FrameBufferPool frame_buffer_pool_;
+        MotionBlurTextureMemory motion_blur_memory_;
+
+        GpuTexture2D frame_texs_[GpuSystem::FrameCount];
+        GpuTexture2D motion_blurred_texs_[GpuSystem::FrameCount];
+
+        uint32_t first_slot_ = 0;
+        uint32_t submitted_frames_ = 0;
+        uint32_t emitted_frames_ = 0;
+    };
+} // namespace MotionToGo
@@ -1,12 +1,14 @@
 #include "Reader.hpp"
 
 #include <filesystem>
+#include <format>
+#include <stdexcept>
 
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb_image.h>
-
+#include "Codec/ImageCodec.hpp"
 #include "Gpu/GpuCommandList.hpp"
 #include "Gpu/GpuSystem.hpp"
+#include "Io/MappedFile.hpp"
+#include "Trace/Trace.hpp"
 
 using namespace MotionToGo;
 
@@ -14,22 +16,25 @@ namespace
 {
     void LoadTexture(GpuSystem& gpu_system, const std::filesystem::path& file_path, DXGI_FORMAT format, GpuTexture2D& output_tex)
     {
-        int width, height;
-        uint8_t* data = stbi_load(file_path.string().c_str(), &width, &height, nullptr, 4);
-        if (data != nullptr)
+        const MappedFile file(file_path);
+        uint32_t width, height;
+        if (ImageSize(file.Data(), width, height))
         {
-            if (!output_tex || (output_tex.Width(0) != static_cast<uint32_t>(width)) ||
-                (output_tex.Height(0) != static_cast<uint32_t>(height)) || (output_tex.Format() != format))
-            {
-                output_tex = GpuTexture2D(
-                    gpu_system, width, height, 1, format, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COMMON);
-            }
+            GO_MOTION_TRACE_SCOPE("UploadFrame");
 
+            gpu_system.RecycleTexture(output_tex, width, height, format, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+
+            // Decodes straight into the upload memory, without a copy of the frame in between
+            bool decoded = false;
             auto cmd_list = gpu_system.CreateCommandList(GpuSystem::CmdQueueType::Compute);
-            output_tex.Upload(gpu_system, cmd_list, 0, data);
+            output_tex.Upload(gpu_system, cmd_list, 0,
+                [&](uint8_t* data, uint32_t row_pitch) { decoded = DecodeImage(file.Data(), data, row_pitch); });
             gpu_system.Execute(std::move(cmd_list));
 
-            stbi_image_free(data);
+            if (!decoded)
+            {
+                throw std::runtime_error(std::format("COULDN'T decode {}", file_path.string()));
+            }
         }
     }
 } // namespace
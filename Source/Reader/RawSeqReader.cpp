@@ -0,0 +1,79 @@
+#include "Reader.hpp"
+
+#include <filesystem>
+
+#include "Gpu/GpuCommandList.hpp"
+#include "Gpu/GpuSystem.hpp"
+#include "Io/RawFrameSequence.hpp"
+#include "Trace/Trace.hpp"
+
+namespace MotionToGo
+{
+    class RawSeqReader final : public Reader
+    {
+    public:
+        RawSeqReader(GpuSystem& gpu_system, const std::filesystem::path& path, uint32_t width, uint32_t height, float framerate)
+            : gpu_system_(gpu_system), sequence_(path, width, height), framerate_(framerate)
+        {
+        }
+
+        bool ReadFrame(GpuTexture2D& frame_tex, float& timespan) override
+        {
+            timespan = 1.0f / framerate_;
+            if (curr_frame_ >= sequence_.NumFrames())
+            {
+                return false;
+            }
+
+            const uint32_t width = sequence_.Width();
+            const uint32_t height = sequence_.Height();
+            DXGI_FORMAT format;
+            D3D12_RESOURCE_FLAGS flags;
+            if (sequence_.Format() == RawPixelFormat::Rgba8)
+            {
+                format = DXGI_FORMAT_R8G8B8A8_UNORM;
+                flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
+            }
+            else
+            {
+                format = DXGI_FORMAT_NV12;
+                flags = D3D12_RESOURCE_FLAG_NONE;
+            }
+
+            // Straight from the mapping to the upload heap, the only copy on the CPU
+            const std::span<const uint8_t> frame = sequence_.Frame(curr_frame_);
+            {
+                GO_MOTION_TRACE_SCOPE("UploadFrame");
+
+                gpu_system_.RecycleTexture(frame_tex, width, height, format, flags, L"raw_frame_tex");
+
+                auto cmd_list = gpu_system_.CreateCommandList(GpuSystem::CmdQueueType::Compute);
+                if (format == DXGI_FORMAT_NV12)
+                {
+                    frame_tex.Upload(gpu_system_, cmd_list, 0, frame.data(), width);
+                    frame_tex.Upload(gpu_system_, cmd_list, 1, frame.data() + width * height, width);
+                }
+                else
+                {
+                    frame_tex.Upload(gpu_system_, cmd_list, 0, frame.data(), width * 4);
+                }
+                gpu_system_.Execute(std::move(cmd_list));
+            }
+
+            ++curr_frame_;
+            return true;
+        }
+
+    private:
+        GpuSystem& gpu_system_;
+        RawFrameSequence sequence_;
+        float framerate_;
+        uint32_t curr_frame_ = 0;
+    };
+
+    std::unique_ptr<Reader> CreateRawSeqReader(
+        GpuSystem& gpu_system, const std::filesystem::path& path, uint32_t width, uint32_t height, float framerate)
+    {
+        return std::make_unique<RawSeqReader>(gpu_system, path, width, height, framerate);
+    }
+} // namespace MotionToGo
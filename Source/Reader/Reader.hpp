@@ -22,4 +22,8 @@ namespace MotionToGo
 
     std::unique_ptr<Reader> CreateImageSeqReader(GpuSystem& gpu_system, const std::filesystem::path& dir, float framerate);
     std::unique_ptr<Reader> CreateVideoReader(GpuSystem& gpu_system, const std::filesystem::path& file_path);
+    // Raw .rgba or .nv12 frames of the given size, one file of them concatenated or a directory of one file per frame. Memory mapped,
+    // not decoded.
+    std::unique_ptr<Reader> CreateRawSeqReader(
+        GpuSystem& gpu_system, const std::filesystem::path& path, uint32_t width, uint32_t height, float framerate);
 } // namespace MotionToGo
@@ -9,6 +9,7 @@
 
 #include "ErrorHandling.hpp"
 #include "Gpu/GpuCommandList.hpp"
+#include "Trace/Trace.hpp"
 
 namespace MotionToGo
 {
@@ -70,16 +71,20 @@ namespace MotionToGo
             DWORD stream_flags;
             LONGLONG timestamp;
             winrt::com_ptr<IMFSample> sample;
-            do
             {
-                TIFHR(source_reader_->ReadSample(static_cast<DWORD>(MF_SOURCE_READER_FIRST_VIDEO_STREAM), read_flags, &actual_stream_index,
-                    &stream_flags, &timestamp, sample.put()));
+                GO_MOTION_TRACE_SCOPE("DecodeVideo");
 
-                if (stream_flags & MF_SOURCE_READERF_ENDOFSTREAM)
+                do
                 {
-                    return false;
-                }
-            } while (sample == nullptr);
+                    TIFHR(source_reader_->ReadSample(static_cast<DWORD>(MF_SOURCE_READER_FIRST_VIDEO_STREAM), read_flags,
+                        &actual_stream_index, &stream_flags, &timestamp, sample.put()));
+
+                    if (stream_flags & MF_SOURCE_READERF_ENDOFSTREAM)
+                    {
+                        return false;
+                    }
+                } while (sample == nullptr);
+            }
 
             timespan = curr_frame_ == 0 ? 0 : (timestamp - last_timestamp_) * 1e-7f;
             last_timestamp_ = timestamp;
@@ -95,6 +100,8 @@ namespace MotionToGo
             winrt::com_ptr<IMFDXGIBuffer> dxgi_buffer;
             if (output_media_buffer.try_as(dxgi_buffer))
             {
+                GO_MOTION_TRACE_SCOPE("UploadFrame");
+
                 winrt::com_ptr<ID3D12Resource> texture;
                 TIFHR(dxgi_buffer->GetResource(winrt::guid_of<ID3D12Resource>(), texture.put_void()));
 
@@ -105,8 +112,8 @@ namespace MotionToGo
                 mf_sync_cmd->EnqueueResourceReadyWait(cmd_queue);
 
                 GpuTexture2D mf_texture(texture.detach(), D3D12_RESOURCE_STATE_COMMON, L"mf_texture");
-                frame_tex = GpuTexture2D(gpu_system_, video_width_, video_height_, 1, mf_texture.Format(), D3D12_RESOURCE_FLAG_NONE,
-                    D3D12_RESOURCE_STATE_COMMON, L"frame_tex");
+                gpu_system_.RecycleTexture(
+                    frame_tex, video_width_, video_height_, mf_texture.Format(), D3D12_RESOURCE_FLAG_NONE, L"frame_tex");
 
                 {
                     auto cmd_list = gpu_system_.CreateCommandList(GpuSystem::CmdQueueType::Compute);
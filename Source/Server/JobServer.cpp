@@ -0,0 +1,777 @@
+#include "JobServer.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstring>
+#include <format>
+#include <iostream>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <winsock2.h>
+
+#include <afunix.h>
+
+namespace
+{
+    [[noreturn]] void ThrowSocketError(std::string_view func)
+    {
+        throw std::runtime_error(std::format("{} failed with error {}", func, ::WSAGetLastError()));
+    }
+
+    std::string SingleLine(std::string str)
+    {
+        for (auto& ch : str)
+        {
+            if ((ch == '\n') || (ch == '\r'))
+            {
+                ch = ' ';
+            }
+        }
+        return str;
+    }
+
+    constexpr std::chrono::milliseconds MinAcceptBackoff(10);
+    constexpr std::chrono::milliseconds MaxAcceptBackoff(1000);
+
+    // No request line comes close, a longer one is a misbehaving client
+    constexpr size_t MaxLineLength = 64 * 1024;
+
+    // A socket file shows up as a reparse point with its own tag, which std::filesystem can report as a regular file
+    bool IsSocketFile(const std::filesystem::path& path)
+    {
+        std::error_code ec;
+        if (std::filesystem::is_socket(std::filesystem::symlink_status(path, ec)))
+        {
+            return true;
+        }
+
+        WIN32_FIND_DATAW find_data;
+        const HANDLE find = ::FindFirstFileW(path.c_str(), &find_data);
+        if (find == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+        ::FindClose(find);
+        return ((find_data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0) && (find_data.dwReserved0 == IO_REPARSE_TAG_AF_UNIX);
+    }
+
+    bool IsTransientAcceptError(int err) noexcept
+    {
+        switch (err)
+        {
+        case WSAECONNRESET:
+        case WSAEINTR:
+        case WSAEMFILE:
+        case WSAENOBUFS:
+        case WSAEWOULDBLOCK:
+            return true;
+
+        default:
+            return false;
+        }
+    }
+
+    template <typename T>
+    bool ParseNumber(std::string_view str, T& value)
+    {
+        const auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+        return (ec == std::errc()) && (ptr == str.data() + str.size());
+    }
+} // namespace
+
+namespace MotionToGo
+{
+    // Only the connection's thread touches the socket. It reads the requests, and sends the lines the workers queue as fast as the
+    // client takes them, so a client that stops reading never blocks a worker. Its PROGRESS lines are coalesced meanwhile.
+    class JobServer::Connection final
+    {
+        DISALLOW_COPY_AND_ASSIGN(Connection)
+
+    public:
+        explicit Connection(SOCKET socket)
+            : socket_(socket), socket_event_(::WSACreateEvent()), wake_event_(::WSACreateEvent())
+        {
+            // Also makes the socket non-blocking
+            if ((socket_event_ == WSA_INVALID_EVENT) || (wake_event_ == WSA_INVALID_EVENT) ||
+                (::WSAEventSelect(socket_, socket_event_, FD_READ | FD_WRITE | FD_CLOSE) == SOCKET_ERROR))
+            {
+                const int err = ::WSAGetLastError();
+                this->CloseEvents();
+                throw std::runtime_error(std::format("Setting up a connection failed with error {}", err));
+            }
+        }
+
+        ~Connection() noexcept
+        {
+            ::closesocket(socket_);
+            this->CloseEvents();
+        }
+
+        // Sends the queued lines while waiting for the next request line. false once nothing more will be read.
+        bool ReadLine(std::string& line)
+        {
+            for (;;)
+            {
+                const size_t pos = recv_buffer_.find('\n');
+                if (pos != std::string::npos)
+                {
+                    line.assign(recv_buffer_, 0, pos);
+                    if (!line.empty() && (line.back() == '\r'))
+                    {
+                        line.pop_back();
+                    }
+                    recv_buffer_.erase(0, pos + 1);
+                    return true;
+                }
+
+                if (closed_ || stopping_)
+                {
+                    return false;
+                }
+
+                if (recv_buffer_.size() > MaxLineLength)
+                {
+                    this->WriteLine(std::format("ERROR Line longer than {} bytes", MaxLineLength));
+                    std::string().swap(recv_buffer_);
+                    closed_ = true;
+                    return false;
+                }
+
+                this->Pump();
+            }
+        }
+
+        // After the last request line, keeps sending until the connection's jobs are done and their lines are sent
+        void FinishJobs()
+        {
+            while (!this->Idle())
+            {
+                this->Pump();
+            }
+            this->Send();
+
+            finished_ = true;
+        }
+
+        void WriteLine(std::string_view line)
+        {
+            std::lock_guard<std::mutex> lock(send_mutex_);
+            this->QueueLine(std::format("{}\n", line), {});
+        }
+
+        // Replaces the job's PROGRESS line if it's still queued, the client only needs the latest
+        void WriteProgress(std::string_view job_id, uint32_t frames)
+        {
+            std::string line = std::format("PROGRESS {} {}\n", job_id, frames);
+
+            std::lock_guard<std::mutex> lock(send_mutex_);
+            for (auto& queued : send_queue_)
+            {
+                if (queued.progress_job_id == job_id)
+                {
+                    queued.line = std::move(line);
+                    return;
+                }
+            }
+            this->QueueLine(std::move(line), job_id);
+        }
+
+        void BeginJob()
+        {
+            std::lock_guard<std::mutex> lock(send_mutex_);
+            ++active_jobs_;
+        }
+
+        void EndJob()
+        {
+            std::lock_guard<std::mutex> lock(send_mutex_);
+            --active_jobs_;
+            ::WSASetEvent(wake_event_);
+        }
+
+        // Stops reading, and sending once the socket takes no more
+        void Stop() noexcept
+        {
+            stopping_ = true;
+            ::WSASetEvent(wake_event_);
+        }
+
+        // The thread can be joined
+        bool Finished() const noexcept
+        {
+            return finished_;
+        }
+
+    private:
+        struct QueuedLine
+        {
+            std::string line;
+            // Empty unless it's a PROGRESS line
+            std::string progress_job_id;
+        };
+
+        // Called with send_mutex_ held
+        void QueueLine(std::string line, std::string_view progress_job_id)
+        {
+            // Once the client is gone, its jobs still run to completion, only the reports are dropped.
+            if (!broken_)
+            {
+                send_queue_.push_back({std::move(line), std::string(progress_job_id)});
+                ::WSASetEvent(wake_event_);
+            }
+        }
+
+        // Waits for the socket or a queued line, then reads what came in and sends what the socket takes
+        void Pump()
+        {
+            const WSAEVENT events[] = {socket_event_, wake_event_};
+            WSANETWORKEVENTS network_events;
+            if ((::WSAWaitForMultipleEvents(static_cast<DWORD>(std::size(events)), events, FALSE, WSA_INFINITE, FALSE) ==
+                    WSA_WAIT_FAILED) ||
+                (::WSAEnumNetworkEvents(socket_, socket_event_, &network_events) == SOCKET_ERROR))
+            {
+                this->Break();
+                return;
+            }
+            ::WSAResetEvent(wake_event_);
+
+            if ((network_events.lNetworkEvents & (FD_READ | FD_CLOSE)) != 0)
+            {
+                this->Receive();
+            }
+            this->Send();
+        }
+
+        void Receive()
+        {
+            // Past a full line, ReadLine stops reading. recv posts FD_READ again for what's left.
+            while (!closed_ && (recv_buffer_.size() <= MaxLineLength))
+            {
+                char buff[4096];
+                const int received = ::recv(socket_, buff, sizeof(buff), 0);
+                if (received == SOCKET_ERROR)
+                {
+                    if (::WSAGetLastError() != WSAEWOULDBLOCK)
+                    {
+                        this->Break();
+                    }
+                    break;
+                }
+                if (received == 0)
+                {
+                    // The client can still read the reports of its jobs
+                    closed_ = true;
+                    break;
+                }
+                recv_buffer_.append(buff, received);
+            }
+        }
+
+        void Send()
+        {
+            for (;;)
+            {
+                if (send_offset_ == send_buffer_.size())
+                {
+                    send_buffer_.clear();
+                    send_offset_ = 0;
+
+                    std::lock_guard<std::mutex> lock(send_mutex_);
+                    for (const auto& queued : send_queue_)
+                    {
+                        send_buffer_ += queued.line;
+                    }
+                    send_queue_.clear();
+                }
+                if (send_buffer_.empty())
+                {
+                    return;
+                }
+
+                const int sent =
+                    ::send(socket_, send_buffer_.data() + send_offset_, static_cast<int>(send_buffer_.size() - send_offset_), 0);
+                if (sent == SOCKET_ERROR)
+                {
+                    // FD_WRITE comes when the client reads again
+                    if (::WSAGetLastError() != WSAEWOULDBLOCK)
+                    {
+                        this->Break();
+                    }
+                    return;
+                }
+                send_offset_ += sent;
+            }
+        }
+
+        void Break()
+        {
+            closed_ = true;
+            send_buffer_.clear();
+            send_offset_ = 0;
+
+            std::lock_guard<std::mutex> lock(send_mutex_);
+            broken_ = true;
+            send_queue_.clear();
+        }
+
+        bool Idle()
+        {
+            std::lock_guard<std::mutex> lock(send_mutex_);
+            return broken_ || stopping_ || ((active_jobs_ == 0) && send_queue_.empty() && (send_offset_ == send_buffer_.size()));
+        }
+
+        void CloseEvents() noexcept
+        {
+            for (const WSAEVENT event : {socket_event_, wake_event_})
+            {
+                if (event != WSA_INVALID_EVENT)
+                {
+                    ::WSACloseEvent(event);
+                }
+            }
+        }
+
+    private:
+        SOCKET socket_;
+        WSAEVENT socket_event_;
+        WSAEVENT wake_event_;
+
+        std::string recv_buffer_;
+        bool closed_ = false;
+        std::string send_buffer_;
+        size_t send_offset_ = 0;
+
+        std::atomic<bool> stopping_ = false;
+        std::atomic<bool> finished_ = false;
+
+        std::mutex send_mutex_;
+        std::deque<QueuedLine> send_queue_;
+        uint32_t active_jobs_ = 0;
+        bool broken_ = false;
+    };
+
+    JobServer::JobServer(const std::filesystem::path& socket_path, uint32_t max_concurrent_jobs)
+        : socket_path_(socket_path), max_concurrent_jobs_(std::max(max_concurrent_jobs, 1U)), listen_socket_(INVALID_SOCKET)
+    {
+        WSADATA wsa_data;
+        const int err = ::WSAStartup(MAKEWORD(2, 2), &wsa_data);
+        if (err != 0)
+        {
+            throw std::runtime_error(std::format("WSAStartup failed with error {}", err));
+        }
+    }
+
+    JobServer::~JobServer() noexcept
+    {
+        if (listen_socket_ != INVALID_SOCKET)
+        {
+            ::closesocket(listen_socket_);
+        }
+
+        ::WSACleanup();
+    }
+
+    void JobServer::Run()
+    {
+        // Everything expensive is created before the first job comes in, and reused by all later ones.
+        std::vector<std::unique_ptr<MtgContext, decltype(&MtgDestroyContext)>> contexts;
+        for (uint32_t i = 0; i < max_concurrent_jobs_; ++i)
+        {
+            MtgContext* context;
+            if (MtgCreateContext(&context) != MTG_RESULT_OK)
+            {
+                throw std::runtime_error(MtgGetLastError(nullptr));
+            }
+            contexts.emplace_back(context, &MtgDestroyContext);
+        }
+
+        const std::string socket_path = socket_path_.string();
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (socket_path.size() >= sizeof(addr.sun_path))
+        {
+            throw std::runtime_error(std::format("Socket path {} is too long", socket_path));
+        }
+        std::memcpy(addr.sun_path, socket_path.c_str(), socket_path.size());
+
+        // A stale socket file from a previous run would make bind fail. Anything else at the path isn't ours to delete.
+        if (IsSocketFile(socket_path_))
+        {
+            std::filesystem::remove(socket_path_);
+        }
+        else if (std::error_code ec; std::filesystem::exists(std::filesystem::symlink_status(socket_path_, ec)))
+        {
+            throw std::runtime_error(std::format("{} exists and is not a socket", socket_path));
+        }
+
+        listen_socket_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_socket_ == INVALID_SOCKET)
+        {
+            ThrowSocketError("socket");
+        }
+        if (::bind(listen_socket_, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == SOCKET_ERROR)
+        {
+            ThrowSocketError("bind");
+        }
+        if (::listen(listen_socket_, SOMAXCONN) == SOCKET_ERROR)
+        {
+            ThrowSocketError("listen");
+        }
+
+        for (uint32_t i = 0; i < max_concurrent_jobs_; ++i)
+        {
+            workers_.emplace_back(&JobServer::WorkerMain, this, i, contexts[i].get());
+        }
+
+        std::cout << std::format("Listening on {} with {} concurrent job(s)\n", socket_path, max_concurrent_jobs_);
+
+        const SOCKET listen_socket = listen_socket_;
+        std::chrono::milliseconds accept_backoff(0);
+        for (;;)
+        {
+            const SOCKET client = ::accept(listen_socket, nullptr, nullptr);
+            if (client == INVALID_SOCKET)
+            {
+                const int err = ::WSAGetLastError();
+                {
+                    std::lock_guard<std::mutex> lock(queue_mutex_);
+                    if (shutting_down_)
+                    {
+                        break;
+                    }
+                }
+
+                if (!IsTransientAcceptError(err))
+                {
+                    std::cerr << std::format("accept failed with error {}, stopping the server\n", err);
+                    this->RequestShutdown();
+                    break;
+                }
+
+                // Out of sockets or memory, wait for some connections to close instead of spinning
+                accept_backoff = std::clamp(accept_backoff * 2, MinAcceptBackoff, MaxAcceptBackoff);
+                std::this_thread::sleep_for(accept_backoff);
+                continue;
+            }
+            accept_backoff = std::chrono::milliseconds(0);
+
+            std::shared_ptr<Connection> connection;
+            try
+            {
+                connection = std::make_shared<Connection>(client);
+            }
+            catch (const std::exception& ex)
+            {
+                std::cerr << std::format("{}, dropping it\n", ex.what());
+                ::closesocket(client);
+                continue;
+            }
+
+            std::lock_guard<std::mutex> lock(connections_mutex_);
+            this->ReapConnections();
+            ConnectionThread& connection_thread = connections_.emplace_back();
+            connection_thread.connection = connection;
+            connection_thread.thread = std::thread(&JobServer::ServeConnection, this, std::move(connection));
+        }
+
+        queue_cv_.notify_all();
+        for (auto& worker : workers_)
+        {
+            worker.join();
+        }
+        workers_.clear();
+
+        {
+            std::lock_guard<std::mutex> lock(connections_mutex_);
+            for (auto& connection_thread : connections_)
+            {
+                if (auto connection = connection_thread.connection.lock())
+                {
+                    connection->Stop();
+                }
+            }
+        }
+        for (auto& connection_thread : connections_)
+        {
+            connection_thread.thread.join();
+        }
+        connections_.clear();
+
+        if (IsSocketFile(socket_path_))
+        {
+            std::filesystem::remove(socket_path_);
+        }
+
+        std::cout << "Server stopped\n";
+    }
+
+    void JobServer::ReapConnections()
+    {
+        // A connection's thread ends once the client closes it and the reports of its jobs are sent, or the client is gone
+        for (auto iter = connections_.begin(); iter != connections_.end();)
+        {
+            const auto connection = iter->connection.lock();
+            if (!connection || connection->Finished())
+            {
+                iter->thread.join();
+                iter = connections_.erase(iter);
+            }
+            else
+            {
+                ++iter;
+            }
+        }
+    }
+
+    void JobServer::ServeConnection(std::shared_ptr<Connection> connection)
+    {
+        std::optional<Job> pending_job;
+        std::string error;
+
+        std::string line;
+        while (connection->ReadLine(line))
+        {
+            if (pending_job)
+            {
+                if (line == "END")
+                {
+                    if (error.empty() && (pending_job->input_path.empty() || pending_job->output_dir.empty()))
+                    {
+                        error = "input and output are required";
+                    }
+
+                    if (error.empty())
+                    {
+                        std::lock_guard<std::mutex> lock(queue_mutex_);
+                        if (shutting_down_)
+                        {
+                            error = "The server is shutting down";
+                        }
+                        else
+                        {
+                            connection->WriteLine(std::format("ACCEPTED {}", pending_job->id));
+                            connection->BeginJob();
+                            pending_job->queued_time = std::chrono::steady_clock::now();
+                            job_queue_.push_back(std::move(*pending_job));
+                            queue_cv_.notify_one();
+                        }
+                    }
+
+                    if (!error.empty())
+                    {
+                        connection->WriteLine(std::format("FAILED {} {}", pending_job->id, error));
+                    }
+
+                    pending_job.reset();
+                    continue;
+                }
+
+                const size_t space = line.find(' ');
+                const std::string_view key = std::string_view(line).substr(0, space);
+                const std::string_view value = space != std::string::npos ? std::string_view(line).substr(space + 1) : std::string_view();
+                if (key == "input")
+                {
+                    pending_job->input_path = value;
+                }
+                else if (key == "output")
+                {
+                    pending_job->output_dir = value;
+                }
+                else if (key == "framerate")
+                {
+                    if (!ParseNumber(value, pending_job->framerate) || !(pending_job->framerate > 0))
+                    {
+                        error = std::format("Invalid framerate {}", value);
+                    }
+                }
+                else if (key == "exposure")
+                {
+                    if (!ParseNumber(value, pending_job->blur.exposure))
+                    {
+                        error = std::format("Invalid exposure {}", value);
+                    }
+                }
+                else if (key == "blur_radius")
+                {
+                    if (!ParseNumber(value, pending_job->blur.blur_radius))
+                    {
+                        error = std::format("Invalid blur radius {}", value);
+                    }
+                }
+                else if (key == "samples")
+                {
+                    if (!ParseNumber(value, pending_job->blur.reconstruction_samples))
+                    {
+                        error = std::format("Invalid reconstruction samples {}", value);
+                    }
+                }
+                else if (key == "min_samples")
+                {
+                    if (!ParseNumber(value, pending_job->min_reconstruction_samples))
+                    {
+                        error = std::format("Invalid min reconstruction samples {}", value);
+                    }
+                }
+                else if (key == "preview")
+                {
+                    if (!ParseNumber(value, pending_job->blur.preview_scale))
+                    {
+                        error = std::format("Invalid preview scale {}", value);
+                    }
+                }
+                else if (key == "neighbor_radius")
+                {
+                    if (!ParseNumber(value, pending_job->neighbor_max_radius))
+                    {
+                        error = std::format("Invalid neighbor max radius {}", value);
+                    }
+                }
+                else if (key == "strip_rows")
+                {
+                    if (!ParseNumber(value, pending_job->strip_rows))
+                    {
+                        error = std::format("Invalid strip rows {}", value);
+                    }
+                }
+                else if (key == "raw_size")
+                {
+                    const size_t x = value.find('x');
+                    if ((x == std::string_view::npos) || !ParseNumber(value.substr(0, x), pending_job->raw_width) ||
+                        !ParseNumber(value.substr(x + 1), pending_job->raw_height) || (pending_job->raw_width == 0) ||
+                        (pending_job->raw_height == 0))
+                    {
+                        error = std::format("Invalid raw frame size {}", value);
+                    }
+                }
+                else if (key == "overlay")
+                {
+                    pending_job->overlay_mv = (value == "1") || (value == "true");
+                }
+                else if (key == "archive")
+                {
+                    if (value == "lz4")
+                    {
+                        pending_job->output_format = MTG_OUTPUT_FORMAT_ARCHIVE;
+                    }
+                    else if (value == "delta")
+                    {
+                        pending_job->output_format = MTG_OUTPUT_FORMAT_DELTA_ARCHIVE;
+                    }
+                    else
+                    {
+                        error = std::format("Invalid archive compression {}", value);
+                    }
+                }
+                else if (error.empty())
+                {
+                    error = std::format("Unknown key {}", key);
+                }
+            }
+            else if (line.starts_with("JOB "))
+            {
+                pending_job.emplace();
+                pending_job->connection = connection;
+                pending_job->id = line.substr(4);
+                error.clear();
+            }
+            else if (line == "SHUTDOWN")
+            {
+                this->RequestShutdown();
+            }
+            else if (!line.empty())
+            {
+                connection->WriteLine(std::format("ERROR Unknown command {}", SingleLine(line)));
+            }
+        }
+
+        connection->FinishJobs();
+    }
+
+    void JobServer::WorkerMain(uint32_t worker_index, MtgContext* context)
+    {
+        for (;;)
+        {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(queue_mutex_);
+                queue_cv_.wait(lock, [this] { return !job_queue_.empty() || shutting_down_; });
+                if (job_queue_.empty())
+                {
+                    break;
+                }
+
+                job = std::move(job_queue_.front());
+                job_queue_.pop_front();
+            }
+
+            const auto queue_duration = std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(
+                std::chrono::steady_clock::now() - job.queued_time);
+
+            job.connection->WriteLine(std::format("STARTED {}", job.id));
+            std::cout << std::format("[worker {}] Job {}: {} -> {}\n", worker_index, job.id, job.input_path, job.output_dir);
+
+            MtgJobDesc job_desc{};
+            job_desc.struct_size = sizeof(job_desc);
+            job_desc.input_path = job.input_path.c_str();
+            job_desc.output_dir = job.output_dir.c_str();
+            job_desc.framerate = job.framerate;
+            job_desc.overlay_motion_vectors = job.overlay_mv;
+            job_desc.blur = job.blur;
+            job_desc.output_format = job.output_format;
+            job_desc.raw_width = job.raw_width;
+            job_desc.raw_height = job.raw_height;
+            job_desc.neighbor_max_radius = job.neighbor_max_radius;
+            job_desc.min_reconstruction_samples = job.min_reconstruction_samples;
+            job_desc.strip_rows = job.strip_rows;
+            job_desc.progress_callback = [](void* user_data, uint32_t frame_index) {
+                const Job& job = *static_cast<const Job*>(user_data);
+                job.connection->WriteProgress(job.id, frame_index + 1);
+            };
+            job_desc.user_data = &job;
+
+            MtgJobStats job_stats{};
+            job_stats.struct_size = sizeof(job_stats);
+
+            if (MtgProcessJob(context, &job_desc, &job_stats) == MTG_RESULT_OK)
+            {
+                job.connection->WriteLine(std::format("DONE {} frames={} total_ms={:.3f} ms_per_frame={:.3f} queue_ms={:.3f} "
+                                                      "frame_bytes={} motion_blur_peak_bytes={}",
+                    job.id, job_stats.frames, job_stats.total_ms, job_stats.ms_per_frame, queue_duration.count(), job_stats.frame_bytes,
+                    job_stats.motion_blur_peak_bytes));
+                std::cout << std::format("[worker {}] Job {} done, {} frames, {:.3f} ms per frame\n", worker_index, job.id,
+                    job_stats.frames, job_stats.ms_per_frame);
+            }
+            else
+            {
+                const std::string error = SingleLine(MtgGetLastError(context));
+                job.connection->WriteLine(std::format("FAILED {} {}", job.id, error));
+                std::cerr << std::format("[worker {}] Job {} failed: {}\n", worker_index, job.id, error);
+            }
+            job.connection->EndJob();
+        }
+    }
+
+    void JobServer::RequestShutdown()
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        if (!shutting_down_)
+        {
+            shutting_down_ = true;
+
+            // Unblocks accept in Run.
+            ::closesocket(listen_socket_);
+            listen_socket_ = INVALID_SOCKET;
+        }
+        queue_cv_.notify_all();
+    }
+} // namespace MotionToGo
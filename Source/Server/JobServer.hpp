@@ -0,0 +1,102 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Api/MotionToGo.h"
+#include "Noncopyable.hpp"
+
+namespace MotionToGo
+{
+    // Accepts jobs over a Unix domain socket and runs them on a fixed number of warm contexts.
+    //
+    // Requests are line based. A job is described by
+    //     JOB <id>
+    //     input <path>
+    //     output <dir>
+    //     framerate <fps>      (optional)
+    //     overlay <0|1>        (optional)
+    //     exposure <fraction>  (optional)
+    //     blur_radius <radius> (optional)
+    //     samples <count>      (optional)
+    //     min_samples <count>  (optional)
+    //     preview <1|2|4>      (optional)
+    //     neighbor_radius <r>  (optional)
+    //     strip_rows <rows>    (optional)
+    //     archive <lz4|delta>  (optional)
+    //     raw_size <w>x<h>     (optional)
+    //     END
+    // and is answered with "ACCEPTED <id>", "STARTED <id>", "PROGRESS <id> <frame>", and finally "DONE <id> <stats>" or
+    // "FAILED <id> <message>". Several jobs can be submitted over one connection. A client that reads slower than the frames
+    // are done only gets the latest PROGRESS of each job. SHUTDOWN stops the server after the queued jobs are finished. A line
+    // over 64 KiB is answered with an ERROR and nothing more is read from that connection.
+    //
+    // The socket path is only replaced if it's a stale socket, anything else there fails Run.
+    class JobServer final
+    {
+        DISALLOW_COPY_AND_ASSIGN(JobServer)
+
+    public:
+        JobServer(const std::filesystem::path& socket_path, uint32_t max_concurrent_jobs);
+        ~JobServer() noexcept;
+
+        void Run();
+
+    private:
+        class Connection;
+
+        struct Job
+        {
+            std::shared_ptr<Connection> connection;
+            std::string id;
+            std::string input_path;
+            std::string output_dir;
+            float framerate = 24;
+            bool overlay_mv = false;
+            // Validated by MtgProcessJob, 0 is the default
+            MtgBlurParams blur{};
+            uint32_t neighbor_max_radius = 0;
+            uint32_t min_reconstruction_samples = 0;
+            uint32_t strip_rows = 0;
+            MtgOutputFormat output_format = MTG_OUTPUT_FORMAT_PNG_SEQUENCE;
+            // 0x0 unless the input is raw frames
+            uint32_t raw_width = 0;
+            uint32_t raw_height = 0;
+            std::chrono::steady_clock::time_point queued_time;
+        };
+
+        struct ConnectionThread
+        {
+            std::weak_ptr<Connection> connection;
+            std::thread thread;
+        };
+
+        // Joins the threads of the closed connections, called with connections_mutex_ held
+        void ReapConnections();
+        void ServeConnection(std::shared_ptr<Connection> connection);
+        void WorkerMain(uint32_t worker_index, MtgContext* context);
+        void RequestShutdown();
+
+    private:
+        std::filesystem::path socket_path_;
+        uint32_t max_concurrent_jobs_;
+
+        uintptr_t listen_socket_;
+
+        std::mutex queue_mutex_;
+        std::condition_variable queue_cv_;
+        std::deque<Job> job_queue_;
+        bool shutting_down_ = false;
+
+        std::vector<std::thread> workers_;
+        std::mutex connections_mutex_;
+        std::vector<ConnectionThread> connections_;
+    };
+} // namespace MotionToGo
@@ -0,0 +1,286 @@
+#include "SyntheticSequence.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "Trace/Trace.hpp"
+
+using namespace MotionToGo;
+
+namespace
+{
+    struct LayerState
+    {
+        float center_x;
+        float center_y;
+        float cos_rotation;
+        float sin_rotation;
+    };
+
+    LayerState LayerAt(const SyntheticLayer& layer, uint32_t frame_index)
+    {
+        const float t = static_cast<float>(frame_index);
+        const float rotation = layer.rotation + layer.angular_velocity * t;
+        return {layer.center_x + layer.velocity_x * t, layer.center_y + layer.velocity_y * t, std::cos(rotation), std::sin(rotation)};
+    }
+
+    void FrameToLayer(const LayerState& state, float x, float y, float& layer_x, float& layer_y) noexcept
+    {
+        const float dx = x - state.center_x;
+        const float dy = y - state.center_y;
+        layer_x = state.cos_rotation * dx + state.sin_rotation * dy;
+        layer_y = -state.sin_rotation * dx + state.cos_rotation * dy;
+    }
+
+    void LayerToFrame(const LayerState& state, float layer_x, float layer_y, float& x, float& y) noexcept
+    {
+        x = state.center_x + state.cos_rotation * layer_x - state.sin_rotation * layer_y;
+        y = state.center_y + state.sin_rotation * layer_x + state.cos_rotation * layer_y;
+    }
+
+    // Returns the index of the top most layer at (x, y), or -1 if there is none.
+    int32_t TopLayer(std::span<const SyntheticLayer> layers, std::span<const LayerState> states, float x, float y, float& layer_x,
+        float& layer_y) noexcept
+    {
+        for (int32_t i = static_cast<int32_t>(layers.size()) - 1; i >= 0; --i)
+        {
+            FrameToLayer(states[i], x, y, layer_x, layer_y);
+
+            const SyntheticLayer& layer = layers[i];
+            if ((layer.half_width <= 0) || ((std::abs(layer_x) <= layer.half_width) && (std::abs(layer_y) <= layer.half_height)))
+            {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    float Hash01(int32_t x, int32_t y, uint32_t seed) noexcept
+    {
+        uint32_t h = static_cast<uint32_t>(x) * 374761393U + static_cast<uint32_t>(y) * 668265263U + seed * 2246822519U;
+        h = (h ^ (h >> 13)) * 1274126177U;
+        h ^= h >> 16;
+        return (h & 0xFFFF) / 65535.0f;
+    }
+
+    // Smoothly interpolated, so sub-pixel motion renders without popping
+    float ValueNoise(float x, float y, uint32_t seed) noexcept
+    {
+        const float fx = std::floor(x);
+        const float fy = std::floor(y);
+        const int32_t ix = static_cast<int32_t>(fx);
+        const int32_t iy = static_cast<int32_t>(fy);
+        float tx = x - fx;
+        float ty = y - fy;
+        tx = tx * tx * (3 - 2 * tx);
+        ty = ty * ty * (3 - 2 * ty);
+
+        const float top = std::lerp(Hash01(ix, iy, seed), Hash01(ix + 1, iy, seed), tx);
+        const float bottom = std::lerp(Hash01(ix, iy + 1, seed), Hash01(ix + 1, iy + 1, seed), tx);
+        return std::lerp(top, bottom, ty);
+    }
+
+    uint8_t Shade(const SyntheticLayer& layer, float layer_x, float layer_y, uint32_t channel) noexcept
+    {
+        const float u = layer_x / layer.feature_size;
+        const float v = layer_y / layer.feature_size;
+        const uint32_t seed = layer.texture_seed * 8 + channel;
+        const float value = 0.65f * ValueNoise(u, v, seed) + 0.35f * ValueNoise(u * 4, v * 4, seed + 4);
+        return static_cast<uint8_t>(std::clamp(value, 0.0f, 1.0f) * 255 + 0.5f);
+    }
+} // namespace
+
+namespace MotionToGo
+{
+    SyntheticSequenceDesc DefaultSyntheticSequence(uint32_t width, uint32_t height, uint32_t num_frames, uint32_t seed)
+    {
+        const float w = static_cast<float>(width);
+        const float h = static_cast<float>(height);
+
+        SyntheticSequenceDesc desc;
+        desc.width = width;
+        desc.height = height;
+        desc.num_frames = num_frames;
+
+        // Background, slow pan in quarter pixel steps
+        desc.layers.push_back({w / 2, h / 2, 0, 0, 2.25f, -1.5f, 0, 0, seed * 3 + 0, 32});
+        // Rotating square drifting to the right
+        desc.layers.push_back({w * 0.35f, h * 0.5f, h * 0.2f, h * 0.2f, 3.5f, 0.75f, 0, 0.02f, seed * 3 + 1, 16});
+        // Fast bar passing in front of the square
+        desc.layers.push_back({-w * 0.1f, h * 0.45f, w * 0.06f, h * 0.3f, w * 0.02f, 0, 0.1f, 0, seed * 3 + 2, 12});
+
+        return desc;
+    }
+
+    SyntheticFrame RenderSyntheticFrame(const SyntheticSequenceDesc& desc, uint32_t frame_index)
+    {
+        GO_MOTION_TRACE_SCOPE("RenderSyntheticFrame");
+
+        const uint32_t width = desc.width;
+        const uint32_t height = desc.height;
+        const uint32_t block_size = desc.block_size;
+        const uint32_t blocks_x = (width + block_size - 1) / block_size;
+        const uint32_t blocks_y = (height + block_size - 1) / block_size;
+        const uint32_t num_blocks = blocks_x * blocks_y;
+
+        std::vector<LayerState> curr_states(desc.layers.size());
+        std::vector<LayerState> prev_states(desc.layers.size());
+        for (size_t i = 0; i < desc.layers.size(); ++i)
+        {
+            curr_states[i] = LayerAt(desc.layers[i], frame_index);
+            if (frame_index > 0)
+            {
+                prev_states[i] = LayerAt(desc.layers[i], frame_index - 1);
+            }
+        }
+
+        SyntheticFrame frame;
+        frame.rgba.resize(width * height * 4);
+        frame.motion_vectors.assign(num_blocks * 2, 0);
+        frame.unreliable.assign(num_blocks, 0);
+
+        std::vector<double> sum_mvs(num_blocks * 2, 0.0);
+        std::vector<uint32_t> num_pixels(num_blocks, 0);
+        std::vector<int32_t> block_layers(num_blocks, -2);
+
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                const float px = x + 0.5f;
+                const float py = y + 0.5f;
+
+                float layer_x;
+                float layer_y;
+                const int32_t layer = TopLayer(desc.layers, curr_states, px, py, layer_x, layer_y);
+
+                uint8_t* pixel = &frame.rgba[(y * width + x) * 4];
+                for (uint32_t c = 0; c < 3; ++c)
+                {
+                    pixel[c] = layer >= 0 ? Shade(desc.layers[layer], layer_x, layer_y, c) : 0;
+                }
+                pixel[3] = 255;
+
+                if (frame_index == 0)
+                {
+                    continue;
+                }
+
+                float prev_x = px;
+                float prev_y = py;
+                if (layer >= 0)
+                {
+                    LayerToFrame(prev_states[layer], layer_x, layer_y, prev_x, prev_y);
+                }
+
+                const uint32_t block = (y / block_size) * blocks_x + x / block_size;
+                sum_mvs[block * 2 + 0] += prev_x - px;
+                sum_mvs[block * 2 + 1] += prev_y - py;
+                ++num_pixels[block];
+
+                if (block_layers[block] == -2)
+                {
+                    block_layers[block] = layer;
+                }
+                else if (block_layers[block] != layer)
+                {
+                    frame.unreliable[block] = 1;
+                }
+
+                if ((prev_x < 0) || (prev_y < 0) || (prev_x >= width) || (prev_y >= height))
+                {
+                    frame.unreliable[block] = 1;
+                }
+                else
+                {
+                    float prev_layer_x;
+                    float prev_layer_y;
+                    if (TopLayer(desc.layers, prev_states, prev_x, prev_y, prev_layer_x, prev_layer_y) != layer)
+                    {
+                        frame.unreliable[block] = 1;
+                    }
+                }
+            }
+        }
+
+        if (frame_index > 0)
+        {
+            for (uint32_t block = 0; block < num_blocks; ++block)
+            {
+                for (uint32_t c = 0; c < 2; ++c)
+                {
+                    const double mv = sum_mvs[block * 2 + c] / num_pixels[block];
+                    frame.motion_vectors[block * 2 + c] = static_cast<int16_t>(std::lround(mv * 4));
+                }
+            }
+        }
+
+        return frame;
+    }
+
+    void MotionVectorScorer::Add(const SyntheticSequenceDesc& desc, const SyntheticFrame& truth, std::span<const int16_t> estimated_mvs,
+        uint32_t est_blocks_x, uint32_t est_blocks_y, uint32_t est_block_size, float est_scale)
+    {
+        assert(estimated_mvs.size() >= est_blocks_x * est_blocks_y * 2);
+
+        const uint32_t block_size = desc.block_size;
+        const uint32_t blocks_x = (desc.width + block_size - 1) / block_size;
+        const uint32_t blocks_y = (desc.height + block_size - 1) / block_size;
+
+        for (uint32_t by = 0; by < blocks_y; ++by)
+        {
+            for (uint32_t bx = 0; bx < blocks_x; ++bx)
+            {
+                const uint32_t block = by * blocks_x + bx;
+
+                const float center_x = std::min(bx * block_size + block_size / 2.0f, desc.width - 0.5f);
+                const float center_y = std::min(by * block_size + block_size / 2.0f, desc.height - 0.5f);
+                const uint32_t est_x = std::min(static_cast<uint32_t>(center_x / est_scale / est_block_size), est_blocks_x - 1);
+                const uint32_t est_y = std::min(static_cast<uint32_t>(center_y / est_scale / est_block_size), est_blocks_y - 1);
+                const uint32_t est_block = est_y * est_blocks_x + est_x;
+
+                const double dx = estimated_mvs[est_block * 2 + 0] * est_scale / 4.0 - truth.motion_vectors[block * 2 + 0] / 4.0;
+                const double dy = estimated_mvs[est_block * 2 + 1] * est_scale / 4.0 - truth.motion_vectors[block * 2 + 1] / 4.0;
+                const double epe = std::sqrt(dx * dx + dy * dy);
+
+                sum_epe_ += epe;
+                ++blocks_;
+                if (!truth.unreliable[block])
+                {
+                    sum_reliable_epe_ += epe;
+                    ++reliable_blocks_;
+                    if (epe > 1)
+                    {
+                        ++reliable_outliers_;
+                    }
+                }
+            }
+        }
+    }
+
+    double MotionVectorScorer::MeanEpe() const noexcept
+    {
+        return blocks_ > 0 ? sum_epe_ / blocks_ : 0;
+    }
+
+    double MotionVectorScorer::ReliableMeanEpe() const noexcept
+    {
+        return reliable_blocks_ > 0 ? sum_reliable_epe_ / reliable_blocks_ : 0;
+    }
+
+    double MotionVectorScorer::ReliableOutlierRatio() const noexcept
+    {
+        return reliable_blocks_ > 0 ? static_cast<double>(reliable_outliers_) / reliable_blocks_ : 0;
+    }
+
+    uint64_t MotionVectorScorer::Blocks() const noexcept
+    {
+        return blocks_;
+    }
+
+    uint64_t MotionVectorScorer::ReliableBlocks() const noexcept
+    {
+        return reliable_blocks_;
+    }
+} // namespace MotionToGo
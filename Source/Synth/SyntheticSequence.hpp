@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace MotionToGo
+{
+    // A procedurally textured rectangle. Layers are drawn in order, later ones on top. Positions and sizes are in pixels, angles in
+    // radians, velocities are per frame.
+    struct SyntheticLayer
+    {
+        float center_x;
+        float center_y;
+        // 0 makes the layer cover the whole frame, for backgrounds
+        float half_width;
+        float half_height;
+        float velocity_x;
+        float velocity_y;
+        float rotation;
+        float angular_velocity;
+        uint32_t texture_seed;
+        float feature_size = 24;
+    };
+
+    struct SyntheticSequenceDesc
+    {
+        uint32_t width;
+        uint32_t height;
+        uint32_t num_frames;
+        uint32_t block_size = 16;
+        std::vector<SyntheticLayer> layers;
+    };
+
+    struct SyntheticFrame
+    {
+        std::vector<uint8_t> rgba;
+
+        // Interleaved x and y per block, in quarter pixels, pointing from the block in this frame to where its content was in the
+        // previous frame. That's the same convention as the raw motion vectors of the estimator. All 0 in the first frame.
+        std::vector<int16_t> motion_vectors;
+        // Non-zero for blocks with an occlusion, a disocclusion, content entering the frame, or more than one layer. No single
+        // vector is right for them.
+        std::vector<uint8_t> unreliable;
+    };
+
+    // A panning background, a rotating square, and a fast bar that passes in front of it.
+    SyntheticSequenceDesc DefaultSyntheticSequence(uint32_t width, uint32_t height, uint32_t num_frames, uint32_t seed = 0);
+
+    SyntheticFrame RenderSyntheticFrame(const SyntheticSequenceDesc& desc, uint32_t frame_index);
+
+    class MotionVectorScorer final
+    {
+    public:
+        // estimated_mvs are raw motion vectors of est_blocks_x * est_blocks_y blocks of est_block_size pixels. They can come from a
+        // downscaled frame, est_scale is the frame width divided by the width the estimator ran at.
+        void Add(const SyntheticSequenceDesc& desc, const SyntheticFrame& truth, std::span<const int16_t> estimated_mvs,
+            uint32_t est_blocks_x, uint32_t est_blocks_y, uint32_t est_block_size, float est_scale);
+
+        // Average endpoint error in pixels
+        double MeanEpe() const noexcept;
+        double ReliableMeanEpe() const noexcept;
+        // Ratio of reliable blocks with more than 1 pixel of error
+        double ReliableOutlierRatio() const noexcept;
+
+        uint64_t Blocks() const noexcept;
+        uint64_t ReliableBlocks() const noexcept;
+
+    private:
+        double sum_epe_ = 0;
+        double sum_reliable_epe_ = 0;
+        uint64_t blocks_ = 0;
+        uint64_t reliable_blocks_ = 0;
+        uint64_t reliable_outliers_ = 0;
+    };
+} // namespace MotionToGo
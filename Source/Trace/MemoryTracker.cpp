@@ -0,0 +1,152 @@
+#include "MemoryTracker.hpp"
+
+#include <array>
+#include <atomic>
+#include <format>
+#include <utility>
+
+using namespace MotionToGo;
+
+namespace
+{
+    struct Counter
+    {
+        std::atomic<uint64_t> bytes = 0;
+        std::atomic<uint64_t> peak_bytes = 0;
+
+        void Add(uint64_t size) noexcept
+        {
+            const uint64_t new_bytes = bytes.fetch_add(size, std::memory_order_relaxed) + size;
+            uint64_t peak = peak_bytes.load(std::memory_order_relaxed);
+            while ((new_bytes > peak) && !peak_bytes.compare_exchange_weak(peak, new_bytes, std::memory_order_relaxed))
+            {
+            }
+        }
+
+        void Subtract(uint64_t size) noexcept
+        {
+            bytes.fetch_sub(size, std::memory_order_relaxed);
+        }
+
+        MemoryUsage Usage() const noexcept
+        {
+            return {bytes.load(std::memory_order_relaxed), peak_bytes.load(std::memory_order_relaxed)};
+        }
+    };
+
+    std::array<Counter, static_cast<uint32_t>(MemoryCategory::Num)> counters;
+    Counter total_counter;
+
+    constexpr double MiB = 1024.0 * 1024.0;
+} // namespace
+
+namespace MotionToGo
+{
+    void MemoryTracker::Allocate(MemoryCategory category, uint64_t bytes) noexcept
+    {
+        counters[static_cast<uint32_t>(category)].Add(bytes);
+        total_counter.Add(bytes);
+    }
+
+    void MemoryTracker::Free(MemoryCategory category, uint64_t bytes) noexcept
+    {
+        counters[static_cast<uint32_t>(category)].Subtract(bytes);
+        total_counter.Subtract(bytes);
+    }
+
+    MemoryUsage MemoryTracker::Usage(MemoryCategory category) noexcept
+    {
+        return counters[static_cast<uint32_t>(category)].Usage();
+    }
+
+    MemoryUsage MemoryTracker::TotalUsage() noexcept
+    {
+        return total_counter.Usage();
+    }
+
+    std::string_view MemoryTracker::CategoryName(MemoryCategory category) noexcept
+    {
+        switch (category)
+        {
+        case MemoryCategory::UploadStaging:
+            return "Upload staging";
+
+        case MemoryCategory::ReadbackStaging:
+            return "Readback staging";
+
+        case MemoryCategory::Descriptors:
+            return "Descriptors";
+
+        case MemoryCategory::FrameTextures:
+            return "Frame textures";
+
+        case MemoryCategory::IntermediateTextures:
+            return "Intermediate textures";
+
+        case MemoryCategory::CpuFrameBuffers:
+            return "CPU frame buffers";
+
+        default:
+            return "Unknown";
+        }
+    }
+
+    std::string MemoryTracker::Summary()
+    {
+        std::string summary = std::format("{:<24} {:>14} {:>14}\n", "Memory", "Current (MiB)", "Peak (MiB)");
+        for (uint32_t i = 0; i < static_cast<uint32_t>(MemoryCategory::Num); ++i)
+        {
+            const MemoryCategory category = static_cast<MemoryCategory>(i);
+            const MemoryUsage usage = Usage(category);
+            summary +=
+                std::format("{:<24} {:>14.1f} {:>14.1f}\n", CategoryName(category), usage.bytes / MiB, usage.peak_bytes / MiB);
+        }
+        const MemoryUsage total = TotalUsage();
+        summary += std::format("{:<24} {:>14.1f} {:>14.1f}\n", "Total", total.bytes / MiB, total.peak_bytes / MiB);
+        return summary;
+    }
+
+    TrackedMemory::TrackedMemory() noexcept = default;
+
+    TrackedMemory::TrackedMemory(MemoryCategory category, uint64_t bytes) noexcept : category_(category), bytes_(bytes)
+    {
+        MemoryTracker::Allocate(category_, bytes_);
+    }
+
+    TrackedMemory::~TrackedMemory() noexcept
+    {
+        this->Reset();
+    }
+
+    TrackedMemory::TrackedMemory(TrackedMemory&& other) noexcept
+        : category_(std::exchange(other.category_, MemoryCategory::Num)), bytes_(std::exchange(other.bytes_, 0))
+    {
+    }
+
+    TrackedMemory& TrackedMemory::operator=(TrackedMemory&& other) noexcept
+    {
+        if (this != &other)
+        {
+            this->Reset();
+
+            category_ = std::exchange(other.category_, MemoryCategory::Num);
+            bytes_ = std::exchange(other.bytes_, 0);
+        }
+        return *this;
+    }
+
+    uint64_t TrackedMemory::Bytes() const noexcept
+    {
+        return bytes_;
+    }
+
+    void TrackedMemory::Reset() noexcept
+    {
+        if (category_ != MemoryCategory::Num)
+        {
+            MemoryTracker::Free(category_, bytes_);
+            category_ = MemoryCategory::Num;
+            bytes_ = 0;
+        }
+    }
+} // namespace MotionToGo
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "Noncopyable.hpp"
+
+namespace MotionToGo
+{
+    enum class MemoryCategory : uint32_t
+    {
+        UploadStaging,
+        ReadbackStaging,
+        Descriptors,
+        // Read, uploaded, and blurred frames
+        FrameTextures,
+        // Only the motion blur generator's
+        IntermediateTextures,
+        CpuFrameBuffers,
+
+        Num,
+    };
+
+    struct MemoryUsage
+    {
+        uint64_t bytes = 0;
+        uint64_t peak_bytes = 0;
+    };
+
+    // Process wide counts of the memory the allocators hold, per category, since the start. They're relaxed atomics updated when
+    // memory is created or destroyed, not when it's recycled, so they cost nothing measurable.
+    class MemoryTracker final
+    {
+    public:
+        static void Allocate(MemoryCategory category, uint64_t bytes) noexcept;
+        static void Free(MemoryCategory category, uint64_t bytes) noexcept;
+
+        static MemoryUsage Usage(MemoryCategory category) noexcept;
+        // Of all the categories. The peak isn't the sum of theirs, they don't all peak at once.
+        static MemoryUsage TotalUsage() noexcept;
+
+        static std::string_view CategoryName(MemoryCategory category) noexcept;
+        // A line per category and one for the total
+        static std::string Summary();
+    };
+
+    // Counts the bytes in the category for as long as it lives
+    class TrackedMemory final
+    {
+        DISALLOW_COPY_AND_ASSIGN(TrackedMemory)
+
+    public:
+        TrackedMemory() noexcept;
+        TrackedMemory(MemoryCategory category, uint64_t bytes) noexcept;
+        ~TrackedMemory() noexcept;
+
+        TrackedMemory(TrackedMemory&& other) noexcept;
+        TrackedMemory& operator=(TrackedMemory&& other) noexcept;
+
+        uint64_t Bytes() const noexcept;
+
+        void Reset() noexcept;
+
+    private:
+        MemoryCategory category_ = MemoryCategory::Num;
+        uint64_t bytes_ = 0;
+    };
+} // namespace MotionToGo
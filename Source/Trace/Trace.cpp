@@ -0,0 +1,157 @@
+#include "Trace.hpp"
+
+#include <chrono>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+    struct TraceEvent
+    {
+        const char* name;
+        uint64_t begin_ns;
+        uint64_t end_ns;
+    };
+
+    // Each thread appends to its own buffer, so the lock is only contended while a trace is being written.
+    struct ThreadBuffer
+    {
+        uint32_t thread_id;
+        std::mutex mutex;
+        std::vector<TraceEvent> events;
+    };
+
+    std::mutex buffers_mutex;
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    uint32_t next_thread_id = 1;
+    uint64_t start_ns = 0;
+
+    ThreadBuffer& CurrentThreadBuffer()
+    {
+        thread_local std::shared_ptr<ThreadBuffer> buffer;
+        if (!buffer)
+        {
+            auto new_buffer = std::make_shared<ThreadBuffer>();
+
+            std::lock_guard<std::mutex> lock(buffers_mutex);
+            new_buffer->thread_id = next_thread_id;
+            ++next_thread_id;
+            buffers.push_back(new_buffer);
+
+            buffer = std::move(new_buffer);
+        }
+        return *buffer;
+    }
+
+    void AppendJsonString(std::string& json, const char* str)
+    {
+        json += '"';
+        for (; *str != '\0'; ++str)
+        {
+            if ((*str == '"') || (*str == '\\'))
+            {
+                json += '\\';
+            }
+            json += *str;
+        }
+        json += '"';
+    }
+} // namespace
+
+namespace MotionToGo
+{
+    void Tracer::Start()
+    {
+        std::lock_guard<std::mutex> lock(buffers_mutex);
+
+        for (auto& buffer : buffers)
+        {
+            std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+            buffer->events.clear();
+        }
+        start_ns = Now();
+
+        enabled_.store(true, std::memory_order_relaxed);
+    }
+
+    void Tracer::Stop(const std::filesystem::path& path)
+    {
+        enabled_.store(false, std::memory_order_relaxed);
+
+        std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        bool first = true;
+        {
+            std::lock_guard<std::mutex> lock(buffers_mutex);
+
+            for (auto iter = buffers.begin(); iter != buffers.end();)
+            {
+                auto& buffer = **iter;
+                {
+                    std::lock_guard<std::mutex> buffer_lock(buffer.mutex);
+                    for (const auto& event : buffer.events)
+                    {
+                        if (event.begin_ns < start_ns)
+                        {
+                            continue;
+                        }
+
+                        if (!first)
+                        {
+                            json += ',';
+                        }
+                        first = false;
+
+                        json += "{\"name\":";
+                        AppendJsonString(json, event.name);
+                        json += std::format(",\"cat\":\"MotionToGo\",\"ph\":\"X\",\"pid\":1,\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f}}}",
+                            buffer.thread_id, (event.begin_ns - start_ns) / 1000.0, (event.end_ns - event.begin_ns) / 1000.0);
+                    }
+                    buffer.events.clear();
+                }
+
+                // Buffers only referenced here belong to threads that have exited.
+                if (iter->use_count() == 1)
+                {
+                    iter = buffers.erase(iter);
+                }
+                else
+                {
+                    ++iter;
+                }
+            }
+        }
+        json += "]}\n";
+
+        std::ofstream ofs(path, std::ios_base::binary);
+        if (!ofs)
+        {
+            throw std::runtime_error(std::format("COULDN'T open {}", path.string()));
+        }
+        ofs.write(json.data(), json.size());
+    }
+
+    uint64_t Tracer::Now() noexcept
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void Tracer::Record(const char* name, uint64_t begin_ns, uint64_t end_ns) noexcept
+    {
+        try
+        {
+            ThreadBuffer& buffer = CurrentThreadBuffer();
+
+            std::lock_guard<std::mutex> lock(buffer.mutex);
+            buffer.events.push_back({name, begin_ns, end_ns});
+        }
+        catch (...)
+        {
+            // Dropping an event is better than failing the processing.
+        }
+    }
+} // namespace MotionToGo
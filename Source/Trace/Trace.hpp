@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+
+#include "Noncopyable.hpp"
+
+#define GO_MOTION_TRACE_CONCAT_IMPL(a, b) a##b
+#define GO_MOTION_TRACE_CONCAT(a, b) GO_MOTION_TRACE_CONCAT_IMPL(a, b)
+
+// Records the enclosing scope as one event. The name MUST be a string literal.
+#define GO_MOTION_TRACE_SCOPE(name) MotionToGo::TraceScope GO_MOTION_TRACE_CONCAT(trace_scope_, __LINE__)(name)
+
+namespace MotionToGo
+{
+    class Tracer final
+    {
+    public:
+        static void Start();
+        // Stops recording and writes everything recorded since Start as a Chrome trace / Perfetto JSON file.
+        static void Stop(const std::filesystem::path& path);
+
+        static bool Enabled() noexcept
+        {
+            return enabled_.load(std::memory_order_relaxed);
+        }
+
+        static uint64_t Now() noexcept;
+        static void Record(const char* name, uint64_t begin_ns, uint64_t end_ns) noexcept;
+
+    private:
+        static inline std::atomic<bool> enabled_ = false;
+    };
+
+    class TraceScope final
+    {
+        DISALLOW_COPY_AND_ASSIGN(TraceScope)
+
+    public:
+        explicit TraceScope(const char* name) noexcept
+            : name_(Tracer::Enabled() ? name : nullptr), begin_ns_(name_ != nullptr ? Tracer::Now() : 0)
+        {
+        }
+
+        ~TraceScope() noexcept
+        {
+            if (name_ != nullptr)
+            {
+                Tracer::Record(name_, begin_ns_, Tracer::Now());
+            }
+        }
+
+    private:
+        const char* name_;
+        uint64_t begin_ns_;
+    };
+} // namespace MotionToGo
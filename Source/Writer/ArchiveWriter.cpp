@@ -0,0 +1,71 @@
+#include "Writer.hpp"
+
+#include <chrono>
+#include <future>
+
+#include "Codec/FrameArchive.hpp"
+
+namespace MotionToGo
+{
+    class ArchiveWriter final : public Writer
+    {
+    public:
+        ArchiveWriter(const std::filesystem::path& path, uint32_t key_frame_interval) : archive_(path, key_frame_interval)
+        {
+        }
+
+        ~ArchiveWriter() noexcept override
+        {
+            if (compressing_thread_.valid())
+            {
+                compressing_thread_.wait();
+            }
+        }
+
+        void WriteFrame(uint32_t frame_index, uint32_t width, uint32_t height, FrameBuffer&& data) override
+        {
+            // The frames are appended in order, one compresses while the next is processed
+            if (compressing_thread_.valid())
+            {
+                compressing_thread_.get();
+            }
+
+            compressing_thread_ = std::async(std::launch::async, [this, frame_index, width, height, data = std::move(data)]() {
+                const auto start = std::chrono::high_resolution_clock::now();
+                archive_.AddFrame(frame_index, width, height, data.Span());
+                encode_ms_ += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+            });
+        }
+
+        // Also writes the index, no frames can be written after
+        void Flush() override
+        {
+            if (compressing_thread_.valid())
+            {
+                compressing_thread_.get();
+            }
+            archive_.Close();
+        }
+
+        WriterStats Stats() const override
+        {
+            WriterStats stats;
+            stats.deduplicated_frames = archive_.NumRepeats();
+            stats.deduplicated_bytes = archive_.RepeatedBytes();
+            stats.encode_ms = encode_ms_;
+            return stats;
+        }
+
+    private:
+        FrameArchiveWriter archive_;
+        std::future<void> compressing_thread_;
+        // Only touched by the compressing thread until it's joined
+        double encode_ms_ = 0;
+    };
+
+    std::unique_ptr<Writer> CreateArchiveWriter(const std::filesystem::path& path, uint32_t key_frame_interval)
+    {
+        std::filesystem::create_directories(path.parent_path());
+        return std::make_unique<ArchiveWriter>(path, key_frame_interval);
+    }
+} // namespace MotionToGo
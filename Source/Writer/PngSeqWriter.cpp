@@ -0,0 +1,131 @@
+#include "Writer.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <format>
+#include <future>
+#include <memory>
+
+#include "Codec/ImageCodec.hpp"
+#include "Io/FileWriteQueue.hpp"
+
+namespace MotionToGo
+{
+    class PngSeqWriter final : public Writer
+    {
+    public:
+        explicit PngSeqWriter(const std::filesystem::path& dir) : dir_(dir), file_queue_(FileWriteBackend::IoUring)
+        {
+            std::filesystem::create_directories(dir_);
+        }
+
+        ~PngSeqWriter() noexcept override
+        {
+            for (auto& th : saving_threads_)
+            {
+                th.wait();
+            }
+        }
+
+        void WriteFrame(uint32_t frame_index, uint32_t width, uint32_t height, FrameBuffer&& data) override
+        {
+            for (auto iter = saving_threads_.begin(); iter != saving_threads_.end();)
+            {
+                auto& th = *iter;
+                if (th.wait_for(std::chrono::milliseconds(0)) == std::future_status::ready)
+                {
+                    iter = saving_threads_.erase(iter);
+                }
+                else
+                {
+                    ++iter;
+                }
+            }
+
+            const std::filesystem::path file_path = dir_ / std::format("Frame_{}.png", frame_index + 1);
+            auto frame = std::make_shared<const FrameBuffer>(std::move(data));
+
+            // A frame identical to the last one encoded links to its PNG. Comparing them costs a fraction of encoding.
+            if (prev_frame_ && (width == prev_width_) && (height == prev_height_) && std::ranges::equal(frame->Span(), prev_frame_->Span()))
+            {
+                saving_threads_.push_back(std::async(std::launch::async,
+                    [this, file_path, source_path = prev_file_path_, source = prev_png_size_]() -> uint64_t {
+                        // The source is in the file queue by then, and the link is queued after it
+                        const uint64_t png_size = source.get();
+                        if (png_size != 0)
+                        {
+                            file_queue_.Link(file_path, source_path);
+                            ++deduplicated_frames_;
+                            deduplicated_bytes_ += png_size;
+                        }
+                        return 0;
+                    }).share());
+                return;
+            }
+
+            // The encoding threads hand the PNGs to the file queue, they never wait for the storage
+            prev_png_size_ = std::async(std::launch::async, [this, file_path, width, height, frame]() -> uint64_t {
+                const auto start = std::chrono::high_resolution_clock::now();
+                std::vector<uint8_t> png = EncodePng(frame->Data(), width, height);
+                encode_ns_ += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start)
+                                  .count();
+
+                const uint64_t png_size = png.size();
+                if (!png.empty())
+                {
+                    file_queue_.Write(file_path, std::move(png));
+                }
+                return png_size;
+            }).share();
+            saving_threads_.push_back(prev_png_size_);
+
+            prev_frame_ = std::move(frame);
+            prev_width_ = width;
+            prev_height_ = height;
+            prev_file_path_ = file_path;
+        }
+
+        void Flush() override
+        {
+            for (auto& th : saving_threads_)
+            {
+                th.wait();
+            }
+            saving_threads_.clear();
+
+            file_queue_.Flush();
+        }
+
+        WriterStats Stats() const override
+        {
+            WriterStats stats;
+            stats.deduplicated_frames = deduplicated_frames_;
+            stats.deduplicated_bytes = deduplicated_bytes_;
+            stats.encode_ms = encode_ns_ / 1e6;
+            return stats;
+        }
+
+    private:
+        std::filesystem::path dir_;
+        FileWriteQueue file_queue_;
+        std::vector<std::shared_future<uint64_t>> saving_threads_;
+
+        // The last frame encoded, and the size of its PNG
+        std::shared_ptr<const FrameBuffer> prev_frame_;
+        uint32_t prev_width_ = 0;
+        uint32_t prev_height_ = 0;
+        std::filesystem::path prev_file_path_;
+        std::shared_future<uint64_t> prev_png_size_;
+
+        std::atomic<uint32_t> deduplicated_frames_ = 0;
+        std::atomic<uint64_t> deduplicated_bytes_ = 0;
+        std::atomic<uint64_t> encode_ns_ = 0;
+    };
+
+    std::unique_ptr<Writer> CreatePngSeqWriter(const std::filesystem::path& dir)
+    {
+        return std::make_unique<PngSeqWriter>(dir);
+    }
+} // namespace MotionToGo
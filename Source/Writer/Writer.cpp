@@ -0,0 +1,7 @@
+#include "Writer.hpp"
+
+namespace MotionToGo
+{
+    Writer::Writer() noexcept = default;
+    Writer::~Writer() noexcept = default;
+} // namespace MotionToGo
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+
+#include "Io/FrameBufferPool.hpp"
+#include "Noncopyable.hpp"
+
+namespace MotionToGo
+{
+    struct WriterStats
+    {
+        // Frames identical to the previous one, written as a link or a repeat instead of encoded again
+        uint32_t deduplicated_frames = 0;
+        // What encoding them would have written
+        uint64_t deduplicated_bytes = 0;
+        // Encoding the other frames, summed over the threads
+        double encode_ms = 0;
+    };
+
+    class Writer
+    {
+        DISALLOW_COPY_AND_ASSIGN(Writer)
+
+    public:
+        Writer() noexcept;
+        virtual ~Writer() noexcept;
+
+        // data is RGBA8 with a row pitch of width * 4.
+        virtual void WriteFrame(uint32_t frame_index, uint32_t width, uint32_t height, FrameBuffer&& data) = 0;
+        virtual void Flush() = 0;
+
+        // Complete after Flush.
+        virtual WriterStats Stats() const = 0;
+    };
+
+    std::unique_ptr<Writer> CreatePngSeqWriter(const std::filesystem::path& dir);
+    // One FrameArchive file. Flush writes its index.
+    std::unique_ptr<Writer> CreateArchiveWriter(const std::filesystem::path& path, uint32_t key_frame_interval);
+} // namespace MotionToGo
@@ -0,0 +1,1226 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <span>
+#include <string>
+#include <thread>
+
+#include <zlib.h>
+
+#include <gtest/gtest.h>
+
+#include "Codec/FrameArchive.hpp"
+#include "Codec/ImageCodec.hpp"
+#include "Codec/Lz4.hpp"
+#include "Cpu/CpuColorConversion.hpp"
+#include "Cpu/CpuFeatures.hpp"
+#include "Cpu/CpuMotionBlur.hpp"
+#include "Gpu/GpuTransientPlanner.hpp"
+#include "Io/FileWriteQueue.hpp"
+#include "Io/FrameBufferPool.hpp"
+#include "Io/RawFrameSequence.hpp"
+#include "Synth/SyntheticSequence.hpp"
+#include "TestImage.hpp"
+#include "Trace/MemoryTracker.hpp"
+
+namespace
+{
+    void AppendPngChunk(std::vector<uint8_t>& png, const char* type, std::span<const uint8_t> data)
+    {
+        const auto append_big_endian = [&png](uint32_t value) {
+            for (int shift = 24; shift >= 0; shift -= 8)
+            {
+                png.push_back(static_cast<uint8_t>(value >> shift));
+            }
+        };
+
+        append_big_endian(static_cast<uint32_t>(data.size()));
+        const size_t type_offset = png.size();
+        png.insert(png.end(), type, type + 4);
+        png.insert(png.end(), data.begin(), data.end());
+        append_big_endian(crc32(0, &png[type_offset], static_cast<uInt>(4 + data.size())));
+    }
+
+    // For the formats EncodePng doesn't write. The filters take turns by row, and the stream is split over small IDATs. 16-bit
+    // gets a low byte that isn't a copy of the high one.
+    std::vector<uint8_t> EncodeTestPng(
+        const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t row_pitch, uint32_t channels, uint32_t bit_depth)
+    {
+        const uint32_t bytes_per_channel = bit_depth / 8;
+        const uint32_t bytes_per_pixel = channels * bytes_per_channel;
+        const uint32_t row_bytes = width * bytes_per_pixel;
+
+        std::vector<uint8_t> rows(height * row_bytes);
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                for (uint32_t c = 0; c < channels; ++c)
+                {
+                    uint8_t* dst = &rows[y * row_bytes + (x * channels + c) * bytes_per_channel];
+                    dst[0] = rgba[y * row_pitch + x * 4 + c];
+                    if (bytes_per_channel == 2)
+                    {
+                        dst[1] = static_cast<uint8_t>(dst[0] ^ 0x5A);
+                    }
+                }
+            }
+        }
+
+        std::vector<uint8_t> filtered(height * (row_bytes + 1));
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            const uint8_t* row = &rows[y * row_bytes];
+            const uint8_t* prev_row = y > 0 ? row - row_bytes : nullptr;
+            const auto filter = static_cast<MotionToGo::PngFilter>(y % 5);
+            uint8_t* dst = &filtered[y * (row_bytes + 1)];
+            dst[0] = static_cast<uint8_t>(filter);
+            for (uint32_t i = 0; i < row_bytes; ++i)
+            {
+                const int a = i >= bytes_per_pixel ? row[i - bytes_per_pixel] : 0;
+                const int b = prev_row != nullptr ? prev_row[i] : 0;
+                const int c = (i >= bytes_per_pixel) && (prev_row != nullptr) ? prev_row[i - bytes_per_pixel] : 0;
+                int predictor = 0;
+                switch (filter)
+                {
+                case MotionToGo::PngFilter::Sub:
+                    predictor = a;
+                    break;
+
+                case MotionToGo::PngFilter::Up:
+                    predictor = b;
+                    break;
+
+                case MotionToGo::PngFilter::Average:
+                    predictor = (a + b) / 2;
+                    break;
+
+                case MotionToGo::PngFilter::Paeth:
+                {
+                    const int pa = std::abs(b - c);
+                    const int pb = std::abs(a - c);
+                    const int pc = std::abs(a + b - 2 * c);
+                    predictor = (pa <= pb) && (pa <= pc) ? a : (pb <= pc ? b : c);
+                    break;
+                }
+
+                default:
+                    break;
+                }
+                dst[i + 1] = static_cast<uint8_t>(row[i] - predictor);
+            }
+        }
+
+        uLongf compressed_size = compressBound(static_cast<uLong>(filtered.size()));
+        std::vector<uint8_t> compressed(compressed_size);
+        compress2(compressed.data(), &compressed_size, filtered.data(), static_cast<uLong>(filtered.size()), 6);
+
+        std::vector<uint8_t> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+        const uint8_t header[] = {static_cast<uint8_t>(width >> 24), static_cast<uint8_t>(width >> 16), static_cast<uint8_t>(width >> 8),
+            static_cast<uint8_t>(width), static_cast<uint8_t>(height >> 24), static_cast<uint8_t>(height >> 16),
+            static_cast<uint8_t>(height >> 8), static_cast<uint8_t>(height), static_cast<uint8_t>(bit_depth),
+            static_cast<uint8_t>(channels == 4 ? 6 : 2), 0, 0, 0};
+        AppendPngChunk(png, "IHDR", header);
+        for (uLongf offset = 0; offset < compressed_size; offset += 1000)
+        {
+            AppendPngChunk(png, "IDAT", std::span(compressed).subspan(offset, std::min<uLongf>(1000, compressed_size - offset)));
+        }
+        AppendPngChunk(png, "IEND", {});
+        return png;
+    }
+} // namespace
+
+namespace MotionToGo
+{
+    TEST(CpuColorConversionTest, SimdMatchesScalar)
+    {
+        const Image input = LoadImage(std::format("{}ImageSeq/Frame_1.png", TEST_DATA_DIR));
+        ASSERT_FALSE(input.data.empty());
+
+        // Not a multiple of the SIMD width, so the tails run too
+        const uint32_t width = (input.width - 6) & ~1U;
+        const uint32_t height = input.height & ~1U;
+        const auto* rgba = reinterpret_cast<const uint8_t*>(input.data.data());
+
+        const CpuSimdLevel detected_level = DetectedCpuSimdLevel();
+
+        std::vector<uint8_t> expected_luma(width * height);
+        std::vector<uint8_t> expected_chroma(width * height / 2);
+        std::vector<uint8_t> expected_rgba(width * height * 4);
+        SetCpuSimdLevel(CpuSimdLevel::Scalar);
+        RgbaToNv12(rgba, input.width * 4, width, height, expected_luma.data(), width, expected_chroma.data(), width);
+        Nv12ToRgba(expected_luma.data(), width, expected_chroma.data(), width, width, height, expected_rgba.data(), width * 4);
+
+        for (uint32_t level = static_cast<uint32_t>(CpuSimdLevel::Sse41); level <= static_cast<uint32_t>(detected_level); ++level)
+        {
+            SetCpuSimdLevel(static_cast<CpuSimdLevel>(level));
+
+            std::vector<uint8_t> luma(width * height);
+            std::vector<uint8_t> chroma(width * height / 2);
+            std::vector<uint8_t> output_rgba(width * height * 4);
+            RgbaToNv12(rgba, input.width * 4, width, height, luma.data(), width, chroma.data(), width);
+            Nv12ToRgba(expected_luma.data(), width, expected_chroma.data(), width, width, height, output_rgba.data(), width * 4);
+
+            EXPECT_EQ(luma, expected_luma) << CpuSimdLevelName(ActiveCpuSimdLevel());
+            EXPECT_EQ(chroma, expected_chroma) << CpuSimdLevelName(ActiveCpuSimdLevel());
+            EXPECT_EQ(output_rgba, expected_rgba) << CpuSimdLevelName(ActiveCpuSimdLevel());
+        }
+
+        SetCpuSimdLevel(detected_level);
+    }
+
+    TEST(PngEncodeTest, RoundTripAndSimdMatchesScalar)
+    {
+        const Image input = LoadImage(std::format("{}ImageSeq/Frame_1.png", TEST_DATA_DIR));
+        ASSERT_FALSE(input.data.empty());
+
+        // Not a multiple of the SIMD width, and with a row pitch
+        const uint32_t width = input.width - 3;
+        const uint32_t height = input.height;
+        const auto* rgba = reinterpret_cast<const uint8_t*>(input.data.data());
+
+        const CpuSimdLevel detected_level = DetectedCpuSimdLevel();
+
+        std::vector<PngEncodeOptions> options_list = {{PngFilterStrategy::Heuristic}, {PngFilterStrategy::Exhaustive}};
+        for (const auto filter : {PngFilter::None, PngFilter::Sub, PngFilter::Up, PngFilter::Average, PngFilter::Paeth})
+        {
+            options_list.push_back({PngFilterStrategy::Fixed, filter});
+        }
+        for (const auto& options : options_list)
+        {
+            SetCpuSimdLevel(CpuSimdLevel::Scalar);
+            const std::vector<uint8_t> expected_png = EncodePng(rgba, width, height, input.width * 4, options);
+
+            uint32_t decoded_width;
+            uint32_t decoded_height;
+            const std::vector<uint8_t> decoded = DecodeImage(expected_png, decoded_width, decoded_height);
+            ASSERT_EQ(decoded_width, width);
+            ASSERT_EQ(decoded_height, height);
+            for (uint32_t y = 0; y < height; ++y)
+            {
+                EXPECT_EQ(std::memcmp(&decoded[y * width * 4], &rgba[y * input.width * 4], width * 4), 0)
+                    << PngFilterStrategyName(options.filter_strategy) << " row " << y;
+            }
+
+            for (uint32_t level = static_cast<uint32_t>(CpuSimdLevel::Sse41); level <= static_cast<uint32_t>(detected_level); ++level)
+            {
+                SetCpuSimdLevel(static_cast<CpuSimdLevel>(level));
+                EXPECT_EQ(EncodePng(rgba, width, height, input.width * 4, options), expected_png)
+                    << PngFilterStrategyName(options.filter_strategy) << " " << CpuSimdLevelName(ActiveCpuSimdLevel());
+            }
+        }
+
+        SetCpuSimdLevel(detected_level);
+    }
+
+    TEST(PngDecodeTest, FormatsAndSimdMatchStb)
+    {
+        const Image input = LoadImage(std::format("{}ImageSeq/Frame_1.png", TEST_DATA_DIR));
+        ASSERT_FALSE(input.data.empty());
+
+        // Not a multiple of the SIMD width, and into padded rows like the upload heap's
+        const uint32_t width = input.width - 3;
+        const uint32_t height = input.height;
+        const uint32_t row_pitch = (width * 4 + 255) & ~255U;
+        const auto* rgba = reinterpret_cast<const uint8_t*>(input.data.data());
+
+        const CpuSimdLevel detected_level = DetectedCpuSimdLevel();
+
+        std::vector<uint8_t> decoded(height * row_pitch);
+        for (const uint32_t channels : {3U, 4U})
+        {
+            for (const uint32_t bit_depth : {8U, 16U})
+            {
+                const std::vector<uint8_t> png = EncodeTestPng(rgba, width, height, input.width * 4, channels, bit_depth);
+
+                int expected_width;
+                int expected_height;
+                uint8_t* expected = stbi_load_from_memory(png.data(), static_cast<int>(png.size()), &expected_width, &expected_height,
+                    nullptr, 4);
+                ASSERT_NE(expected, nullptr);
+
+                uint32_t decoded_width;
+                uint32_t decoded_height;
+                ASSERT_TRUE(ImageSize(png, decoded_width, decoded_height));
+                EXPECT_EQ(decoded_width, width);
+                EXPECT_EQ(decoded_height, height);
+
+                for (uint32_t level = 0; level <= static_cast<uint32_t>(detected_level); ++level)
+                {
+                    SetCpuSimdLevel(static_cast<CpuSimdLevel>(level));
+                    ASSERT_TRUE(DecodeImage(png, decoded.data(), row_pitch));
+                    for (uint32_t y = 0; y < height; ++y)
+                    {
+                        EXPECT_EQ(std::memcmp(&decoded[y * row_pitch], &expected[y * width * 4], width * 4), 0)
+                            << channels << " channels " << bit_depth << "-bit " << CpuSimdLevelName(ActiveCpuSimdLevel()) << " row " << y;
+                    }
+                }
+
+                stbi_image_free(expected);
+            }
+        }
+
+        SetCpuSimdLevel(detected_level);
+    }
+
+    TEST(FrameArchiveTest, RoundTrip)
+    {
+        // Mostly static with a moving square, and a size change that forces a key frame
+        std::vector<std::vector<uint8_t>> frames;
+        std::vector<std::pair<uint32_t, uint32_t>> sizes;
+        for (uint32_t i = 0; i < 8; ++i)
+        {
+            const uint32_t width = i < 6 ? 96 : 64;
+            const uint32_t height = i < 6 ? 80 : 48;
+            std::vector<uint8_t> rgba(width * height * 4);
+            for (uint32_t y = 0; y < height; ++y)
+            {
+                for (uint32_t x = 0; x < width; ++x)
+                {
+                    const bool in_square = (x - i * 4 < 16) && (y - i * 2 < 16);
+                    const uint32_t hash = ((y * width + x) * 2654435761U) >> (in_square ? 8 : 24);
+                    for (uint32_t c = 0; c < 4; ++c)
+                    {
+                        rgba[(y * width + x) * 4 + c] = static_cast<uint8_t>(hash >> c);
+                    }
+                }
+            }
+            frames.push_back(std::move(rgba));
+            sizes.emplace_back(width, height);
+        }
+
+        const std::filesystem::path archive_path = std::filesystem::temp_directory_path() / "MotionToGoTest.mtga";
+        for (const uint32_t key_frame_interval : {0U, 1U, 3U})
+        {
+            uint64_t size;
+            {
+                FrameArchiveWriter writer(archive_path, key_frame_interval);
+                for (uint32_t i = 0; i < frames.size(); ++i)
+                {
+                    writer.AddFrame(i + 10, sizes[i].first, sizes[i].second, frames[i]);
+                }
+                writer.Close();
+                size = writer.Size();
+            }
+            EXPECT_EQ(std::filesystem::file_size(archive_path), size);
+
+            FrameArchiveReader reader(archive_path);
+            ASSERT_EQ(reader.Entries().size(), frames.size());
+            for (uint32_t i = 0; i < frames.size(); ++i)
+            {
+                const FrameArchiveEntry& entry = reader.Entries()[i];
+                EXPECT_EQ(entry.frame_index, i + 10);
+                EXPECT_EQ(entry.width, sizes[i].first);
+                EXPECT_EQ(entry.height, sizes[i].second);
+                EXPECT_EQ(entry.delta, (key_frame_interval > 1) && (i % key_frame_interval != 0) && (i != 6)) << "frame " << i;
+            }
+
+            // In order, then seeking around
+            for (const uint32_t i : {0, 1, 2, 3, 4, 5, 6, 7, 4, 2, 5, 5, 7, 1})
+            {
+                EXPECT_EQ(reader.ReadFrame(i), frames[i]) << "frame " << i << ", key frame interval " << key_frame_interval;
+            }
+        }
+        std::filesystem::remove(archive_path);
+
+        // Incompressible, short, and empty blocks
+        for (const size_t size : {0, 1, 13, 100000})
+        {
+            std::vector<uint8_t> data(size);
+            for (size_t i = 0; i < size; ++i)
+            {
+                data[i] = static_cast<uint8_t>((i * 2654435761U) >> 24);
+            }
+            const std::vector<uint8_t> compressed = CompressLz4Block(data);
+            std::vector<uint8_t> decompressed(size);
+            EXPECT_TRUE(DecompressLz4Block(compressed, decompressed)) << size;
+            EXPECT_EQ(decompressed, data) << size;
+            if (size > 0)
+            {
+                EXPECT_FALSE(DecompressLz4Block(std::span(compressed).first(compressed.size() - 1), decompressed)) << size;
+            }
+        }
+    }
+
+    TEST(FrameArchiveTest, Repeats)
+    {
+        // Holds of 1, 3, and 2 frames, the last after a size change
+        std::vector<std::vector<uint8_t>> frames;
+        std::vector<std::pair<uint32_t, uint32_t>> sizes;
+        for (const uint32_t shot : {0U, 1U, 1U, 1U, 2U, 3U, 3U})
+        {
+            const uint32_t width = shot < 3 ? 64 : 32;
+            const uint32_t height = 40;
+            std::vector<uint8_t> rgba(width * height * 4);
+            for (size_t i = 0; i < rgba.size(); ++i)
+            {
+                rgba[i] = static_cast<uint8_t>(((i * 2654435761U) >> 24) + shot * 37);
+            }
+            frames.push_back(std::move(rgba));
+            sizes.emplace_back(width, height);
+        }
+        const std::vector<bool> repeats = {false, false, true, true, false, false, true};
+
+        const std::filesystem::path archive_path = std::filesystem::temp_directory_path() / "MotionToGoRepeatsTest.mtga";
+        for (const uint32_t key_frame_interval : {0U, 3U})
+        {
+            {
+                FrameArchiveWriter writer(archive_path, key_frame_interval);
+                for (uint32_t i = 0; i < frames.size(); ++i)
+                {
+                    writer.AddFrame(i, sizes[i].first, sizes[i].second, frames[i]);
+                }
+                EXPECT_EQ(writer.NumFrames(), frames.size());
+                EXPECT_EQ(writer.NumRepeats(), 3U);
+                EXPECT_GT(writer.RepeatedBytes(), 0U);
+                writer.Close();
+            }
+
+            FrameArchiveReader reader(archive_path);
+            ASSERT_EQ(reader.Entries().size(), frames.size());
+            for (uint32_t i = 0; i < frames.size(); ++i)
+            {
+                const FrameArchiveEntry& entry = reader.Entries()[i];
+                EXPECT_EQ(entry.repeat, repeats[i]) << "frame " << i;
+                if (entry.repeat)
+                {
+                    EXPECT_EQ(entry.size, 0U) << "frame " << i;
+                }
+            }
+
+            // Repeats don't count toward the key frame interval, frame 4 is still a delta after the 2 of them
+            EXPECT_EQ(reader.Entries()[4].delta, key_frame_interval == 3);
+
+            for (const uint32_t i : {0, 1, 2, 3, 4, 5, 6, 3, 2, 6, 1, 4})
+            {
+                EXPECT_EQ(reader.ReadFrame(i), frames[i]) << "frame " << i << ", key frame interval " << key_frame_interval;
+            }
+        }
+        std::filesystem::remove(archive_path);
+    }
+
+    TEST(RawFrameSequenceTest, ConcatenatedAndPerFile)
+    {
+        constexpr uint32_t Width = 48;
+        constexpr uint32_t Height = 32;
+        const std::filesystem::path dir = std::filesystem::temp_directory_path() / "MotionToGoRawFrameSequenceTest";
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directories(dir / "PerFile");
+
+        for (const RawPixelFormat format : {RawPixelFormat::Rgba8, RawPixelFormat::Nv12})
+        {
+            const char* ext = format == RawPixelFormat::Rgba8 ? "rgba" : "NV12";
+            const uint64_t frame_bytes = RawFrameBytes(format, Width, Height);
+            EXPECT_EQ(frame_bytes, format == RawPixelFormat::Rgba8 ? Width * Height * 4U : Width * Height * 3U / 2);
+
+            std::vector<std::vector<uint8_t>> frames;
+            std::ofstream concatenated(dir / std::format("Frames.{}", ext), std::ios_base::binary);
+            for (uint32_t i = 0; i < 5; ++i)
+            {
+                std::vector<uint8_t> frame(frame_bytes);
+                for (size_t j = 0; j < frame.size(); ++j)
+                {
+                    frame[j] = static_cast<uint8_t>((j * 2654435761U + i) >> 24);
+                }
+                concatenated.write(reinterpret_cast<const char*>(frame.data()), frame.size());
+                std::ofstream(dir / "PerFile" / std::format("Frame_{}.{}", i, ext), std::ios_base::binary)
+                    .write(reinterpret_cast<const char*>(frame.data()), frame.size());
+                frames.push_back(std::move(frame));
+            }
+            concatenated.close();
+
+            for (const auto& path : {dir / std::format("Frames.{}", ext), dir / "PerFile"})
+            {
+                RawFrameSequence sequence(path, Width, Height);
+                EXPECT_EQ(sequence.Format(), format);
+                ASSERT_EQ(sequence.NumFrames(), frames.size());
+
+                // In order, then seeking around
+                for (const uint32_t i : {0, 1, 2, 3, 4, 2, 0, 4})
+                {
+                    const std::span<const uint8_t> frame = sequence.Frame(i);
+                    EXPECT_TRUE(std::equal(frame.begin(), frame.end(), frames[i].begin(), frames[i].end())) << path << ", frame " << i;
+                }
+            }
+
+            // Not a whole number of frames
+            EXPECT_THROW(RawFrameSequence(dir / std::format("Frames.{}", ext), Width, Height + 2), std::runtime_error);
+            std::filesystem::remove_all(dir / "PerFile");
+            std::filesystem::create_directories(dir / "PerFile");
+        }
+
+        EXPECT_THROW(RawFrameSequence(dir / "PerFile", Width, Height), std::runtime_error);
+        std::filesystem::remove_all(dir);
+    }
+
+    TEST(FileWriteQueueTest, WritesFiles)
+    {
+        const std::filesystem::path dir = std::filesystem::temp_directory_path() / "MotionToGoFileWriteQueueTest";
+        std::filesystem::create_directories(dir);
+
+        for (const FileWriteBackend backend : {FileWriteBackend::Blocking, FileWriteBackend::IoUring})
+        {
+            FileWriteQueue queue(backend);
+            EXPECT_EQ(queue.ActiveBackend(), IsIoUringSupported() ? backend : FileWriteBackend::Blocking);
+
+            // More files than io_uring keeps in flight, and some written twice in a row. The second write is smaller than the first,
+            // so the first landing last would show.
+            std::vector<std::vector<uint8_t>> contents;
+            for (uint32_t i = 0; i < 100; ++i)
+            {
+                std::vector<uint8_t> data((i + 1) * 997);
+                for (size_t j = 0; j < data.size(); ++j)
+                {
+                    data[j] = static_cast<uint8_t>((j * 2654435761U + i) >> 24);
+                }
+                contents.push_back(data);
+                if (i % 10 == 0)
+                {
+                    queue.Write(dir / std::format("{}.bin", i), std::vector<uint8_t>(1 << 20, 0xCD));
+                }
+                queue.Write(dir / std::format("{}.bin", i), std::move(data));
+            }
+            queue.Flush();
+
+            for (uint32_t i = 0; i < contents.size(); ++i)
+            {
+                std::ifstream ifs(dir / std::format("{}.bin", i), std::ios_base::binary);
+                const std::vector<uint8_t> data((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+                EXPECT_EQ(data, contents[i]) << FileWriteBackendName(queue.ActiveBackend()) << ", file " << i;
+            }
+
+            // The error surfaces on the next Flush only
+            queue.Write(dir / "Missing" / "0.bin", std::vector<uint8_t>(16));
+            EXPECT_THROW(queue.Flush(), std::runtime_error);
+            EXPECT_NO_THROW(queue.Flush());
+
+            const FileWriteStats stats = queue.Stats();
+            EXPECT_EQ(stats.files, 111U);
+            EXPECT_EQ(stats.latencies_us.size(), 111U);
+            EXPECT_GT(stats.syscalls, 0U);
+            EXPECT_LE(FileWriteLatencyPercentile(stats, 50), FileWriteLatencyPercentile(stats, 99));
+        }
+
+        std::filesystem::remove_all(dir);
+    }
+
+    TEST(FileWriteQueueTest, LinksFiles)
+    {
+        const std::filesystem::path dir = std::filesystem::temp_directory_path() / "MotionToGoFileWriteQueueLinkTest";
+        std::filesystem::create_directories(dir);
+
+        for (const FileWriteBackend backend : {FileWriteBackend::Blocking, FileWriteBackend::IoUring})
+        {
+            FileWriteQueue queue(backend);
+
+            // Each link right after the write of its target, one replacing an existing file, and one repeating an existing link
+            std::vector<std::vector<uint8_t>> contents;
+            for (uint32_t i = 0; i < 40; ++i)
+            {
+                std::vector<uint8_t> data(1000 + i);
+                for (size_t j = 0; j < data.size(); ++j)
+                {
+                    data[j] = static_cast<uint8_t>((j * 2654435761U + i) >> 24);
+                }
+                contents.push_back(data);
+                queue.Write(dir / std::format("{}.bin", i * 2), std::move(data));
+                queue.Link(dir / std::format("{}.bin", i * 2 + 1), dir / std::format("{}.bin", i * 2));
+            }
+            queue.Link(dir / "1.bin", dir / "2.bin");
+            queue.Link(dir / "3.bin", dir / "2.bin");
+            queue.Flush();
+
+            for (uint32_t i = 0; i < contents.size() * 2; ++i)
+            {
+                std::ifstream ifs(dir / std::format("{}.bin", i), std::ios_base::binary);
+                const std::vector<uint8_t> data((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+                EXPECT_EQ(data, contents[i == 1 ? 1 : i / 2]) << FileWriteBackendName(queue.ActiveBackend()) << ", file " << i;
+            }
+
+            // A failed link leaves the file it would have replaced
+            queue.Link(dir / "0.bin", dir / "Missing.bin");
+            EXPECT_THROW(queue.Flush(), std::runtime_error);
+            {
+                std::ifstream ifs(dir / "0.bin", std::ios_base::binary);
+                const std::vector<uint8_t> data((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+                EXPECT_EQ(data, contents[0]) << FileWriteBackendName(queue.ActiveBackend());
+            }
+
+            // No temporary files left behind
+            EXPECT_EQ(std::distance(std::filesystem::directory_iterator(dir), std::filesystem::directory_iterator()), 80)
+                << FileWriteBackendName(queue.ActiveBackend());
+
+            const FileWriteStats stats = queue.Stats();
+            EXPECT_EQ(stats.files, 83U);
+            EXPECT_EQ(stats.links, 43U);
+        }
+
+        std::filesystem::remove_all(dir);
+    }
+
+#ifdef __linux__
+    // The tests above cover io_uring only where it's active. A kernel or a sandbox that turns it off leaves them with Blocking.
+    TEST(FileWriteQueueTest, IoUringIsActiveOnLinux)
+    {
+        if (!IsIoUringSupported())
+        {
+            GTEST_SKIP() << "io_uring is off here, the FileWriteQueue tests only ran the Blocking backend";
+        }
+
+        const FileWriteQueue queue(FileWriteBackend::IoUring);
+        EXPECT_EQ(queue.ActiveBackend(), FileWriteBackend::IoUring);
+    }
+#endif
+
+    TEST(FrameBufferPoolTest, RecyclesAcrossThreads)
+    {
+        constexpr size_t FrameSize = 1920 * 1080 * 4;
+
+        FrameBuffer outlives_pool;
+        {
+            FrameBufferPool pool;
+
+            FrameBuffer frame = pool.Acquire(FrameSize);
+            ASSERT_TRUE(frame);
+            EXPECT_EQ(frame.Size(), FrameSize);
+            EXPECT_EQ(reinterpret_cast<uintptr_t>(frame.Data()) % 4096, 0U);
+            std::memset(frame.Data(), 0xAB, frame.Size());
+            uint8_t* const data = frame.Data();
+
+            // Released on another thread, like a writer does
+            std::thread([frame = std::move(frame)]() mutable { frame = FrameBuffer(); }).join();
+            EXPECT_FALSE(frame);
+
+            FrameBuffer reused = pool.Acquire(FrameSize);
+            EXPECT_EQ(reused.Data(), data);
+            EXPECT_EQ(reused.Data()[FrameSize - 1], 0xAB);
+
+            // A different size, and one the released buffer is too small for
+            FrameBuffer small = pool.Acquire(100);
+            EXPECT_EQ(small.Size(), 100U);
+            reused = FrameBuffer();
+            FrameBuffer bigger = pool.Acquire(FrameSize * 2);
+            EXPECT_NE(bigger.Data(), data);
+
+            FrameBufferPoolStats stats = pool.Stats();
+            EXPECT_EQ(stats.acquires, 4U);
+            EXPECT_EQ(stats.hits, 1U);
+            EXPECT_GE(stats.peak_bytes, FrameSize * 3 + 100);
+            EXPECT_EQ(stats.bytes, stats.peak_bytes);
+
+            pool.Trim();
+            stats = pool.Stats();
+            EXPECT_LT(stats.bytes, stats.peak_bytes);
+            EXPECT_GE(stats.bytes, FrameSize * 2 + 100);
+
+            outlives_pool = std::move(bigger);
+        }
+        EXPECT_EQ(outlives_pool.Size(), FrameSize * 2);
+        std::memset(outlives_pool.Data(), 0, outlives_pool.Size());
+    }
+
+    TEST(MemoryTrackerTest, CountsCurrentAndPeak)
+    {
+        // The counts are process wide, only the changes are checked
+        const MemoryUsage descriptors_before = MemoryTracker::Usage(MemoryCategory::Descriptors);
+        const MemoryUsage total_before = MemoryTracker::TotalUsage();
+
+        {
+            TrackedMemory a(MemoryCategory::Descriptors, 1000);
+            TrackedMemory b(MemoryCategory::Descriptors, 24);
+            EXPECT_EQ(MemoryTracker::Usage(MemoryCategory::Descriptors).bytes, descriptors_before.bytes + 1024);
+            EXPECT_GE(MemoryTracker::Usage(MemoryCategory::Descriptors).peak_bytes, descriptors_before.bytes + 1024);
+            EXPECT_EQ(MemoryTracker::TotalUsage().bytes, total_before.bytes + 1024);
+
+            // Moving doesn't count twice, or free
+            TrackedMemory c(std::move(a));
+            EXPECT_EQ(a.Bytes(), 0U);
+            b = std::move(c);
+            EXPECT_EQ(MemoryTracker::Usage(MemoryCategory::Descriptors).bytes, descriptors_before.bytes + 1000);
+
+            b.Reset();
+            EXPECT_EQ(MemoryTracker::Usage(MemoryCategory::Descriptors).bytes, descriptors_before.bytes);
+        }
+        EXPECT_EQ(MemoryTracker::Usage(MemoryCategory::Descriptors).bytes, descriptors_before.bytes);
+        EXPECT_EQ(MemoryTracker::TotalUsage().bytes, total_before.bytes);
+        EXPECT_GE(MemoryTracker::TotalUsage().peak_bytes, total_before.bytes + 1024);
+
+        // The frame buffers count what they take from the OS, while the pool holds it
+        const uint64_t cpu_frame_buffers_before = MemoryTracker::Usage(MemoryCategory::CpuFrameBuffers).bytes;
+        {
+            FrameBufferPool pool;
+            FrameBuffer buffer = pool.Acquire(3 * 1024 * 1024);
+            const uint64_t pool_bytes = pool.Stats().bytes;
+            EXPECT_EQ(MemoryTracker::Usage(MemoryCategory::CpuFrameBuffers).bytes, cpu_frame_buffers_before + pool_bytes);
+
+            buffer = FrameBuffer();
+            EXPECT_EQ(MemoryTracker::Usage(MemoryCategory::CpuFrameBuffers).bytes, cpu_frame_buffers_before + pool_bytes);
+            pool.Trim();
+            EXPECT_EQ(MemoryTracker::Usage(MemoryCategory::CpuFrameBuffers).bytes, cpu_frame_buffers_before);
+        }
+
+        EXPECT_NE(MemoryTracker::Summary().find("CPU frame buffers"), std::string::npos);
+    }
+
+    TEST(GpuTransientPlannerTest, AliasesDisjointLifetimes)
+    {
+        constexpr uint64_t Alignment = 64 * 1024;
+        const auto align = [](uint64_t size) { return (size + Alignment - 1) / Alignment * Alignment; };
+
+        // Like the intermediates of a 4K NV12 frame, passes numbered as the stages
+        struct Use
+        {
+            uint64_t size;
+            uint32_t first_pass;
+            uint32_t last_pass;
+        };
+        const Use uses[] = {
+            {align(3840 * 2160 * 4), 1, 8},     // RGB frame
+            {align(240 * 135 * 2), 5, 10},      // Motion vectors
+            {align(240 * 135 * 2), 5, 8},       // Inverse blur length
+            {align(240 * 135 * 2), 5, 5},       // Tile max
+            {align(135 * 240 * 2), 5, 5},       // Neighbor max transposed
+            {align(240 * 135 * 2), 5, 8},       // Neighbor max
+            {align(240 * 135 * 3 * 4), 6, 8},   // Tile lists
+            {Alignment, 6, 8},                  // Tile counts
+            {align(3840 * 2160 * 3 / 2), 0, 3}, // NV12 frame
+        };
+
+        GpuTransientPlanner planner;
+        uint64_t unaliased_size = 0;
+        for (const Use& use : uses)
+        {
+            const uint32_t id = planner.AddResource(use.size, Alignment);
+            planner.Use(id, use.first_pass);
+            planner.Use(id, use.last_pass);
+            unaliased_size += use.size;
+        }
+        const uint32_t unused = planner.AddResource(Alignment, Alignment);
+        const uint32_t odd = planner.AddResource(100, 256);
+        planner.Use(odd, 9);
+
+        const uint64_t heap_size = planner.Plan();
+        EXPECT_EQ(heap_size, planner.HeapSize());
+        EXPECT_EQ(planner.UnaliasedSize(), unaliased_size + 100);
+        EXPECT_FALSE(planner.Used(unused));
+
+        // Everything after the scale fits in the memory of the NV12 frame
+        EXPECT_EQ(heap_size, uses[0].size + uses[8].size);
+
+        for (uint32_t i = 0; i < std::size(uses); ++i)
+        {
+            EXPECT_EQ(planner.Offset(i) % Alignment, 0U);
+            EXPECT_LE(planner.Offset(i) + uses[i].size, heap_size);
+            for (uint32_t j = i + 1; j < std::size(uses); ++j)
+            {
+                const bool live_together = (uses[i].first_pass <= uses[j].last_pass) && (uses[j].first_pass <= uses[i].last_pass);
+                const bool share_memory = (planner.Offset(i) < planner.Offset(j) + uses[j].size) &&
+                                          (planner.Offset(j) < planner.Offset(i) + uses[i].size);
+                EXPECT_FALSE(live_together && share_memory);
+            }
+        }
+        EXPECT_EQ(planner.Offset(odd) % 256, 0U);
+    }
+
+    TEST(SyntheticSequenceTest, PanningBackground)
+    {
+        constexpr uint32_t Width = 64;
+        constexpr uint32_t Height = 48;
+
+        // A whole pixel pan, so each frame is the previous one shifted
+        SyntheticSequenceDesc desc;
+        desc.width = Width;
+        desc.height = Height;
+        desc.num_frames = 2;
+        desc.layers.push_back({Width / 2, Height / 2, 0, 0, 2, -1, 0, 0, 5, 8});
+
+        const SyntheticFrame first = RenderSyntheticFrame(desc, 0);
+        const SyntheticFrame second = RenderSyntheticFrame(desc, 1);
+        EXPECT_TRUE(std::all_of(first.motion_vectors.begin(), first.motion_vectors.end(), [](int16_t mv) { return mv == 0; }));
+
+        for (uint32_t y = 0; y < Height - 1; ++y)
+        {
+            for (uint32_t x = 2; x < Width; ++x)
+            {
+                ASSERT_EQ(std::memcmp(&second.rgba[(y * Width + x) * 4], &first.rgba[((y + 1) * Width + x - 2) * 4], 4), 0)
+                    << std::format("({}, {})", x, y);
+            }
+        }
+
+        // From the block back to the previous frame, in quarter pixels. The content comes in at the left and bottom edges.
+        const uint32_t blocks_x = Width / desc.block_size;
+        const uint32_t blocks_y = Height / desc.block_size;
+        for (uint32_t by = 0; by < blocks_y; ++by)
+        {
+            for (uint32_t bx = 0; bx < blocks_x; ++bx)
+            {
+                const uint32_t block = by * blocks_x + bx;
+                EXPECT_EQ(second.motion_vectors[block * 2 + 0], -8);
+                EXPECT_EQ(second.motion_vectors[block * 2 + 1], 4);
+                EXPECT_EQ(second.unreliable[block] != 0, (bx == 0) || (by == blocks_y - 1)) << std::format("({}, {})", bx, by);
+            }
+        }
+    }
+
+    TEST(SyntheticSequenceTest, ScoresEndpointError)
+    {
+        const SyntheticSequenceDesc desc = DefaultSyntheticSequence(160, 96, 4);
+        const SyntheticFrame truth = RenderSyntheticFrame(desc, 2);
+
+        const uint32_t blocks_x = (desc.width + desc.block_size - 1) / desc.block_size;
+        const uint32_t blocks_y = (desc.height + desc.block_size - 1) / desc.block_size;
+        const uint32_t num_blocks = blocks_x * blocks_y;
+        const auto num_unreliable = static_cast<uint32_t>(std::count(truth.unreliable.begin(), truth.unreliable.end(), 1));
+        ASSERT_GT(num_unreliable, 0U);
+        ASSERT_LT(num_unreliable, num_blocks);
+
+        MotionVectorScorer self_scorer;
+        self_scorer.Add(desc, truth, truth.motion_vectors, blocks_x, blocks_y, desc.block_size, 1);
+        EXPECT_EQ(self_scorer.Blocks(), num_blocks);
+        EXPECT_EQ(self_scorer.ReliableBlocks(), num_blocks - num_unreliable);
+        EXPECT_EQ(self_scorer.MeanEpe(), 0);
+        EXPECT_EQ(self_scorer.ReliableMeanEpe(), 0);
+        EXPECT_EQ(self_scorer.ReliableOutlierRatio(), 0);
+
+        // A quarter pixel off on the reliable blocks, 10 pixels off where there is no right answer. Only the quarter counts.
+        std::vector<int16_t> estimated = truth.motion_vectors;
+        for (uint32_t block = 0; block < num_blocks; ++block)
+        {
+            estimated[block * 2 + 0] += truth.unreliable[block] ? 40 : 1;
+        }
+
+        MotionVectorScorer scorer;
+        scorer.Add(desc, truth, estimated, blocks_x, blocks_y, desc.block_size, 1);
+        EXPECT_DOUBLE_EQ(scorer.ReliableMeanEpe(), 0.25);
+        EXPECT_EQ(scorer.ReliableOutlierRatio(), 0);
+        EXPECT_DOUBLE_EQ(scorer.MeanEpe(), (0.25 * (num_blocks - num_unreliable) + 10.0 * num_unreliable) / num_blocks);
+    }
+
+    TEST(CpuMotionBlurTest, SkipStaticTilesMatchesAllTiles)
+    {
+        // Not a multiple of the tile size, so tiles straddle 2 motion vectors
+        const uint32_t width = 200;
+        const uint32_t height = 120;
+        std::vector<uint8_t> rgba(width * height * 4);
+        for (uint32_t i = 0; i < rgba.size(); ++i)
+        {
+            rgba[i] = static_cast<uint8_t>((i * 2654435761U) >> 24);
+        }
+
+        // One moving block, the rest is static
+        const uint32_t tiles_x = (width + MotionBlurTileSize - 1) / MotionBlurTileSize;
+        const uint32_t tiles_y = (height + MotionBlurTileSize - 1) / MotionBlurTileSize;
+        std::vector<uint8_t> motion_vectors(tiles_x * tiles_y * 2, 128);
+        for (uint32_t y = 2; y < 6; ++y)
+        {
+            for (uint32_t x = 3; x < 8; ++x)
+            {
+                motion_vectors[(y * tiles_x + x) * 2 + 0] = 220;
+                motion_vectors[(y * tiles_x + x) * 2 + 1] = 100;
+            }
+        }
+        std::vector<uint8_t> neighbor_max(motion_vectors.size());
+        MotionBlurNeighborMax(motion_vectors.data(), tiles_x, tiles_y, 1, neighbor_max.data());
+
+        const CpuMotionBlurParams params{width, height, 1, 0.5f, 15, (2 * height + 1056) / 416.0f};
+        const MotionBlurTileLists tile_lists = ClassifyMotionBlurTiles(params, motion_vectors.data(), neighbor_max.data());
+        EXPECT_FALSE(tile_lists.tiles[static_cast<uint32_t>(MotionBlurTileClass::Static)].empty());
+        EXPECT_FALSE(tile_lists.tiles[static_cast<uint32_t>(MotionBlurTileClass::UniformMotion)].empty());
+        EXPECT_FALSE(tile_lists.tiles[static_cast<uint32_t>(MotionBlurTileClass::Complex)].empty());
+
+        const std::vector<uint8_t> random_tile = GenerateMotionBlurRandomTile();
+        std::vector<uint8_t> expected(rgba.size());
+        GatherMotionBlur(params, rgba.data(), motion_vectors.data(), neighbor_max.data(), random_tile, nullptr, expected.data());
+        std::vector<uint8_t> output(expected.size());
+        GatherMotionBlur(params, rgba.data(), motion_vectors.data(), neighbor_max.data(), random_tile, &tile_lists, output.data());
+
+        EXPECT_EQ(output, expected);
+    }
+
+    TEST(CpuMotionBlurTest, AdaptiveSamplesStayCloseToFixed)
+    {
+        const uint32_t width = 320;
+        const uint32_t height = 180;
+        std::vector<uint8_t> rgba(width * height * 4);
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                for (uint32_t c = 0; c < 4; ++c)
+                {
+                    const uint32_t noise = ((y * width + x) * 4 + c) * 2654435761U >> 28;
+                    rgba[(y * width + x) * 4 + c] = static_cast<uint8_t>((x * (c + 1) + y * 3) % 240 + noise);
+                }
+            }
+        }
+
+        // From static on the left to the longest blur on the right
+        const uint32_t tiles_x = (width + MotionBlurTileSize - 1) / MotionBlurTileSize;
+        const uint32_t tiles_y = (height + MotionBlurTileSize - 1) / MotionBlurTileSize;
+        std::vector<uint8_t> motion_vectors(tiles_x * tiles_y * 2);
+        for (uint32_t y = 0; y < tiles_y; ++y)
+        {
+            for (uint32_t x = 0; x < tiles_x; ++x)
+            {
+                motion_vectors[(y * tiles_x + x) * 2 + 0] = static_cast<uint8_t>(128 + 127 * x / (tiles_x - 1));
+                motion_vectors[(y * tiles_x + x) * 2 + 1] = static_cast<uint8_t>(128 + 40 * y / (tiles_y - 1));
+            }
+        }
+        std::vector<uint8_t> neighbor_max(motion_vectors.size());
+        MotionBlurNeighborMax(motion_vectors.data(), tiles_x, tiles_y, 1, neighbor_max.data());
+
+        CpuMotionBlurParams params{width, height, 1, 0.5f, 15, (2 * height + 1056) / 416.0f};
+        const std::vector<uint8_t> random_tile = GenerateMotionBlurRandomTile();
+        std::vector<uint8_t> fixed(rgba.size());
+        const uint64_t fixed_taps =
+            GatherMotionBlur(params, rgba.data(), motion_vectors.data(), neighbor_max.data(), random_tile, nullptr, fixed.data());
+
+        params.min_reconstruction_samples = 5;
+        std::vector<uint8_t> adaptive(rgba.size());
+        const uint64_t adaptive_taps =
+            GatherMotionBlur(params, rgba.data(), motion_vectors.data(), neighbor_max.data(), random_tile, nullptr, adaptive.data());
+
+        EXPECT_LT(adaptive_taps, fixed_taps / 2);
+
+        // At least 35 dB PSNR against the fixed 15 samples
+        double sum_squared_error = 0;
+        for (uint32_t i = 0; i < rgba.size(); ++i)
+        {
+            const double diff = static_cast<double>(adaptive[i]) - fixed[i];
+            sum_squared_error += diff * diff;
+        }
+        EXPECT_LE(sum_squared_error / rgba.size(), 255.0 * 255.0 / std::pow(10.0, 3.5));
+    }
+
+    TEST(CpuMotionBlurTest, FixedPointStaysWithinOneOfFloat)
+    {
+        const uint32_t width = 320;
+        const uint32_t height = 180;
+        std::vector<uint8_t> rgba(width * height * 4);
+        for (uint32_t i = 0; i < rgba.size(); ++i)
+        {
+            rgba[i] = static_cast<uint8_t>(i * 2654435761U >> 24);
+        }
+
+        const uint32_t tiles_x = (width + MotionBlurTileSize - 1) / MotionBlurTileSize;
+        const uint32_t tiles_y = (height + MotionBlurTileSize - 1) / MotionBlurTileSize;
+        std::vector<uint8_t> motion_vectors(tiles_x * tiles_y * 2);
+        for (uint32_t i = 0; i < motion_vectors.size(); ++i)
+        {
+            motion_vectors[i] = static_cast<uint8_t>(i * 40503U >> 8);
+        }
+        std::vector<uint8_t> neighbor_max(motion_vectors.size());
+        MotionBlurNeighborMax(motion_vectors.data(), tiles_x, tiles_y, 1, neighbor_max.data());
+
+        CpuMotionBlurParams params{width, height, 1, 0.5f, 15, (2 * height + 1056) / 416.0f};
+        const std::vector<uint8_t> random_tile = GenerateMotionBlurRandomTile();
+        std::vector<uint8_t> float_output(rgba.size());
+        GatherMotionBlur(params, rgba.data(), motion_vectors.data(), neighbor_max.data(), random_tile, nullptr, float_output.data());
+
+        params.fixed_point = true;
+        std::vector<uint8_t> fixed_point_output(rgba.size());
+        GatherMotionBlur(params, rgba.data(), motion_vectors.data(), neighbor_max.data(), random_tile, nullptr, fixed_point_output.data());
+
+        for (uint32_t i = 0; i < rgba.size(); ++i)
+        {
+            EXPECT_LE(std::abs(fixed_point_output[i] - float_output[i]), 1) << "at " << i;
+        }
+    }
+
+    TEST(CpuMotionBlurTest, FixedPointSimdMatchesScalar)
+    {
+        const uint32_t width = 320;
+        const uint32_t height = 180;
+        std::vector<uint8_t> rgba(width * height * 4);
+        for (uint32_t i = 0; i < rgba.size(); ++i)
+        {
+            rgba[i] = static_cast<uint8_t>(i * 2654435761U >> 24);
+        }
+
+        const uint32_t tiles_x = (width + MotionBlurTileSize - 1) / MotionBlurTileSize;
+        const uint32_t tiles_y = (height + MotionBlurTileSize - 1) / MotionBlurTileSize;
+        std::vector<uint8_t> motion_vectors(tiles_x * tiles_y * 2);
+        for (uint32_t i = 0; i < motion_vectors.size(); ++i)
+        {
+            motion_vectors[i] = static_cast<uint8_t>(i * 40503U >> 8);
+        }
+        std::vector<uint8_t> neighbor_max(motion_vectors.size());
+        MotionBlurNeighborMax(motion_vectors.data(), tiles_x, tiles_y, 1, neighbor_max.data());
+
+        const std::vector<uint8_t> random_tile = GenerateMotionBlurRandomTile();
+        const CpuSimdLevel detected_level = DetectedCpuSimdLevel();
+
+        // Tap counts that leave every remainder of the SIMD widths, and the most taps
+        for (const uint32_t samples : {15, 16, 17, 18, 64})
+        {
+            CpuMotionBlurParams params{width, height, 1, 0.5f, samples, (2 * height + 1056) / 416.0f};
+            params.fixed_point = true;
+
+            SetCpuSimdLevel(CpuSimdLevel::Scalar);
+            std::vector<uint8_t> expected_output(rgba.size());
+            GatherMotionBlur(params, rgba.data(), motion_vectors.data(), neighbor_max.data(), random_tile, nullptr, expected_output.data());
+
+            for (uint32_t level = static_cast<uint32_t>(CpuSimdLevel::Sse41); level <= static_cast<uint32_t>(detected_level); ++level)
+            {
+                SetCpuSimdLevel(static_cast<CpuSimdLevel>(level));
+
+                std::vector<uint8_t> output(rgba.size());
+                GatherMotionBlur(params, rgba.data(), motion_vectors.data(), neighbor_max.data(), random_tile, nullptr, output.data());
+                EXPECT_EQ(output, expected_output) << CpuSimdLevelName(ActiveCpuSimdLevel()) << ", " << samples << " samples";
+            }
+        }
+
+        SetCpuSimdLevel(detected_level);
+    }
+
+    TEST(CpuMotionBlurTest, SpecializedSamplesMatchGeneric)
+    {
+        const uint32_t width = 320;
+        const uint32_t height = 180;
+        std::vector<uint8_t> rgba(width * height * 4);
+        for (uint32_t i = 0; i < rgba.size(); ++i)
+        {
+            rgba[i] = static_cast<uint8_t>(i * 2654435761U >> 24);
+        }
+
+        const uint32_t tiles_x = (width + MotionBlurTileSize - 1) / MotionBlurTileSize;
+        const uint32_t tiles_y = (height + MotionBlurTileSize - 1) / MotionBlurTileSize;
+        std::vector<uint8_t> motion_vectors(tiles_x * tiles_y * 2);
+        for (uint32_t i = 0; i < motion_vectors.size(); ++i)
+        {
+            motion_vectors[i] = static_cast<uint8_t>(i * 40503U >> 8);
+        }
+        std::vector<uint8_t> neighbor_max(motion_vectors.size());
+        MotionBlurNeighborMax(motion_vectors.data(), tiles_x, tiles_y, 1, neighbor_max.data());
+
+        const std::vector<uint8_t> random_tile = GenerateMotionBlurRandomTile();
+
+        // Each count with an unrolled kernel, in float and in fixed point
+        for (const uint32_t samples : {7, 11, 15, 23})
+        {
+            for (const bool fixed_point : {false, true})
+            {
+                CpuMotionBlurParams params{width, height, 1, 0.5f, samples, (2 * height + 1056) / 416.0f};
+                params.fixed_point = fixed_point;
+
+                params.specialized_samples = false;
+                std::vector<uint8_t> expected_output(rgba.size());
+                const uint64_t expected_taps = GatherMotionBlur(
+                    params, rgba.data(), motion_vectors.data(), neighbor_max.data(), random_tile, nullptr, expected_output.data());
+
+                params.specialized_samples = true;
+                std::vector<uint8_t> output(rgba.size());
+                const uint64_t taps =
+                    GatherMotionBlur(params, rgba.data(), motion_vectors.data(), neighbor_max.data(), random_tile, nullptr, output.data());
+
+                EXPECT_EQ(output, expected_output) << samples << " samples" << (fixed_point ? ", fixed point" : "");
+                EXPECT_EQ(taps, expected_taps) << samples << " samples" << (fixed_point ? ", fixed point" : "");
+            }
+        }
+    }
+
+    TEST(CpuMotionBlurTest, PreviewStaysCloseToFullResolution)
+    {
+        const uint32_t width = 320;
+        const uint32_t height = 180;
+        std::vector<uint8_t> rgba(width * height * 4);
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                for (uint32_t c = 0; c < 4; ++c)
+                {
+                    rgba[(y * width + x) * 4 + c] = static_cast<uint8_t>((x * (c + 1) + y * 3) % 240);
+                }
+            }
+        }
+
+        // Static on the left quarter
+        const uint32_t tiles_x = (width + MotionBlurTileSize - 1) / MotionBlurTileSize;
+        const uint32_t tiles_y = (height + MotionBlurTileSize - 1) / MotionBlurTileSize;
+        std::vector<uint8_t> motion_vectors(tiles_x * tiles_y * 2, 128);
+        for (uint32_t y = 0; y < tiles_y; ++y)
+        {
+            for (uint32_t x = tiles_x / 4; x < tiles_x; ++x)
+            {
+                motion_vectors[(y * tiles_x + x) * 2 + 0] = static_cast<uint8_t>(128 + 127 * x / (tiles_x - 1));
+                motion_vectors[(y * tiles_x + x) * 2 + 1] = static_cast<uint8_t>(128 + 40 * y / (tiles_y - 1));
+            }
+        }
+        std::vector<uint8_t> neighbor_max(motion_vectors.size());
+        MotionBlurNeighborMax(motion_vectors.data(), tiles_x, tiles_y, 1, neighbor_max.data());
+
+        const CpuMotionBlurParams params{width, height, 1, 0.5f, 15, (2 * height + 1056) / 416.0f};
+        const std::vector<uint8_t> random_tile = GenerateMotionBlurRandomTile();
+        std::vector<uint8_t> full(rgba.size());
+        GatherMotionBlur(params, rgba.data(), motion_vectors.data(), neighbor_max.data(), random_tile, nullptr, full.data());
+
+        for (const uint32_t scale : {2U, 4U})
+        {
+            const CpuMotionBlurParams preview_params = MotionBlurPreviewParams(params, scale);
+            std::vector<uint8_t> preview(preview_params.width * preview_params.height * 4);
+            std::vector<uint8_t> blurred_preview(preview.size());
+            DownsampleMotionBlurPreview(rgba.data(), width, height, scale, preview.data());
+            GatherMotionBlur(preview_params, preview.data(), motion_vectors.data(), neighbor_max.data(), random_tile, nullptr,
+                blurred_preview.data());
+            std::vector<uint8_t> output(rgba.size());
+            UpsampleMotionBlurPreview(
+                preview_params, rgba.data(), preview.data(), blurred_preview.data(), neighbor_max.data(), output.data());
+
+            // The tiles away from the motion are the frame, at full resolution
+            for (uint32_t y = 0; y < height; ++y)
+            {
+                for (uint32_t x = 0; x < (tiles_x / 4 - 1) * MotionBlurTileSize; ++x)
+                {
+                    const uint32_t offset = (y * width + x) * 4;
+                    EXPECT_TRUE(std::equal(&output[offset], &output[offset + 4], &rgba[offset]))
+                        << "scale " << scale << " at " << x << ", " << y;
+                }
+            }
+
+            // At least 30 dB PSNR against the full resolution gather at half resolution, 25 dB at quarter
+            const double min_psnr = scale == 2 ? 30 : 25;
+            double sum_squared_error = 0;
+            for (uint32_t i = 0; i < rgba.size(); ++i)
+            {
+                const double diff = static_cast<double>(output[i]) - full[i];
+                sum_squared_error += diff * diff;
+            }
+            EXPECT_LE(sum_squared_error / rgba.size(), 255.0 * 255.0 / std::pow(10.0, min_psnr / 10)) << "scale " << scale;
+        }
+    }
+
+    TEST(CpuMotionBlurTest, SeparableNeighborMaxMatchesBruteForce)
+    {
+        // 3x3 tiles per tile max texel, with partial ones on the right and bottom
+        const uint32_t tiles_x = 40;
+        const uint32_t tiles_y = 23;
+        const uint32_t tile_size = MotionBlurTileSize * 3;
+        std::vector<uint8_t> motion_vectors(tiles_x * tiles_y * 2, 128);
+        for (uint32_t i = 0; i < motion_vectors.size(); i += 2)
+        {
+            const uint32_t hash = static_cast<uint32_t>(i * 2654435761U);
+            if ((hash >> 28) == 0)
+            {
+                motion_vectors[i + 0] = static_cast<uint8_t>(hash >> 8);
+                motion_vectors[i + 1] = static_cast<uint8_t>(hash >> 16);
+            }
+        }
+
+        const auto length_squared = [](const uint8_t* texel) {
+            const int32_t dx = texel[0] - 128;
+            const int32_t dy = texel[1] - 128;
+            return dx * dx + dy * dy;
+        };
+
+        const uint32_t tile_max_x = MotionBlurTileMaxSize(tiles_x, tile_size);
+        const uint32_t tile_max_y = MotionBlurTileMaxSize(tiles_y, tile_size);
+        std::vector<uint8_t> tile_max(tile_max_x * tile_max_y * 2);
+        MotionBlurTileMax(motion_vectors.data(), tiles_x, tiles_y, tile_size, tile_max.data());
+
+        for (uint32_t radius = 0; radius <= MaxMotionBlurNeighborMaxRadius; ++radius)
+        {
+            std::vector<uint8_t> neighbor_max(tile_max.size());
+            MotionBlurNeighborMax(tile_max.data(), tile_max_x, tile_max_y, radius, neighbor_max.data());
+
+            // Only the lengths, the ties may pick any of the vectors
+            for (uint32_t y = 0; y < tile_max_y; ++y)
+            {
+                for (uint32_t x = 0; x < tile_max_x; ++x)
+                {
+                    int32_t expected = 0;
+                    for (uint32_t ty = y * 3 - std::min(y, radius) * 3; ty < std::min((y + radius + 1) * 3, tiles_y); ++ty)
+                    {
+                        for (uint32_t tx = x * 3 - std::min(x, radius) * 3; tx < std::min((x + radius + 1) * 3, tiles_x); ++tx)
+                        {
+                            expected = std::max(expected, length_squared(&motion_vectors[(ty * tiles_x + tx) * 2]));
+                        }
+                    }
+
+                    EXPECT_EQ(length_squared(&neighbor_max[(y * tile_max_x + x) * 2]), expected)
+                        << "radius " << radius << " at " << x << ", " << y;
+                }
+            }
+        }
+    }
+
+    TEST(CpuMotionBlurTest, StreamedMatchesWholeFrame)
+    {
+        const uint32_t width = 320;
+        const uint32_t height = 180;
+        std::vector<uint8_t> rgba(width * height * 4);
+        for (uint32_t i = 0; i < rgba.size(); ++i)
+        {
+            rgba[i] = static_cast<uint8_t>(i * 2654435761U >> 24);
+        }
+
+        // Mostly vertical, to reach the farthest into the halo
+        const uint32_t tiles_x = (width + MotionBlurTileSize - 1) / MotionBlurTileSize;
+        const uint32_t tiles_y = (height + MotionBlurTileSize - 1) / MotionBlurTileSize;
+        std::vector<uint8_t> motion_vectors(tiles_x * tiles_y * 2, 128);
+        for (uint32_t i = 0; i < motion_vectors.size(); i += 2)
+        {
+            const uint32_t hash = static_cast<uint32_t>(i * 40503U);
+            if ((hash >> 14) % 3 != 0)
+            {
+                motion_vectors[i + 0] = static_cast<uint8_t>(112 + (hash >> 8) % 32);
+                motion_vectors[i + 1] = (hash & 1) != 0 ? 255 : 0;
+            }
+        }
+        std::vector<uint8_t> neighbor_max(motion_vectors.size());
+        MotionBlurNeighborMax(motion_vectors.data(), tiles_x, tiles_y, 1, neighbor_max.data());
+
+        // A long exposure, the blur is clamped to the radius
+        CpuMotionBlurParams params{width, height, 2, 4, 15, (2 * height + 1056) / 416.0f};
+        const std::vector<uint8_t> random_tile = GenerateMotionBlurRandomTile();
+        const MotionBlurTileLists tile_lists = ClassifyMotionBlurTiles(params, motion_vectors.data(), neighbor_max.data());
+
+        for (const bool fixed_point : {false, true})
+        {
+            params.fixed_point = fixed_point;
+            for (const MotionBlurTileLists* lists : {static_cast<const MotionBlurTileLists*>(nullptr), &tile_lists})
+            {
+                std::vector<uint8_t> expected(rgba.size());
+                GatherMotionBlur(params, rgba.data(), motion_vectors.data(), neighbor_max.data(), random_tile, lists, expected.data());
+
+                for (const uint32_t strip_rows : {MotionBlurTileSize, MotionBlurTileSize * 3, MotionBlurStripRows(params, 0), 256U})
+                {
+                    std::vector<uint8_t> output(rgba.size());
+                    uint32_t next_read_row = 0;
+                    uint32_t next_write_row = 0;
+                    StreamMotionBlur(
+                        params, motion_vectors.data(), neighbor_max.data(), random_tile, lists, strip_rows,
+                        [&](uint32_t first_row, uint32_t num_rows, uint8_t* rows) {
+                            EXPECT_EQ(first_row, next_read_row);
+                            std::memcpy(rows, &rgba[first_row * width * 4], num_rows * width * 4);
+                            next_read_row += num_rows;
+                        },
+                        [&](uint32_t first_row, uint32_t num_rows, const uint8_t* rows) {
+                            EXPECT_EQ(first_row, next_write_row);
+                            EXPECT_LE(num_rows, strip_rows);
+                            std::memcpy(&output[first_row * width * 4], rows, num_rows * width * 4);
+                            next_write_row += num_rows;
+                        });
+                    EXPECT_EQ(next_read_row, height);
+                    EXPECT_EQ(next_write_row, height);
+
+                    EXPECT_EQ(std::memcmp(output.data(), expected.data(), expected.size()), 0)
+                        << "strips of " << strip_rows << (fixed_point ? ", fixed point" : "") << (lists ? ", tile lists" : "");
+                }
+            }
+        }
+
+        const uint64_t budget = width * height * 2;
+        EXPECT_LE(MotionBlurStreamWorkingSetBytes(params, MotionBlurStripRows(params, budget)), budget);
+    }
+} // namespace MotionToGo
+
+int main(int argc, char** argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
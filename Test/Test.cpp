@@ -1,42 +1,36 @@
+#include <algorithm>
+#include <chrono>
 #include <cstdlib>
+#include <cstring>
 #include <filesystem>
 #include <format>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
 
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb_image.h>
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <winsock2.h>
+
+#include <afunix.h>
 
 #include <gtest/gtest.h>
 
+#include "Api/MotionToGo.h"
+#include "Codec/FrameArchive.hpp"
+#include "Gpu/GpuTexturePool.hpp"
+#include "TestImage.hpp"
+
 namespace
 {
-    struct Image
-    {
-        uint32_t width;
-        uint32_t height;
-        std::vector<uint32_t> data;
-    };
-
-    Image LoadImage(const std::filesystem::path& file_path)
-    {
-        Image ret{};
-
-        int width, height;
-        auto* data = stbi_load(file_path.string().c_str(), &width, &height, nullptr, 4);
-        if (data != nullptr)
-        {
-            ret.width = width;
-            ret.height = height;
-
-            const uint32_t* data_32 = reinterpret_cast<uint32_t*>(data);
-            ret.data.assign(data_32, data_32 + width * height);
-
-            stbi_image_free(data);
-        }
-
-        return ret;
-    }
-
-    void CompareImage(const Image& lhs, const Image& rhs, int ch_threshole)
+    void CompareImage(const MotionToGo::Image& lhs, const MotionToGo::Image& rhs, int ch_threshole)
     {
         ASSERT_EQ(lhs.width, rhs.width);
         ASSERT_EQ(lhs.height, rhs.height);
@@ -65,6 +59,86 @@ namespace
             }
         }
     }
+
+    // A client of the server mode, over its Unix domain socket
+    class ServerClient final
+    {
+    public:
+        explicit ServerClient(const std::filesystem::path& socket_path)
+        {
+            const std::string path = socket_path.string();
+            sockaddr_un addr{};
+            addr.sun_family = AF_UNIX;
+            std::memcpy(addr.sun_path, path.c_str(), std::min(path.size(), sizeof(addr.sun_path) - 1));
+
+            // The server creates its contexts before it listens
+            for (uint32_t attempt = 0; attempt < 300; ++attempt)
+            {
+                socket_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+                if (::connect(socket_, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0)
+                {
+                    // Fails the test instead of hanging it
+                    const DWORD timeout_ms = 60 * 1000;
+                    ::setsockopt(socket_, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeout_ms), sizeof(timeout_ms));
+                    return;
+                }
+
+                ::closesocket(socket_);
+                socket_ = INVALID_SOCKET;
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+        }
+
+        ~ServerClient() noexcept
+        {
+            if (socket_ != INVALID_SOCKET)
+            {
+                ::closesocket(socket_);
+            }
+        }
+
+        bool Connected() const noexcept
+        {
+            return socket_ != INVALID_SOCKET;
+        }
+
+        void Send(std::string_view data)
+        {
+            while (!data.empty())
+            {
+                const int sent = ::send(socket_, data.data(), static_cast<int>(data.size()), 0);
+                ASSERT_GT(sent, 0) << "send failed with error " << ::WSAGetLastError();
+                data.remove_prefix(sent);
+            }
+        }
+
+        // Empty once the server closes the connection
+        std::optional<std::string> ReadLine()
+        {
+            for (;;)
+            {
+                const size_t pos = recv_buffer_.find('\n');
+                if (pos != std::string::npos)
+                {
+                    std::string line = recv_buffer_.substr(0, pos);
+                    recv_buffer_.erase(0, pos + 1);
+                    return line;
+                }
+
+                char buff[4096];
+                const int received = ::recv(socket_, buff, sizeof(buff), 0);
+                if (received <= 0)
+                {
+                    return std::nullopt;
+                }
+                recv_buffer_.append(buff, received);
+            }
+        }
+
+    private:
+        SOCKET socket_ = INVALID_SOCKET;
+        std::string recv_buffer_;
+    };
 } // namespace
 
 namespace MotionToGo
@@ -108,6 +182,75 @@ namespace MotionToGo
         CompareImage(output_frame_2, expected_frame_2, 0);
     }
 
+    TEST(MotionToGoTest, ImageSeqTrace)
+    {
+        const std::string trace_path = std::format("{}ImageSeq/Output/Trace.json", TEST_DATA_DIR);
+        std::filesystem::remove(trace_path);
+
+        EXPECT_EQ(std::system(std::format("{} -I \"{}ImageSeq\" -T \"{}\"", MOTION_TO_GO_APP, TEST_DATA_DIR, trace_path).c_str()), 0);
+
+        std::ifstream ifs(trace_path);
+        ASSERT_TRUE(ifs);
+        const std::string trace((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+        EXPECT_TRUE(trace.starts_with("{\"displayTimeUnit\":\"ms\",\"traceEvents\":["));
+        for (const char* stage : {"DecodeImage", "UploadFrame", "GatherMotionBlur", "Readback", "EncodePng", "Deflate", "WriteFiles"})
+        {
+            EXPECT_NE(trace.find(std::format("\"name\":\"{}\"", stage)), std::string::npos) << stage;
+        }
+    }
+
+    TEST(MotionToGoTest, ImageSeqArchive)
+    {
+        const std::string archive_path = std::format("{}ImageSeq/Output/Frames.mtga", TEST_DATA_DIR);
+        std::filesystem::remove(archive_path);
+
+        EXPECT_EQ(std::system(std::format("{} -I \"{}ImageSeq\" -A delta", MOTION_TO_GO_APP, TEST_DATA_DIR).c_str()), 0);
+
+        FrameArchiveReader reader(archive_path);
+        ASSERT_EQ(reader.Entries().size(), 2U);
+        EXPECT_FALSE(reader.Entries()[0].delta);
+        EXPECT_TRUE(reader.Entries()[1].delta);
+
+        // Backward, the second one is decoded from the first
+        for (const uint32_t frame : {1, 0})
+        {
+            const std::vector<uint8_t> rgba = reader.ReadFrame(frame);
+            const uint32_t* rgba_32 = reinterpret_cast<const uint32_t*>(rgba.data());
+            const Image output_frame{reader.Entries()[frame].width, reader.Entries()[frame].height,
+                std::vector<uint32_t>(rgba_32, rgba_32 + rgba.size() / 4)};
+            const Image expected_frame = frame == 0 ? LoadImage(std::format("{}ImageSeq/Frame_1.png", TEST_DATA_DIR))
+                                                    : LoadImage(std::format("{}ImageSeq/Expected/ImageSeq_Frame_2.png", TEST_DATA_DIR));
+            CompareImage(output_frame, expected_frame, 0);
+        }
+    }
+
+    TEST(MotionToGoTest, RawSeq)
+    {
+        // The image sequence, concatenated as raw RGBA
+        const Image frames[] = {LoadImage(std::format("{}ImageSeq/Frame_1.png", TEST_DATA_DIR)),
+            LoadImage(std::format("{}ImageSeq/Frame_2.png", TEST_DATA_DIR))};
+        const std::filesystem::path raw_dir = std::filesystem::temp_directory_path() / "MotionToGoRawSeqTest";
+        std::filesystem::create_directories(raw_dir);
+        {
+            std::ofstream ofs(raw_dir / "Frames.rgba", std::ios_base::binary);
+            for (const auto& frame : frames)
+            {
+                ofs.write(reinterpret_cast<const char*>(frame.data.data()), frame.data.size() * sizeof(uint32_t));
+            }
+        }
+
+        EXPECT_EQ(std::system(std::format("{} -I \"{}\" -W {}x{}", MOTION_TO_GO_APP, (raw_dir / "Frames.rgba").string(),
+                                  frames[0].width, frames[0].height)
+                                  .c_str()),
+            0);
+
+        CompareImage(LoadImage(raw_dir / "Output/Frame_1.png"), frames[0], 0);
+        Image expected_frame_2 = LoadImage(std::format("{}ImageSeq/Expected/ImageSeq_Frame_2.png", TEST_DATA_DIR));
+        CompareImage(LoadImage(raw_dir / "Output/Frame_2.png"), expected_frame_2, 0);
+
+        std::filesystem::remove_all(raw_dir);
+    }
+
     TEST(MotionToGoTest, Video)
     {
         EXPECT_EQ(std::system(std::format("{} -I \"{}Video/3719155-hd_1920_1080_8fps.mp4\"", MOTION_TO_GO_APP, TEST_DATA_DIR).c_str()), 0);
@@ -120,6 +263,225 @@ namespace MotionToGo
             CompareImage(output_frame, expected_frame, 5);
         }
     }
+
+    TEST(MotionToGoTest, ImageSeqStrips)
+    {
+        EXPECT_EQ(std::system(std::format("{} -I \"{}ImageSeq\" -G 32", MOTION_TO_GO_APP, TEST_DATA_DIR).c_str()), 0);
+
+        Image output_frame_1 = LoadImage(std::format("{}ImageSeq/Output/Frame_1.png", TEST_DATA_DIR));
+        Image original_frame_1 = LoadImage(std::format("{}ImageSeq/Frame_1.png", TEST_DATA_DIR));
+        CompareImage(output_frame_1, original_frame_1, 0);
+
+        Image expected_frame_2 = LoadImage(std::format("{}ImageSeq/Expected/ImageSeq_Frame_2.png", TEST_DATA_DIR));
+        Image output_frame_2 = LoadImage(std::format("{}ImageSeq/Output/Frame_2.png", TEST_DATA_DIR));
+        CompareImage(output_frame_2, expected_frame_2, 0);
+    }
+
+    TEST(MotionToGoTest, VideoStrips)
+    {
+        // The NV12 frames are converted a strip at a time, the output must be the same as of whole frames
+        const std::string video_path = std::format("{}Video/3719155-hd_1920_1080_8fps.mp4", TEST_DATA_DIR);
+        const uint32_t check_frames[] = {1, 14, 39, 56};
+
+        EXPECT_EQ(std::system(std::format("{} -I \"{}\"", MOTION_TO_GO_APP, video_path).c_str()), 0);
+        std::vector<Image> whole_frames;
+        for (const uint32_t frame : check_frames)
+        {
+            whole_frames.push_back(LoadImage(std::format("{}Video/Output/Frame_{}.png", TEST_DATA_DIR, frame)));
+        }
+
+        EXPECT_EQ(std::system(std::format("{} -I \"{}\" -G 256", MOTION_TO_GO_APP, video_path).c_str()), 0);
+        for (uint32_t i = 0; i < std::size(check_frames); ++i)
+        {
+            Image output_frame = LoadImage(std::format("{}Video/Output/Frame_{}.png", TEST_DATA_DIR, check_frames[i]));
+            CompareImage(output_frame, whole_frames[i], 0);
+        }
+    }
+
+    TEST(MotionToGoTest, ServerProtocol)
+    {
+        WSADATA wsa_data;
+        ASSERT_EQ(::WSAStartup(MAKEWORD(2, 2), &wsa_data), 0);
+
+        const std::filesystem::path test_dir = std::filesystem::temp_directory_path() / "MotionToGoServerTest";
+        std::filesystem::remove_all(test_dir);
+        std::filesystem::create_directories(test_dir);
+
+        // Anything but a stale socket at the path is left alone
+        const std::filesystem::path not_socket_path = test_dir / "NotASocket";
+        std::ofstream(not_socket_path) << "Not a socket";
+        EXPECT_NE(std::system(std::format("{} -S \"{}\"", MOTION_TO_GO_APP, not_socket_path.string()).c_str()), 0);
+        EXPECT_TRUE(std::filesystem::is_regular_file(not_socket_path));
+
+        const std::filesystem::path socket_path = test_dir / "Server.sock";
+        int server_result = -1;
+        std::thread server_thread(
+            [&] { server_result = std::system(std::format("{} -S \"{}\"", MOTION_TO_GO_APP, socket_path.string()).c_str()); });
+
+        {
+            ServerClient client(socket_path);
+            if (!client.Connected())
+            {
+                server_thread.join();
+                FAIL() << "Couldn't connect to the server, it returned " << server_result;
+            }
+
+            client.Send("HELLO\n");
+            EXPECT_EQ(client.ReadLine(), "ERROR Unknown command HELLO");
+
+            // Rejected when their END is read, in order
+            client.Send("JOB bad_key\ninput a\noutput b\nbogus 1\nEND\n");
+            client.Send("JOB no_input\nEND\n");
+            client.Send("JOB bad_size\ninput a\noutput b\nraw_size -1x5\nEND\n");
+            EXPECT_EQ(client.ReadLine(), "FAILED bad_key Unknown key bogus");
+            EXPECT_EQ(client.ReadLine(), "FAILED no_input input and output are required");
+            EXPECT_EQ(client.ReadLine(), "FAILED bad_size Invalid raw frame size -1x5");
+
+            const std::filesystem::path output_dir = test_dir / "Output";
+            client.Send(std::format("JOB seq\ninput {}ImageSeq\noutput {}\nEND\n", TEST_DATA_DIR, output_dir.string()));
+            EXPECT_EQ(client.ReadLine(), "ACCEPTED seq");
+            EXPECT_EQ(client.ReadLine(), "STARTED seq");
+
+            // Coalesced PROGRESS lines can skip frames, but never go back
+            uint32_t last_progress = 0;
+            std::optional<std::string> line;
+            while ((line = client.ReadLine()) && line->starts_with("PROGRESS seq "))
+            {
+                const uint32_t progress = std::stoul(line->substr(std::size("PROGRESS seq ") - 1));
+                EXPECT_GT(progress, last_progress);
+                last_progress = progress;
+            }
+            EXPECT_TRUE(line && line->starts_with("DONE seq frames=2 ")) << line.value_or("The connection is closed");
+
+            Image expected_frame_2 = LoadImage(std::format("{}ImageSeq/Expected/ImageSeq_Frame_2.png", TEST_DATA_DIR));
+            CompareImage(LoadImage(output_dir / "Frame_2.png"), expected_frame_2, 0);
+
+            // Nothing more is read after an over-long line
+            {
+                ServerClient flooder(socket_path);
+                EXPECT_TRUE(flooder.Connected());
+                if (flooder.Connected())
+                {
+                    flooder.Send(std::string(64 * 1024 + 1, 'a'));
+                    EXPECT_EQ(flooder.ReadLine(), "ERROR Line longer than 65536 bytes");
+                    EXPECT_EQ(flooder.ReadLine(), std::nullopt);
+                }
+            }
+
+            client.Send("SHUTDOWN\n");
+            EXPECT_EQ(client.ReadLine(), std::nullopt);
+        }
+
+        server_thread.join();
+        EXPECT_EQ(server_result, 0);
+        EXPECT_FALSE(std::filesystem::exists(socket_path));
+
+        std::filesystem::remove_all(test_dir);
+        ::WSACleanup();
+    }
+
+    TEST(MotionToGoTest, ApiImageSeqStream)
+    {
+        MtgContext* context;
+        ASSERT_EQ(MtgCreateContext(&context), MTG_RESULT_OK) << MtgGetLastError(nullptr);
+
+        std::vector<Image> outputs;
+        MtgStreamDesc stream_desc{};
+        stream_desc.struct_size = sizeof(stream_desc);
+        stream_desc.frame_callback = [](void* user_data, uint32_t frame_index, const MtgFrame* frame) {
+            auto& outputs = *static_cast<std::vector<Image>*>(user_data);
+            ASSERT_EQ(frame_index, outputs.size());
+
+            Image& image = outputs.emplace_back();
+            image.width = frame->width;
+            image.height = frame->height;
+            image.data.resize(frame->width * frame->height);
+            for (uint32_t y = 0; y < frame->height; ++y)
+            {
+                std::memcpy(&image.data[y * frame->width], static_cast<const uint8_t*>(frame->planes[0]) + y * frame->row_pitches[0],
+                    frame->width * sizeof(uint32_t));
+            }
+        };
+        stream_desc.user_data = &outputs;
+
+        // Push the same sequence twice to make sure a context can be reused.
+        for (uint32_t pass = 0; pass < 2; ++pass)
+        {
+            outputs.clear();
+
+            ASSERT_EQ(MtgBeginStream(context, &stream_desc), MTG_RESULT_OK) << MtgGetLastError(context);
+            for (uint32_t i = 1; i <= 2; ++i)
+            {
+                const Image input = LoadImage(std::format("{}ImageSeq/Frame_{}.png", TEST_DATA_DIR, i));
+
+                MtgFrame frame{};
+                frame.format = MTG_PIXEL_FORMAT_RGBA8;
+                frame.width = input.width;
+                frame.height = input.height;
+                frame.planes[0] = input.data.data();
+                frame.row_pitches[0] = input.width * sizeof(uint32_t);
+                EXPECT_EQ(MtgPushFrame(context, &frame, 1 / 24.0f), MTG_RESULT_OK) << MtgGetLastError(context);
+            }
+            ASSERT_EQ(MtgEndStream(context), MTG_RESULT_OK) << MtgGetLastError(context);
+
+            ASSERT_EQ(outputs.size(), 2U);
+            CompareImage(outputs[0], LoadImage(std::format("{}ImageSeq/Frame_1.png", TEST_DATA_DIR)), 0);
+            CompareImage(outputs[1], LoadImage(std::format("{}ImageSeq/Expected/ImageSeq_Frame_2.png", TEST_DATA_DIR)), 0);
+        }
+
+        MtgDestroyContext(context);
+    }
+
+    TEST(GpuTexturePoolTest, RecyclesOnceFenced)
+    {
+        // Stands in for a GpuTexture2D, no device needed
+        struct FakeTexture
+        {
+            uint32_t id;
+        };
+
+        GpuTexturePool<FakeTexture> pool;
+        uint32_t num_created = 0;
+        const auto create = [&num_created] { return FakeTexture{num_created++}; };
+
+        const GpuTextureKey frame_key{1920, 1080, DXGI_FORMAT_R8G8B8A8_UNORM, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS};
+        const GpuTextureKey nv12_key{1920, 1080, DXGI_FORMAT_NV12, D3D12_RESOURCE_FLAG_NONE};
+        constexpr uint64_t FrameBytes = 1920 * 1080 * 4;
+
+        FakeTexture a = pool.Acquire(frame_key, 0, create);
+        FakeTexture b = pool.Acquire(frame_key, 0, create);
+        EXPECT_NE(a.id, b.id);
+
+        // Last used in the frame of fence 5, and 6
+        pool.Release(frame_key, std::move(a), FrameBytes, 5);
+        pool.Release(frame_key, std::move(b), FrameBytes, 6);
+        EXPECT_EQ(pool.Stats().resident_bytes, 2 * FrameBytes);
+
+        // Still in flight, or another key
+        EXPECT_EQ(pool.Acquire(frame_key, 4, create).id, 2U);
+        EXPECT_EQ(pool.Acquire(nv12_key, 10, create).id, 3U);
+
+        // The oldest first
+        EXPECT_EQ(pool.Acquire(frame_key, 6, create).id, 0U);
+        EXPECT_EQ(pool.Stats().resident_bytes, FrameBytes);
+
+        // Only the fenced ones go
+        pool.Release(nv12_key, FakeTexture{3}, FrameBytes / 2, 8);
+        pool.Trim(7);
+        EXPECT_EQ(pool.Stats().resident_bytes, FrameBytes / 2);
+        EXPECT_EQ(pool.Acquire(nv12_key, 8, create).id, 3U);
+
+        const GpuTexturePoolStats stats = pool.Stats();
+        EXPECT_EQ(stats.hits, 2U);
+        EXPECT_EQ(stats.misses, 4U);
+        EXPECT_EQ(stats.resident_bytes, 0U);
+        EXPECT_EQ(stats.peak_resident_bytes, 2 * FrameBytes);
+        EXPECT_EQ(num_created, 4U);
+
+        pool.Release(frame_key, FakeTexture{0}, FrameBytes, 9);
+        pool.ResetPeak();
+        EXPECT_EQ(pool.Stats().peak_resident_bytes, FrameBytes);
+    }
 } // namespace MotionToGo
 
 int main(int argc, char** argv)
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include <stb_image.h>
+
+// Shared by the tests of the portable library and the ones that need a GPU
+namespace MotionToGo
+{
+    struct Image
+    {
+        uint32_t width;
+        uint32_t height;
+        std::vector<uint32_t> data;
+    };
+
+    inline Image LoadImage(const std::filesystem::path& file_path)
+    {
+        Image ret{};
+
+        int width, height;
+        auto* data = stbi_load(file_path.string().c_str(), &width, &height, nullptr, 4);
+        if (data != nullptr)
+        {
+            ret.width = width;
+            ret.height = height;
+
+            const uint32_t* data_32 = reinterpret_cast<uint32_t*>(data);
+            ret.data.assign(data_32, data_32 + width * height);
+
+            stbi_image_free(data);
+        }
+
+        return ret;
+    }
+} // namespace MotionToGo
@@ -0,0 +1,124 @@
+#include <exception>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#ifndef _DEBUG
+#define CXXOPTS_NO_RTTI
+#endif
+#include <cxxopts.hpp>
+
+#include "Codec/FrameArchive.hpp"
+#include "Codec/ImageCodec.hpp"
+
+using namespace MotionToGo;
+
+namespace
+{
+    void List(const FrameArchiveReader& reader)
+    {
+        uint64_t compressed_size = 0;
+        uint64_t raw_size = 0;
+        for (const auto& entry : reader.Entries())
+        {
+            std::cout << std::format("Frame {}: {}x{}, {} bytes{}\n", entry.frame_index + 1, entry.width, entry.height, entry.size,
+                entry.delta ? ", delta" : (entry.repeat ? ", repeat" : ""));
+            compressed_size += entry.size;
+            raw_size += static_cast<uint64_t>(entry.width) * entry.height * 4;
+        }
+        std::cout << std::format("{} frames, {:.1f}% of the raw size\n", reader.Entries().size(),
+            raw_size > 0 ? compressed_size * 100.0 / raw_size : 0.0);
+    }
+
+    // Frame_N.png, like the PNG sequence output
+    int Extract(FrameArchiveReader& reader, const std::filesystem::path& output_dir)
+    {
+        std::filesystem::create_directories(output_dir);
+
+        const uint32_t num_frames = static_cast<uint32_t>(reader.Entries().size());
+        std::vector<uint8_t> png;
+        for (uint32_t i = 0; i < num_frames; ++i)
+        {
+            // A repeat is the previous frame again, and so is its PNG
+            const FrameArchiveEntry& entry = reader.Entries()[i];
+            if (!entry.repeat)
+            {
+                const std::vector<uint8_t> rgba = reader.ReadFrame(i);
+                png = EncodePng(rgba.data(), entry.width, entry.height);
+            }
+
+            const std::filesystem::path file_path = output_dir / std::format("Frame_{}.png", entry.frame_index + 1);
+            std::ofstream ofs(file_path, std::ios_base::binary);
+            ofs.write(reinterpret_cast<const char*>(png.data()), png.size());
+            if (png.empty() || !ofs)
+            {
+                std::cerr << std::format("ERROR: COULDN'T write {}\n", file_path.string());
+                return 1;
+            }
+
+            std::cout << std::format("Frame {}/{}\r", i + 1, num_frames);
+        }
+
+        std::cout << std::format("\nExtracted {} frames to {}\n", num_frames, output_dir.string());
+        return 0;
+    }
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    cxxopts::Options options("MotionArchive", "MotionArchive: List or extract the frames of a MotionToGo frame archive.");
+    // clang-format off
+    options.add_options()
+        ("H,help", "Produce help message.")
+        ("I,input-path", "The archive, Frames.mtga.", cxxopts::value<std::string>())
+        ("O,output-directory", "The directory to extract the frames to, as PNG.", cxxopts::value<std::string>())
+        ("L,list", "List the frames.");
+    // clang-format on
+
+    const auto vm = options.parse(argc, argv);
+
+    if ((argc <= 1) || (vm.count("help") > 0))
+    {
+        std::cout << std::format("{}\n", options.help());
+        return 0;
+    }
+
+    if (vm.count("input-path") == 0)
+    {
+        std::cerr << "ERROR: MUST have a input path\n";
+        return 1;
+    }
+
+    try
+    {
+        FrameArchiveReader reader(vm["input-path"].as<std::string>());
+
+        bool has_work = false;
+        int ret = 0;
+        if (vm.count("list") > 0)
+        {
+            has_work = true;
+            List(reader);
+        }
+        if (vm.count("output-directory") > 0)
+        {
+            has_work = true;
+            ret = Extract(reader, vm["output-directory"].as<std::string>());
+        }
+
+        if (!has_work)
+        {
+            std::cerr << "ERROR: Nothing to do, specify an output directory or list\n";
+            ret = 1;
+        }
+
+        return ret;
+    }
+    catch (const std::exception& ex)
+    {
+        std::cerr << std::format("ERROR: {}\n", ex.what());
+        return 1;
+    }
+}
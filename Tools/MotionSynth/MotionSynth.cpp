@@ -0,0 +1,234 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <span>
+#include <vector>
+
+#ifndef _DEBUG
+#define CXXOPTS_NO_RTTI
+#endif
+#include <cxxopts.hpp>
+
+#include "Codec/ImageCodec.hpp"
+#include "Synth/SyntheticSequence.hpp"
+
+#ifdef _WIN32
+#include "Gpu/GpuCommandList.hpp"
+#include "Gpu/GpuSystem.hpp"
+#include "Gpu/GpuTexture2D.hpp"
+#include "MotionBlurGenerator/MotionBlurGenerator.hpp"
+#endif
+
+using namespace MotionToGo;
+
+namespace
+{
+    bool WriteFile(const std::filesystem::path& path, std::span<const uint8_t> data)
+    {
+        std::ofstream ofs(path, std::ios_base::binary);
+        if (!ofs)
+        {
+            std::cerr << std::format("ERROR: COULDN'T open {}\n", path.string());
+            return false;
+        }
+        ofs.write(reinterpret_cast<const char*>(data.data()), data.size());
+        return static_cast<bool>(ofs);
+    }
+
+    // Frame_XXXX.png, and Frame_XXXX.mv with the ground truth: the int16 x and y of every block, row by row, then one uint8 per block,
+    // non-zero when it's unreliable. Sequence.json describes the layout.
+    int Generate(const SyntheticSequenceDesc& desc, const std::filesystem::path& output_dir)
+    {
+        std::filesystem::create_directories(output_dir);
+
+        const uint32_t blocks_x = (desc.width + desc.block_size - 1) / desc.block_size;
+        const uint32_t blocks_y = (desc.height + desc.block_size - 1) / desc.block_size;
+
+        for (uint32_t i = 0; i < desc.num_frames; ++i)
+        {
+            const SyntheticFrame frame = RenderSyntheticFrame(desc, i);
+
+            const std::vector<uint8_t> png = EncodePng(frame.rgba.data(), desc.width, desc.height);
+            if (png.empty() || !WriteFile(output_dir / std::format("Frame_{:04}.png", i + 1), png))
+            {
+                return 1;
+            }
+
+            std::vector<uint8_t> mv_data(frame.motion_vectors.size() * sizeof(int16_t) + frame.unreliable.size());
+            std::memcpy(mv_data.data(), frame.motion_vectors.data(), frame.motion_vectors.size() * sizeof(int16_t));
+            std::memcpy(&mv_data[frame.motion_vectors.size() * sizeof(int16_t)], frame.unreliable.data(), frame.unreliable.size());
+            if (!WriteFile(output_dir / std::format("Frame_{:04}.mv", i + 1), mv_data))
+            {
+                return 1;
+            }
+
+            std::cout << std::format("Frame {}/{}\r", i + 1, desc.num_frames);
+        }
+
+        std::ofstream ofs(output_dir / "Sequence.json");
+        ofs << std::format("{{\n  \"width\": {},\n  \"height\": {},\n  \"frames\": {},\n  \"block_size\": {},\n  \"blocks_x\": {},\n"
+                           "  \"blocks_y\": {},\n  \"motion_vectors\": \"int16 x, y per block in quarter pixels, previous minus current\","
+                           "\n  \"unreliable\": \"uint8 per block after the motion vectors\"\n}}\n",
+            desc.width, desc.height, desc.num_frames, desc.block_size, blocks_x, blocks_y);
+
+        std::cout << std::format("\nWrote {} frames to {}\n", desc.num_frames, output_dir.string());
+        return 0;
+    }
+
+#ifdef _WIN32
+    double Median(std::vector<double> samples)
+    {
+        if (samples.empty())
+        {
+            return 0;
+        }
+
+        std::sort(samples.begin(), samples.end());
+        const size_t num = samples.size();
+        return (num & 1) ? samples[num / 2] : (samples[num / 2 - 1] + samples[num / 2]) / 2;
+    }
+
+    // Runs the sequence through the motion estimator, and compares its vectors with the ground truth.
+    int Score(const SyntheticSequenceDesc& desc)
+    {
+        using Stage = MotionBlurGenerator::Stage;
+
+        GpuSystem gpu_system(MotionBlurGenerator::ConfirmDeviceFunc);
+        MotionBlurGenerator generator(gpu_system);
+        generator.ProfileStages(true);
+
+        GpuTexture2D frame_tex(gpu_system, desc.width, desc.height, 1, DXGI_FORMAT_R8G8B8A8_UNORM,
+            D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COMMON, L"synth_frame_tex");
+        GpuTexture2D motion_blurred_texs[GpuSystem::FrameCount];
+        for (uint32_t i = 0; i < GpuSystem::FrameCount; ++i)
+        {
+            motion_blurred_texs[i] = GpuTexture2D(gpu_system, desc.width, desc.height, 1, DXGI_FORMAT_R8G8B8A8_UNORM,
+                D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COMMON, std::format(L"synth_motion_blurred_tex {}", i));
+        }
+
+        MotionVectorScorer scorer;
+        std::vector<double> estimate_ms;
+        std::vector<double> add_frame_ms;
+        std::vector<int16_t> estimated_mvs;
+        for (uint32_t i = 0; i < desc.num_frames; ++i)
+        {
+            const SyntheticFrame frame = RenderSyntheticFrame(desc, i);
+            {
+                auto cmd_list = gpu_system.CreateCommandList(GpuSystem::CmdQueueType::Compute);
+                frame_tex.Upload(gpu_system, cmd_list, 0, frame.rgba.data());
+                gpu_system.Execute(std::move(cmd_list));
+            }
+
+            const auto start = std::chrono::high_resolution_clock::now();
+            generator.AddFrame(motion_blurred_texs[gpu_system.FrameIndex() % GpuSystem::FrameCount], frame_tex, 1 / 24.0f, false);
+            gpu_system.WaitForGpu();
+            const auto duration = std::chrono::high_resolution_clock::now() - start;
+
+            if (i > 0)
+            {
+                add_frame_ms.push_back(std::chrono::duration<double, std::milli>(duration).count());
+                estimate_ms.push_back(generator.StageTimes()[static_cast<uint32_t>(Stage::EstimateMotionVectors)]);
+
+                const GpuTexture2D& raw_mv_tex = generator.RawMotionVectorTexture();
+                const uint32_t est_blocks_x = raw_mv_tex.Width(0);
+                const uint32_t est_blocks_y = raw_mv_tex.Height(0);
+                estimated_mvs.resize(est_blocks_x * est_blocks_y * 2);
+
+                auto cmd_list = gpu_system.CreateCommandList(GpuSystem::CmdQueueType::Compute);
+                raw_mv_tex.Readback(gpu_system, cmd_list, 0, estimated_mvs.data());
+                gpu_system.Execute(std::move(cmd_list));
+
+                const float est_scale = static_cast<float>(desc.width) / generator.EstimationWidth();
+                scorer.Add(desc, frame, estimated_mvs, est_blocks_x, est_blocks_y, generator.MotionVectorBlockSize(), est_scale);
+            }
+
+            gpu_system.MoveToNextFrame();
+        }
+
+        gpu_system.WaitForGpu();
+
+        std::cout << std::format("Frames: {}, {}x{}, estimated at {} wide with {}x{} blocks\n", desc.num_frames, desc.width, desc.height,
+            generator.EstimationWidth(), generator.MotionVectorBlockSize(), generator.MotionVectorBlockSize());
+        std::cout << std::format("Mean EPE: {:.3f} px ({} blocks)\n", scorer.MeanEpe(), scorer.Blocks());
+        std::cout << std::format("Reliable mean EPE: {:.3f} px ({} blocks), {:.2f}% over 1 px\n", scorer.ReliableMeanEpe(),
+            scorer.ReliableBlocks(), scorer.ReliableOutlierRatio() * 100);
+        std::cout << std::format("EstimateMotionVectors: {:.3f} ms per frame (median)\n", Median(std::move(estimate_ms)));
+        std::cout << std::format("AddFrame: {:.3f} ms per frame (median)\n", Median(std::move(add_frame_ms)));
+
+        return 0;
+    }
+#endif
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    cxxopts::Options options("MotionSynth", "MotionSynth: Generate synthetic sequences with ground truth motion vectors.");
+    // clang-format off
+    options.add_options()
+        ("H,help", "Produce help message.")
+        ("W,width", "Frame width (1280 by default).", cxxopts::value<uint32_t>())
+        ("E,height", "Frame height (720 by default).", cxxopts::value<uint32_t>())
+        ("N,frames", "Number of frames (30 by default).", cxxopts::value<uint32_t>())
+        ("D,seed", "Seed of the textures (0 by default).", cxxopts::value<uint32_t>())
+        ("O,output-directory", "The directory to write the frames and motion vectors to.", cxxopts::value<std::string>())
+#ifdef _WIN32
+        ("S,score", "Run the motion estimator on the sequence and report its error against the ground truth.")
+#endif
+        ;
+    // clang-format on
+
+    const auto vm = options.parse(argc, argv);
+
+    if (vm.count("help") > 0)
+    {
+        std::cout << std::format("{}\n", options.help());
+        return 0;
+    }
+
+    const uint32_t width = vm.count("width") > 0 ? vm["width"].as<uint32_t>() : 1280;
+    const uint32_t height = vm.count("height") > 0 ? vm["height"].as<uint32_t>() : 720;
+    const uint32_t num_frames = vm.count("frames") > 0 ? vm["frames"].as<uint32_t>() : 30;
+    const uint32_t seed = vm.count("seed") > 0 ? vm["seed"].as<uint32_t>() : 0;
+    if ((width < 16) || (height < 16) || (num_frames < 2))
+    {
+        std::cerr << "ERROR: The frames must be at least 16x16, and there must be at least 2 of them\n";
+        return 1;
+    }
+
+    const SyntheticSequenceDesc desc = DefaultSyntheticSequence(width, height, num_frames, seed);
+
+    bool has_work = false;
+    int ret = 0;
+    if (vm.count("output-directory") > 0)
+    {
+        has_work = true;
+        ret = Generate(desc, vm["output-directory"].as<std::string>());
+    }
+#ifdef _WIN32
+    if ((ret == 0) && (vm.count("score") > 0))
+    {
+        has_work = true;
+        try
+        {
+            ret = Score(desc);
+        }
+        catch (const std::exception& ex)
+        {
+            std::cerr << std::format("ERROR: {}\n", ex.what());
+            ret = 1;
+        }
+    }
+#endif
+
+    if (!has_work)
+    {
+        std::cerr << "ERROR: Nothing to do, specify an output directory\n";
+        ret = 1;
+    }
+
+    return ret;
+}